@@ -0,0 +1,246 @@
+/*
+ * Source of the time alignment of the channels on a common grid.
+ *
+ * Each channel is read at its own moment of the cycle: the HS3001 value is
+ * the measurement requested by the previous cycle, the OB1203 values are
+ * read a few ms later. The resampler brings them to the same instants, so
+ * a value derived from several channels, the dew point, is coherent.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "align.h"
+#include "vclock.h"
+
+/* Magnus formula coefficients over water, -45..60 degC */
+#define DEWPOINT_B 17.62f
+#define DEWPOINT_C 243.12f
+
+static const char *const mode_names[] = {
+	[ALIGN_OFF] = "off",
+	[ALIGN_HOLD] = "hold",
+	[ALIGN_LINEAR] = "linear",
+};
+
+static int64_t clock_ns(clockid_t id) {
+	struct timespec ts;
+
+	vclock_gettime(id, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t align_now_ns(void) {
+	return clock_ns(CLOCK_MONOTONIC);
+}
+
+/*
+ * Sample the wall clock between two reads of the monotonic one, the
+ * offset is good to the time of a clock_gettime(). Called again from time
+ * to time to follow the steps and the slew of the wall clock.
+ */
+void align_clock_sync(struct align_clock *c) {
+	int64_t before = clock_ns(CLOCK_MONOTONIC);
+	int64_t wall = clock_ns(CLOCK_REALTIME);
+	int64_t after = clock_ns(CLOCK_MONOTONIC);
+
+	c->offset_ns = wall - before - (after - before) / 2;
+}
+
+/* a CLOCK_MONOTONIC time as ms since the epoch */
+int64_t align_wall_ms(const struct align_clock *c, int64_t mono_ns) {
+	return (mono_ns + c->offset_ns) / 1000000;
+}
+
+/* ALIGN_* of a mode name, -1 when unknown */
+int align_mode_lookup(const char *name) {
+	int n;
+
+	for (n = 0; n < (int)(sizeof(mode_names) / sizeof(mode_names[0])); n++) {
+		if (strcmp(name, mode_names[n]) == 0) {
+			return n;
+		}
+	}
+
+	return -1;
+}
+
+void align_init(struct align *a, int mode, int period_ms) {
+	memset(a, 0, sizeof(*a));
+
+	a->mode = mode;
+	a->period_ns = (int64_t)period_ms * 1000000;
+}
+
+/* index in the ring of the n-th reading held, 0 the oldest */
+static int reading(const struct align_channel *ch, int n) {
+	return (ch->first + n) % ALIGN_HISTORY;
+}
+
+static int64_t newest_time(const struct align_channel *ch) {
+	return ch->t[reading(ch, ch->count - 1)];
+}
+
+/* interval between the n-th newest reading and the one before, 0 without */
+static int64_t interval(const struct align_channel *ch, int n) {
+	if (ch->count < n + 2) {
+		return 0;
+	}
+
+	return ch->t[reading(ch, ch->count - 1 - n)] - ch->t[reading(ch, ch->count - 2 - n)];
+}
+
+/* account one reading taken at t, a value read again with the same time is skipped */
+void align_add(struct align *a, int channel, int64_t t, float value) {
+	struct align_channel *ch = &a->ch[channel];
+	int n;
+
+	if (ch->count && t <= newest_time(ch)) {
+		return;
+	}
+
+	if (ch->count == ALIGN_HISTORY) {
+		ch->first = reading(ch, 1);
+		ch->count--;
+	}
+	n = reading(ch, ch->count);
+	ch->t[n] = t;
+	ch->v[n] = value;
+	ch->count++;
+}
+
+/*
+ * value of a channel at t, which is at or before its newest reading, 0
+ * when the channel has no reading at or before t
+ */
+static int channel_value(const struct align_channel *ch, int mode, int64_t t, float *value) {
+	int lo = 0, hi = ch->count - 1, mid, a, b;
+
+	if (t < ch->t[reading(ch, 0)]) {
+		return 0;
+	}
+
+	/* the newest reading at or before t */
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (ch->t[reading(ch, mid)] <= t) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	a = reading(ch, lo);
+
+	if (lo == ch->count - 1 || ch->t[a] == t || mode == ALIGN_HOLD) {
+		*value = ch->v[a];
+		return 1;
+	}
+
+	b = reading(ch, lo + 1);
+	*value = ch->v[a] + (ch->v[b] - ch->v[a]) * (float)(t - ch->t[a]) /
+				(float)(ch->t[b] - ch->t[a]);
+
+	return 1;
+}
+
+/* time after which a channel without new reading is stale, at least ALIGN_STALE periods */
+static int64_t channel_stale(const struct align_channel *ch, int64_t period) {
+	int64_t last = interval(ch, 0);
+
+	return ALIGN_STALE * (last > period ? last : period);
+}
+
+/*
+ * Emit the next grid point into out once the readings cover it, returns 1
+ * then, 0 when it is not due yet. Call it until it returns 0.
+ *
+ * The grid follows the channels still delivering, up to the oldest of
+ * their newest readings. Lagging behind it by more than ALIGN_CATCH_UP
+ * points or, if longer, intervals of the slowest channel, after an idle
+ * period, it skips to there: waiting for a slow channel doesn't make it
+ * skip the points it waited for.
+ */
+int align_next(struct align *a, int64_t now, struct align_sample *out) {
+	const struct align_channel *ch;
+	int64_t t, newest = 0, frontier = 0, slowest = a->period_ns, held = 0, last;
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		ch = &a->ch[n];
+		if (!ch->count) {
+			continue;
+		}
+		last = newest_time(ch);
+		if (last > newest) {
+			newest = last;
+		}
+		if (now - last < channel_stale(ch, a->period_ns) &&
+		    (!frontier || last < frontier)) {
+			frontier = last;
+		}
+		/* the interval before the newest one, which may be an idle period */
+		if (interval(ch, ch->count > 2) > slowest) {
+			slowest = interval(ch, ch->count > 2);
+		}
+		/* the older readings were dropped, the grid can't go before these */
+		if (ch->count == ALIGN_HISTORY && ch->t[reading(ch, 0)] > held) {
+			held = ch->t[reading(ch, 0)];
+		}
+	}
+	if (a->mode == ALIGN_OFF || !newest) {
+		return 0;
+	}
+	if (!frontier) {
+		frontier = newest;
+	}
+
+	if (!a->next_ns || frontier - a->next_ns > ALIGN_CATCH_UP * slowest) {
+		a->next_ns = frontier / a->period_ns * a->period_ns;
+	}
+	if (a->next_ns < held) {
+		a->next_ns = (held + a->period_ns - 1) / a->period_ns * a->period_ns;
+	}
+	t = a->next_ns;
+
+	/* wait for the channels still delivering, without reading at or after t yet */
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		ch = &a->ch[n];
+		if (ch->count && newest_time(ch) < t &&
+		    now - newest_time(ch) < channel_stale(ch, a->period_ns)) {
+			return 0;
+		}
+	}
+
+	memset(out, 0, sizeof(*out));
+	out->time_ns = t;
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		ch = &a->ch[n];
+		/* a channel that stopped delivering is not held forever */
+		if (!ch->count || (newest_time(ch) < t &&
+				   t - newest_time(ch) >= channel_stale(ch, a->period_ns))) {
+			continue;
+		}
+		out->valid[n] = channel_value(ch, a->mode, t, &out->value[n]);
+	}
+
+	if (out->valid[CHANNEL_TEMP] && out->valid[CHANNEL_HUMM] && out->value[CHANNEL_HUMM] > 0) {
+		out->dewpoint = align_dewpoint(out->value[CHANNEL_TEMP], out->value[CHANNEL_HUMM]);
+		out->dewpoint_valid = 1;
+	}
+
+	a->next_ns += a->period_ns;
+
+	return 1;
+}
+
+/* dew point in degC of air at temperature degC and humidity %RH */
+float align_dewpoint(float temperature, float humidity) {
+	float gamma = logf(humidity / 100.0f) +
+		      DEWPOINT_B * temperature / (DEWPOINT_C + temperature);
+
+	return DEWPOINT_C * gamma / (DEWPOINT_B - gamma);
+}
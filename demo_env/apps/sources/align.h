@@ -0,0 +1,80 @@
+/*
+ * Header of the time alignment of the channels on a common grid.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _ALIGN_H_
+#define _ALIGN_H_
+
+#include <stdint.h>
+
+#include "sensor_sample.h"
+
+#define ALIGN_CATCH_UP 4 /* grid points or reading intervals a grid lags before it skips ahead */
+#define ALIGN_STALE 3 /* reading intervals without reading making a channel stale */
+#define ALIGN_HISTORY 64 /* readings held per channel, 16s at 250ms */
+
+enum align_mode {
+	ALIGN_OFF,
+	ALIGN_HOLD, /* zero-order hold: the last reading at or before the grid point */
+	ALIGN_LINEAR, /* linear interpolation between the readings around it */
+};
+
+/* offset of CLOCK_REALTIME from CLOCK_MONOTONIC, to stamp the readings */
+
+struct align_clock {
+	int64_t offset_ns;
+};
+
+/*
+ * The last readings of a channel, a ring from first. The channels may be
+ * read at different periods, a fast one holds the readings of a slow
+ * one's interval, so the grid points the slow one waits for are still
+ * interpolated from their own readings.
+ */
+
+struct align_channel {
+	int64_t t[ALIGN_HISTORY]; /* ns, CLOCK_MONOTONIC */
+	float v[ALIGN_HISTORY];
+	int first; /* oldest reading */
+	int count; /* readings held, up to ALIGN_HISTORY */
+};
+
+/*
+ * Resampler of the channels: a grid point is emitted once every channel
+ * still delivering has a reading at or after it, so its values are
+ * interpolated and never extrapolated. A channel is waited for while its
+ * newest reading is less than ALIGN_STALE of its reading intervals old, a
+ * dead sensor doesn't hold the grid. The grid skips the points older than
+ * the readings a channel still holds, rather than clamp them.
+ */
+
+struct align {
+	int mode;
+	int64_t period_ns;
+	int64_t next_ns; /* next grid point, 0 before the first reading */
+	struct align_channel ch[CHANNEL_COUNT];
+};
+
+/* one grid point */
+
+struct align_sample {
+	int64_t time_ns; /* CLOCK_MONOTONIC */
+	float value[CHANNEL_COUNT];
+	int valid[CHANNEL_COUNT]; /* the channel has readings */
+	float dewpoint; /* degC, from the aligned temp and humm */
+	int dewpoint_valid;
+};
+
+int64_t align_now_ns(void);
+void align_clock_sync(struct align_clock *c);
+int64_t align_wall_ms(const struct align_clock *c, int64_t mono_ns);
+
+int align_mode_lookup(const char *name);
+void align_init(struct align *a, int mode, int period_ms);
+void align_add(struct align *a, int channel, int64_t t, float value);
+int align_next(struct align *a, int64_t now, struct align_sample *out);
+float align_dewpoint(float temperature, float humidity);
+
+#endif /* _ALIGN_H_ */
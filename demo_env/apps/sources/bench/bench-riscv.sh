@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Microbenchmarks and end-to-end run of a riscv64 build under qemu-user,
+# run by "make bench-riscv" in a build made with cmake/riscv64-linux-gnu.cmake.
+#
+#   $ QEMU="qemu-riscv64 -L <sysroot>" [QEMU_INSN_PLUGIN=<libinsn.so>] \
+#     [BENCH_RISCV_BASELINE=<dir>] bench-riscv.sh <bench-suite> [<server>]
+#
+# The timings under qemu only compare with a baseline run on the same host.
+# The instruction counts, with the libinsn plugin built along qemu, are
+# exact and don't depend on the host: the count of a case is the difference
+# between its runs of 2N and N iterations divided by N, so the setup and
+# the process start cancel out. The server, built with SIMULATION, serves
+# the simulated sensors for BENCH_RISCV_SECONDS to a second instance in
+# gateway mode, its instructions are reported per sample sent.
+#
+# The results are written to the current directory: bench-riscv.json,
+# bench-riscv-insns.txt and the server's bench-riscv-stats.json. Copy them
+# to a directory given as BENCH_RISCV_BASELINE to compare a later run, a
+# case executing BENCH_RISCV_THRESHOLD percent more instructions is a
+# regression and the exit status is 1.
+#
+# Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+
+BENCH=$1
+SERVER=$2
+ITERATIONS=${BENCH_RISCV_ITERATIONS:-2000}
+SECONDS_E2E=${BENCH_RISCV_SECONDS:-20}
+THRESHOLD=${BENCH_RISCV_THRESHOLD:-1}
+PORT=${BENCH_RISCV_PORT:-7690}
+BASELINE=$BENCH_RISCV_BASELINE
+status=0
+
+if [ -z "$BENCH" ] || [ -z "$QEMU" ]; then
+	echo "Usage: QEMU=<qemu-riscv64 ...> $0 <bench-suite> [<server>]" >&2
+	exit 2
+fi
+
+# instructions executed by the program, its output discarded
+insns() {
+	log=$(mktemp)
+	$QEMU -plugin "$QEMU_INSN_PLUGIN" -d plugin -D "$log" "$@" > /dev/null
+	awk '/insns:/ { n = $NF } END { print n + 0 }' "$log"
+	rm -f "$log"
+}
+
+# compare the "<name> <count>" lines of two files, returns the regressions
+compare_insns() {
+	awk -v threshold="$THRESHOLD" '
+		NR == FNR { base[$1] = $2; next }
+		!($1 in base) || !base[$1] { printf "%-28s %14s -> %14d insns\n", $1, "new", $2; next }
+		{
+			delta = 100 * ($2 - base[$1]) / base[$1]
+			printf "%-28s %14d -> %14d insns %+7.2f%%", $1, base[$1], $2, delta
+			# the end-to-end count moves with the timers, it is only reported
+			if (delta > threshold && $1 !~ /^end_to_end/) { printf "  REGRESSION"; regressions++ }
+			printf "\n"
+		}
+		END { exit regressions ? 1 : 0 }' "$1" "$2"
+}
+
+echo "== microbenchmarks under qemu"
+if [ -n "$BASELINE" ] && [ -f "$BASELINE/bench-riscv.json" ]; then
+	$QEMU "$BENCH" --json bench-riscv.json --baseline "$BASELINE/bench-riscv.json" || status=1
+else
+	$QEMU "$BENCH" --json bench-riscv.json || status=1
+fi
+
+if [ -n "$QEMU_INSN_PLUGIN" ]; then
+	echo "== instructions per operation, $ITERATIONS iterations"
+	: > bench-riscv-insns.txt
+	for name in $($QEMU "$BENCH" --list); do
+		once=$(insns "$BENCH" --case "$name" --iterations "$ITERATIONS" --repeat 1)
+		twice=$(insns "$BENCH" --case "$name" --iterations $((ITERATIONS * 2)) --repeat 1)
+		echo "$name $(((twice - once) / ITERATIONS))" | tee -a bench-riscv-insns.txt
+	done
+else
+	echo "== no QEMU_INSN_PLUGIN, instructions not counted"
+fi
+
+if [ -n "$SERVER" ]; then
+	echo "== simulated sensors served for ${SECONDS_E2E}s"
+	printf 'bench 127.0.0.1 %d\n' "$PORT" > bench-riscv-boards.txt
+	plugin_log=$(mktemp)
+
+	if [ -n "$QEMU_INSN_PLUGIN" ]; then
+		$QEMU -plugin "$QEMU_INSN_PLUGIN" -d plugin -D "$plugin_log" \
+			"$SERVER" 250 --port "$PORT" --ppg --standby-grace 3600000 \
+			> bench-riscv-server.log 2>&1 &
+	else
+		$QEMU "$SERVER" 250 --port "$PORT" --ppg --standby-grace 3600000 \
+			> bench-riscv-server.log 2>&1 &
+	fi
+	server=$!
+	sleep 2
+
+	# the gateway is the client of the board, it decodes and relays every sample
+	$QEMU "$SERVER" --port $((PORT + 1)) --gateway bench-riscv-boards.txt \
+		> bench-riscv-gateway.log 2>&1 &
+	gateway=$!
+
+	sleep "$SECONDS_E2E"
+	if ! curl -s "http://127.0.0.1:$PORT/stats" > bench-riscv-stats.json; then
+		echo "Error: can't fetch the server /stats" >&2
+		status=1
+	fi
+	kill -INT "$gateway" "$server"
+	wait "$gateway" "$server"
+
+	sent=$(sed -n 's/.*"sent":\([0-9]*\).*/\1/p' bench-riscv-stats.json)
+	sed -n 's/.*"cpu":\({[^}]*}\).*"latency_us":\({[^}]*}\).*/cpu \1\nlatency_us \2/p' \
+		bench-riscv-stats.json
+	echo "samples sent ${sent:-0}"
+
+	if [ -n "$QEMU_INSN_PLUGIN" ] && [ "${sent:-0}" -gt 0 ]; then
+		total=$(awk '/insns:/ { n = $NF } END { print n + 0 }' "$plugin_log")
+		echo "end_to_end_per_sample $((total / sent))" | tee -a bench-riscv-insns.txt
+	fi
+	rm -f "$plugin_log"
+fi
+
+if [ -n "$BASELINE" ] && [ -f "$BASELINE/bench-riscv-insns.txt" ] &&
+   [ -f bench-riscv-insns.txt ]; then
+	echo "== instructions, baseline $BASELINE, threshold $THRESHOLD%"
+	compare_insns "$BASELINE/bench-riscv-insns.txt" bench-riscv-insns.txt || status=1
+fi
+
+exit $status
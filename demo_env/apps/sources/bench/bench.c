@@ -0,0 +1,348 @@
+/*
+ * Microbenchmark suite of the server hot paths: the JSON formatting and
+ * parsing, the lws_ring handoff between the threads and the sensor count
+ * conversion.
+ *
+ *   $ ./bench-suite [--filter <name>] [--min-time <ms>] [--repeat <n>]
+ *                   [--json <file>] [--baseline <file>] [--threshold <%>]
+ *                   [--case <name>] [--iterations <n>] [--list]
+ *
+ * Each case is calibrated to run for at least min-time, then timed repeat
+ * times, the median is reported in ns/op. The allocations are counted by
+ * interposing malloc(), so the ones of libwebsockets and jansson count.
+ * --json writes the results, which a later run compares with --baseline:
+ * a case slower than the baseline by more than threshold percent, or
+ * allocating more, is a regression and the exit status is 1.
+ *
+ * --iterations skips the calibration, for runs doing a known amount of work
+ * such as the instruction counts under qemu of bench-riscv.sh. --case
+ * selects the case of that exact name, --list prints the names.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libwebsockets.h>
+#include <jansson.h>
+
+#include "bench.h"
+
+#define BENCH_MIN_TIME 200 /* default time of one timed run(ms) */
+#define BENCH_REPEAT 5 /* default number of timed runs */
+#define BENCH_THRESHOLD 10.0 /* default regression threshold(%) */
+#define BENCH_MAX_ITERATIONS (1ULL << 40)
+
+volatile uintptr_t bench_sink;
+
+static const struct bench_case *suites[] = {
+	bench_json_cases,
+	bench_ring_cases,
+	bench_convert_cases,
+	bench_stats_cases,
+};
+
+struct bench_result {
+	const char *name;
+	uint64_t iterations;
+	double ns_per_op;
+	double allocs_per_op;
+};
+
+/*
+ * Allocation counting. glibc exports its allocator under __libc_ names, the
+ * definitions below take precedence over the ones of the C library for the
+ * whole process, shared libraries included.
+ */
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int counting;
+static uint64_t allocs;
+
+void *malloc(size_t size) {
+	if (counting)
+		allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	if (counting)
+		allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	if (counting)
+		allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+
+#define ALLOCS_COUNTED 1
+
+#else
+
+static int counting;
+static uint64_t allocs;
+
+#define ALLOCS_COUNTED 0
+
+#endif
+
+static double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double timed_run(const struct bench_case *bc, uint64_t iterations, uint64_t *count) {
+	double start, end;
+
+	allocs = 0;
+	counting = 1;
+	start = now_ns();
+	bc->run(bc->arg, iterations);
+	end = now_ns();
+	counting = 0;
+
+	if (count)
+		*count = allocs;
+
+	return end - start;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* grow the iterations until one run lasts min_time_ns */
+static uint64_t calibrate(const struct bench_case *bc, double min_time_ns) {
+	uint64_t iterations = 1, next;
+	double elapsed;
+
+	for (;;) {
+		elapsed = timed_run(bc, iterations, NULL);
+		if (elapsed >= min_time_ns || iterations >= BENCH_MAX_ITERATIONS)
+			return iterations;
+
+		/* aim 20% over, at most 100 times more per step */
+		if (elapsed < min_time_ns / 100)
+			next = iterations * 100;
+		else
+			next = (uint64_t)(iterations * min_time_ns * 1.2 / elapsed);
+		iterations = next > iterations ? next : iterations + 1;
+	}
+}
+
+static int run_case(const struct bench_case *bc, double min_time_ns, int repeat,
+		    uint64_t iterations, struct bench_result *result) {
+	double times[repeat];
+	uint64_t count = 0;
+	int n, ret = 0;
+
+	if (bc->setup)
+		bc->setup(bc->arg);
+
+	result->name = bc->name;
+	result->iterations = iterations ? iterations : calibrate(bc, min_time_ns);
+
+	for (n = 0; n < repeat; n++)
+		times[n] = timed_run(bc, result->iterations, n ? NULL : &count);
+
+	qsort(times, repeat, sizeof(times[0]), compare_double);
+	result->ns_per_op = times[repeat / 2] / result->iterations;
+	result->allocs_per_op = ALLOCS_COUNTED ? (double)count / result->iterations : -1;
+
+	if (bc->check && bc->check(bc->arg)) {
+		fprintf(stderr, "Error: %s: wrong results\n", bc->name);
+		ret = -1;
+	}
+
+	if (bc->teardown)
+		bc->teardown(bc->arg);
+
+	return ret;
+}
+
+static int write_json(const char *path, const struct bench_result *results, int count) {
+	json_t *root, *list;
+	int n, ret;
+
+	list = json_array();
+	for (n = 0; n < count; n++)
+		json_array_append_new(list, json_pack("{s:s, s:I, s:f, s:f}",
+				      "name", results[n].name,
+				      "iterations", (json_int_t)results[n].iterations,
+				      "ns_per_op", results[n].ns_per_op,
+				      "allocs_per_op", results[n].allocs_per_op));
+
+	root = json_pack("{s:i, s:o}", "version", 1, "benchmarks", list);
+
+	if (strcmp(path, "-") == 0)
+		ret = json_dumpf(root, stdout, JSON_INDENT(1));
+	else
+		ret = json_dump_file(root, path, JSON_INDENT(1));
+	if (ret == -1)
+		fprintf(stderr, "Error: can't write %s\n", path);
+
+	json_decref(root);
+
+	return ret;
+}
+
+/* compare with a file written by --json, returns the number of regressions */
+static int compare_baseline(FILE *out, const char *path, const struct bench_result *results,
+			    int count, double threshold) {
+	json_t *root, *list, *entry = NULL;
+	json_error_t error;
+	const char *name;
+	double ns, alloc, delta;
+	size_t i;
+	int n, regressions = 0;
+
+	root = json_load_file(path, 0, &error);
+	if (!root) {
+		fprintf(stderr, "Error: %s:%d: %s\n", path, error.line, error.text);
+		return -1;
+	}
+
+	list = json_object_get(root, "benchmarks");
+	if (!json_is_array(list)) {
+		fprintf(stderr, "Error: %s has no benchmarks\n", path);
+		json_decref(root);
+		return -1;
+	}
+
+	fprintf(out, "\nbaseline %s, threshold %.1f%%\n", path, threshold);
+
+	for (n = 0; n < count; n++) {
+		json_array_foreach(list, i, entry) {
+			name = json_string_value(json_object_get(entry, "name"));
+			if (name && strcmp(name, results[n].name) == 0)
+				break;
+		}
+		if (i == json_array_size(list)) {
+			fprintf(out, "%-28s new\n", results[n].name);
+			continue;
+		}
+
+		ns = json_number_value(json_object_get(entry, "ns_per_op"));
+		alloc = json_number_value(json_object_get(entry, "allocs_per_op"));
+		delta = ns > 0 ? 100.0 * (results[n].ns_per_op - ns) / ns : 0;
+
+		fprintf(out, "%-28s %10.2f -> %10.2f ns/op %+7.1f%%  %6.2f -> %6.2f allocs/op",
+			results[n].name, ns, results[n].ns_per_op, delta,
+			alloc, results[n].allocs_per_op);
+
+		if (delta > threshold || (alloc >= 0 && results[n].allocs_per_op > alloc + 0.005)) {
+			fprintf(out, "  REGRESSION");
+			regressions++;
+		}
+		fprintf(out, "\n");
+	}
+
+	json_decref(root);
+
+	return regressions;
+}
+
+int main(int argc, const char **argv) {
+	struct bench_result *results;
+	const struct bench_case *bc;
+	const char *filter = NULL, *only = NULL, *json = NULL, *baseline = NULL, *p;
+	double min_time = BENCH_MIN_TIME, threshold = BENCH_THRESHOLD;
+	int repeat = BENCH_REPEAT, count = 0, total = 0, failed = 0, quiet, n, ret;
+	uint64_t iterations = 0;
+
+	if ((p = lws_cmdline_option(argc, argv, "--filter")))
+		filter = p;
+	if ((p = lws_cmdline_option(argc, argv, "--min-time")))
+		min_time = atof(p);
+	if ((p = lws_cmdline_option(argc, argv, "--repeat")))
+		repeat = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "--json")))
+		json = p;
+	if ((p = lws_cmdline_option(argc, argv, "--baseline")))
+		baseline = p;
+	if ((p = lws_cmdline_option(argc, argv, "--threshold")))
+		threshold = atof(p);
+	if ((p = lws_cmdline_option(argc, argv, "--case")))
+		only = p;
+	if ((p = lws_cmdline_option(argc, argv, "--iterations")))
+		iterations = strtoull(p, NULL, 10);
+
+	if (lws_cmdline_option(argc, argv, "--list")) {
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(suites); n++)
+			for (bc = suites[n]; bc->name; bc++)
+				printf("%s\n", bc->name);
+		return 0;
+	}
+
+	if (min_time <= 0 || repeat < 1) {
+		fprintf(stderr, "Error: invalid --min-time or --repeat\n");
+		return 1;
+	}
+
+	/* nothing but the results on stdout with --json - */
+	quiet = json && !strcmp(json, "-");
+	lws_set_log_level(LLL_ERR, NULL);
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(suites); n++)
+		for (bc = suites[n]; bc->name; bc++)
+			total++;
+
+	results = calloc(total, sizeof(*results));
+	if (results == NULL) {
+		fprintf(stderr, "Error: results allocation failed\n");
+		return 1;
+	}
+
+	srand(1);
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(suites); n++)
+		for (bc = suites[n]; bc->name; bc++) {
+			if ((filter && !strstr(bc->name, filter)) ||
+			    (only && strcmp(bc->name, only)))
+				continue;
+
+			if (run_case(bc, min_time * 1e6, repeat, iterations, &results[count]))
+				failed++;
+
+			if (!quiet)
+				printf("%-28s %10.2f ns/op %8.2f allocs/op %12llu iterations\n",
+				       results[count].name, results[count].ns_per_op,
+				       results[count].allocs_per_op,
+				       (unsigned long long)results[count].iterations);
+			count++;
+		}
+
+	ret = failed ? 1 : 0;
+
+	if (json && write_json(json, results, count))
+		ret = 1;
+
+	/* with --json - the comparison goes to stderr, after the JSON */
+	if (baseline && compare_baseline(quiet ? stderr : stdout,
+					 baseline, results, count, threshold))
+		ret = 1;
+
+	free(results);
+
+	return ret;
+}
@@ -0,0 +1,37 @@
+/*
+ * Header of the microbenchmark suite of the server hot paths.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+
+/*
+ * One benchmark. run() performs "iterations" operations and is the only
+ * timed part, setup() and teardown() surround all the runs of the case.
+ * check() verifies the results of the last run, returns 0 if they are
+ * right. Any of them but run() may be NULL. The tables of cases end with
+ * an entry without name.
+ */
+
+struct bench_case {
+	const char *name;
+	const void *arg; /* passed to each of the functions */
+	void (*setup)(const void *arg);
+	void (*run)(const void *arg, uint64_t iterations);
+	void (*teardown)(const void *arg);
+	int (*check)(const void *arg);
+};
+
+extern const struct bench_case bench_json_cases[];
+extern const struct bench_case bench_ring_cases[];
+extern const struct bench_case bench_convert_cases[];
+extern const struct bench_case bench_stats_cases[];
+
+/* results are stored here so the compiler keeps the work benchmarked */
+extern volatile uintptr_t bench_sink;
+
+#endif /* _BENCH_H_ */
@@ -0,0 +1,173 @@
+/*
+ * Benchmarks of the sensor count conversion: the float/pow() path the
+ * drivers used before against the fixed-point single and batch paths.
+ * One operation is the conversion of one sample.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "bench.h"
+#include "convert.h"
+
+#define SAMPLES 4096 /* power of 2 */
+
+static unsigned char frames[SAMPLES][HS3001_FRAME_SIZE];
+static int red[SAMPLES], green[SAMPLES], blue[SAMPLES];
+
+static int32_t humidity_milli[SAMPLES], temperature_milli[SAMPLES];
+static float humidity[SAMPLES], temperature[SAMPLES];
+static int light[SAMPLES];
+
+/* the conversion data_fetch() and calc_light() did per sample */
+
+static void legacy_hs3001(const unsigned char *d, float *h, float *t) {
+	float tmp;
+
+	tmp = (float)(((uint16_t)d[0] << 8) | (uint16_t)d[1]);
+	*h = (tmp / 16383.0f) * 100.0f;
+
+	tmp = (float)((((uint16_t)d[2] << 8) | (uint16_t)d[3]) >> 2);
+	*t = (tmp / 16383.0f) * 165.0f - 40.0f;
+}
+
+static int legacy_light(int color_green, int color_blue, int color_red) {
+	int gain = 3, res = 18, c = 1;
+	int gain_scale = 0, res_scale = 0;
+
+	res_scale = pow(2, 20 - res);
+	gain_scale = 6 / gain;
+
+	return gain_scale * res_scale * ((color_red + color_green + color_blue) * c);
+}
+
+static void convert_setup(const void *arg) {
+	int n;
+
+	convert_init();
+
+	for (n = 0; n < SAMPLES; n++) {
+		frames[n][0] = rand() & 0x3F;
+		frames[n][1] = rand();
+		frames[n][2] = rand();
+		frames[n][3] = rand() & 0xFC;
+		red[n] = rand() & 0xFF;
+		green[n] = rand() & 0xFF;
+		blue[n] = rand() & 0xFF;
+	}
+}
+
+static void hs3001_float_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	int n;
+
+	for (i = 0; i < iterations; i++) {
+		n = i & (SAMPLES - 1);
+		legacy_hs3001(frames[n], &humidity[n], &temperature[n]);
+	}
+	bench_sink = (uintptr_t)humidity[0];
+}
+
+/* what decode_frame() does now */
+static void hs3001_fixed_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	int n;
+
+	for (i = 0; i < iterations; i++) {
+		n = i & (SAMPLES - 1);
+		humidity[n] = MILLI_TO_FLOAT(hs3001_humidity_milli(hs3001_humidity_counts(frames[n])));
+		temperature[n] = MILLI_TO_FLOAT(hs3001_temperature_milli(hs3001_temperature_counts(frames[n])));
+	}
+	bench_sink = (uintptr_t)humidity[0];
+}
+
+static void hs3001_batch_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	size_t n;
+
+	for (i = 0; i < iterations; i += n) {
+		n = iterations - i < SAMPLES ? iterations - i : SAMPLES;
+		hs3001_convert_batch(frames, n, humidity_milli, temperature_milli);
+	}
+	bench_sink = humidity_milli[0];
+}
+
+/* the fixed-point path must agree with the float one to the printed 3 decimals */
+static int hs3001_check(const void *arg) {
+	double err = 0;
+	int n;
+
+	hs3001_convert_batch(frames, SAMPLES, humidity_milli, temperature_milli);
+	for (n = 0; n < SAMPLES; n++) {
+		legacy_hs3001(frames[n], &humidity[n], &temperature[n]);
+		err = fmax(err, fabs(humidity[n] - MILLI_TO_FLOAT(humidity_milli[n])));
+		err = fmax(err, fabs(temperature[n] - MILLI_TO_FLOAT(temperature_milli[n])));
+	}
+
+	if (err > 0.001) {
+		fprintf(stderr, "Error: max abs error %.6f\n", err);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void light_pow_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	int n;
+
+	for (i = 0; i < iterations; i++) {
+		n = i & (SAMPLES - 1);
+		light[n] = legacy_light(green[n], blue[n], red[n]);
+	}
+	bench_sink = light[0];
+}
+
+static void light_fixed_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	int n;
+
+	for (i = 0; i < iterations; i++) {
+		n = i & (SAMPLES - 1);
+		light[n] = ob1203_light(red[n], green[n], blue[n]);
+	}
+	bench_sink = light[0];
+}
+
+static void light_batch_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+	size_t n;
+
+	for (i = 0; i < iterations; i += n) {
+		n = iterations - i < SAMPLES ? iterations - i : SAMPLES;
+		ob1203_light_batch(red, green, blue, n, light);
+	}
+	bench_sink = light[0];
+}
+
+static int light_check(const void *arg) {
+	int n;
+
+	ob1203_light_batch(red, green, blue, SAMPLES, light);
+	for (n = 0; n < SAMPLES; n++)
+		if (light[n] != legacy_light(green[n], blue[n], red[n])) {
+			fprintf(stderr, "Error: light mismatch at %d\n", n);
+			return -1;
+		}
+
+	return 0;
+}
+
+const struct bench_case bench_convert_cases[] = {
+	{ "convert_hs3001_float", NULL, convert_setup, hs3001_float_run, NULL, NULL },
+	{ "convert_hs3001_fixed", NULL, convert_setup, hs3001_fixed_run, NULL, hs3001_check },
+	{ "convert_hs3001_batch", NULL, convert_setup, hs3001_batch_run, NULL, hs3001_check },
+	{ "convert_ob1203_pow", NULL, convert_setup, light_pow_run, NULL, NULL },
+	{ "convert_ob1203_fixed", NULL, convert_setup, light_fixed_run, NULL, light_check },
+	{ "convert_ob1203_batch", NULL, convert_setup, light_batch_run, NULL, light_check },
+	{ NULL }
+};
@@ -0,0 +1,202 @@
+/*
+ * Benchmarks of the JSON paths: the formatting of a sample in
+ * thread_sensor(), with lws_snprintf() as it was and with
+ * sensor_sample_json(), and the parsing of the client commands in
+ * thread_led().
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libwebsockets.h>
+#include <jansson.h>
+
+#include "bench.h"
+#include "sensor_sample.h"
+
+#define SAMPLES 256 /* power of 2 */
+#define SAMPLE_JSON_MAX 512 /* the payload length of thread_sensor() */
+
+struct json_sample {
+	float temperature;
+	float humidity;
+	int light;
+	int proximity;
+};
+
+static struct json_sample samples[SAMPLES];
+static char out[SAMPLE_JSON_MAX];
+static int out_len;
+
+static long long time_ms = 1666137600000LL; /* the wall clock time of the readings */
+
+static void format_setup(const void *arg) {
+	int n;
+
+	for (n = 0; n < SAMPLES; n++) {
+		samples[n].temperature = -40.0f + 165.0f * rand() / RAND_MAX;
+		samples[n].humidity = 100.0f * rand() / RAND_MAX;
+		samples[n].light = rand() & 0xFFFFF;
+		samples[n].proximity = rand() & 0xFFFF;
+	}
+}
+
+static void format_run(const void *arg, uint64_t iterations) {
+	const struct json_sample *s;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		s = &samples[i & (SAMPLES - 1)];
+		out_len = lws_snprintf(out, sizeof(out), SENSOR_SAMPLE_JSON_FORMAT,
+				       s->temperature, 1, 1000, time_ms - 50,
+				       s->humidity, 1, 1000, time_ms - 50,
+				       s->light, 1, 1000, time_ms,
+				       s->proximity, 1, 1000, time_ms);
+		bench_sink = out_len;
+	}
+}
+
+/* the last message formatted must be complete and valid JSON */
+static int format_check(const void *arg) {
+	json_t *root;
+	int ret;
+
+	if (out_len >= (int)sizeof(out) - 1)
+		return -1;
+
+	root = json_loadb(out, out_len, 0, NULL);
+	ret = json_is_object(root) && json_object_get(root, "proximity") ? 0 : -1;
+	json_decref(root);
+
+	return ret;
+}
+
+static void message_of(struct sensor_message *m, const struct json_sample *s) {
+	int n;
+
+	m->temp = s->temperature;
+	m->humm = s->humidity;
+	m->light = s->light;
+	m->proximity = s->proximity;
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		m->is_active[n] = 1;
+		m->period[n] = 1000;
+		m->time_ms[n] = n < CHANNEL_LIGHT ? time_ms - 50 : time_ms;
+	}
+}
+
+static void format_fast_run(const void *arg, uint64_t iterations) {
+	struct sensor_message m;
+	uint64_t i;
+
+	message_of(&m, &samples[0]);
+	for (i = 0; i < iterations; i++) {
+		message_of(&m, &samples[i & (SAMPLES - 1)]);
+		out_len = sensor_sample_json(out, sizeof(out), &m);
+		bench_sink = out_len;
+	}
+}
+
+/* the values on which a float conversion is likely to go wrong */
+static const float edge_floats[] = {
+	0.0f, -0.0f, 0.0005f, -0.0005f, 0.0015f, 0.0025f, 1e-10f, -1e-10f,
+	FLT_MIN, FLT_MIN / 4, 9.9995f, 99.9995f, 124.9995f, -39.9995f, 0.1f,
+	2147483520.0f, 2147483648.0f, -2147483648.0f, 1e10f, -1e20f, FLT_MAX,
+};
+
+static const int edge_ints[] = { 0, -1, 9, 10, INT_MAX, INT_MIN };
+
+static int format_compare(const struct json_sample *s, int active, int period, long long t) {
+	struct sensor_message m;
+	char expect[SAMPLE_JSON_MAX];
+	int n, len;
+
+	message_of(&m, s);
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		m.is_active[n] = active;
+		m.period[n] = period;
+		m.time_ms[n] = t;
+	}
+
+	len = lws_snprintf(expect, sizeof(expect), SENSOR_SAMPLE_JSON_FORMAT,
+			   s->temperature, active, period, t, s->humidity, active, period, t,
+			   s->light, active, period, t, s->proximity, active, period, t);
+	n = sensor_sample_json(out, sizeof(out), &m);
+	if (n != len || memcmp(out, expect, len)) {
+		fprintf(stderr, "sensor_sample_json: %.*s\n  instead of %s\n",
+			n < 0 ? 0 : n, out, expect);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the messages must be byte for byte those of lws_snprintf(), for the
+ * samples and the edge values, and too small a buffer must be refused
+ */
+static int format_fast_check(const void *arg) {
+	struct json_sample s;
+	struct sensor_message m;
+	int n, ret = 0;
+
+	for (n = 0; n < SAMPLES; n++)
+		ret |= format_compare(&samples[n], 1, 1000, time_ms);
+
+	for (n = 0; n < (int)(sizeof(edge_floats) / sizeof(edge_floats[0])); n++) {
+		s.temperature = edge_floats[n];
+		s.humidity = -edge_floats[n];
+		s.light = edge_ints[n % (sizeof(edge_ints) / sizeof(edge_ints[0]))];
+		s.proximity = -s.light;
+		ret |= format_compare(&s, n & 1, edge_ints[n % 6], n & 1 ? -time_ms : 0);
+	}
+
+	message_of(&m, &samples[0]);
+	n = sensor_sample_json(out, sizeof(out), &m);
+	if (n <= 0 || sensor_sample_json(out, n - 1, &m) != -1)
+		ret = -1;
+
+	return ret;
+}
+
+/* one command as thread_led() handles it */
+static void parse_run(const void *arg, uint64_t iterations) {
+	const char *command = arg;
+	size_t len = strlen(command);
+	json_t *root;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		root = json_loadb(command, len, 0, NULL);
+		bench_sink = (uintptr_t)json_object_get(root, "led");
+		json_decref(root);
+	}
+}
+
+static int parse_check(const void *arg) {
+	json_t *root;
+	int ret;
+
+	root = json_loads(arg, 0, NULL);
+	ret = json_is_object(root) ? 0 : -1;
+	json_decref(root);
+
+	return ret;
+}
+
+const struct bench_case bench_json_cases[] = {
+	{ "json_format_sample", NULL, format_setup, format_run, NULL, format_check },
+	{ "json_format_sample_fast", NULL, format_setup, format_fast_run, NULL, format_fast_check },
+	{ "json_parse_led", "{\"led\":\"on\"}", NULL, parse_run, NULL, parse_check },
+	{ "json_parse_rules", "{\"rules\":\"proximity >= 100 -> led on\"}",
+	  NULL, parse_run, NULL, parse_check },
+	{ "json_parse_sampling",
+	  "{\"sampling\":{\"channel\":\"light\",\"adaptive\":true,\"max\":2000,\"delta\":5}}",
+	  NULL, parse_run, NULL, parse_check },
+	{ NULL }
+};
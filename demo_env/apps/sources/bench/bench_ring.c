@@ -0,0 +1,116 @@
+/*
+ * Benchmarks of the lws_ring handoff of a sample message from
+ * thread_sensor() to the sessions written by the lws service thread, with
+ * the same locking, allocation and consumption as the server.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libwebsockets.h>
+
+#include "bench.h"
+
+#define RING_ELEMENTS 8 /* the sample ring of the server */
+#define RING_SESSIONS_MAX 8
+#define MESSAGE_LEN 200 /* about the length of a sample message */
+
+struct msg {
+	void *payload; /* is malloc'd */
+	size_t len;
+};
+
+struct session {
+	struct session *pss_list;
+	uint32_t tail;
+};
+
+static struct lws_ring *ring;
+static pthread_mutex_t lock_ring = PTHREAD_MUTEX_INITIALIZER;
+static struct session sessions[RING_SESSIONS_MAX];
+static struct session *pss_list;
+static char message[MESSAGE_LEN];
+static uint64_t delivered;
+
+static void destroy_message(void *_msg) {
+	struct msg *msg = _msg;
+
+	free(msg->payload);
+	msg->payload = NULL;
+	msg->len = 0;
+}
+
+static void ring_setup(const void *arg) {
+	int count = (int)(intptr_t)arg, n;
+
+	memset(message, 'x', sizeof(message));
+
+	ring = lws_ring_create(sizeof(struct msg), RING_ELEMENTS, destroy_message);
+
+	pss_list = NULL;
+	for (n = 0; n < count; n++) {
+		sessions[n].pss_list = pss_list;
+		sessions[n].tail = lws_ring_get_oldest_tail(ring);
+		pss_list = &sessions[n];
+	}
+}
+
+/*
+ * Each iteration hands one message over: the producer side of
+ * thread_sensor() then the SERVER_WRITEABLE of each session.
+ */
+static void ring_run(const void *arg, uint64_t iterations) {
+	const struct msg *pmsg;
+	struct msg amsg;
+	uint64_t i;
+
+	delivered = 0;
+
+	for (i = 0; i < iterations; i++) {
+		pthread_mutex_lock(&lock_ring);
+		if (lws_ring_get_count_free_elements(ring)) {
+			amsg.payload = malloc(LWS_PRE + sizeof(message));
+			memcpy((char *)amsg.payload + LWS_PRE, message, sizeof(message));
+			amsg.len = sizeof(message);
+			if (lws_ring_insert(ring, &amsg, 1) != 1)
+				destroy_message(&amsg);
+		}
+		pthread_mutex_unlock(&lock_ring);
+
+		lws_start_foreach_llp(struct session **, ppss, pss_list) {
+			pthread_mutex_lock(&lock_ring);
+			pmsg = lws_ring_get_element(ring, &(*ppss)->tail);
+			if (pmsg) {
+				bench_sink = pmsg->len;
+				delivered++;
+				lws_ring_consume_and_update_oldest_tail(ring, struct session,
+					&(*ppss)->tail, 1, pss_list, tail, pss_list);
+			}
+			pthread_mutex_unlock(&lock_ring);
+		} lws_end_foreach_llp(ppss, pss_list);
+	}
+}
+
+static void ring_teardown(const void *arg) {
+	lws_ring_destroy(ring);
+	ring = NULL;
+}
+
+/* every message reached every session, in the last run */
+static int ring_check(const void *arg) {
+	int count = (int)(intptr_t)arg;
+
+	return delivered && delivered % count == 0 &&
+	       !lws_ring_get_count_waiting_elements(ring, &sessions[0].tail) ? 0 : -1;
+}
+
+const struct bench_case bench_ring_cases[] = {
+	{ "ring_handoff_1_session", (const void *)1, ring_setup, ring_run,
+	  ring_teardown, ring_check },
+	{ "ring_handoff_4_sessions", (const void *)4, ring_setup, ring_run,
+	  ring_teardown, ring_check },
+	{ NULL }
+};
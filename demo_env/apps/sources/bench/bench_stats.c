@@ -0,0 +1,78 @@
+/*
+ * Benchmarks of the rolling channel statistics updated by thread_sensor()
+ * on each reading. One operation is one reading, 250ms after the previous
+ * one so the windows move as they do on the board.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "rolling_stats.h"
+
+#define SAMPLES 4096 /* power of 2 */
+#define READING_PERIOD 250 /* ms, the default sampling period */
+
+static struct rolling_stats stats;
+static float values[SAMPLES];
+static long now;
+
+static void stats_setup(const void *arg) {
+	int n;
+
+	for (n = 0; n < SAMPLES; n++) {
+		values[n] = 20.0f + 10.0f * rand() / RAND_MAX;
+	}
+
+	now = 0;
+	rolling_init(&stats, now);
+}
+
+static void update_run(const void *arg, uint64_t iterations) {
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		now += READING_PERIOD;
+		rolling_update(&stats, CHANNEL_TEMP, values[i & (SAMPLES - 1)], now);
+	}
+	bench_sink = stats.ch[CHANNEL_TEMP].w[ROLLING_1M].closed.n;
+}
+
+/* the summary of one window, what a push or a /stats/channels does per window */
+static void summary_run(const void *arg, uint64_t iterations) {
+	struct rolling_summary sum;
+	uint64_t i;
+
+	for (i = 0; i < SAMPLES; i++) {
+		now += READING_PERIOD;
+		rolling_update(&stats, CHANNEL_TEMP, values[i], now);
+	}
+
+	for (i = 0; i < iterations; i++) {
+		rolling_summary(&stats, CHANNEL_TEMP, i % ROLLING_WINDOW_COUNT, now, &sum);
+		bench_sink = sum.n;
+	}
+}
+
+/* 59 closed slices and the current one of readings every 250ms once full */
+static int stats_check(const void *arg) {
+	struct rolling_summary sum;
+	uint32_t per_slice = 1000 / READING_PERIOD;
+
+	rolling_summary(&stats, CHANNEL_TEMP, ROLLING_1M, now, &sum);
+	if (now >= ROLLING_SLICES * 1000 &&
+	    (sum.n <= (ROLLING_SLICES - 1) * per_slice || sum.n > ROLLING_SLICES * per_slice)) {
+		fprintf(stderr, "Error: %u readings in the 1m window\n", sum.n);
+		return -1;
+	}
+
+	return 0;
+}
+
+const struct bench_case bench_stats_cases[] = {
+	{ "stats_rolling_update", NULL, stats_setup, update_run, NULL, stats_check },
+	{ "stats_rolling_summary", NULL, stats_setup, summary_run, NULL, stats_check },
+	{ NULL }
+};
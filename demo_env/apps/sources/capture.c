@@ -0,0 +1,212 @@
+/*
+ * Source of the triggered capture of the proximity, modelled on an
+ * oscilloscope.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define CAPTURE_LINE_MAX 128
+
+static const char *const edge_names[] = {
+	[CAPTURE_NONE] = "none",
+	[CAPTURE_RISING] = "rising",
+	[CAPTURE_FALLING] = "falling",
+	[CAPTURE_EITHER] = "either",
+};
+
+void capture_init(struct capture *c, const struct capture_config *config, int source) {
+	memset(c, 0, sizeof(*c));
+	c->config = *config;
+	c->source = source;
+}
+
+static int parse_window(char **save, int *value, const char *what) {
+	char *token = strtok_r(NULL, " \t", save), *end;
+	long ms;
+
+	ms = token ? strtol(token, &end, 10) : -1;
+	if (token == NULL || *end != '\0' || ms < 0 || ms > CAPTURE_WINDOW_MS) {
+		fprintf(stderr, "Error: capture has invalid %s window\n", what);
+		return -1;
+	}
+	*value = (int)ms;
+
+	return 0;
+}
+
+/*
+ * Parse a trigger of the form
+ *
+ *   <rising|falling|either> <level> [pre <ms>] [post <ms>]
+ *   none [pre <ms>] [post <ms>]
+ *
+ * On error config is left untouched.
+ */
+int capture_parse(const char *text, struct capture_config *config) {
+	struct capture_config tmp = { CAPTURE_NONE, 0, CAPTURE_PRE_MS, CAPTURE_POST_MS };
+	char line[CAPTURE_LINE_MAX], *token, *save = NULL, *end;
+	unsigned long level;
+	int n;
+
+	if (text == NULL || strlen(text) >= sizeof(line)) {
+		fprintf(stderr, "Error: capture trigger too long\n");
+		return -1;
+	}
+	strcpy(line, text);
+
+	token = strtok_r(line, " \t", &save);
+	for (n = 0; token && n < (int)(sizeof(edge_names) / sizeof(edge_names[0])); n++) {
+		if (strcmp(token, edge_names[n]) == 0) {
+			break;
+		}
+	}
+	if (token == NULL || n == (int)(sizeof(edge_names) / sizeof(edge_names[0]))) {
+		fprintf(stderr, "Error: capture has unknown trigger \"%s\"\n", token ? token : "");
+		return -1;
+	}
+	tmp.edge = n;
+
+	if (tmp.edge != CAPTURE_NONE) {
+		token = strtok_r(NULL, " \t", &save);
+		level = token ? strtoul(token, &end, 10) : 0;
+		if (token == NULL || *end != '\0') {
+			fprintf(stderr, "Error: capture has invalid trigger level\n");
+			return -1;
+		}
+		tmp.level = (uint32_t)level;
+	}
+
+	for (token = strtok_r(NULL, " \t", &save); token;
+	     token = strtok_r(NULL, " \t", &save)) {
+		if (strcmp(token, "pre") == 0) {
+			if (parse_window(&save, &tmp.pre_ms, "pre")) {
+				return -1;
+			}
+		} else if (strcmp(token, "post") == 0) {
+			if (parse_window(&save, &tmp.post_ms, "post")) {
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "Error: capture has unknown keyword \"%s\"\n", token);
+			return -1;
+		}
+	}
+
+	/* the window before the trigger must still be in the ring at the end */
+	if (tmp.pre_ms + tmp.post_ms > CAPTURE_WINDOW_MS) {
+		fprintf(stderr, "Error: capture windows longer than %dms\n", CAPTURE_WINDOW_MS);
+		return -1;
+	}
+
+	*config = tmp;
+
+	return 0;
+}
+
+/* trigger on the next sample, whatever its value */
+void capture_force(struct capture *c) {
+	c->forced = 1;
+}
+
+static const struct capture_sample *sample(const struct capture *c, uint64_t n) {
+	return &c->ring[n & (CAPTURE_SAMPLES - 1)];
+}
+
+static int crossed(const struct capture *c, uint32_t value) {
+	int rising = c->last < c->config.level && value >= c->config.level;
+	int falling = c->last >= c->config.level && value < c->config.level;
+
+	switch (c->config.edge) {
+	case CAPTURE_RISING:
+		return rising;
+	case CAPTURE_FALLING:
+		return falling;
+	case CAPTURE_EITHER:
+		return rising || falling;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Push the next sample, O(1) but for the trigger which looks back for the
+ * start of the window before it. Returns 1 when the capture is complete,
+ * it is then read with capture_blob() before the next push.
+ */
+int capture_push(struct capture *c, int64_t time_ns, uint32_t value) {
+	struct capture_sample *s = &c->ring[c->head & (CAPTURE_SAMPLES - 1)];
+	int64_t from;
+	int edge;
+
+	if (c->state == CAPTURE_COMPLETE) {
+		c->state = CAPTURE_ARMED;
+	}
+
+	s->time_ns = time_ns;
+	s->value = value;
+
+	edge = c->head && crossed(c, value);
+	if (c->state == CAPTURE_ARMED && (edge || c->forced)) {
+		c->state = CAPTURE_RECORDING;
+		c->trigger_forced = !edge;
+		c->forced = 0;
+		c->trigger = c->head;
+		c->first = c->head;
+		from = time_ns - (int64_t)c->config.pre_ms * 1000000;
+		while (c->first && c->head - (c->first - 1) < CAPTURE_SAMPLES &&
+		       sample(c, c->first - 1)->time_ns >= from) {
+			c->first--;
+		}
+	}
+
+	c->last = value;
+	c->head++;
+
+	if (c->state == CAPTURE_RECORDING &&
+	    (time_ns - sample(c, c->trigger)->time_ns >= (int64_t)c->config.post_ms * 1000000 ||
+	     c->head - c->first == CAPTURE_SAMPLES)) {
+		c->state = CAPTURE_COMPLETE;
+		c->captures++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* bytes of the blob of the capture just completed */
+size_t capture_size(const struct capture *c) {
+	return sizeof(struct capture_header) +
+	       (size_t)(c->head - c->first) * sizeof(struct capture_point);
+}
+
+int64_t capture_trigger_ns(const struct capture *c) {
+	return sample(c, c->trigger)->time_ns;
+}
+
+/* write the capture just completed into buf, capture_size() bytes */
+size_t capture_blob(const struct capture *c, void *buf, int64_t trigger_ms) {
+	struct capture_header *hdr = buf;
+	struct capture_point *pt = (struct capture_point *)(hdr + 1);
+	int64_t trigger_ns = capture_trigger_ns(c);
+	uint64_t n;
+
+	hdr->type = CAPTURE_BLOB_TYPE;
+	hdr->source = (uint16_t)c->source;
+	hdr->count = (uint32_t)(c->head - c->first);
+	hdr->pre = (uint32_t)(c->trigger - c->first);
+	hdr->forced = (uint32_t)c->trigger_forced;
+	hdr->trigger_ms = trigger_ms;
+
+	for (n = c->first; n < c->head; n++, pt++) {
+		pt->offset_us = (int32_t)((sample(c, n)->time_ns - trigger_ns) / 1000);
+		pt->value = sample(c, n)->value;
+	}
+
+	return capture_size(c);
+}
@@ -0,0 +1,96 @@
+/*
+ * Header of the triggered capture of the proximity, modelled on an
+ * oscilloscope.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_SAMPLES 2048 /* pre-trigger ring, power of 2: 5s of PPG at 400Hz */
+#define CAPTURE_WINDOW_MS 5120 /* longest pre + post, the ring at 400Hz */
+#define CAPTURE_PRE_MS 1000 /* window before the trigger by default */
+#define CAPTURE_POST_MS 1000 /* window after it */
+#define CAPTURE_BLOB_TYPE 2 /* binary message type, PPG_BATCH_TYPE is 1 */
+
+enum capture_edge {
+	CAPTURE_NONE, /* triggered by the commands only */
+	CAPTURE_RISING, /* the value reaches the level from below */
+	CAPTURE_FALLING, /* the value goes below the level */
+	CAPTURE_EITHER,
+};
+
+enum capture_source {
+	CAPTURE_SOURCE_PPG, /* the PPG FIFO, every sample of the sensor */
+	CAPTURE_SOURCE_PROXIMITY, /* the proximity channel as sampled */
+};
+
+enum capture_state {
+	CAPTURE_ARMED, /* waiting for a trigger */
+	CAPTURE_RECORDING, /* the window after the trigger */
+	CAPTURE_COMPLETE, /* until the next push */
+};
+
+struct capture_config {
+	int edge;
+	uint32_t level;
+	int pre_ms;
+	int post_ms;
+};
+
+struct capture_sample {
+	int64_t time_ns; /* CLOCK_MONOTONIC */
+	uint32_t value;
+};
+
+/*
+ * The samples are pushed into a ring which always holds the last
+ * CAPTURE_SAMPLES of them, so the window before a trigger is there when it
+ * fires. The capture completes once the samples of the window after it are
+ * in, or once the ring is about to overwrite the first sample of the
+ * window before it. The next trigger is armed on the following sample.
+ */
+
+struct capture {
+	struct capture_config config;
+	int source;
+	struct capture_sample ring[CAPTURE_SAMPLES];
+	uint64_t head; /* samples ever pushed */
+	uint32_t last; /* previous value, for the edges */
+	int state;
+	int forced; /* a command asked for a trigger */
+	int trigger_forced; /* the capture was triggered by a command */
+	uint64_t trigger; /* number of the trigger sample */
+	uint64_t first; /* of the first sample of the window before it */
+	unsigned long captures;
+};
+
+/* header of a completed capture, followed by count capture_point */
+
+struct capture_header {
+	uint16_t type; /* CAPTURE_BLOB_TYPE */
+	uint16_t source; /* CAPTURE_SOURCE_* */
+	uint32_t count;
+	uint32_t pre; /* samples before the trigger, the trigger is the next one */
+	uint32_t forced; /* triggered by a command, not by the level */
+	int64_t trigger_ms; /* wall clock of the trigger */
+};
+
+struct capture_point {
+	int32_t offset_us; /* from the trigger */
+	uint32_t value;
+};
+
+void capture_init(struct capture *c, const struct capture_config *config, int source);
+int capture_parse(const char *text, struct capture_config *config);
+void capture_force(struct capture *c);
+int capture_push(struct capture *c, int64_t time_ns, uint32_t value);
+size_t capture_size(const struct capture *c);
+size_t capture_blob(const struct capture *c, void *buf, int64_t trigger_ms);
+int64_t capture_trigger_ns(const struct capture *c);
+
+#endif /* _CAPTURE_H_ */
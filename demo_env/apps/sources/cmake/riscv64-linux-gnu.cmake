@@ -0,0 +1,41 @@
+# Cross compilation for the RZ/Five, riscv64 Linux:
+#
+#   $ cmake -DCMAKE_TOOLCHAIN_FILE=../cmake/riscv64-linux-gnu.cmake \
+#           -DRISCV_SYSROOT=<sysroot> -DSIMULATION=ON ..
+#
+# The sysroot provides libwebsockets and jansson built for the target, e.g.
+# the one of the board SDK. Without one, the Debian cross compiler and the
+# riscv64 packages of the libraries are used (multiarch). The programs
+# built run on the host under qemu-user, see "RISC-V benchmarks" in README.md.
+
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR riscv64)
+
+set(RISCV_TOOLCHAIN_PREFIX "riscv64-linux-gnu-" CACHE STRING "Prefix of the cross compiler, e.g. riscv64-poky-linux-")
+set(RISCV_SYSROOT "" CACHE PATH "Root of the target headers and libraries")
+set(RISCV_ARCH_FLAGS "-march=rv64gc -mabi=lp64d" CACHE STRING "Code generation flags of the RZ/Five AX45MP core")
+set(QEMU_RISCV64 "qemu-riscv64" CACHE FILEPATH "qemu-user emulator running the programs built")
+
+set(CMAKE_C_COMPILER ${RISCV_TOOLCHAIN_PREFIX}gcc)
+set(CMAKE_C_FLAGS_INIT "${RISCV_ARCH_FLAGS}")
+
+if (RISCV_SYSROOT)
+	set(CMAKE_SYSROOT ${RISCV_SYSROOT})
+	set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+	set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+	set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
+	set(CMAKE_FIND_ROOT_PATH_MODE_PACKAGE ONLY)
+
+	# jansson is found with pkg-config, it must only see the target's
+	set(ENV{PKG_CONFIG_SYSROOT_DIR} ${RISCV_SYSROOT})
+	set(ENV{PKG_CONFIG_LIBDIR} "${RISCV_SYSROOT}/usr/lib/pkgconfig:${RISCV_SYSROOT}/usr/share/pkgconfig")
+	set(QEMU_LD_PREFIX ${RISCV_SYSROOT})
+else()
+	# Debian multiarch, the libwebsockets-dev:riscv64 and libjansson-dev:riscv64 packages
+	set(ENV{PKG_CONFIG_LIBDIR} "/usr/lib/riscv64-linux-gnu/pkgconfig:/usr/share/pkgconfig")
+	set(QEMU_LD_PREFIX /usr/riscv64-linux-gnu)
+endif()
+
+# the custom targets running an executable target, "make bench" included,
+# run it under qemu
+set(CMAKE_CROSSCOMPILING_EMULATOR ${QEMU_RISCV64} -L ${QEMU_LD_PREFIX})
@@ -0,0 +1,115 @@
+/*
+ * Source of the line reader of the configuration files and texts: the
+ * rules, the detectors, the gateway boards and the sensor instances are
+ * one item per line, '#' starts a comment.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config_file.h"
+
+/* the line without its comment and surrounding blanks, NULL if nothing is left */
+static char *strip_line(char *line) {
+	char *p;
+	size_t len;
+
+	p = strchr(line, '#');
+	if (p != NULL) {
+		*p = '\0';
+	}
+
+	line += strspn(line, " \t\r\n");
+	len = strlen(line);
+	while (len && strchr(" \t\r\n", line[len - 1]) != NULL) {
+		line[--len] = '\0';
+	}
+
+	return len ? line : NULL;
+}
+
+/*
+ * Call cb with each line of text, "what" names the text in the errors.
+ * Stops at the first line cb fails, returns 0 or -1.
+ */
+int config_text_lines(const char *text, const char *what, config_line_cb cb, void *arg) {
+	char line[CONFIG_LINE_MAX];
+	const char *p = text, *eol;
+	size_t len;
+	char *s;
+	int lineno = 0;
+
+	while (*p) {
+		lineno++;
+
+		eol = strchr(p, '\n');
+		len = eol ? (size_t)(eol - p) : strlen(p);
+		if (len >= sizeof(line)) {
+			fprintf(stderr, "Error: %s line %d too long\n", what, lineno);
+			return -1;
+		}
+		memcpy(line, p, len);
+		line[len] = '\0';
+		p += len + (eol ? 1 : 0);
+
+		s = strip_line(line);
+		if (s != NULL && cb(s, arg)) {
+			fprintf(stderr, "Error: %s line %d\n", what, lineno);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* same with each line of the file at path, read whole whatever its size */
+int config_file_lines(const char *path, const char *what, config_line_cb cb, void *arg) {
+	char line[CONFIG_LINE_MAX + 1]; /* the '\n' included */
+	char *s;
+	int lineno = 0, ret = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: can't open %s file %s\n", what, path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+
+		if (strchr(line, '\n') == NULL && !feof(fp)) {
+			fprintf(stderr, "Error: %s:%d: line too long\n", path, lineno);
+			ret = -1;
+			break;
+		}
+
+		s = strip_line(line);
+		if (s != NULL && cb(s, arg)) {
+			fprintf(stderr, "Error: %s:%d\n", path, lineno);
+			ret = -1;
+			break;
+		}
+	}
+
+	if (ret == 0 && ferror(fp)) {
+		fprintf(stderr, "Error: can't read %s file %s\n", what, path);
+		ret = -1;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+/*
+ * A name going verbatim in the JSON of the samples: letters, digits, '-',
+ * '_' and '.' only, fitting a buffer of size bytes.
+ */
+int config_name_valid(const char *name, size_t size) {
+	size_t len = strlen(name);
+
+	return len > 0 && len < size && strspn(name, "abcdefghijklmnopqrstuvwxyz"
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.") == len;
+}
@@ -0,0 +1,21 @@
+/*
+ * Header of the line reader of the configuration files and texts.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _CONFIG_FILE_H_
+#define _CONFIG_FILE_H_
+
+#include <stddef.h>
+
+#define CONFIG_LINE_MAX 256
+
+/* called with each line left once the comment and the blanks are stripped */
+typedef int (*config_line_cb)(char *line, void *arg);
+
+int config_text_lines(const char *text, const char *what, config_line_cb cb, void *arg);
+int config_file_lines(const char *path, const char *what, config_line_cb cb, void *arg);
+int config_name_valid(const char *name, size_t size);
+
+#endif /* _CONFIG_FILE_H_ */
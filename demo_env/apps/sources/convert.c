@@ -0,0 +1,61 @@
+/*
+ * Source of the fixed-point conversion of the raw sensor counts.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include "convert.h"
+
+#if defined(CONVERT_WITH_LUT)
+
+int32_t hs3001_humidity_lut[HS3001_COUNTS_MAX + 1];
+int32_t hs3001_temperature_lut[HS3001_COUNTS_MAX + 1];
+
+/* fill the tables once with the same arithmetic as the inline path */
+void convert_init(void) {
+	uint32_t counts;
+
+	for (counts = 0; counts <= HS3001_COUNTS_MAX; counts++) {
+		hs3001_humidity_lut[counts] = (int32_t)
+			((counts * HS3001_HUMIDITY_SCALE + (1u << (HS3001_Q - 1))) >> HS3001_Q);
+		hs3001_temperature_lut[counts] = (int32_t)
+			((counts * HS3001_TEMPERATURE_SCALE + (1u << (HS3001_Q - 1))) >> HS3001_Q) +
+			HS3001_TEMPERATURE_OFFSET_MILLI;
+	}
+}
+
+#else
+
+void convert_init(void) {
+	/* the scale factors are compile-time constants, nothing to prepare */
+}
+
+#endif
+
+void hs3001_convert_batch(const unsigned char (*restrict frames)[HS3001_FRAME_SIZE],
+			  size_t n, int32_t *restrict humidity_milli,
+			  int32_t *restrict temperature_milli) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		humidity_milli[i] = hs3001_humidity_milli(hs3001_humidity_counts(frames[i]));
+		temperature_milli[i] = hs3001_temperature_milli(hs3001_temperature_counts(frames[i]));
+	}
+}
+
+void ob1203_light_batch(const int *restrict color_red, const int *restrict color_green,
+			const int *restrict color_blue, size_t n, int *restrict light) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		light[i] = ob1203_light(color_red[i], color_green[i], color_blue[i]);
+	}
+}
+
+void milli_to_float_batch(const int32_t *restrict milli, size_t n, float *restrict out) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = MILLI_TO_FLOAT(milli[i]);
+	}
+}
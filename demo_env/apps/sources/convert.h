@@ -0,0 +1,99 @@
+/*
+ * Header of the fixed-point conversion of the raw sensor counts.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HS3001: 14 bit counts to milli %RH and milli degC.
+ *
+ *   humidity    = counts / 16383 * 100
+ *   temperature = counts / 16383 * 165 - 40
+ *
+ * The scale factors are Q14 constants folded by the compiler, so a conversion
+ * is one 32 bit multiply, one add and one shift and fits vector lanes of
+ * 32 bits (16383 * 165010 < 2^32).
+ */
+
+#define HS3001_COUNTS_MAX 16383
+#define HS3001_Q 14
+#define HS3001_HUMIDITY_SCALE ((uint32_t)(((100000ULL << HS3001_Q) + HS3001_COUNTS_MAX / 2) / HS3001_COUNTS_MAX))
+#define HS3001_TEMPERATURE_SCALE ((uint32_t)(((165000ULL << HS3001_Q) + HS3001_COUNTS_MAX / 2) / HS3001_COUNTS_MAX))
+#define HS3001_TEMPERATURE_OFFSET_MILLI (-40000)
+
+/* raw frame as fetched from the HS3001 */
+#define HS3001_FRAME_SIZE 4
+
+/*
+ * OB1203: light = 6 / gain * 2^(20 - resolution) * (red + green + blue)
+ *
+ * gain and resolution are the LS_GAIN and LS_RES_PERIOD settings the driver
+ * runs with, so the whole factor is a constant.
+ */
+
+#define OB1203_LS_GAIN 3
+#define OB1203_LS_RESOLUTION 18
+#define OB1203_LIGHT_SCALE(gain, res) ((6 / (gain)) << (20 - (res)))
+#define OB1203_LIGHT_FACTOR OB1203_LIGHT_SCALE(OB1203_LS_GAIN, OB1203_LS_RESOLUTION)
+
+#define MILLI_TO_FLOAT(milli) ((float)(milli) * 0.001f)
+
+static inline uint32_t hs3001_humidity_counts(const unsigned char *frame) {
+	return ((uint32_t)(frame[0] & 0x3F) << 8) | frame[1];
+}
+
+static inline uint32_t hs3001_temperature_counts(const unsigned char *frame) {
+	return ((uint32_t)frame[2] << 6) | (frame[3] >> 2);
+}
+
+#if defined(CONVERT_WITH_LUT)
+
+extern int32_t hs3001_humidity_lut[HS3001_COUNTS_MAX + 1];
+extern int32_t hs3001_temperature_lut[HS3001_COUNTS_MAX + 1];
+
+static inline int32_t hs3001_humidity_milli(uint32_t counts) {
+	return hs3001_humidity_lut[counts & HS3001_COUNTS_MAX];
+}
+
+static inline int32_t hs3001_temperature_milli(uint32_t counts) {
+	return hs3001_temperature_lut[counts & HS3001_COUNTS_MAX];
+}
+
+#else
+
+static inline int32_t hs3001_humidity_milli(uint32_t counts) {
+	return (int32_t)((counts * HS3001_HUMIDITY_SCALE + (1u << (HS3001_Q - 1))) >> HS3001_Q);
+}
+
+static inline int32_t hs3001_temperature_milli(uint32_t counts) {
+	return (int32_t)((counts * HS3001_TEMPERATURE_SCALE + (1u << (HS3001_Q - 1))) >> HS3001_Q) +
+	       HS3001_TEMPERATURE_OFFSET_MILLI;
+}
+
+#endif
+
+static inline int ob1203_light(int color_red, int color_green, int color_blue) {
+	return OB1203_LIGHT_FACTOR * (color_red + color_green + color_blue);
+}
+
+void convert_init(void);
+
+/*
+ * Batch conversion: one pass over n samples, no branches and no aliasing
+ * between input and output so the loops can be vectorised.
+ */
+
+void hs3001_convert_batch(const unsigned char (*restrict frames)[HS3001_FRAME_SIZE],
+			  size_t n, int32_t *restrict humidity_milli,
+			  int32_t *restrict temperature_milli);
+void ob1203_light_batch(const int *restrict color_red, const int *restrict color_green,
+			const int *restrict color_blue, size_t n, int *restrict light);
+void milli_to_float_batch(const int32_t *restrict milli, size_t n, float *restrict out);
+
+#endif /* _CONVERT_H_ */
@@ -0,0 +1,332 @@
+/*
+ * Source of the streaming anomaly and change detectors of the channels.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_file.h"
+#include "detector.h"
+
+#define DETECTOR_ALPHA 0.05f /* about the last 20 readings */
+#define DETECTOR_K 0.5f
+#define DETECTOR_H 5.0f
+#define DETECTOR_EPSILON 0.0f /* stuck means the very same reading */
+
+/* noise floor of the sensors, a quiet channel isn't standardized by zero */
+
+static const float default_min_sigma[CHANNEL_COUNT] = {
+	[CHANNEL_TEMP] = 0.05f, /* degC */
+	[CHANNEL_HUMM] = 0.2f, /* %RH */
+	[CHANNEL_LIGHT] = 5.0f,
+	[CHANNEL_PROXIMITY] = 20.0f,
+};
+
+static const char *const kind_names[DETECT_KIND_COUNT] = {
+	[DETECT_CHANGE] = "change",
+	[DETECT_STUCK] = "stuck",
+	[DETECT_RANGE] = "range",
+};
+
+const char *detector_kind_name(int kind) {
+	return kind_names[kind];
+}
+
+/* every detector disabled */
+void detector_init(struct detector *d) {
+	int n;
+
+	memset(d, 0, sizeof(*d));
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		d->ch[n].alpha = DETECTOR_ALPHA;
+		d->ch[n].k = DETECTOR_K;
+		d->ch[n].h = DETECTOR_H;
+		d->ch[n].min_sigma = default_min_sigma[n];
+		d->ch[n].epsilon = DETECTOR_EPSILON;
+	}
+}
+
+static int parse_float(char **save, float *value, const char *what) {
+	char *token = strtok_r(NULL, " \t", save), *end;
+
+	if (token == NULL) {
+		fprintf(stderr, "Error: detector has no %s\n", what);
+		return -1;
+	}
+
+	*value = strtof(token, &end);
+	if (*end != '\0') {
+		fprintf(stderr, "Error: detector has invalid %s \"%s\"\n", what, token);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Compile one line of the form
+ *
+ *   <channel> [change] [slack <k>] [threshold <h>] [alpha <a>] [sigma <min>]
+ *             [stuck <n>] [epsilon <e>] [range <lo> <hi>]
+ */
+static int compile_line(char *line, struct detector *d) {
+	struct detector_channel *ch;
+	char *token, *save = NULL, *end;
+	long count;
+	int channel;
+
+	token = strtok_r(line, " \t", &save);
+	channel = sensor_channel_lookup(token);
+	if (channel == -1) {
+		fprintf(stderr, "Error: detector has unknown channel \"%s\"\n", token);
+		return -1;
+	}
+	ch = &d->ch[channel];
+
+	for (token = strtok_r(NULL, " \t", &save); token;
+	     token = strtok_r(NULL, " \t", &save)) {
+		if (strcmp(token, "change") == 0) {
+			ch->change = 1;
+		} else if (strcmp(token, "slack") == 0) {
+			if (parse_float(&save, &ch->k, "slack")) {
+				return -1;
+			}
+			if (ch->k < 0.0f) {
+				fprintf(stderr, "Error: detector slack must not be negative\n");
+				return -1;
+			}
+		} else if (strcmp(token, "threshold") == 0) {
+			if (parse_float(&save, &ch->h, "threshold")) {
+				return -1;
+			}
+			if (ch->h <= 0.0f) {
+				fprintf(stderr, "Error: detector threshold must be positive\n");
+				return -1;
+			}
+		} else if (strcmp(token, "alpha") == 0) {
+			if (parse_float(&save, &ch->alpha, "alpha")) {
+				return -1;
+			}
+			if (ch->alpha <= 0.0f || ch->alpha > 1.0f) {
+				fprintf(stderr, "Error: detector alpha must be in ]0, 1]\n");
+				return -1;
+			}
+		} else if (strcmp(token, "sigma") == 0) {
+			if (parse_float(&save, &ch->min_sigma, "sigma")) {
+				return -1;
+			}
+			if (ch->min_sigma <= 0.0f) {
+				fprintf(stderr, "Error: detector sigma must be positive\n");
+				return -1;
+			}
+		} else if (strcmp(token, "stuck") == 0) {
+			token = strtok_r(NULL, " \t", &save);
+			count = token ? strtol(token, &end, 10) : 0;
+			if (!token || *end != '\0' || count < 2 || count > 65535) {
+				fprintf(stderr, "Error: detector has invalid stuck count\n");
+				return -1;
+			}
+			ch->stuck = (uint16_t)count;
+		} else if (strcmp(token, "epsilon") == 0) {
+			if (parse_float(&save, &ch->epsilon, "epsilon")) {
+				return -1;
+			}
+			if (ch->epsilon < 0.0f) {
+				fprintf(stderr, "Error: detector epsilon must not be negative\n");
+				return -1;
+			}
+		} else if (strcmp(token, "range") == 0) {
+			if (parse_float(&save, &ch->lo, "range low") ||
+			    parse_float(&save, &ch->hi, "range high")) {
+				return -1;
+			}
+			if (ch->lo > ch->hi) {
+				fprintf(stderr, "Error: detector has empty range %g..%g\n", ch->lo, ch->hi);
+				return -1;
+			}
+			ch->range = 1;
+		} else {
+			fprintf(stderr, "Error: detector has unknown keyword \"%s\"\n", token);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* config_line_cb adding the detectors of a line to the set being compiled */
+static int add_line(char *line, void *arg) {
+	return compile_line(line, arg);
+}
+
+/* enable the detection if any detector was configured, and install tmp */
+static void install(struct detector *tmp, struct detector *d) {
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (tmp->ch[n].change || tmp->ch[n].stuck || tmp->ch[n].range) {
+			tmp->enabled = 1;
+		}
+	}
+
+	*d = *tmp;
+}
+
+/*
+ * Configure the detectors from newline separated lines, one channel per
+ * line, a channel may appear more than once. '#' starts a comment. On
+ * error d is left untouched.
+ */
+int detector_compile(const char *text, struct detector *d) {
+	struct detector tmp;
+
+	if (text == NULL || d == NULL) {
+		return -1;
+	}
+
+	detector_init(&tmp);
+	if (config_text_lines(text, "detector", add_line, &tmp)) {
+		return -1;
+	}
+	install(&tmp, d);
+
+	return 0;
+}
+
+int detector_load_file(const char *path, struct detector *d) {
+	struct detector tmp;
+
+	detector_init(&tmp);
+	if (config_file_lines(path, "detector", add_line, &tmp)) {
+		return -1;
+	}
+	install(&tmp, d);
+
+	return 0;
+}
+
+static int detect_change(struct detector_channel *ch, float value, struct detector_event *ev) {
+	float sigma, z, diff;
+
+	if (!ch->n++) {
+		ch->mean = value;
+		ch->var = 0.0f;
+		return 0;
+	}
+
+	/* the CUSUM only runs once the EWMA saw about 1/alpha readings */
+	if (ch->n > 1.0f / ch->alpha) {
+		sigma = sqrtf(ch->var);
+		if (sigma < ch->min_sigma) {
+			sigma = ch->min_sigma;
+		}
+		z = (value - ch->mean) / sigma;
+		ch->pos = fmaxf(0.0f, ch->pos + z - ch->k);
+		ch->neg = fmaxf(0.0f, ch->neg - z - ch->k);
+
+		if (ch->pos > ch->h || ch->neg > ch->h) {
+			ev->kind = DETECT_CHANGE;
+			ev->direction = ch->pos > ch->h ? 1 : -1;
+			ev->reference = ch->mean;
+
+			/* learn the new level from this reading on */
+			ch->mean = value;
+			ch->pos = 0.0f;
+			ch->neg = 0.0f;
+			ch->n = 1;
+			return 1;
+		}
+	}
+
+	diff = value - ch->mean;
+	ch->mean += ch->alpha * diff;
+	ch->var = (1.0f - ch->alpha) * (ch->var + ch->alpha * diff * diff);
+
+	return 0;
+}
+
+static int detect_stuck(struct detector_channel *ch, float value, struct detector_event *ev) {
+	if (ch->run && fabsf(value - ch->held) <= ch->epsilon) {
+		if (ch->run < UINT16_MAX) {
+			ch->run++;
+		}
+		if (ch->run < ch->stuck || ch->stuck_raised) {
+			return 0;
+		}
+		ch->stuck_raised = 1;
+		ev->kind = DETECT_STUCK;
+		ev->reference = ch->held;
+		return 1;
+	}
+
+	/* moving again */
+	if (ch->stuck_raised) {
+		ev->kind = DETECT_STUCK;
+		ev->reference = ch->held;
+		ev->cleared = 1;
+	}
+
+	ch->held = value;
+	ch->run = 1;
+	if (!ch->stuck_raised) {
+		return 0;
+	}
+	ch->stuck_raised = 0;
+
+	return 1;
+}
+
+static int detect_range(struct detector_channel *ch, float value, struct detector_event *ev) {
+	int state = value < ch->lo ? -1 : value > ch->hi ? 1 : 0;
+
+	if (state == ch->range_state) {
+		return 0;
+	}
+
+	ev->kind = DETECT_RANGE;
+	ev->direction = state ? state : ch->range_state;
+	ev->cleared = !state;
+	ev->reference = ev->direction > 0 ? ch->hi : ch->lo;
+	ch->range_state = state;
+
+	return 1;
+}
+
+/*
+ * Feed one reading of a channel to its detectors. The events raised are
+ * written to events, up to DETECTOR_EVENTS_MAX, and their number returned.
+ */
+int detector_update(struct detector *d, int channel, float value,
+		    struct detector_event *events) {
+	struct detector_channel *ch = &d->ch[channel];
+	struct detector_event *ev;
+	int count = 0, n;
+
+	memset(events, 0, DETECTOR_EVENTS_MAX * sizeof(*events));
+
+	if (ch->range && detect_range(ch, value, &events[count])) {
+		count++;
+	}
+	if (ch->stuck && detect_stuck(ch, value, &events[count])) {
+		count++;
+	}
+	if (ch->change && detect_change(ch, value, &events[count])) {
+		count++;
+	}
+
+	for (n = 0; n < count; n++) {
+		ev = &events[n];
+		ev->channel = channel;
+		ev->value = value;
+		if (!ev->cleared) {
+			d->events[channel][ev->kind]++;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,86 @@
+/*
+ * Header of the streaming anomaly and change detectors of the channels.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _DETECTOR_H_
+#define _DETECTOR_H_
+
+#include <stdint.h>
+
+#include "sensor_sample.h"
+
+#define DETECTOR_EVENTS_MAX 3 /* events one reading can raise, one per kind */
+
+enum detector_kind {
+	DETECT_CHANGE, /* the mean shifted */
+	DETECT_STUCK, /* the reading stopped moving */
+	DETECT_RANGE, /* the reading is out of its valid range */
+
+	DETECT_KIND_COUNT
+};
+
+/*
+ * One event. A change is a one-off, a stuck or out of range condition is
+ * reported when it starts and when it clears.
+ */
+
+struct detector_event {
+	uint8_t channel;
+	uint8_t kind;
+	int8_t direction; /* change and range: 1 up or above, -1 down or below */
+	uint8_t cleared; /* stuck and range: the condition ended */
+	float value; /* the reading */
+	float reference; /* change: mean before, range: bound crossed, stuck: value held */
+};
+
+/*
+ * Detectors of one channel, all O(1) per reading:
+ *
+ *  - change: two-sided CUSUM of the reading standardized by an EWMA of its
+ *    mean and variance. It fires once either sum passes h standard
+ *    deviations, with a slack of k per reading, then learns the new level.
+ *  - stuck: "stuck" consecutive readings within epsilon of each other.
+ *  - range: a reading outside lo..hi.
+ */
+
+struct detector_channel {
+	/* configuration */
+	uint8_t change; /* change detection enabled */
+	float alpha; /* weight of a reading in the EWMA */
+	float k; /* CUSUM slack, in standard deviations */
+	float h; /* CUSUM threshold, in standard deviations */
+	float min_sigma; /* floor of the standard deviation, the sensor noise */
+	uint16_t stuck; /* readings making a stuck sensor, 0 disabled */
+	float epsilon;
+	uint8_t range; /* range check enabled */
+	float lo;
+	float hi;
+
+	/* detection state */
+	uint32_t n; /* readings since the level was (re)learnt */
+	float mean;
+	float var;
+	float pos; /* CUSUM of the upward deviations */
+	float neg; /* CUSUM of the downward deviations */
+	float held; /* value a stuck sensor holds */
+	uint16_t run; /* readings within epsilon of held */
+	uint8_t stuck_raised;
+	int8_t range_state; /* -1 below, 0 in range, 1 above */
+};
+
+struct detector {
+	struct detector_channel ch[CHANNEL_COUNT];
+	int enabled; /* a channel has a detector configured */
+	unsigned long events[CHANNEL_COUNT][DETECT_KIND_COUNT]; /* raised so far */
+};
+
+void detector_init(struct detector *d);
+int detector_compile(const char *text, struct detector *d);
+int detector_load_file(const char *path, struct detector *d);
+int detector_update(struct detector *d, int channel, float value,
+		    struct detector_event *events);
+const char *detector_kind_name(int kind);
+
+#endif /* _DETECTOR_H_ */
@@ -0,0 +1,104 @@
+/*
+ * Source of the board list of the gateway mode.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_file.h"
+#include "gateway.h"
+
+/*
+ * Parse one line of the form
+ *
+ *   <board id> <address> [<port> [<path>]]
+ *
+ * The id goes verbatim in the JSON of the samples, see config_name_valid().
+ */
+static int parse_line(char *line, struct gateway_board *board) {
+	char *id, *address, *port, *path, *end, *save = NULL;
+	long n;
+
+	memset(board, 0, sizeof(*board));
+
+	id = strtok_r(line, " \t", &save);
+	address = strtok_r(NULL, " \t", &save);
+	port = strtok_r(NULL, " \t", &save);
+	path = strtok_r(NULL, " \t", &save);
+
+	if (address == NULL) {
+		fprintf(stderr, "Error: board \"%s\" has no address\n", id);
+		return -1;
+	}
+
+	if (!config_name_valid(id, sizeof(board->id))) {
+		fprintf(stderr, "Error: invalid board id \"%s\"\n", id);
+		return -1;
+	}
+	strcpy(board->id, id);
+
+	if (strlen(address) >= sizeof(board->address)) {
+		fprintf(stderr, "Error: board \"%s\" address too long\n", id);
+		return -1;
+	}
+	strcpy(board->address, address);
+
+	board->port = GATEWAY_DEFAULT_PORT;
+	if (port != NULL) {
+		n = strtol(port, &end, 10);
+		if (*end != '\0' || n < 1 || n > 65535) {
+			fprintf(stderr, "Error: board \"%s\" has invalid port \"%s\"\n", id, port);
+			return -1;
+		}
+		board->port = (int)n;
+	}
+
+	snprintf(board->path, sizeof(board->path), "%s", path != NULL ? path : "/");
+
+	return 0;
+}
+
+/* config_line_cb appending the board of a line to the config */
+static int add_line(char *line, void *arg) {
+	struct gateway_config *config = arg;
+	int n;
+
+	if (config->count == GATEWAY_BOARDS_MAX) {
+		fprintf(stderr, "Error: more than %d boards\n", GATEWAY_BOARDS_MAX);
+		return -1;
+	}
+
+	if (parse_line(line, &config->boards[config->count])) {
+		return -1;
+	}
+
+	for (n = 0; n < config->count; n++) {
+		if (strcmp(config->boards[n].id, config->boards[config->count].id) == 0) {
+			fprintf(stderr, "Error: duplicate board id \"%s\"\n", config->boards[n].id);
+			return -1;
+		}
+	}
+
+	config->count++;
+
+	return 0;
+}
+
+/* one board per line, '#' starts a comment */
+int gateway_load_file(const char *path, struct gateway_config *config) {
+	memset(config, 0, sizeof(*config));
+
+	if (config_file_lines(path, "gateway", add_line, config)) {
+		return -1;
+	}
+
+	if (config->count == 0) {
+		fprintf(stderr, "Error: no board in %s\n", path);
+		return -1;
+	}
+
+	return 0;
+}
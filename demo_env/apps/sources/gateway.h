@@ -0,0 +1,32 @@
+/*
+ * Header of the board list of the gateway mode.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#define GATEWAY_BOARDS_MAX 64
+#define GATEWAY_ID_MAX 32
+#define GATEWAY_ADDRESS_MAX 64
+#define GATEWAY_PATH_MAX 64
+#define GATEWAY_DEFAULT_PORT 3000
+
+/* one upstream board, the server of its graph-update protocol */
+
+struct gateway_board {
+	char id[GATEWAY_ID_MAX]; /* tag of its samples */
+	char address[GATEWAY_ADDRESS_MAX];
+	char path[GATEWAY_PATH_MAX];
+	int port;
+};
+
+struct gateway_config {
+	struct gateway_board boards[GATEWAY_BOARDS_MAX];
+	int count;
+};
+
+int gateway_load_file(const char *path, struct gateway_config *config);
+
+#endif /* _GATEWAY_H_ */
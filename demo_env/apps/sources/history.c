@@ -0,0 +1,121 @@
+/*
+ * Source of the history of the messages published to the sessions, kept
+ * for the clients resuming after a disconnection.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+int history_init(struct history *h, size_t size) {
+	memset(h, 0, sizeof(*h));
+
+	if (size == 0 || size > UINT32_MAX) {
+		fprintf(stderr, "Error: invalid history size %zu\n", size);
+		return -1;
+	}
+
+	h->buf = malloc(size);
+	h->entries = calloc(HISTORY_ENTRIES, sizeof(*h->entries));
+	if (h->buf == NULL || h->entries == NULL) {
+		fprintf(stderr, "Error: history allocation failed\n");
+		history_destroy(h);
+		return -1;
+	}
+	h->size = size;
+	h->first = h->next = 1;
+
+	return 0;
+}
+
+void history_destroy(struct history *h) {
+	free(h->buf);
+	free(h->entries);
+	memset(h, 0, sizeof(*h));
+}
+
+static struct history_entry *entry(const struct history *h, uint64_t seq) {
+	return &h->entries[seq & (HISTORY_ENTRIES - 1)];
+}
+
+static void clear(struct history *h, uint64_t next) {
+	h->first = h->next = next;
+	h->head = 0;
+	h->used = 0;
+}
+
+/*
+ * Offset where len bytes fit without dropping a message, or -1. The
+ * messages retained lie in [tail, head), or in [tail, end) and [0, head)
+ * once the head wrapped.
+ */
+static long place(const struct history *h, size_t len) {
+	size_t tail;
+
+	if (h->first == h->next) {
+		return len <= h->size ? 0 : -1;
+	}
+
+	tail = entry(h, h->first)->offset;
+	if (h->head > tail) {
+		if (h->size - h->head >= len) {
+			return (long)h->head;
+		}
+		return tail >= len ? 0 : -1;
+	}
+
+	return tail - h->head >= len ? (long)h->head : -1;
+}
+
+/*
+ * Retain a message, dropping the oldest ones to make room. A seq not
+ * following the last one clears the history first, a message larger
+ * than the history clears it too, so what is retained stays consecutive.
+ */
+void history_append(struct history *h, uint64_t seq, const void *data, size_t len, int tag) {
+	struct history_entry *e;
+	long offset;
+
+	if (seq != h->next) {
+		clear(h, seq);
+	}
+	if (len == 0 || len > h->size) {
+		clear(h, seq + 1);
+		return;
+	}
+
+	for (;;) {
+		offset = h->next - h->first < HISTORY_ENTRIES ? place(h, len) : -1;
+		if (offset >= 0) {
+			break;
+		}
+		h->used -= entry(h, h->first)->len;
+		h->first++;
+		if (h->first == h->next) {
+			h->head = 0;
+		}
+	}
+
+	memcpy(h->buf + offset, data, len);
+	e = entry(h, seq);
+	e->offset = (uint32_t)offset;
+	e->len = (uint32_t)len;
+	e->tag = tag;
+
+	h->head = (size_t)offset + len;
+	h->used += len;
+	h->next = seq + 1;
+}
+
+/* the entry of seq, NULL if it is not retained */
+const struct history_entry *history_get(const struct history *h, uint64_t seq) {
+	if (seq < h->first || seq >= h->next) {
+		return NULL;
+	}
+
+	return entry(h, seq);
+}
@@ -0,0 +1,49 @@
+/*
+ * Header of the history of the messages published to the sessions, kept
+ * for the clients resuming after a disconnection.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_SIZE 256 /* bytes of messages retained by default(KiB) */
+#define HISTORY_ENTRIES 4096 /* most messages retained, power of 2 */
+
+struct history_entry {
+	uint32_t offset; /* in buf */
+	uint32_t len;
+	int tag; /* of the caller, the topic of the message */
+};
+
+/*
+ * The messages are copied one after the other in buf, wrapping to its
+ * start when the next one doesn't fit before its end, and the oldest are
+ * dropped to make room. Their sequence numbers are consecutive, the entry
+ * of seq is entries[seq & (HISTORY_ENTRIES - 1)].
+ */
+
+struct history {
+	char *buf;
+	size_t size;
+	size_t head; /* offset of the next message */
+	size_t used; /* bytes of the messages retained */
+	struct history_entry *entries;
+	uint64_t first; /* seq of the oldest message retained */
+	uint64_t next; /* seq of the next message, first if empty */
+};
+
+int history_init(struct history *h, size_t size);
+void history_destroy(struct history *h);
+void history_append(struct history *h, uint64_t seq, const void *data, size_t len, int tag);
+const struct history_entry *history_get(const struct history *h, uint64_t seq);
+
+static inline const char *history_data(const struct history *h, const struct history_entry *e) {
+	return h->buf + e->offset;
+}
+
+#endif /* _HISTORY_H_ */
@@ -6,6 +6,11 @@
 
 #ifndef _HS3001_H_
 
+#include <stdint.h>
+
+#include "i2c_sched.h"
+
+#define HS3001_SLAVE_ADDRESS 0x44 /* address of the device, the instances default to it */
 #define HS3001_WAIT_TIME 50000
 
 /* retain the value of the hs3001 sensor */
@@ -15,6 +20,17 @@ struct hs3001_data {
 	float temperature;
 };
 
-int read_humidity_and_temperature(struct hs3001_data *data);
+/* buffers of the HS3001 transfers queued on the I2C scheduler */
+
+struct hs3001_request {
+	uint32_t dummy;
+	unsigned char frame[4];
+};
+
+int hs3001_queue_measurement(struct i2c_sched *sched, uint16_t addr, struct hs3001_request *req,
+			     struct i2c_completion *c);
+int hs3001_queue_fetch(struct i2c_sched *sched, uint16_t addr, struct hs3001_request *req,
+		       struct i2c_completion *c);
+int hs3001_decode(const struct hs3001_request *req, struct hs3001_data *data);
 
 #endif /* _HS3001_H_ */
@@ -0,0 +1,89 @@
+/*
+ * Source of the I2C bus access shared by the sensor drivers.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "i2c_bus.h"
+#include "trace.h"
+
+#if defined(SENSOR_SIMULATION)
+
+#include "sensor_sim.h"
+
+/* the fd is the simulated bus, no file is opened */
+int i2c_bus_open(const char *path) {
+	return sensor_sim_open(path);
+}
+
+int i2c_bus_close(int fd) {
+	(void)fd;
+
+	return 0;
+}
+
+int i2c_bus_transfer(int fd, struct i2c_msg *msgs, int nmsgs) {
+	TRACE_SCOPE("i2c_rdwr");
+
+	return sensor_sim_transfer(fd, msgs, nmsgs);
+}
+
+int i2c_bus_set_timeout(int fd, int timeout_ms, int retries) {
+	(void)fd;
+	(void)timeout_ms;
+	(void)retries;
+
+	return 0;
+}
+
+#else
+
+int i2c_bus_open(const char *path) {
+	return open(path, O_RDWR);
+}
+
+int i2c_bus_close(int fd) {
+	return close(fd);
+}
+
+int i2c_bus_transfer(int fd, struct i2c_msg *msgs, int nmsgs) {
+	struct i2c_rdwr_ioctl_data packets;
+	TRACE_SCOPE("i2c_rdwr");
+
+	packets.msgs = msgs;
+	packets.nmsgs = nmsgs;
+
+	return ioctl(fd, I2C_RDWR, &packets);
+}
+
+int i2c_bus_set_timeout(int fd, int timeout_ms, int retries) {
+	/* I2C_TIMEOUT is in units of 10ms */
+	if (ioctl(fd, I2C_TIMEOUT, (unsigned long)(timeout_ms + 9) / 10) == -1) {
+		return -1;
+	}
+
+	return ioctl(fd, I2C_RETRIES, (unsigned long)retries);
+}
+
+#endif
+
+unsigned long i2c_bus_bits(const struct i2c_msg *msgs, int nmsgs) {
+	unsigned long bits = 1; /* stop */
+	int n;
+
+	for (n = 0; n < nmsgs; n++) {
+		bits += 1 + (unsigned long)(1 + msgs[n].len) * 9;
+	}
+
+	return bits;
+}
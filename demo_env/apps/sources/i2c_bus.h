@@ -0,0 +1,41 @@
+/*
+ * Header of the I2C bus access shared by the sensor drivers.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _I2C_BUS_H_
+#define _I2C_BUS_H_
+
+#include <linux/i2c.h>
+
+#define I2C_DEVICE_FILE "/dev/i2c-1"
+#define I2C_BUS_HZ 400000 /* SCL of the sensor bus, for the utilisation figures */
+#define I2C_BUS_TIMEOUT 100 /* adapter timeout of a transfer(ms), I2C_TIMEOUT */
+#define I2C_BUS_RETRIES 1 /* adapter retries on arbitration loss, I2C_RETRIES */
+
+/*
+ * Bus time of a transfer in SCL clocks: 9 clocks per byte including the
+ * address byte of each message, plus one per (repeated) start and the stop.
+ */
+
+static inline unsigned long i2c_write_bits(int len) {
+	return (unsigned long)(1 + len) * 9 + 2;
+}
+
+static inline unsigned long i2c_read_bits(int reg_len, int len) {
+	return (unsigned long)(1 + reg_len + 1 + len) * 9 + 3;
+}
+
+/*
+ * With SENSOR_SIMULATION the transfers are served by the simulated HS3001
+ * and OB1203 in sensor_sim.c instead of the i2c-dev driver.
+ */
+
+int i2c_bus_open(const char *path);
+int i2c_bus_close(int fd);
+int i2c_bus_transfer(int fd, struct i2c_msg *msgs, int nmsgs);
+int i2c_bus_set_timeout(int fd, int timeout_ms, int retries);
+unsigned long i2c_bus_bits(const struct i2c_msg *msgs, int nmsgs);
+
+#endif /* _I2C_BUS_H_ */
@@ -0,0 +1,434 @@
+/*
+ * Source of the I2C transaction scheduler owning the sensor bus.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "trace.h"
+
+static long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int transfer(struct i2c_sched *sched, struct i2c_msg *msgs, int nmsgs,
+		    struct i2c_sched_stats *stats) {
+	long start;
+	int ret;
+
+	start = now_ns();
+	ret = i2c_bus_transfer(sched->fd, msgs, nmsgs);
+	stats->busy_ns += now_ns() - start;
+
+	stats->syscalls++;
+	stats->msgs += nmsgs;
+	stats->bus_bits += i2c_bus_bits(msgs, nmsgs);
+
+	return ret;
+}
+
+/*
+ * Issue the requests in one I2C_RDWR and complete them. The kernel doesn't
+ * tell which message of a failed transfer failed, so the requests of a
+ * failed merged transfer are reissued alone, but for the I2C_SCHED_NO_REPLAY
+ * ones: the device may have served them already, and a status flag cleared
+ * by the first read would read as not set again.
+ */
+static void run_batch(struct i2c_sched *sched, struct i2c_sched_request *reqs, int nreqs,
+		      struct i2c_sched_stats *stats) {
+	struct i2c_msg msgs[I2C_SCHED_MAX_MSGS];
+	int n, m, nmsgs = 0, ret;
+
+	for (n = 0; n < nreqs; n++) {
+		for (m = 0; m < reqs[n].nmsgs; m++) {
+			msgs[nmsgs++] = reqs[n].msgs[m];
+		}
+	}
+
+	stats->requests += nreqs;
+
+	ret = transfer(sched, msgs, nmsgs, stats);
+	if (ret == -1 && nreqs > 1) {
+		for (n = 0; n < nreqs; n++) {
+			if (reqs[n].flags & I2C_SCHED_NO_REPLAY) {
+				stats->unreplayed++;
+				if (reqs[n].cb) {
+					reqs[n].cb(reqs[n].arg, -1);
+				}
+				continue;
+			}
+
+			stats->isolated++;
+			ret = transfer(sched, reqs[n].msgs, reqs[n].nmsgs, stats);
+			if (ret == -1) {
+				fprintf(stderr, "Error: I2C_RDWR to 0x%02x failed: %s\n",
+					reqs[n].msgs[0].addr, strerror(errno));
+			}
+			if (reqs[n].cb) {
+				reqs[n].cb(reqs[n].arg, ret == -1 ? -1 : 0);
+			}
+		}
+		return;
+	}
+
+	if (ret == -1) {
+		fprintf(stderr, "Error: I2C_RDWR to 0x%02x failed: %s\n", msgs[0].addr, strerror(errno));
+	}
+
+	for (n = 0; n < nreqs; n++) {
+		if (reqs[n].cb) {
+			reqs[n].cb(reqs[n].arg, ret == -1 ? -1 : 0);
+		}
+	}
+}
+
+/*
+ * Close and reopen the bus device, with the timeout and retries applied
+ * again. Runs in the bus thread between two transfers.
+ */
+static void reopen_bus(struct i2c_sched *sched, int timeout_ms, int retries) {
+	if (sched->fd != -1) {
+		i2c_bus_close(sched->fd);
+	}
+
+	sched->fd = i2c_bus_open(sched->path);
+	if (sched->fd == -1) {
+		fprintf(stderr, "Error: can't reopen %s: %s\n", sched->path, strerror(errno));
+		return;
+	}
+
+	if (timeout_ms && i2c_bus_set_timeout(sched->fd, timeout_ms, retries) == -1) {
+		fprintf(stderr, "Error: can't set the timeout of %s: %s\n", sched->path, strerror(errno));
+	}
+
+	fprintf(stderr, "I2C bus %s reopened\n", sched->path);
+}
+
+/*
+ * Split the queue snapshot into I2C_RDWR sized batches and run them. An
+ * I2C_SCHED_ALONE request gets a batch of its own: a failure of another
+ * device can't fail it, and a batch of one is never reissued.
+ */
+static void run_queue(struct i2c_sched *sched, struct i2c_sched_request *reqs, int nreqs,
+		      struct i2c_sched_stats *stats) {
+	int first = 0, n, nmsgs = 0;
+
+	for (n = 0; n < nreqs; n++) {
+		if (reqs[n].flags & I2C_SCHED_ALONE) {
+			if (first < n) {
+				run_batch(sched, &reqs[first], n - first, stats);
+			}
+			run_batch(sched, &reqs[n], 1, stats);
+			first = n + 1;
+			nmsgs = 0;
+			continue;
+		}
+
+		if (nmsgs + reqs[n].nmsgs > I2C_SCHED_MAX_MSGS) {
+			run_batch(sched, &reqs[first], n - first, stats);
+			first = n;
+			nmsgs = 0;
+		}
+
+		nmsgs += reqs[n].nmsgs;
+
+		if (reqs[n].flags & I2C_SCHED_STOP) {
+			run_batch(sched, &reqs[first], n + 1 - first, stats);
+			first = n + 1;
+			nmsgs = 0;
+		}
+	}
+
+	if (first < nreqs) {
+		run_batch(sched, &reqs[first], nreqs - first, stats);
+	}
+}
+
+/*
+ * Take the whole queue and issue it, called with sched->lock held. The lock
+ * is released around the transfers, new requests can be queued meanwhile.
+ */
+static void run_cycle(struct i2c_sched *sched) {
+	struct i2c_sched_request reqs[I2C_SCHED_QUEUE];
+	struct i2c_sched_stats stats;
+	int nreqs, recover, timeout_ms, retries;
+
+	nreqs = sched->count;
+	memcpy(reqs, sched->queue, nreqs * sizeof(reqs[0]));
+	sched->count = 0;
+	sched->kicked = 0;
+	recover = sched->recover;
+	sched->recover = 0;
+	timeout_ms = sched->timeout_ms;
+	retries = sched->retries;
+
+	pthread_mutex_unlock(&sched->lock);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.cycles = 1;
+	if (recover) {
+		reopen_bus(sched, timeout_ms, retries);
+		stats.recoveries = 1;
+	}
+	run_queue(sched, reqs, nreqs, &stats);
+
+	pthread_mutex_lock(&sched->lock);
+
+	sched->last = stats;
+	sched->stats.cycles += stats.cycles;
+	sched->stats.syscalls += stats.syscalls;
+	sched->stats.requests += stats.requests;
+	sched->stats.msgs += stats.msgs;
+	sched->stats.bus_bits += stats.bus_bits;
+	sched->stats.busy_ns += stats.busy_ns;
+	sched->stats.isolated += stats.isolated;
+	sched->stats.unreplayed += stats.unreplayed;
+	sched->stats.recoveries += stats.recoveries;
+}
+
+static void *thread_bus(void *d) {
+	struct i2c_sched *sched = d;
+
+	TRACE_THREAD("i2c bus");
+
+	pthread_mutex_lock(&sched->lock);
+
+	for (;;) {
+		while (!sched->kicked && !sched->finished) {
+			pthread_cond_wait(&sched->cond_wake, &sched->lock);
+		}
+		if (sched->finished) {
+			break;
+		}
+
+		run_cycle(sched);
+	}
+
+	pthread_mutex_unlock(&sched->lock);
+
+	return NULL;
+}
+
+static int open_bus(struct i2c_sched *sched, const char *path) {
+	memset(sched, 0, sizeof(*sched));
+
+	sched->path = path;
+	sched->fd = i2c_bus_open(path);
+	if (sched->fd == -1) {
+		fprintf(stderr, "Error: can't open %s\n", path);
+		return -1;
+	}
+
+	pthread_mutex_init(&sched->lock, NULL);
+	pthread_cond_init(&sched->cond_wake, NULL);
+
+	return 0;
+}
+
+int i2c_sched_init(struct i2c_sched *sched, const char *path) {
+	if (open_bus(sched, path)) {
+		return -1;
+	}
+
+	if (pthread_create(&sched->thread, NULL, thread_bus, sched)) {
+		fprintf(stderr, "Error: I2C bus thread creation failed\n");
+		pthread_cond_destroy(&sched->cond_wake);
+		pthread_mutex_destroy(&sched->lock);
+		i2c_bus_close(sched->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Same without the bus thread, for a single threaded caller: the queue is
+ * issued by i2c_sched_flush() itself, the requests are completed when it
+ * returns.
+ */
+int i2c_sched_init_inline(struct i2c_sched *sched, const char *path) {
+	if (open_bus(sched, path)) {
+		return -1;
+	}
+
+	sched->inline_flush = 1;
+
+	return 0;
+}
+
+void i2c_sched_destroy(struct i2c_sched *sched) {
+	int n;
+
+	pthread_mutex_lock(&sched->lock);
+	sched->finished = 1;
+	pthread_cond_signal(&sched->cond_wake);
+	pthread_mutex_unlock(&sched->lock);
+
+	if (!sched->inline_flush) {
+		pthread_join(sched->thread, NULL);
+	}
+
+	/* fail what was never issued so no waiter is left behind */
+	for (n = 0; n < sched->count; n++) {
+		if (sched->queue[n].cb) {
+			sched->queue[n].cb(sched->queue[n].arg, -1);
+		}
+	}
+	sched->count = 0;
+
+	pthread_cond_destroy(&sched->cond_wake);
+	pthread_mutex_destroy(&sched->lock);
+	if (sched->fd != -1) {
+		i2c_bus_close(sched->fd);
+	}
+}
+
+/*
+ * Queue one request of up to I2C_SCHED_REQUEST_MSGS messages. The message
+ * buffers must stay valid until the callback ran.
+ */
+int i2c_sched_submit(struct i2c_sched *sched, const struct i2c_msg *msgs, int nmsgs,
+		     int flags, i2c_sched_cb cb, void *arg) {
+	struct i2c_sched_request *req;
+
+	if (nmsgs < 1 || nmsgs > I2C_SCHED_REQUEST_MSGS) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&sched->lock);
+
+	if (sched->count == I2C_SCHED_QUEUE || sched->finished) {
+		pthread_mutex_unlock(&sched->lock);
+		fprintf(stderr, "Error: I2C request queue full\n");
+		return -1;
+	}
+
+	req = &sched->queue[sched->count++];
+	memcpy(req->msgs, msgs, nmsgs * sizeof(msgs[0]));
+	req->nmsgs = nmsgs;
+	req->flags = flags;
+	req->cb = cb;
+	req->arg = arg;
+
+	pthread_mutex_unlock(&sched->lock);
+
+	return 0;
+}
+
+/* hand everything queued so far to the bus thread, or issue it inline */
+void i2c_sched_flush(struct i2c_sched *sched) {
+	pthread_mutex_lock(&sched->lock);
+	if (sched->count && sched->inline_flush) {
+		run_cycle(sched);
+	} else if (sched->count) {
+		sched->kicked = 1;
+		pthread_cond_signal(&sched->cond_wake);
+	}
+	pthread_mutex_unlock(&sched->lock);
+}
+
+/*
+ * Set the adapter timeout and retries of the bus, kept across the bus
+ * recoveries. Call before any request is queued.
+ */
+int i2c_sched_set_timeout(struct i2c_sched *sched, int timeout_ms, int retries) {
+	pthread_mutex_lock(&sched->lock);
+	sched->timeout_ms = timeout_ms;
+	sched->retries = retries;
+	pthread_mutex_unlock(&sched->lock);
+
+	if (i2c_bus_set_timeout(sched->fd, timeout_ms, retries) == -1) {
+		fprintf(stderr, "Error: can't set the timeout of %s: %s\n", sched->path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* reopen the bus device before the next transfer, after a device got stuck */
+void i2c_sched_recover(struct i2c_sched *sched) {
+	pthread_mutex_lock(&sched->lock);
+	sched->recover = 1;
+	pthread_mutex_unlock(&sched->lock);
+}
+
+void i2c_sched_get_stats(struct i2c_sched *sched, struct i2c_sched_stats *total,
+			 struct i2c_sched_stats *last) {
+	pthread_mutex_lock(&sched->lock);
+	if (total) {
+		*total = sched->stats;
+	}
+	if (last) {
+		*last = sched->last;
+	}
+	pthread_mutex_unlock(&sched->lock);
+}
+
+/*
+ * Queue a request completed through c. The request is accounted in c
+ * before it is queued, another thread may flush the queue at any time.
+ */
+int i2c_sched_submit_completion(struct i2c_sched *sched, const struct i2c_msg *msgs,
+				int nmsgs, int flags, struct i2c_completion *c) {
+	pthread_mutex_lock(&c->lock);
+	c->pending++;
+	pthread_mutex_unlock(&c->lock);
+
+	if (i2c_sched_submit(sched, msgs, nmsgs, flags, i2c_completion_done, c)) {
+		i2c_completion_done(c, -1);
+		return -1;
+	}
+
+	return 0;
+}
+
+void i2c_completion_init(struct i2c_completion *c) {
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	c->pending = 0;
+	c->errors = 0;
+}
+
+/* i2c_sched_cb completing one of the requests waited for */
+void i2c_completion_done(void *arg, int status) {
+	struct i2c_completion *c = arg;
+
+	pthread_mutex_lock(&c->lock);
+	if (status) {
+		c->errors++;
+	}
+	if (--c->pending == 0) {
+		pthread_cond_signal(&c->cond);
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+/* returns 0 if all the requests succeeded, -1 otherwise, and rearms c */
+int i2c_completion_wait(struct i2c_completion *c) {
+	int errors;
+
+	pthread_mutex_lock(&c->lock);
+	while (c->pending > 0) {
+		pthread_cond_wait(&c->cond, &c->lock);
+	}
+	errors = c->errors;
+	c->errors = 0;
+	pthread_mutex_unlock(&c->lock);
+
+	return errors ? -1 : 0;
+}
+
+void i2c_completion_destroy(struct i2c_completion *c) {
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+}
@@ -0,0 +1,112 @@
+/*
+ * Header of the I2C transaction scheduler owning the sensor bus.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _I2C_SCHED_H_
+#define _I2C_SCHED_H_
+
+#include <pthread.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define I2C_SCHED_MAX_MSGS I2C_RDWR_IOCTL_MAX_MSGS /* per I2C_RDWR, kernel limit */
+#define I2C_SCHED_QUEUE 64 /* requests waiting for the bus */
+#define I2C_SCHED_REQUEST_MSGS 2 /* a register read is a write + read pair */
+
+/* the request must be followed by a STOP, it ends the I2C_RDWR it is merged in */
+#define I2C_SCHED_STOP 0x01
+/* the request pops a FIFO or clears a flag: issued in an I2C_RDWR of its own */
+#define I2C_SCHED_ALONE 0x02
+/* the request clears a flag: it fails with a failed merged I2C_RDWR, never reissued */
+#define I2C_SCHED_NO_REPLAY 0x04
+
+/* called from the bus thread once the request is done, status 0 or -1 */
+typedef void (*i2c_sched_cb)(void *arg, int status);
+
+struct i2c_sched_request {
+	struct i2c_msg msgs[I2C_SCHED_REQUEST_MSGS];
+	int nmsgs;
+	int flags;
+	i2c_sched_cb cb;
+	void *arg;
+};
+
+struct i2c_sched_stats {
+	unsigned long cycles; /* flushes served */
+	unsigned long syscalls; /* I2C_RDWR issued */
+	unsigned long requests;
+	unsigned long msgs;
+	unsigned long bus_bits; /* SCL clocks of the transfers */
+	long busy_ns; /* time spent in I2C_RDWR */
+	unsigned long isolated; /* requests reissued alone after a merged failure */
+	unsigned long unreplayed; /* I2C_SCHED_NO_REPLAY requests failed with a merged failure */
+	unsigned long recoveries; /* bus reopened */
+};
+
+/*
+ * The scheduler owns the bus file descriptor and a bus thread. Drivers
+ * queue requests with i2c_sched_submit(), i2c_sched_flush() wakes the bus
+ * thread which merges everything queued into as few I2C_RDWR calls as the
+ * kernel limit and the STOP requirements allow, then completes the
+ * requests through their callbacks. When a merged I2C_RDWR fails, its
+ * requests are reissued one by one so each gets its own status and a dead
+ * device doesn't fail the others. Reissuing is only safe for requests
+ * without side effects: the device may have served them before the
+ * failure. An I2C_SCHED_ALONE request is never merged, so never reissued,
+ * an I2C_SCHED_NO_REPLAY one is merged but fails with the transfer.
+ *
+ * i2c_sched_init_inline() starts no bus thread, i2c_sched_flush() issues
+ * the queue in the calling thread instead, for a single threaded server.
+ */
+
+struct i2c_sched {
+	const char *path;
+	int fd; /* owned by the bus thread once started */
+	int timeout_ms; /* {lock} I2C_TIMEOUT, 0 for the adapter default */
+	int retries; /* {lock} I2C_RETRIES */
+
+	pthread_t thread;
+	pthread_mutex_t lock; /* serialize access to the queue and the stats */
+	pthread_cond_t cond_wake; /* wakeup the bus thread */
+	struct i2c_sched_request queue[I2C_SCHED_QUEUE]; /* {lock} */
+	int count; /* {lock} */
+	int kicked; /* {lock} */
+	int finished; /* {lock} */
+	int recover; /* {lock} reopen the bus before the next transfer */
+	int inline_flush; /* no bus thread, the queue is issued on flush */
+
+	struct i2c_sched_stats stats; /* {lock} since i2c_sched_init() */
+	struct i2c_sched_stats last; /* {lock} of the last flush */
+};
+
+/* helper to wait synchronously for a set of requests */
+
+struct i2c_completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int pending;
+	int errors;
+};
+
+int i2c_sched_init(struct i2c_sched *sched, const char *path);
+int i2c_sched_init_inline(struct i2c_sched *sched, const char *path);
+void i2c_sched_destroy(struct i2c_sched *sched);
+int i2c_sched_submit(struct i2c_sched *sched, const struct i2c_msg *msgs, int nmsgs,
+		     int flags, i2c_sched_cb cb, void *arg);
+void i2c_sched_flush(struct i2c_sched *sched);
+int i2c_sched_set_timeout(struct i2c_sched *sched, int timeout_ms, int retries);
+void i2c_sched_recover(struct i2c_sched *sched);
+void i2c_sched_get_stats(struct i2c_sched *sched, struct i2c_sched_stats *total,
+			 struct i2c_sched_stats *last);
+
+int i2c_sched_submit_completion(struct i2c_sched *sched, const struct i2c_msg *msgs,
+				int nmsgs, int flags, struct i2c_completion *c);
+
+void i2c_completion_init(struct i2c_completion *c);
+void i2c_completion_done(void *arg, int status);
+int i2c_completion_wait(struct i2c_completion *c);
+void i2c_completion_destroy(struct i2c_completion *c);
+
+#endif /* _I2C_SCHED_H_ */
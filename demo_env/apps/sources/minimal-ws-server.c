@@ -28,13 +28,64 @@
 static struct lws_protocols protocols[] = {
 	{ "http", lws_callback_http_dummy, 0, 0 },
 	LWS_PLUGIN_PROTOCOL_MINIMAL,
+	LWS_PLUGIN_PROTOCOL_STATS,
+	LWS_PLUGIN_PROTOCOL_EVENTS,
 	{ NULL, NULL, 0, 0 } /* terminator */
 };
 
 static int interrupted;
 
-static const struct lws_http_mount mount = {
+#if defined(SENSOR_TRACE)
+static volatile sig_atomic_t trace_requested;
+static const char *trace_file = TRACE_FILE;
+#endif
+
+/* the samples as Server-Sent Events, served by the graph-events protocol */
+
+static const struct lws_http_mount mount_events = {
 	/* .mount_next */		NULL,		/* linked-list "next" */
+	/* .mountpoint */		"/events",	/* mountpoint URL */
+	/* .origin */			"graph-events",	/* protocol name */
+	/* .def */			NULL,
+	/* .protocol */			NULL,
+	/* .cgienv */			NULL,
+	/* .extra_mimetypes */		NULL,
+	/* .interpret */		NULL,
+	/* .cgi_timeout */		0,
+	/* .cache_max_age */		0,
+	/* .auth_mask */		0,
+	/* .cache_reusable */		0,
+	/* .cache_revalidate */		0,
+	/* .cache_intermediaries */	0,
+	/* .origin_protocol */		LWSMPRO_CALLBACK, /* dynamic */
+	/* .mountpoint_len */		7,		/* char count */
+	/* .basic_auth_login_file */	NULL,
+};
+
+/* the session counters as JSON, served by the graph-stats protocol */
+
+static const struct lws_http_mount mount_stats = {
+	/* .mount_next */		&mount_events,	/* linked-list "next" */
+	/* .mountpoint */		"/stats",	/* mountpoint URL */
+	/* .origin */			"graph-stats",	/* protocol name */
+	/* .def */			NULL,
+	/* .protocol */			NULL,
+	/* .cgienv */			NULL,
+	/* .extra_mimetypes */		NULL,
+	/* .interpret */		NULL,
+	/* .cgi_timeout */		0,
+	/* .cache_max_age */		0,
+	/* .auth_mask */		0,
+	/* .cache_reusable */		0,
+	/* .cache_revalidate */		0,
+	/* .cache_intermediaries */	0,
+	/* .origin_protocol */		LWSMPRO_CALLBACK, /* dynamic */
+	/* .mountpoint_len */		6,		/* char count */
+	/* .basic_auth_login_file */	NULL,
+};
+
+static const struct lws_http_mount mount = {
+	/* .mount_next */		&mount_stats,	/* linked-list "next" */
 	/* .mountpoint */		"/",		/* mountpoint URL */
 	/* .origin */			"./", /* serve from dir */
 	/* .def */			"index.html",	/* default filename */
@@ -81,6 +132,14 @@ void sigint_handler(int sig)
 	interrupted = 1;
 }
 
+#if defined(SENSOR_TRACE)
+/* the trace is written by the service loop, not from the handler */
+void sigusr1_handler(int sig)
+{
+	trace_requested = 1;
+}
+#endif
+
 int main(int argc, const char **argv)
 {
 	struct lws_context_creation_info info;
@@ -95,9 +154,13 @@ int main(int argc, const char **argv)
 			/* | LLL_DEBUG */;
 
 	int interval = 0;
+	int port = 3000;
 
 	signal(SIGINT, sigint_handler);
 	signal(SIGTERM, sigint_handler);
+#if defined(SENSOR_TRACE)
+	signal(SIGUSR1, sigusr1_handler);
+#endif
 
 	/* argv[1]: interval(ms) */
 	if(argv[1] == NULL) {
@@ -110,14 +173,128 @@ int main(int argc, const char **argv)
 	if ((p = lws_cmdline_option(argc, argv, "-d")))
 		logs = atoi(p);
 
+	/* --ppg: stream the OB1203 PPG FIFO instead of reading the proximity */
+	if (lws_cmdline_option(argc, argv, "--ppg"))
+		set_ppg(1);
+
+	/*
+	 * --adaptive [--max-period <ms>]: stretch the sampling period of each
+	 * channel up to max-period while its readings are stable
+	 */
+	if (lws_cmdline_option(argc, argv, "--adaptive")) {
+		p = lws_cmdline_option(argc, argv, "--max-period");
+		set_adaptive(p ? atoi(p) : 0);
+	}
+
+	/* --standby-grace <ms>: time without client before the sensors standby */
+	if ((p = lws_cmdline_option(argc, argv, "--standby-grace")))
+		set_standby_grace(atoi(p));
+
+	/* --feed [name]: publish the samples in shared memory for local processes */
+	if ((p = lws_cmdline_option(argc, argv, "--feed")))
+		set_feed(*p && *p != '-' ? p : SAMPLE_FEED_NAME);
+
+	/* --sensors <file>: sensor instances and their buses */
+	if ((p = lws_cmdline_option(argc, argv, "--sensors")))
+		set_sensors_file(p);
+
+#if defined(SENSOR_SIMULATION)
+	/* --sim-speed <x>: run the simulated sensors and the sampling x times faster */
+	if ((p = lws_cmdline_option(argc, argv, "--sim-speed")))
+		set_sim_speed(atoi(p));
+#endif
+
+	/* --detect <file>: anomaly and change detectors of the channels */
+	if ((p = lws_cmdline_option(argc, argv, "--detect")))
+		set_detector_file(p);
+
+	/*
+	 * --resample <hold|linear> [--grid <ms>]: publish the channels
+	 * resampled on a common grid too, with the dew point
+	 */
+	if ((p = lws_cmdline_option(argc, argv, "--resample")))
+		set_resample(p);
+	if ((p = lws_cmdline_option(argc, argv, "--grid")))
+		set_resample_grid(atoi(p));
+
+	/*
+	 * --capture "<rising|falling|either|none> [level] [pre <ms>] [post <ms>]":
+	 * capture the PPG samples of --ppg around their edges, or the trigger
+	 * commands
+	 */
+	if ((p = lws_cmdline_option(argc, argv, "--capture")))
+		set_capture(p);
+
+	/*
+	 * --history <KiB>: messages retained for the clients resuming after a
+	 * disconnection, 0 disables it
+	 */
+	if ((p = lws_cmdline_option(argc, argv, "--history")))
+		set_history(atoi(p));
+
+	/* --rules <file>: led rules evaluated after each sample */
+	if ((p = lws_cmdline_option(argc, argv, "--rules")))
+		set_rules_file(p);
+
+	/* --max-lag <ms>: close a session unable to write for that long */
+	if ((p = lws_cmdline_option(argc, argv, "--max-lag")))
+		set_max_lag(atoi(p));
+
+	/* --i2c-timeout <ms>, --i2c-retries <n>: adapter settings of the sensor bus */
+	if ((p = lws_cmdline_option(argc, argv, "--i2c-timeout")))
+		set_i2c_timeout(atoi(p), -1);
+	if ((p = lws_cmdline_option(argc, argv, "--i2c-retries")))
+		set_i2c_timeout(0, atoi(p));
+
+	/* --i2c-recovery: reopen the bus when a sensor stops answering */
+	if (lws_cmdline_option(argc, argv, "--i2c-recovery"))
+		set_i2c_recovery(1);
+
+	/* --gateway <file>: relay the boards listed instead of the local sensors */
+	if ((p = lws_cmdline_option(argc, argv, "--gateway")))
+		set_gateway(p);
+
+	/*
+	 * --uncompressed-small: the messages under the threshold of a session
+	 * go uncompressed, without it a threshold is refused
+	 */
+	set_deflate_passthrough(!!lws_cmdline_option(argc, argv, "--uncompressed-small"));
+
+	/*
+	 * --deflate <off|on|bytes>: permessage-deflate policy of the clients
+	 * not passing their own as ?deflate=, on compresses the messages from
+	 * that size only
+	 */
+	if ((p = lws_cmdline_option(argc, argv, "--deflate")))
+		set_deflate(p);
+
+	/*
+	 * --no-context-takeover, --max-window-bits <bits>: bound the
+	 * compressor memory of each session
+	 */
+	p = lws_cmdline_option(argc, argv, "--max-window-bits");
+	set_deflate_memory(!!lws_cmdline_option(argc, argv, "--no-context-takeover"),
+			   p ? atoi(p) : 0);
+
+#if defined(SENSOR_TRACE)
+	/* --trace <file>: where SIGUSR1 writes the trace events */
+	if ((p = lws_cmdline_option(argc, argv, "--trace")))
+		trace_file = p;
+#endif
+
+	/* --port <n>: listen port, to run several instances on one host */
+	if ((p = lws_cmdline_option(argc, argv, "--port")))
+		port = atoi(p);
+
 	lws_set_log_level(logs, NULL);
-	lwsl_user("LWS minimal ws server + threads | visit http://localhost:3000\n");
+	lwsl_user("LWS minimal ws server + threads | visit http://localhost:%d\n", port);
 
 	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
-	info.port = 3000;
+	info.port = port;
 	info.mounts = &mount;
 	info.protocols = protocols;
 	info.pvo = &pvo; /* per-vhost options */
+	info.extensions = extensions; /* permessage-deflate */
 	info.options =
 		LWS_SERVER_OPTION_HTTP_HEADERS_SECURITY_BEST_PRACTICES_ENFORCE;
 
@@ -129,9 +306,17 @@ int main(int argc, const char **argv)
 
 	/* start the threads that create content */
 
-	while (!interrupted)
+	while (!interrupted) {
 		if (lws_service(context, 0))
 			interrupted = 1;
+#if defined(SENSOR_TRACE)
+		if (trace_requested) {
+			trace_requested = 0;
+			if (!trace_dump_file(trace_file))
+				lwsl_user("trace events written to %s\n", trace_file);
+		}
+#endif
+	}
 
 	lws_context_destroy(context);
 
@@ -4,311 +4,376 @@
  * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
  */
 
-#include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <math.h>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/ioctl.h>
 
 #include <linux/i2c.h>
-#include <linux/i2c-dev.h>
 
+#include "i2c_bus.h"
 #include "ob1203.h"
+#include "convert.h"
+#include "trace.h"
+#include "vclock.h"
 
-#define OB1203_SLAVE_ADDRESS 0x53
-#define I2C_DEVICE_FILE "/dev/i2c-1"
-
-static int read_i2c_data(int fd, unsigned char register_address, unsigned char *data, int size) {
-	struct i2c_msg msg[2];
-	struct i2c_rdwr_ioctl_data packets;
-	int ret;
-
-	msg[0].addr = OB1203_SLAVE_ADDRESS;
-	msg[0].flags = 0;
-	msg[0].len = 1;
-	msg[0].buf = &register_address;
-
-	msg[1].addr = OB1203_SLAVE_ADDRESS;
-	msg[1].flags = I2C_M_RD;
-	msg[1].len = size;
-	msg[1].buf = data;
-
-	packets.msgs = msg;
-	packets.nmsgs = 2;
-	ret = ioctl(fd, I2C_RDWR, &packets);
-
-	return ret;
-}
-
-static int write_i2c_data(int fd, unsigned char register_address, unsigned char data, int size) {
+static int write_i2c_data(int fd, uint16_t addr, unsigned char register_address, unsigned char data, int size) {
 	struct i2c_msg msg[1];
-	struct i2c_rdwr_ioctl_data packets;
 	unsigned char buf[size + 1]; /* Allocate size byte of data to be written + 1 byte of register address */
 	int ret;
+	TRACE_SCOPE("ob1203 write");
 
 	buf[0] = register_address;
 	buf[1] = data;
 
-	msg[0].addr = OB1203_SLAVE_ADDRESS;
+	msg[0].addr = addr;
 	msg[0].flags = 0;
 	msg[0].len = sizeof(buf);
 	msg[0].buf = buf;
 
-	packets.msgs = msg;
-	packets.nmsgs = 1;
-	ret = ioctl(fd, I2C_RDWR, &packets);
+	ret = i2c_bus_transfer(fd, msg, 1);
 
 	return ret;
 }
 
-int set_ls_status() {
+int set_ls_status(const char *path, uint16_t addr) {
 	int size = 1;
 	int fd, ret = 0;
 	unsigned char register_address = 0x15, data = 0x03;
 
-	fd = open(I2C_DEVICE_FILE, O_RDWR);
+	fd = i2c_bus_open(path);
 	if (fd == -1) {
 		return -1;
 	}
 
 	/* set Light sensor mode: CS Mode */
 	/* set Light sensor enable: Light sensor active */
-	ret = write_i2c_data(fd, register_address, data, size);
+	ret = write_i2c_data(fd, addr, register_address, data, size);
 
 	if(ret == -1){
 		fprintf(stderr, "Error: light sensor activation failed\n");
 		return -1;
 	}
 
-	close(fd);
+	i2c_bus_close(fd);
 	return 0;
 }
 
-int set_ps_status() {
+int set_ps_status(const char *path, uint16_t addr) {
 	int fd, ret = 0, size = 1;
 	unsigned char register_address = 0x16, data = 0x01;
 
-	fd = open(I2C_DEVICE_FILE, O_RDWR);
+	fd = i2c_bus_open(path);
 	if (fd == -1) {
 		return -1;
 	}
 
 	/* set PPG proximity mode: PS Mode(default) */
 	/* set PPG or proximity sensor enable: PPG/PS active */
-	ret = write_i2c_data(fd, register_address, data, size);
+	ret = write_i2c_data(fd, addr, register_address, data, size);
 
 	if(ret == -1){
 		fprintf(stderr, "Error: proximity sensor activation failed\n");
 		return -1;
 	}
 
-	close(fd);
+	i2c_bus_close(fd);
 	return 0;
 }
 
-int set_ps_measurement_period() {
+int set_ps_measurement_period(const char *path, uint16_t addr) {
 	int fd, ret = 0, size = 1;
 	unsigned char register_address = 0x1A, data = 0x14;
 
-	fd = open(I2C_DEVICE_FILE, O_RDWR);
+	fd = i2c_bus_open(path);
 	if (fd == -1) {
 		return -1;
 	}
 
 	/* set PS_measurement_period: 50ms */
-	ret = write_i2c_data(fd, register_address, data, size);
+	ret = write_i2c_data(fd, addr, register_address, data, size);
 
 	if(ret == -1){
 		fprintf(stderr, "Error: Failed to update the ps measurement period\n");
 		return -1;
 	}
 
-	close(fd);
+	i2c_bus_close(fd);
 	return 0;
 }
 
-static int read_ls_data_status(int fd) {
-	int size = 1, ret;
-	unsigned char ls_data_status = 0;
-	unsigned char register_address = 0x00;
+/*
+ * Stop the LS engine, and the PS engine too unless proximity is 0 (the PPG
+ * mode owns it), they stop converting until set_ls_status() and
+ * set_ps_status() enable them again.
+ */
+int set_standby(const char *path, uint16_t addr, int proximity) {
+	int fd, ret = 0, size = 1;
 
-	ret = read_i2c_data(fd, register_address, &ls_data_status, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read LS_data_status\n");
+	fd = i2c_bus_open(path);
+	if (fd == -1) {
 		return -1;
 	}
 
-	return ls_data_status & 0x01;
-}
+	/* MAIN_CTRL_0: Light sensor standby */
+	ret = write_i2c_data(fd, addr, 0x15, 0x00, size);
+	if (ret != -1 && proximity) {
+		/* MAIN_CTRL_1: PPG/PS standby */
+		ret = write_i2c_data(fd, addr, OB1203_REG_MAIN_CTRL_1, 0x00, size);
+	}
 
-static int read_ps_data_status(int fd) {
-	int size = 1, ret;
-	unsigned char ps_data_status = 0;
-	unsigned char register_address = 0x01;
+	if (ret == -1) {
+		fprintf(stderr, "Error: Failed to put the OB1203 in standby\n");
+	}
 
-	ret = read_i2c_data(fd, register_address, &ps_data_status, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read PS_data_status\n");
+	i2c_bus_close(fd);
+	return ret == -1 ? -1 : 0;
+}
+
+int set_ppg_mode(const char *path, uint16_t addr) {
+	int fd, n, ret = 0, size = 1;
+	static const unsigned char config[][2] = {
+		/* PPG_AVG: no averaging */
+		{ OB1203_REG_PPG_AVG, 0x00 },
+		/* PPG_PWIDTH_PERIOD: 130us pulse, 2.5ms period (400 samples/s) */
+		{ OB1203_REG_PPG_PWIDTH_PERIOD, 0x41 },
+		/* FIFO_CFG: roll over when full, the oldest samples are dropped */
+		{ OB1203_REG_FIFO_CFG, 0x10 },
+		/* empty the FIFO */
+		{ OB1203_REG_FIFO_WR_PTR, 0x00 },
+		{ OB1203_REG_FIFO_RD_PTR, 0x00 },
+		{ OB1203_REG_FIFO_OVF_CNT, 0x00 },
+		/* set PPG proximity mode: HR Mode, PPG/PS active */
+		{ OB1203_REG_MAIN_CTRL_1, OB1203_PPG_MODE_HR | OB1203_PPG_ENABLE },
+	};
+
+	fd = i2c_bus_open(path);
+	if (fd == -1) {
 		return -1;
 	}
 
-	return ps_data_status & 0x01;
+	for (n = 0; n < (int)(sizeof(config) / sizeof(config[0])); n++) {
+		ret = write_i2c_data(fd, addr, config[n][0], config[n][1], size);
+		if (ret == -1) {
+			fprintf(stderr, "Error: PPG mode activation failed at register 0x%02x\n", config[n][0]);
+			break;
+		}
+	}
+
+	i2c_bus_close(fd);
+	return ret == -1 ? -1 : 0;
 }
 
-static int read_ls_green_data(int fd) {
-	int size = 1, ret;
-	unsigned char color_green = 0;
-	unsigned char register_address = 0x07;
+/*
+ * Queue a register read, the register address is kept in *reg until done.
+ * flags are the I2C_SCHED_* ones of the register: a status read clearing
+ * its flag mustn't be reissued, a FIFO read popping it mustn't be merged.
+ */
+static int queue_read(struct i2c_sched *sched, uint16_t addr, unsigned char *reg,
+		      unsigned char register_address, unsigned char *data, int size,
+		      int flags, struct i2c_completion *c) {
+	struct i2c_msg msg[2];
 
-	ret = read_i2c_data(fd, register_address, &color_green, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read LS_GREEN_DATA\n");
-		return -1;
-	}
-	return color_green;
+	*reg = register_address;
+
+	msg[0].addr = addr;
+	msg[0].flags = 0;
+	msg[0].len = 1;
+	msg[0].buf = reg;
+
+	msg[1].addr = addr;
+	msg[1].flags = I2C_M_RD;
+	msg[1].len = size;
+	msg[1].buf = data;
+
+	return i2c_sched_submit_completion(sched, msg, 2, flags, c);
 }
 
-static int read_ls_blue_data(int fd) {
-	int size = 1, ret;
-	unsigned char color_blue = 0;
-	unsigned char register_address = 0x0A;
+/*
+ * Queue the LS and PS data reads. There is no wait for new data, an old
+ * value is just read again. The status registers clear on read, only
+ * ob1203_queue_status() reads them, for the callers needing them.
+ */
 
-	ret = read_i2c_data(fd, register_address, &color_blue, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read LS_BLUE_DATA\n");
+int ob1203_queue_light(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+		       struct i2c_completion *c) {
+	if (queue_read(sched, addr, &req->reg[1], 0x07, &req->green, 1, 0, c) ||
+	    queue_read(sched, addr, &req->reg[2], 0x0A, &req->blue, 1, 0, c) ||
+	    queue_read(sched, addr, &req->reg[3], 0x0D, &req->red, 1, 0, c)) {
+		fprintf(stderr, "Error: Failed to queue the LS data read\n");
 		return -1;
 	}
 
-	return color_blue;
+	return 0;
 }
 
-static int read_ls_red_data(int fd) {
-	int size = 1, ret;
-	unsigned char color_red = 0;
-	unsigned char register_address = 0x0D;
-
-	ret = read_i2c_data(fd, register_address, &color_red, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read LS_RED_DATA\n");
+int ob1203_queue_proximity(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+			   struct i2c_completion *c) {
+	if (queue_read(sched, addr, &req->reg[5], 0x02, req->ps, sizeof(req->ps), 0, c)) {
+		fprintf(stderr, "Error: Failed to queue the PS data read\n");
 		return -1;
 	}
 
-	return color_red;
+	return 0;
 }
 
-static int read_ps_data(int fd) {
-	int size = 2, ret;
-	unsigned char data[size];
-	unsigned char register_address = 0x02;
-	unsigned int proximity;
-
-	ret = read_i2c_data(fd, register_address, data, size);
-	if(ret == -1){
-		fprintf(stderr, "Error: Failed to read PS_DATA\n");
+/*
+ * Read the LS data status, and the PS one unless proximity is 0, into
+ * ls_status and ps_status. Their OB1203_STATUS_NEW_DATA bit is set once
+ * the engine delivered a measurement and cleared by the read.
+ */
+int ob1203_queue_status(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+			int proximity, struct i2c_completion *c) {
+	if (queue_read(sched, addr, &req->reg[0], 0x00, &req->ls_status, 1,
+		       I2C_SCHED_NO_REPLAY, c) ||
+	    (proximity && queue_read(sched, addr, &req->reg[4], 0x01, &req->ps_status, 1,
+				     I2C_SCHED_NO_REPLAY, c))) {
+		fprintf(stderr, "Error: Failed to queue the data status read\n");
 		return -1;
 	}
 
-	proximity = (data[1] << 8) | data[0];
+	return 0;
+}
 
-	return proximity;
+void ob1203_decode_light(const struct ob1203_request *req, struct ob1203_data *data) {
+	data->color_green = req->green;
+	data->color_blue = req->blue;
+	data->color_red = req->red;
+	data->light = ob1203_light(data->color_red, data->color_green, data->color_blue);
 }
 
-static int calc_light(int color_green, int color_blue, int color_red) {
-	int gain = 3, res = 18, c = 1;
-	int gain_scale = 0, res_scale = 0;
-	int light = 0;
+void ob1203_decode_proximity(const struct ob1203_request *req, struct ob1203_data *data) {
+	data->proximity = (req->ps[1] << 8) | req->ps[0];
+}
 
-	res_scale = pow(2, 20 - res);
-	gain_scale = 6 / gain;
-	light = gain_scale * res_scale * ((color_red + color_green + color_blue) * c);
+/*
+ * Poll the data status registers until the LS engine, and the PS engine
+ * unless proximity is 0, delivered their first measurement after being
+ * enabled. Gives up after OB1203_WARMUP_TIMEOUT.
+ */
+int wait_data_ready(struct i2c_sched *sched, uint16_t addr, int proximity) {
+	struct i2c_completion c;
+	struct ob1203_request req;
+	int ls_ready = 0, ps_ready = !proximity, waited = 0, ret = 0;
+	TRACE_SCOPE("ob1203 warm-up");
+
+	i2c_completion_init(&c);
+
+	while (!ls_ready || !ps_ready) {
+		if (waited >= OB1203_WARMUP_TIMEOUT) {
+			fprintf(stderr, "Error: OB1203 data not ready after %dus\n", waited);
+			ret = -1;
+			break;
+		}
+
+		ob1203_queue_status(sched, addr, &req, proximity, &c);
+		i2c_sched_flush(sched);
+		if (i2c_completion_wait(&c)) {
+			fprintf(stderr, "Error: Failed to read the data status\n");
+			ret = -1;
+			break;
+		}
+
+		/* the "new data" flags clear on read, remember them */
+		ls_ready |= req.ls_status & OB1203_STATUS_NEW_DATA;
+		if (proximity) {
+			ps_ready |= req.ps_status & OB1203_STATUS_NEW_DATA;
+		}
+
+		if (!ls_ready || !ps_ready) {
+			TRACE_BEGIN(poll);
+			vclock_usleep(OB1203_WARMUP_POLL_TIME);
+			TRACE_END(poll, "ob1203 warm-up sleep");
+			waited += OB1203_WARMUP_POLL_TIME;
+		}
+	}
 
-	return light;
+	i2c_completion_destroy(&c);
+	return ret;
 }
 
-int read_light(struct ob1203_data *data) {
-	int fd, ret = 0, color_green = 0, color_blue = 0, color_red = 0;
-	unsigned char ls_data_status;
-
-	fd = open(I2C_DEVICE_FILE, O_RDWR);
-	if (fd == -1) {
-		return -1;
-	}
+/*
+ * Drain the PPG FIFO: one read of the three pointer registers to get the
+ * fill level, then one burst read of exactly that many samples from
+ * FIFO_DATA (the register address doesn't auto increment there). Both
+ * go through the I2C scheduler, merged with the other sensors requests.
+ *
+ * Equal pointers are an empty FIFO or an exactly full one, late tells the
+ * caller let it produce more than half of it since the previous drain.
+ */
+int read_ppg_fifo(struct i2c_sched *sched, uint16_t addr, struct ob1203_ppg_data *data,
+		  int late) {
+	struct i2c_completion c;
+	struct i2c_msg msg[1];
+	int n, level, ret = 0;
+	unsigned char reg[2], clear[2];
+	unsigned char pointers[3]; /* FIFO_WR_PTR, FIFO_RD_PTR, FIFO_OVF_CNT */
+	unsigned char fifo[OB1203_FIFO_DEPTH * OB1203_PPG_SAMPLE_SIZE];
+	unsigned char *p;
+	TRACE_SCOPE("ob1203 ppg fifo");
 
 	if (data == NULL) {
-		fprintf(stderr, "Error: ob1203_data is NULL\n");
-		ret = -1;
-		goto close;
+		fprintf(stderr, "Error: ob1203_ppg_data is NULL\n");
+		return -1;
 	}
 
-	ls_data_status = read_ls_data_status(fd);
+	data->count = 0;
+	data->overflow = 0;
+	data->bus_bits = 0;
 
-	if (ls_data_status == 0) {
-		printf("The LS data is an old data, already read\n");
-		usleep(OB1203_LS_WAIT_TIME);
-	}
+	i2c_completion_init(&c);
 
-	color_green = read_ls_green_data(fd);
-	if(color_green == -1) {
-		ret = -1;
-		goto close;
+	queue_read(sched, addr, &reg[0], OB1203_REG_FIFO_WR_PTR, pointers, sizeof(pointers), 0, &c);
+	i2c_sched_flush(sched);
+	ret = i2c_completion_wait(&c);
+	if (ret == -1) {
+		fprintf(stderr, "Error: Failed to read the FIFO pointers\n");
+		goto done;
 	}
-
-	color_blue = read_ls_blue_data(fd);
-	if(color_blue == -1) {
-		ret = -1;
-		goto close;
+	data->bus_bits += i2c_read_bits(1, sizeof(pointers));
+
+	level = (pointers[0] - pointers[1]) & (OB1203_FIFO_DEPTH - 1);
+	if (pointers[2]) {
+		/* rolled over: the FIFO is full and the oldest samples are gone */
+		level = OB1203_FIFO_DEPTH;
+		data->overflow = pointers[2];
+	} else if (level == 0 && late) {
+		/* full, the write pointer caught up with the read one */
+		level = OB1203_FIFO_DEPTH;
 	}
 
-	color_red = read_ls_red_data(fd);
-	if(color_red == -1) {
-		ret = -1;
-		goto close;
+	if (level == 0) {
+		goto done;
 	}
 
-	data->color_green = color_green;
-	data->color_blue = color_blue;
-	data->color_red = color_red;
-	data->light = calc_light(data->color_red, data->color_green, data->color_blue);
+	queue_read(sched, addr, &reg[1], OB1203_REG_FIFO_DATA, fifo, level * OB1203_PPG_SAMPLE_SIZE,
+		   I2C_SCHED_ALONE, &c);
+	if (data->overflow) {
+		clear[0] = OB1203_REG_FIFO_OVF_CNT;
+		clear[1] = 0x00;
 
-close:
-	close(fd);
-	return ret;
-}
+		msg[0].addr = addr;
+		msg[0].flags = 0;
+		msg[0].len = sizeof(clear);
+		msg[0].buf = clear;
 
-int read_proximity(struct ob1203_data * data) {
-	int fd ,ret = 0, proximity = 0;
-	unsigned char ps_data_status;
-
-	fd = open(I2C_DEVICE_FILE, O_RDWR);
-	if (fd == -1) {
-		return -1;
-	}
-
-	if (data == NULL) {
-		fprintf(stderr, "Error: ob1203_data is NULL\n");
-		ret = -1;
-		goto close;
+		i2c_sched_submit_completion(sched, msg, 1, I2C_SCHED_ALONE, &c);
+		data->bus_bits += i2c_write_bits(sizeof(clear));
 	}
-
-	ps_data_status = read_ps_data_status(fd);
-
-	if (ps_data_status == 0) {
-		printf("The PS data is an old data, already read\n");
-		usleep(OB1203_PS_WAIT_TIME);
+	i2c_sched_flush(sched);
+	ret = i2c_completion_wait(&c);
+	if (ret == -1) {
+		fprintf(stderr, "Error: Failed to read FIFO_DATA\n");
+		goto done;
 	}
+	data->bus_bits += i2c_read_bits(1, level * OB1203_PPG_SAMPLE_SIZE);
 
-	proximity = read_ps_data(fd);
-	if(proximity == -1) {
-		ret = -1;
-		goto close;
+	for (n = 0, p = fifo; n < level; n++, p += OB1203_PPG_SAMPLE_SIZE) {
+		data->samples[n] = (((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]) &
+				   OB1203_PPG_SAMPLE_MASK;
 	}
-	data->proximity = proximity;
+	data->count = level;
 
-close:
-	close(fd);
-	return ret;
-}
\ No newline at end of file
+done:
+	i2c_completion_destroy(&c);
+	return ret == -1 ? -1 : data->count;
+}
@@ -6,10 +6,36 @@
 
 #ifndef _OB1203_H_
 
+#include <stdint.h>
+
+#include "i2c_sched.h"
+
+#define OB1203_SLAVE_ADDRESS 0x53 /* address of the device, the instances default to it */
 #define OB1203_LS_MEASUREMRNT_TIME 100000
-#define OB1203_LS_WAIT_TIME OB1203_LS_MEASUREMRNT_TIME
 #define OB1203_PS_MEASUREMRNT_TIME 50000
-#define OB1203_PS_WAIT_TIME OB1203_PS_MEASUREMRNT_TIME
+#define OB1203_WARMUP_TIMEOUT (2 * OB1203_LS_MEASUREMRNT_TIME) /* first data after enabling */
+#define OB1203_WARMUP_POLL_TIME 5000
+#define OB1203_STATUS_NEW_DATA 0x01 /* LS and PS data status, clears on read */
+
+/* registers used by the PPG mode */
+
+#define OB1203_REG_MAIN_CTRL_1 0x16
+#define OB1203_REG_PPG_AVG 0x34
+#define OB1203_REG_PPG_PWIDTH_PERIOD 0x35
+#define OB1203_REG_FIFO_CFG 0x36
+#define OB1203_REG_FIFO_WR_PTR 0x37
+#define OB1203_REG_FIFO_RD_PTR 0x38
+#define OB1203_REG_FIFO_OVF_CNT 0x39
+#define OB1203_REG_FIFO_DATA 0x3A
+
+#define OB1203_PPG_MODE_MASK 0x30
+#define OB1203_PPG_MODE_HR 0x10 /* PPG_PS_MODE: HR mode, IR LED only */
+#define OB1203_PPG_ENABLE 0x01
+
+#define OB1203_FIFO_DEPTH 32 /* samples */
+#define OB1203_PPG_SAMPLE_SIZE 3 /* bytes, 18 bit per sample */
+#define OB1203_PPG_SAMPLE_MASK 0x3FFFF
+#define OB1203_PPG_RATE_HZ 400 /* with the PPG_PWIDTH_PERIOD/PPG_AVG setting below */
 
 /* retain the value of the ob1203 sensor */
 
@@ -21,10 +47,42 @@ struct ob1203_data {
 	int proximity;
 };
 
-int set_ls_status();
-int set_ps_status();
-int set_ps_measurement_period();
-int read_light(struct ob1203_data *data);
-int read_proximity(struct ob1203_data *data);
+/* retain the samples drained from the ob1203 PPG FIFO */
+
+struct ob1203_ppg_data {
+	uint32_t samples[OB1203_FIFO_DEPTH];
+	int count;
+	int overflow; /* samples lost since the previous drain */
+	unsigned long bus_bits; /* bits clocked on the bus by the drain */
+};
+
+/* buffers of the OB1203 register reads queued on the I2C scheduler */
+
+struct ob1203_request {
+	unsigned char reg[6]; /* register addresses written before each read */
+	unsigned char ls_status;
+	unsigned char green;
+	unsigned char blue;
+	unsigned char red;
+	unsigned char ps_status;
+	unsigned char ps[2];
+};
+
+int set_ls_status(const char *path, uint16_t addr);
+int set_ps_status(const char *path, uint16_t addr);
+int set_ps_measurement_period(const char *path, uint16_t addr);
+int set_standby(const char *path, uint16_t addr, int proximity);
+int wait_data_ready(struct i2c_sched *sched, uint16_t addr, int proximity);
+int set_ppg_mode(const char *path, uint16_t addr);
+int read_ppg_fifo(struct i2c_sched *sched, uint16_t addr, struct ob1203_ppg_data *data,
+		  int late);
+int ob1203_queue_light(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+		       struct i2c_completion *c);
+int ob1203_queue_proximity(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+			   struct i2c_completion *c);
+int ob1203_queue_status(struct i2c_sched *sched, uint16_t addr, struct ob1203_request *req,
+			int proximity, struct i2c_completion *c);
+void ob1203_decode_light(const struct ob1203_request *req, struct ob1203_data *data);
+void ob1203_decode_proximity(const struct ob1203_request *req, struct ob1203_data *data);
 
 #endif /* _OB1203_H_ */
@@ -11,6 +11,8 @@
 #include <errno.h> /* for errno */
 
 #include "pmodled-control.h"
+#include "trace.h"
+#include "vclock.h"
 
 #define GPIO_LD0 508
 #define GPIO_LD1 368
@@ -25,6 +27,30 @@
 #define LED_ON "high"
 #define LED_OFF "low"
 
+#if defined(SENSOR_SIMULATION)
+
+/* no Pmod LED on the simulation host, just trace the requested state */
+
+int led_prepare(void) {
+	return 0;
+}
+
+int led_on(void) {
+	TRACE_SCOPE("led on");
+
+	fprintf(stderr, "LED: %s\n", LED_ON);
+	return 0;
+}
+
+int led_off(void) {
+	TRACE_SCOPE("led off");
+
+	fprintf(stderr, "LED: %s\n", LED_OFF);
+	return 0;
+}
+
+#else
+
 int gpio_sysfs_export(int gpio, char* pin) {
 	int fd;
 	char path[64];
@@ -65,6 +91,7 @@ int gpio_sysfs_direction(char* pin, char* direction) {
 	int fd;
 	char path[64];
 	int count, ret = 0;
+	TRACE_SCOPE("gpio write");
 
 	memset(path, 0, sizeof(path));
 
@@ -110,7 +137,7 @@ int led_prepare(void) {
 		return result;
 	}
 
-	usleep(1000000); /* wait for udev handling of GPIO sysfs */
+	vclock_usleep(1000000); /* wait for udev handling of GPIO sysfs */
 
 	result = gpio_sysfs_direction(PIN_GPIO_LD0, LED_OFF);
 	if (result) {
@@ -137,6 +164,7 @@ int led_prepare(void) {
 
 int led_on(void) {
 	int result = 0;
+	TRACE_SCOPE("led on");
 
 	result = gpio_sysfs_direction(PIN_GPIO_LD0, LED_ON);
 	if (result) {
@@ -163,6 +191,7 @@ int led_on(void) {
 
 int led_off(void) {
 	int result = 0;
+	TRACE_SCOPE("led off");
 
 	result = gpio_sysfs_direction(PIN_GPIO_LD0, LED_OFF);
 	if (result) {
@@ -187,3 +216,4 @@ int led_off(void) {
 	return 0;
 }
 
+#endif
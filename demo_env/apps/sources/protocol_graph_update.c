@@ -12,24 +12,133 @@
 #include <libwebsockets.h>
 #endif
 
-#define MIN_INTERVAL 250 /* Minimum sensor data reading interval(ms) */
+#define DEFAULT_INTERVAL 250 /* Default sensor data reading interval(ms) */
+#define PPG_POLL_INTERVAL 40 /* PPG FIFO drain interval(ms), the FIFO holds 80ms of samples */
+#define PPG_REPORT_INTERVAL 10 /* PPG rate and bus utilisation report interval(s) */
+#define I2C_REPORT_INTERVAL 10 /* I2C scheduler statistics report interval(s) */
+#define STANDBY_GRACE 30000 /* time without client before the sensors standby(ms) */
+#define UPSTREAM_BACKOFF_MIN 1000 /* first gateway reconnection delay(ms) */
+#define UPSTREAM_BACKOFF_MAX 60000 /* longest gateway reconnection delay(ms) */
+#define UPSTREAM_MSG_MAX 2048 /* longest message relayed from a board, the channel stats */
+#define STATS_SESSION_LEN 320 /* room for the stats of one session */
+#define STATS_I2C_LEN 640 /* room for the stats of one bus, 20 digit counters */
+#define STATS_SUMMARY_INTERVAL 10 /* channel statistics push interval(s) */
+#define STATS_SUMMARY_LEN 2048 /* room for the statistics of all the channels */
+#define DETECTOR_EVENT_LEN 192 /* room for one detector event message */
+#define DEFLATE_OFF -1 /* permessage-deflate policy: never compress */
+#define DEFLATE_INVALID -2
+#define SSE_KEEPALIVE 15 /* comment sent to an idle event stream, for the proxies(s) */
+#define STAMP_MAX 64 /* room for the {"seq":<seq>,"epoch":<epoch>, of a message */
+#define RING_PRE (LWS_PRE + STAMP_MAX) /* before a sample ring message, then its stamp */
+#define SSE_EVENT_MAX (UPSTREAM_MSG_MAX + GATEWAY_ID_MAX + STAMP_MAX + 64) /* room for one event */
+#define RESUME_HEADER_MAX 256 /* room for the header of a resume frame */
 
+#if defined(SENSOR_EVENT_LOOP)
+#define ACQUISITION_MODE "event-loop" /* sensors read from lws timers, no thread */
+#else
+#define ACQUISITION_MODE "threads"
+#endif
+
+#include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <sys/resource.h>
 
 #include <jansson.h>
 
 /* hardware manipulation */
 
 #include "hs3001.h"
+#include "sensor_health.h"
 #include "ob1203.h"
 #include "pmodled-control.h"
 
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "convert.h"
+#include "sensor_sample.h"
+#include "rules.h"
+#include "sampling.h"
+#include "sample_feed.h"
+#include "gateway.h"
+#include "sensor_config.h"
+#include "rolling_stats.h"
+#include "detector.h"
+#include "align.h"
+#include "capture.h"
+#include "history.h"
+#include "vclock.h"
+#include "trace.h"
+
 /* one of these created for each message in the ringbuffer */
 
 struct msg {
 	void *payload; /* is malloc'd */
 	size_t len;
+	lws_usec_t queued; /* when it entered the ring, for the latency stats */
+	uint64_t seq; /* number of a sample ring message from 1 in this run */
+	uint8_t topic; /* TOPIC_*, in the sample ring */
+	size_t start; /* of a sample ring message in payload, its stamp included */
+};
+
+/*
+ * The topics of the sample ring messages, told apart by their first member
+ * after the board id of the gateway. A session receives all of them until
+ * it unsubscribes from some.
+ */
+
+enum {
+	TOPIC_SAMPLES,		/* {"temp":... */
+	TOPIC_INSTANCES,	/* {"instance":... */
+	TOPIC_ALIGNED,		/* {"aligned":... */
+	TOPIC_EVENTS,		/* {"event":... */
+	TOPIC_STATS,		/* {"stats":... */
+	TOPIC_COUNT
+};
+
+static const char * const topic_names[] = {
+	"samples", "instances", "aligned", "events", "stats"
+};
+
+static const char * const topic_keys[] = {
+	"temp", "instance", "aligned", "event", "stats"
+};
+
+/* the topics whose message is superseded by the next one, a lagging session skips them */
+#define TOPICS_SUPERSEDED ((1 << TOPIC_SAMPLES) | (1 << TOPIC_ALIGNED))
+
+/*
+ * Header of the binary batches of PPG samples sent to the subscribed
+ * clients, followed by count uint32_t samples. Host byte order, which is
+ * little endian on the RZ/Five.
+ */
+
+#define PPG_BATCH_TYPE 1
+
+struct ppg_batch_header {
+	uint16_t type; /* PPG_BATCH_TYPE */
+	uint16_t count; /* samples in this batch */
+	uint32_t index; /* index of the first sample, gaps mean lost samples */
+};
+
+/*
+ * Gateway mode: one of these is created for each upstream board.
+ *
+ * It is ONLY read or written from the lws service thread context.
+ */
+
+struct upstream {
+	lws_sorted_usec_list_t sul; /* reconnection timer */
+	struct per_vhost_data__minimal *vhd;
+	struct gateway_board board;
+	struct lws *wsi; /* NULL while disconnected */
+	struct lws_ring *ring_tx; /* commands waiting to be forwarded */
+	uint32_t tail_tx;
+	int backoff; /* next reconnection delay(ms) */
+	char retrying; /* the reconnection timer is scheduled */
+	char rx[UPSTREAM_MSG_MAX]; /* message being reassembled */
+	size_t rx_len;
+	char rx_overflow;
 };
 
 /*
@@ -42,7 +151,98 @@ struct per_session_data__minimal {
 	struct per_session_data__minimal *pss_list;
 	struct lws *wsi;
 	uint32_t tail;
+	uint32_t tail_ppg; /* tail in ring_ppg */
+	uint32_t tail_capture; /* tail in ring_capture */
 	uint32_t msglen;
+	char ppg; /* subscribed to the PPG batches */
+	char capture; /* subscribed to the triggered captures */
+	uint8_t muted; /* topics unsubscribed from, bit 1 << TOPIC_* */
+	char sse; /* event stream on /events, not a ws connection */
+	char keepalive; /* event stream idle, a comment is due */
+	void *resume; /* messages missed before a reconnection, written first, LWS_PRE before */
+	size_t resume_len;
+
+	uint32_t id; /* number of the session in the stats */
+	uint64_t sent; /* sample messages written */
+	uint64_t skipped; /* sample messages skipped while lagging */
+	uint64_t lost; /* events, stats or instances skipped for a nearly full ring */
+	uint32_t max_lag; /* most sample messages ever waiting */
+	lws_usec_t pending_since; /* since when messages are waiting, 0 if none */
+	char closing; /* closed for lagging too long */
+	char deflate; /* permessage-deflate negotiated */
+	int deflate_min; /* smallest message compressed(bytes) */
+};
+
+/*
+ * A sensor instance other than the primary ones, read every cycle on its
+ * own bus along the primary sensors. Its samples are only published,
+ * tagged with its name.
+ */
+
+struct sensor_extra {
+	const struct sensor_instance *inst;
+	struct i2c_sched *bus;
+	struct hs3001_request hs3001_req;
+	struct ob1203_request ob1203_req;
+	struct hs3001_data hs3001_data;
+	struct ob1203_data ob1203_data;
+	struct i2c_completion c;
+	struct sensor_health health;
+	int ok; /* not left alone by its breaker this cycle */
+	int measuring; /* HS3001: a measurement was requested by the last cycle */
+	int armed; /* OB1203: the engines are enabled */
+	int ready; /* OB1203: converted since armed */
+	int valid; /* the data holds a reading */
+};
+
+/*
+ * State of the sensor acquisition, kept across the cycles. It is ONLY
+ * read or written from the sensor thread context, or from the lws service
+ * thread context in event loop mode, but for the primary instances and
+ * their buses, set at init.
+ */
+
+struct sensor_acq {
+	const struct sensor_instance *hs3001, *ob1203; /* the primary instances */
+	struct i2c_sched *hs3001_bus, *ob1203_bus;
+	struct sensor_extra extras[SENSOR_INSTANCES_MAX];
+	int extra_count;
+	struct hs3001_data hs3001_data;
+	struct ob1203_data ob1203_data;
+	struct hs3001_request hs3001_req;
+	struct ob1203_request ob1203_req;
+	struct i2c_completion c_hs3001, c_ls, c_ps;
+	struct sensor_health health_hs3001, health_ob1203;
+	int hs3001_ok, ob1203_ok; /* not left alone by their breaker this cycle */
+	int hs3001_measuring; /* a measurement was requested by the last cycle */
+	int64_t hs3001_requested; /* when the pending measurement was requested(ns) */
+	int64_t time_ns[CHANNEL_COUNT]; /* when each channel was last read(ns) */
+	int armed; /* the OB1203 engines are enabled */
+	struct align_clock clock; /* the wall clock of the readings */
+	struct align align; /* the channels resampled on a common grid */
+	struct timespec report_time;
+	struct timespec summary_time;
+	struct i2c_sched_stats report_stats[SENSOR_BUSES_MAX];
+#if defined(SENSOR_EVENT_LOOP)
+	lws_sorted_usec_list_t sul; /* next step of the acquisition */
+	char idle; /* no consumer, only the standby may be scheduled */
+	long idle_since; /* since when idle(ms) */
+	long warmup_start; /* when the OB1203 engines were enabled(ms), 0 if not warming up */
+	int ls_ready, ps_ready; /* new data flags seen during the warm-up */
+	long convert_until; /* end of the first HS3001 conversion(ms) */
+#endif
+};
+
+/* the same for the PPG FIFO drain, owned by thread_ppg in threaded mode */
+
+struct ppg_state {
+	unsigned long samples, lost, bus_bits; /* since the last report */
+	uint32_t index; /* of the next sample */
+	int64_t drained_ns; /* time of the previous drain */
+	struct timespec report_time;
+#if defined(SENSOR_EVENT_LOOP)
+	lws_sorted_usec_list_t sul; /* next drain */
+#endif
 };
 
 /* one of these is created for each vhost our protocol is used with */
@@ -55,306 +255,3213 @@ struct per_vhost_data__minimal {
 	struct per_session_data__minimal *pss_list; /* linked-list of live pss*/
 	pthread_t pthread_sensor[1];
 	pthread_t pthread_led[1]; /* thread for led control */
+	pthread_t pthread_ppg[1]; /* thread draining the PPG FIFO */
+
+	struct sensor_config sensors; /* the sensor instances and their buses */
+	struct i2c_sched i2c[SENSOR_BUSES_MAX]; /* own a bus each, shared by the threads above */
+	int i2c_count; /* buses opened */
+	char i2c_ready; /* all of them */
+	struct sensor_acq acq;
+	struct ppg_state ppg;
 
 	pthread_mutex_t lock_ring; /* serialize access to the ring buffer */
 	struct lws_ring *ring; /* {lock_ring} ringbuffer holding unsent content */
+	uint32_t ring_elements; /* size of ring */
+	uint64_t dropped; /* {lock_ring} samples dropped for a full ring */
+	uint64_t published; /* {lock_ring} messages published, seq of the last */
+	uint64_t epoch; /* wall clock of the start(ms), tells the runs apart */
+	struct history history; /* {lock_ring} messages published lately, for the resumes */
+	uint64_t resumed; /* {lock_ring} sessions resumed */
+	uint64_t resume_gaps; /* {lock_ring} of which some missed messages were lost */
+	lws_usec_t sessions_left; /* when the last session closed(vclock), 0 if none did */
+	uint32_t session_ids; /* id of the last session established */
+	uint64_t latency_count; /* ring messages written, lws service thread only */
+	lws_usec_t latency_sum; /* their time from the ring insert to lws_write() */
+	lws_usec_t latency_max;
+	uint64_t deflate_messages; /* compressed, lws service thread only */
+	uint64_t deflate_raw; /* sent uncompressed, under the session threshold */
+	uint64_t deflate_in; /* bytes before compression */
+	uint64_t deflate_out; /* bytes after */
+	lws_usec_t deflate_busy; /* time spent compressing */
+	struct lws_ring *ring_ppg; /* {lock_ring} ringbuffer holding unsent PPG batches */
+	int ppg_subscribers; /* sessions subscribed to the PPG batches */
+	struct lws_ring *ring_capture; /* {lock_ring} ringbuffer holding unsent captures */
+	int capture_subscribers; /* sessions subscribed to the captures */
 
 	pthread_mutex_t lock_ring_receive; /* serialize access to the ring buffer for receive */
 	pthread_cond_t cond_wake_receive; /* wakeup thread for receive */
 	struct lws_ring *ring_receive; /* {lock_ring_receive} ringbuffer holding received messages */
 	uint32_t tail_receive; /* tail of ring_receive */
 
+	pthread_mutex_t lock_rules; /* serialize access to the rule set */
+	struct rule_set rules; /* {lock_rules} rules evaluated after each sample */
+
+	pthread_mutex_t lock_rolling; /* serialize access to the channel statistics */
+	struct rolling_stats *rolling; /* {lock_rolling} channel statistics, NULL in gateway mode */
+	struct detector detector; /* {lock_rolling} anomaly and change detectors */
+
+	pthread_mutex_t lock_capture; /* serialize access to the capture */
+	struct capture *capture; /* {lock_capture} triggered capture, NULL if disabled */
+
+	pthread_mutex_t lock_sampling; /* serialize access to the sampling controller */
+	pthread_cond_t cond_wake_sensor; /* wakeup the sensor thread, CLOCK_MONOTONIC */
+	struct sampling sampling; /* {lock_sampling} per channel sampling periods */
+	char sampling_changed; /* {lock_sampling} */
+
+	struct sample_feed *feed; /* shared memory feed for local processes, or NULL */
+
+	struct upstream *upstreams; /* gateway mode, the boards relayed */
+	int upstream_count;
+
 	const char *config;
 	char finished;
 };
 
 /* Sensor data read interval(ms) */
 
-static int read_sensor_data_interval = MIN_INTERVAL;
+static int read_sensor_data_interval = DEFAULT_INTERVAL;
 
 void
 set_interval(int interval)
 {
-	if(interval >= MIN_INTERVAL) {
+	/* the floor of the periods set by the clients too */
+	if(interval >= SAMPLING_PERIOD_FLOOR) {
 		read_sensor_data_interval = interval;
 	} else {
 		/* The default value for read_sensor_data_interval is used */
 	}
 }
 
-/*
- * This runs under lws service, "sensor threads" context, and "led threads" context.
- * Access is serialized by vhd->lock_ring or vhd->lock_ring_receive.
- */
+/* Stream the OB1203 PPG FIFO instead of reading the proximity */
 
-static void
-__minimal_destroy_message(void *_msg)
-{
-	struct msg *msg = _msg;
+static int ppg_mode;
 
-	free(msg->payload);
-	msg->payload = NULL;
-	msg->len = 0;
+void
+set_ppg(int enable)
+{
+	ppg_mode = enable;
 }
 
-/*
- * This runs under the "sensor thread" thread context only.
- *
- * We spawn one thread that generate messages with this.
- *
- */
+/* Adapt the sampling period of each channel to its activity */
 
-static void *
-thread_sensor(void *d)
+static int adaptive_sampling;
+static int max_sampling_period = SAMPLING_MAX_PERIOD;
+
+void
+set_adaptive(int max_period)
 {
-	struct per_vhost_data__minimal *vhd =
-			(struct per_vhost_data__minimal *)d;
-	struct msg amsg;
-	struct hs3001_data hs3001_data;
-	struct ob1203_data ob1203_data;
-	int len = 512, n, ret = 0;
-	int temp_is_active = 1, humm_is_active = 1, light_is_active = 1, proximity_is_active = 1;
-	struct timespec start_time;
-	struct timespec end_time;
-	long tmp_start_time = 0, tmp_end_time = 0, diff_time = 0;
+	adaptive_sampling = 1;
+	if (max_period > 0)
+		max_sampling_period = max_period;
+}
 
-	memset(&hs3001_data, 0, sizeof(hs3001_data));
-	memset(&ob1203_data, 0, sizeof(ob1203_data));
+/* Time without client or rule before the sensors are put in standby(ms) */
 
-	set_ls_status();
-	set_ps_measurement_period();
-	set_ps_status();
+static int standby_grace = STANDBY_GRACE;
 
-	do {
-		clock_gettime(CLOCK_MONOTONIC, &start_time);
+void
+set_standby_grace(int grace)
+{
+	if (grace >= 0)
+		standby_grace = grace;
+}
 
-		/* don't generate output if nobody connected */
-		if (!vhd->pss_list)
-			goto wait;
+/* Shared memory object name of the local sample feed, NULL for none */
 
-		pthread_mutex_lock(&vhd->lock_ring); /* --------- ring lock { */
+static const char *feed_name;
 
-		/* only create if space in ringbuffer */
-		n = (int)lws_ring_get_count_free_elements(vhd->ring);
-		if (!n) {
-			lwsl_user("dropping!\n");
-			goto wait_unlock;
-		}
+void
+set_feed(const char *name)
+{
+	feed_name = name;
+}
 
-		amsg.payload = malloc(LWS_PRE + len);
-		if (!amsg.payload) {
-			lwsl_user("OOM: dropping\n");
-			goto wait_unlock;
-		}
+/* Gateway mode board list, NULL to serve the local sensors */
 
-		ret = read_humidity_and_temperature(&hs3001_data);
-		if (ret != 0) {
-			lwsl_err("THREAD_SENSOR: ERROR failed to read data from the HS3001 sensor\n");
-			temp_is_active = 0;
-			humm_is_active = 0;
-		}
+static const char *gateway_file;
 
-		ret = read_light(&ob1203_data);
-		if (ret != 0) {
-			lwsl_err("THREAD_SENSOR: ERROR failed to read light data from the OB1203 sensor\n");
-			light_is_active = 0;
-		}
+void
+set_gateway(const char *path)
+{
+	gateway_file = path;
+}
 
-		ret = read_proximity(&ob1203_data);
-		if (ret != 0) {
-			lwsl_err("THREAD_SENSOR: ERROR failed to read proximity data from the OB1203 sensor\n");
-			proximity_is_active = 0;
-		}
+/* Time a session may not write pending messages before it is closed(ms), 0 for never */
 
-		n = lws_snprintf((char *)amsg.payload + LWS_PRE, len,
-			"{\"temp\":{\"value\":\"%2.3f\", \"isActive\":\"%d\"},"
-			"\"humm\":{\"value\":\"%2.3f\", \"isActive\":\"%d\"},"
-			"\"light\":{\"value\":\"%d\", \"isActive\":\"%d\"},"
-			"\"proximity\":{\"value\":\"%d\", \"isActive\":\"%d\"}}",
-			hs3001_data.temperature, temp_is_active,
-			hs3001_data.humidity, humm_is_active,
-			ob1203_data.light, light_is_active,
-			ob1203_data.proximity, proximity_is_active);
+static int max_lag;
 
-		amsg.len = n;
-		n = lws_ring_insert(vhd->ring, &amsg, 1);
+void
+set_max_lag(int lag)
+{
+	if (lag >= 0)
+		max_lag = lag;
+}
 
-		if (n != 1) {
-			__minimal_destroy_message(&amsg);
-			lwsl_user("dropping!\n");
-		} else
-			/*
-			 * This will cause a LWS_CALLBACK_EVENT_WAIT_CANCELLED
-			 * in the lws service thread context.
-			 */
-			lws_cancel_service(vhd->context);
+/*
+ * Adapter timeout(ms) and retries of the sensor bus. In event loop mode
+ * the transfers block the service thread, i2c-dev has no asynchronous
+ * I2C_RDWR, so a hung device is given up on sooner.
+ */
 
-wait_unlock:
-		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+#if defined(SENSOR_EVENT_LOOP)
+#define I2C_TIMEOUT_DEFAULT 20
+#else
+#define I2C_TIMEOUT_DEFAULT I2C_BUS_TIMEOUT
+#endif
 
-wait:
-		clock_gettime(CLOCK_MONOTONIC, &end_time);
-		tmp_start_time = start_time.tv_sec * (LWS_US_PER_SEC * LWS_NS_PER_US) + start_time.tv_nsec;
-		tmp_end_time = end_time.tv_sec * (LWS_US_PER_SEC * LWS_NS_PER_US) + end_time.tv_nsec;
+static int i2c_timeout = I2C_TIMEOUT_DEFAULT;
+static int i2c_retries = I2C_BUS_RETRIES;
 
-		diff_time = (read_sensor_data_interval * LWS_US_PER_MS) - ((tmp_end_time - tmp_start_time) / LWS_NS_PER_US);
+void
+set_i2c_timeout(int timeout, int retries)
+{
+	if (timeout > 0)
+		i2c_timeout = timeout;
+	if (retries >= 0)
+		i2c_retries = retries;
+}
 
-		if (diff_time > 0) {
-			usleep(diff_time);
-		} else {
-			/* no sleep */
-		}
+/* Reopen the bus when a sensor stops answering */
 
-	} while (!vhd->finished);
+static int i2c_recovery;
 
-	lwsl_notice("thread_spam %p exiting\n", (void *)pthread_self());
+void
+set_i2c_recovery(int enable)
+{
+	i2c_recovery = enable;
+}
 
-	pthread_exit(NULL);
+/* Sensor instances and their buses, NULL for the HS3001 and OB1203 of the board */
 
-	return NULL;
+static const char *sensors_file;
+
+void
+set_sensors_file(const char *path)
+{
+	sensors_file = path;
 }
 
+#if defined(SENSOR_SIMULATION)
 /*
- * This runs under the "led thread" thread context only.
- *
- * We spawn one thread that controll led's GPIO.
- *
+ * Speed of the sampling clock, the simulated sensors, the sampling and the
+ * standby run that many times faster than the real time, see vclock.h
  */
 
-static void *
-thread_led(void *d)
+void
+set_sim_speed(int speed)
 {
-	struct per_vhost_data__minimal *vhd =
-			(struct per_vhost_data__minimal *)d;
-	const struct msg *pmsg;
-	struct msg amsg;
-	int len = 128, index = 1, n, ret = 0;
+	if (vclock_set_speed(speed))
+		lwsl_warn("%s: invalid clock speed %d\n", __func__, speed);
+}
+#endif
 
-	json_t *root;
-	json_t *ledstate;
-	json_error_t error;
+/*
+ * Resampling of the channels on a common grid of resample_grid ms, "hold"
+ * or "linear", published along the samples with the dew point. The grid
+ * defaults to the sampling interval.
+ */
 
-	do {
-		pthread_mutex_lock(&vhd->lock_ring_receive); /* --------- ring lock { */
+static int resample_mode = ALIGN_OFF;
+static int resample_grid;
 
-		for (;;) {
-			pmsg = lws_ring_get_element(vhd->ring_receive, &vhd->tail_receive);
-			if (pmsg) {
-				break;
-			} else if (vhd->finished) {
-				break;
-			}
+void
+set_resample(const char *mode)
+{
+	int n = align_mode_lookup(mode);
 
-			pthread_cond_wait(&vhd->cond_wake_receive, &vhd->lock_ring_receive);
-		}
+	if (n < 0)
+		lwsl_warn("%s: invalid resampling mode %s\n", __func__, mode);
+	else
+		resample_mode = n;
+}
 
-		if (vhd->finished) {
-			break;
-		}
+void
+set_resample_grid(int ms)
+{
+	if (ms > 0)
+		resample_grid = ms;
+}
 
-		amsg.len = pmsg->len;
-		amsg.payload = malloc(LWS_PRE + len);
-		if (!amsg.payload) {
-			lwsl_user("THREAD_LED: OOM: dropping\n");
-			pthread_mutex_unlock(&vhd->lock_ring_receive); /* } ring lock ------- */
-			continue;
-		}
-		memcpy(amsg.payload + LWS_PRE, pmsg->payload + LWS_PRE, len);
+/*
+ * Triggered capture of the proximity around an edge of the level or a
+ * {"capture": "trigger"} command, see capture_parse()
+ */
 
-		lws_ring_consume(
-			vhd->ring_receive,	/* lws_ring object */
-			&vhd->tail_receive,	/* tail of guy doing the consuming */
-			NULL,			/* no destination but just delete */
-			1			/* number of payload objects being consumed */
-		);
-		lws_ring_update_oldest_tail(
-			vhd->ring_receive,	/* lws_ring object */
-			vhd->tail_receive	/* single tail */
-		);
+static struct capture_config capture_config;
+static int capture_enabled;
 
-		pthread_mutex_unlock(&vhd->lock_ring_receive); /* } ring lock ------- */
+void
+set_capture(const char *trigger)
+{
+	if (capture_parse(trigger, &capture_config))
+		lwsl_warn("%s: invalid capture trigger %s\n", __func__, trigger);
+	else
+		capture_enabled = 1;
+}
 
-		root = json_loadb(((unsigned char *)amsg.payload) + LWS_PRE, amsg.len, 0, &error);
-		free(amsg.payload);
+/* History retained for the resuming clients(bytes), 0 for none */
 
-		if (!root) {
-			lwsl_err("THREAD_LED: ERROR json parse error on line %d: %s\n", error.line, error.text);
-			continue;
-		}
-		if (!json_is_object(root)) {
-			lwsl_err("THREAD_LED: ERROR json top is not an object\n");
-			json_decref(root);
-			continue;
-		}
+static size_t history_size = HISTORY_SIZE * 1024;
 
-		ledstate = json_object_get(root, "led");
-		if (!json_is_string(ledstate)) {
-			lwsl_err("THREAD_LED: ERROR json has no key \"led\" with string value\n");
-			json_decref(root);
-			continue;
-		}
-		lwsl_user("THREAD_LED: led: %s\n", json_string_value(ledstate));
-		if (strcmp(json_string_value(ledstate), "on") == 0) {
-			ret = led_on();
-			if(ret != 0) {
-				lwsl_err("%s\n", strerror(ret));
-			}
-		} else if (strcmp(json_string_value(ledstate), "off") == 0) {
-			ret = led_off();
-			if(ret != 0) {
-				lwsl_err("%s\n", strerror(ret));
-			}
-		} else {
-			lwsl_err("THREAD_LED: ERROR unknown value \"%s\" to the key \"led\"\n", json_string_value(ledstate));
-		}
+void
+set_history(int kib)
+{
+	if (kib >= 0)
+		history_size = (size_t)kib * 1024;
+}
 
-		json_decref(ledstate);
-		json_decref(root);
+/* Detectors configured at startup, NULL for none */
 
-	} while (!vhd->finished);
+static const char *detector_file;
 
-	lwsl_notice("thread_led %p exiting\n", (void *)pthread_self());
+void
+set_detector_file(const char *path)
+{
+	detector_file = path;
+}
 
-	pthread_exit(NULL);
+/*
+ * Let the messages under the threshold of a session skip the compressor.
+ * It leans on lws setting RSV1 only on the frames it compressed, not yet
+ * checked against a browser, so it is off unless asked for: without it
+ * a threshold is refused.
+ */
 
-	return NULL;
+static int deflate_passthrough;
+
+void
+set_deflate_passthrough(int enable)
+{
+	deflate_passthrough = enable;
 }
 
-/* this runs under the lws service thread context only */
+/*
+ * permessage-deflate policy of the clients not choosing one with the
+ * "deflate" URL argument: "off", "on" or the smallest message compressed
+ * in bytes, the small ones cost more CPU than they save bandwidth.
+ */
+
+static int deflate_default = DEFLATE_OFF;
 
 static int
-callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
-			void *user, void *in, size_t len)
+deflate_policy(const char *policy)
 {
-	struct per_session_data__minimal *pss =
-			(struct per_session_data__minimal *)user;
-	struct per_vhost_data__minimal *vhd =
-			(struct per_vhost_data__minimal *)
-			lws_protocol_vh_priv_get(lws_get_vhost(wsi),
-					lws_get_protocol(wsi));
-	const struct lws_protocol_vhost_options *pvo;
-	const struct msg *pmsg;
-	struct msg amsg;
-	void *retval;
-	int n, m, r = 0;
+	char *end;
+	long n;
 
-	switch (reason) {
-	case LWS_CALLBACK_PROTOCOL_INIT:
-		/* create our per-vhost struct */
-		vhd = lws_protocol_vh_priv_zalloc(lws_get_vhost(wsi),
-				lws_get_protocol(wsi),
-				sizeof(struct per_vhost_data__minimal));
-		if (!vhd)
-			return 1;
+	if (!strcmp(policy, "off"))
+		return DEFLATE_OFF;
+	if (!strcmp(policy, "on"))
+		return 0;
 
-		if (led_prepare()) {
-			lwsl_err("%s: Can't export pmodled's GPIO\n", __func__);
-			return 1;
-		}
+	n = strtol(policy, &end, 10);
+	if (end == policy || *end || n < 0 || n > 65536)
+		return DEFLATE_INVALID;
 
-		pthread_mutex_init(&vhd->lock_ring, NULL);
+	if (!deflate_passthrough) {
+		lwsl_warn("%s: deflate threshold %s needs --uncompressed-small\n",
+			  __func__, policy);
+		return DEFLATE_INVALID;
+	}
+
+	return (int)n;
+}
+
+void
+set_deflate(const char *policy)
+{
+	int n = deflate_policy(policy);
+
+	if (n == DEFLATE_INVALID)
+		lwsl_warn("%s: invalid deflate policy %s\n", __func__, policy);
+	else
+		deflate_default = n;
+}
+
+/*
+ * Bound the compressor memory of each session: drop its context after
+ * each message, and a window smaller than the 32KB default(bits, 9 to 15)
+ */
+
+static int deflate_no_takeover;
+static int deflate_window_bits;
+
+void
+set_deflate_memory(int no_takeover, int window_bits)
+{
+	deflate_no_takeover = no_takeover;
+	if (window_bits >= 9 && window_bits <= 15)
+		deflate_window_bits = window_bits;
+}
+
+/* Rules loaded at startup, NULL for none */
+
+static const char *rules_file;
+
+void
+set_rules_file(const char *path)
+{
+	rules_file = path;
+}
+
+#if defined(SENSOR_EVENT_LOOP)
+static void
+sensor_step(lws_sorted_usec_list_t *sul);
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Event loop mode: run the next acquisition step in us of the sampling
+ * clock.
+ */
+
+static void
+sensor_schedule(struct per_vhost_data__minimal *vhd, lws_usec_t us)
+{
+	lws_sul_schedule(vhd->context, 0, &vhd->acq.sul, sensor_step,
+			 vclock_real_us(us));
+}
+#endif
+
+/*
+ * This runs under lws service, "led thread" context and at destroy.
+ *
+ * Wake the sensor thread up to recheck if it has something to do. In
+ * event loop mode the acquisition step runs right away instead, if it is
+ * idle or the sampling was reconfigured.
+ */
+
+static void
+wake_sensor(struct per_vhost_data__minimal *vhd)
+{
+#if defined(SENSOR_EVENT_LOOP)
+	if (!vhd->i2c_ready || vhd->finished)
+		return;
+
+	if (vhd->acq.idle || vhd->sampling_changed) {
+		vhd->sampling_changed = 0;
+		sensor_schedule(vhd, 1);
+	}
+#else
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	pthread_cond_signal(&vhd->cond_wake_sensor);
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+#endif
+}
+
+/* the time of the sampling in ms, vclock CLOCK_MONOTONIC */
+
+static long
+sampling_now_ms(void)
+{
+	return (long)(vclock_now_ns() / (LWS_US_PER_MS * LWS_NS_PER_US));
+}
+
+/*
+ * This runs under the "sensor thread" and lws service thread contexts.
+ *
+ * The sample ring messages are formatted for the sessions, and for the
+ * history while a client which just left may resume from it.
+ */
+
+static int
+ring_wanted(struct per_vhost_data__minimal *vhd)
+{
+	return vhd->pss_list ||
+	       (vhd->history.buf && vhd->sessions_left &&
+		vclock_now_ns() / LWS_NS_PER_US - vhd->sessions_left <
+			(lws_usec_t)standby_grace * LWS_US_PER_MS);
+}
+
+/*
+ * This runs under the "led thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Replace the rule set with the rules in text, the new rules start from a
+ * released state.
+ */
+
+static int
+load_rules(struct per_vhost_data__minimal *vhd, const char *text)
+{
+	struct rule_set set;
+
+	if (rules_compile(text, &set)) {
+		lwsl_err("THREAD_LED: ERROR invalid rules \"%s\"\n", text);
+		return -1;
+	}
+
+	pthread_mutex_lock(&vhd->lock_rules); /* --------- rules lock { */
+	vhd->rules = set;
+	pthread_mutex_unlock(&vhd->lock_rules); /* } rules lock ------- */
+
+	lwsl_user("THREAD_LED: %d rule(s) loaded\n", set.count);
+
+	/* rules need samples, even with nobody connected */
+	wake_sensor(vhd);
+
+	return 0;
+}
+
+/*
+ * This runs under the "led thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Tune the sampling controller of one channel, or of all of them, with
+ * {"sampling": {"channel": "proximity", "adaptive": true, "min": 50,
+ * "max": 2000, "delta": 100, "stddev": 60}}, every member is optional.
+ */
+
+static int
+configure_sampling(struct per_vhost_data__minimal *vhd, json_t *config)
+{
+	struct sampling_config c = { -1, -1, -1, -1.0f, -1.0f };
+	json_t *value;
+	int channel = -1, ret;
+
+	value = json_object_get(config, "channel");
+	if (json_is_string(value)) {
+		channel = sensor_channel_lookup(json_string_value(value));
+		if (channel == -1) {
+			lwsl_err("THREAD_LED: ERROR unknown channel \"%s\"\n",
+				 json_string_value(value));
+			return -1;
+		}
+	}
+
+	value = json_object_get(config, "adaptive");
+	if (json_is_boolean(value))
+		c.adaptive = json_is_true(value);
+
+	value = json_object_get(config, "min");
+	if (json_is_integer(value))
+		c.min_period = (int)json_integer_value(value);
+
+	value = json_object_get(config, "max");
+	if (json_is_integer(value))
+		c.max_period = (int)json_integer_value(value);
+
+	value = json_object_get(config, "delta");
+	if (json_is_number(value))
+		c.delta = (float)json_number_value(value);
+
+	value = json_object_get(config, "stddev");
+	if (json_is_number(value))
+		c.stddev = (float)json_number_value(value);
+
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	ret = sampling_configure(&vhd->sampling, channel, &c);
+	/* apply it now rather than after the current period */
+	if (!ret)
+		vhd->sampling_changed = 1;
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+	if (ret) {
+		lwsl_err("THREAD_LED: ERROR invalid sampling configuration\n");
+		return -1;
+	}
+
+	wake_sensor(vhd);
+
+	lwsl_user("THREAD_LED: sampling of %s updated\n",
+		  channel == -1 ? "all channels" : sensor_channel_name(channel));
+
+	return 0;
+}
+
+#if !defined(SENSOR_EVENT_LOOP)
+/*
+ * This runs under the "sensor thread" thread context only.
+ *
+ * Sleep until the monotonic time until (ms), or until the sampling is
+ * reconfigured or the thread has to exit.
+ */
+
+static void
+sensor_sleep(struct per_vhost_data__minimal *vhd, long until)
+{
+	struct timespec ts;
+	TRACE_SCOPE("sensor sleep");
+
+	ts.tv_sec = until / LWS_US_PER_MS;
+	ts.tv_nsec = (until % LWS_US_PER_MS) * LWS_US_PER_MS * LWS_NS_PER_US;
+
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	while (!vhd->finished && !vhd->sampling_changed)
+		if (vclock_cond_timedwait(&vhd->cond_wake_sensor,
+					  &vhd->lock_sampling, &ts) == ETIMEDOUT)
+			break;
+	vhd->sampling_changed = 0;
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+}
+
+#endif
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Enable the engines of an OB1203, the PS one unless proximity is 0 (it
+ * serves the PPG mode).
+ */
+
+static int
+sensor_enable(struct per_vhost_data__minimal *vhd,
+	      const struct sensor_instance *ob1203, int proximity)
+{
+	const char *path = vhd->sensors.buses[ob1203->bus];
+	int ret;
+
+	ret = set_ls_status(path, ob1203->address);
+	if (!ret && proximity) {
+		ret = set_ps_measurement_period(path, ob1203->address);
+		if (!ret)
+			ret = set_ps_status(path, ob1203->address);
+	}
+
+	return ret;
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Stop the OB1203 engines, the HS3001s only convert on request.
+ */
+
+static void
+sensor_standby(struct per_vhost_data__minimal *vhd)
+{
+	struct sensor_acq *acq = &vhd->acq;
+	struct sensor_extra *ex;
+	int n, ret;
+
+	ret = set_standby(vhd->sensors.buses[acq->ob1203->bus], acq->ob1203->address,
+			  !ppg_mode);
+
+	for (n = 0; n < acq->extra_count; n++) {
+		ex = &acq->extras[n];
+		if (!ex->armed)
+			continue;
+		if (set_standby(vhd->sensors.buses[ex->inst->bus], ex->inst->address, 1))
+			ret = -1;
+		ex->armed = 0;
+		ex->ready = 0;
+	}
+
+	if (ret)
+		lwsl_err("THREAD_SENSOR: ERROR failed to put the OB1203 in standby\n");
+	else
+		lwsl_user("THREAD_SENSOR: no client, sensors in standby\n");
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Nothing to acquire, the next cycle starts with fresh HS3001 measurements.
+ */
+
+static void
+sensor_acq_idle(struct sensor_acq *acq)
+{
+	int n;
+
+	acq->hs3001_measuring = 0;
+	for (n = 0; n < acq->extra_count; n++)
+		acq->extras[n].measuring = 0;
+}
+
+#if !defined(SENSOR_EVENT_LOOP)
+/*
+ * This runs under the "sensor thread" thread context only.
+ *
+ * Enable the OB1203 engines and wait for their first conversion, the
+ * warm-up time is measured and logged. The HS3001 needs nothing, it
+ * converts on each measurement request only.
+ */
+
+static int
+sensor_arm(struct per_vhost_data__minimal *vhd)
+{
+	struct timespec start_time;
+	struct timespec end_time;
+	int ret;
+
+	vclock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	ret = sensor_enable(vhd, vhd->acq.ob1203, !ppg_mode);
+	if (!ret)
+		ret = wait_data_ready(vhd->acq.ob1203_bus, vhd->acq.ob1203->address, !ppg_mode);
+
+	vclock_gettime(CLOCK_MONOTONIC, &end_time);
+
+	if (ret) {
+		lwsl_err("THREAD_SENSOR: ERROR failed to arm the OB1203 sensor\n");
+		return -1;
+	}
+
+	lwsl_user("THREAD_SENSOR: sensors armed, warm-up %ldms\n",
+		  (end_time.tv_sec - start_time.tv_sec) * LWS_US_PER_MS +
+		  (end_time.tv_nsec - start_time.tv_nsec) / (LWS_US_PER_MS * LWS_NS_PER_US));
+
+	return 0;
+}
+
+/*
+ * This runs under the "sensor thread" thread context only.
+ *
+ * Block while nobody is connected, no rule is loaded and there is no local
+ * feed. The sensors stay armed for standby_grace ms so a reconnecting
+ * browser doesn't pay the warm-up, then the OB1203 engines are stopped and
+ * the HS3001 gets no more measurement requests. Returns if the sensors are
+ * still armed.
+ */
+
+static int
+sensor_idle(struct per_vhost_data__minimal *vhd, int armed)
+{
+	struct timespec ts;
+	TRACE_SCOPE("sensor idle");
+
+	vclock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += standby_grace / LWS_US_PER_MS;
+	ts.tv_nsec += (standby_grace % LWS_US_PER_MS) * LWS_US_PER_MS * LWS_NS_PER_US;
+	if (ts.tv_nsec >= LWS_US_PER_SEC * LWS_NS_PER_US) {
+		ts.tv_sec++;
+		ts.tv_nsec -= LWS_US_PER_SEC * LWS_NS_PER_US;
+	}
+
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+
+	while (!vhd->finished && !ring_wanted(vhd) && !vhd->rules.count && !vhd->feed) {
+		if (!armed) {
+			pthread_cond_wait(&vhd->cond_wake_sensor, &vhd->lock_sampling);
+			continue;
+		}
+
+		if (vclock_cond_timedwait(&vhd->cond_wake_sensor, &vhd->lock_sampling,
+					  &ts) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+		sensor_standby(vhd);
+		armed = 0;
+
+		pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	}
+
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+	return armed;
+}
+#endif
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Evaluate the rules against the channels read this cycle, fresh[channel]
+ * not 0, and switch the led GPIO right away, so the reaction doesn't
+ * depend on a browser being connected.
+ */
+
+static void
+apply_rules(struct per_vhost_data__minimal *vhd,
+	    const struct sensor_sample *sample, const int *fresh)
+{
+	int state, ret;
+
+	pthread_mutex_lock(&vhd->lock_rules); /* --------- rules lock { */
+	state = rules_evaluate(&vhd->rules, sample, fresh);
+	pthread_mutex_unlock(&vhd->lock_rules); /* } rules lock ------- */
+
+	if (state == RULE_LED_NONE)
+		return;
+
+	lwsl_user("THREAD_SENSOR: rule: led: %s\n",
+		  state == RULE_LED_ON ? "on" : "off");
+
+	ret = state == RULE_LED_ON ? led_on() : led_off();
+	if (ret != 0) {
+		lwsl_err("%s\n", strerror(-ret));
+	}
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Account the result of a sensor access in its breaker and log the state
+ * changes. A sensor that stops answering gets its bus reopened when
+ * enabled, a stuck device can hold SDA low for all of them.
+ */
+
+static enum health_event
+sensor_report(struct i2c_sched *bus, struct sensor_health *h, int ok, long now)
+{
+	enum health_event ev = sensor_health_report(h, ok, now);
+
+	switch (ev) {
+	case HEALTH_EVENT_OPENED:
+		lwsl_err("THREAD_SENSOR: %s failed %d times, probed every %dms\n",
+			 h->name, HEALTH_FAILURES, h->backoff);
+		if (i2c_recovery)
+			i2c_sched_recover(bus);
+		break;
+	case HEALTH_EVENT_PROBE_FAILED:
+		lwsl_notice("THREAD_SENSOR: %s still failing, next probe in %dms\n",
+			    h->name, h->backoff);
+		break;
+	case HEALTH_EVENT_RECOVERED:
+		lwsl_user("THREAD_SENSOR: %s recovered\n", h->name);
+		break;
+	default:
+		break;
+	}
+
+	return ev;
+}
+
+/*
+ * This runs under lws service, "sensor threads" context, and "led threads" context.
+ * Access is serialized by vhd->lock_ring or vhd->lock_ring_receive.
+ */
+
+static void
+__minimal_destroy_message(void *_msg)
+{
+	struct msg *msg = _msg;
+
+	free(msg->payload);
+	msg->payload = NULL;
+	msg->len = 0;
+}
+
+/*
+ * Length of the stamp {"seq":N,"epoch":E, of a message less its '{', to
+ * skip it, or 0 if there is none
+ */
+
+static int
+message_stamp(const char *json, size_t len)
+{
+	const char *p = json, *end = json + len;
+
+	if (len < 8 || strncmp(p, "{\"seq\":", 7))
+		return 0;
+	for (p += 7; p < end && *p >= '0' && *p <= '9'; p++)
+		;
+	if (end - p < 9 || strncmp(p, ",\"epoch\":", 9))
+		return 0;
+	for (p += 9; p < end && *p >= '0' && *p <= '9'; p++)
+		;
+	if (p == end || *p != ',')
+		return 0;
+
+	return lws_ptr_diff(p, json);
+}
+
+/* the TOPIC_* of a sample ring message, by its first member */
+
+static int
+message_topic(const char *json, size_t len)
+{
+	const char *p = json, *end = json + len, *q;
+	size_t m;
+	int n;
+
+	/* gateway mode, {"board":"<id>",... */
+	if (len > 10 && !strncmp(p, "{\"board\":\"", 10)) {
+		q = memchr(p + 10, '"', len - 10);
+		if (q)
+			p = q + 1;
+	}
+
+	/* '{' or ',' then the quoted name */
+	p += 2;
+	for (n = 0; n < TOPIC_COUNT; n++) {
+		m = strlen(topic_keys[n]);
+		if (end - p > (long)m && !strncmp(p, topic_keys[n], m) && p[m] == '"')
+			return n;
+	}
+
+	return TOPIC_SAMPLES;
+}
+
+/* the TOPIC_* named by the first len chars of name, or -1 */
+
+static int
+topic_lookup(const char *name, size_t len)
+{
+	int n;
+
+	for (n = 0; n < TOPIC_COUNT; n++)
+		if (strlen(topic_names[n]) == len && !strncmp(name, topic_names[n], len))
+			return n;
+
+	return -1;
+}
+
+/*
+ * This runs under the "sensor thread" and lws service thread contexts.
+ *
+ * Format the statistics of every channel over each window and its detector
+ * event counts as JSON, returns the length written. Called with
+ * vhd->lock_rolling held.
+ */
+
+static int
+rolling_stats_json(struct per_vhost_data__minimal *vhd, long now, char *buf, size_t len)
+{
+	struct rolling_summary sum;
+	char *p = buf, *end = buf + len;
+	int n, m;
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "{\"stats\":{");
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		p += lws_snprintf(p, lws_ptr_diff(end, p), "%s\"%s\":{",
+				  n ? "," : "", sensor_channel_name(n));
+		for (m = 0; m < ROLLING_WINDOW_COUNT; m++) {
+			rolling_summary(vhd->rolling, n, m, now, &sum);
+			if (!sum.n) {
+				p += lws_snprintf(p, lws_ptr_diff(end, p), "%s\"%s\":{\"n\":0}",
+						  m ? "," : "", rolling_window_name(m));
+				continue;
+			}
+			p += lws_snprintf(p, lws_ptr_diff(end, p),
+					  "%s\"%s\":{\"n\":%u,\"min\":%.3f,\"max\":%.3f,"
+					  "\"mean\":%.3f,\"stddev\":%.3f,\"p95\":%.3f}",
+					  m ? "," : "", rolling_window_name(m), sum.n,
+					  sum.min, sum.max, sum.mean, sum.stddev, sum.quantile);
+		}
+		p += lws_snprintf(p, lws_ptr_diff(end, p),
+				  ",\"events\":{\"change\":%lu,\"stuck\":%lu,\"range\":%lu}}",
+				  vhd->detector.events[n][DETECT_CHANGE],
+				  vhd->detector.events[n][DETECT_STUCK],
+				  vhd->detector.events[n][DETECT_RANGE]);
+	}
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "}}");
+
+	return lws_ptr_diff(p, buf);
+}
+
+static void
+sessions_writable(struct per_vhost_data__minimal *vhd);
+
+/*
+ * This runs under the "sensor thread" and "ppg thread" contexts, or the lws
+ * service thread context in event loop mode.
+ *
+ * Get the sessions to write what was just queued in the rings, called
+ * without vhd->lock_ring held.
+ */
+
+static void
+sessions_notify(struct per_vhost_data__minimal *vhd)
+{
+#if defined(SENSOR_EVENT_LOOP)
+	/* we are the service thread already, no wakeup through the pipe */
+	sessions_writable(vhd);
+#else
+	/*
+	 * This will cause a LWS_CALLBACK_EVENT_WAIT_CANCELLED
+	 * in the lws service thread context.
+	 */
+	lws_cancel_service(vhd->context);
+#endif
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop and gateway modes.
+ *
+ * Stamp a message with the next seq and the epoch, {"seq":N,"epoch":E,...
+ * with the members of the message after them, retain it in the history
+ * and queue it for the sessions. It is freed if there is no session or if
+ * the ring is full, the seq is used anyway. Returns 1 if queued, 0 if not
+ * and -1 if dropped for a full ring.
+ *
+ * The message is at RING_PRE in its payload, the stamp goes in the room
+ * left before it, in place of its '{'.
+ */
+
+static int
+ring_insert(struct per_vhost_data__minimal *vhd, struct msg *amsg)
+{
+	char stamp[STAMP_MAX], *body;
+	int n, ret = 0;
+
+	amsg->queued = lws_now_usecs();
+	amsg->topic = (uint8_t)message_topic((char *)amsg->payload + RING_PRE, amsg->len);
+
+	TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+	amsg->seq = ++vhd->published;
+	n = lws_snprintf(stamp, sizeof(stamp), "{\"seq\":%llu,\"epoch\":%llu,",
+			 (unsigned long long)amsg->seq, (unsigned long long)vhd->epoch);
+	amsg->start = RING_PRE + 1 - n;
+	amsg->len += n - 1;
+	body = (char *)amsg->payload + amsg->start;
+	memcpy(body, stamp, n);
+
+	if (vhd->history.buf)
+		history_append(&vhd->history, amsg->seq, body, amsg->len, amsg->topic);
+
+	if (!vhd->pss_list)
+		__minimal_destroy_message(amsg); /* only retained */
+	else if (!lws_ring_get_count_free_elements(vhd->ring) ||
+		 lws_ring_insert(vhd->ring, amsg, 1) != 1) {
+		__minimal_destroy_message(amsg);
+		vhd->dropped++;
+		ret = -1;
+	} else
+		ret = 1;
+
+	pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+
+	return ret;
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Publish a message to the sessions through the sample ring.
+ */
+
+static void
+ring_publish(struct per_vhost_data__minimal *vhd, struct msg *amsg)
+{
+	int n;
+
+	n = ring_insert(vhd, amsg);
+	if (n < 0)
+		lwsl_user("dropping!\n");
+	else if (n)
+		sessions_notify(vhd);
+}
+
+/*
+ * This runs under the "sensor thread" or "ppg thread" context, or the lws
+ * service thread context in event loop mode.
+ *
+ * Push samples into the capture, the last one read at last_ns and the
+ * others period_ns apart before it. A capture completed is queued for the
+ * subscribed sessions as one binary message, the pushing thread only
+ * copies it out.
+ */
+
+static void
+capture_feed(struct per_vhost_data__minimal *vhd, const uint32_t *values,
+	     int count, int64_t last_ns, int64_t period_ns)
+{
+	struct align_clock clock;
+	struct msg amsg;
+	int n, queued = 0;
+
+	if (!vhd->capture)
+		return;
+
+	TRACE_LOCK(&vhd->lock_capture, "lock_capture"); /* --------- capture lock { */
+
+	for (n = 0; n < count; n++) {
+		if (!capture_push(vhd->capture, last_ns - (count - 1 - n) * period_ns,
+				  values[n]))
+			continue;
+
+		lwsl_notice("%s: capture %lu, %s trigger\n", __func__,
+			    vhd->capture->captures,
+			    vhd->capture->trigger_forced ? "command" : "level");
+
+		/* don't generate output if nobody subscribed */
+		if (!vhd->capture_subscribers)
+			continue;
+
+		amsg.len = capture_size(vhd->capture);
+		amsg.payload = malloc(LWS_PRE + amsg.len);
+		if (!amsg.payload) {
+			lwsl_user("OOM: dropping\n");
+			continue;
+		}
+		align_clock_sync(&clock);
+		capture_blob(vhd->capture, (char *)amsg.payload + LWS_PRE,
+			     align_wall_ms(&clock, capture_trigger_ns(vhd->capture)));
+		amsg.queued = lws_now_usecs();
+
+		TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+		if (!lws_ring_get_count_free_elements(vhd->ring_capture) ||
+		    lws_ring_insert(vhd->ring_capture, &amsg, 1) != 1) {
+			__minimal_destroy_message(&amsg);
+			lwsl_user("dropping capture!\n");
+		} else
+			queued = 1;
+
+		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+	}
+
+	pthread_mutex_unlock(&vhd->lock_capture); /* } capture lock ------- */
+
+	if (queued)
+		sessions_notify(vhd);
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Push the channel statistics to the sessions, through the sample ring.
+ */
+
+static void
+publish_rolling_stats(struct per_vhost_data__minimal *vhd, long now)
+{
+	struct msg amsg;
+
+	amsg.payload = malloc(RING_PRE + STATS_SUMMARY_LEN);
+	if (!amsg.payload) {
+		lwsl_user("OOM: dropping\n");
+		return;
+	}
+
+	pthread_mutex_lock(&vhd->lock_rolling); /* --------- rolling lock { */
+	amsg.len = rolling_stats_json(vhd, now, (char *)amsg.payload + RING_PRE,
+				      STATS_SUMMARY_LEN);
+	pthread_mutex_unlock(&vhd->lock_rolling); /* } rolling lock ------- */
+
+	ring_publish(vhd, &amsg);
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Log a detector event and push it to the sessions as a message of its
+ * own, {"event":{...}}.
+ */
+
+static void
+publish_detector_event(struct per_vhost_data__minimal *vhd,
+		       const struct detector_event *ev)
+{
+	const char *direction = "";
+	struct msg amsg;
+
+	if (ev->kind == DETECT_CHANGE)
+		direction = ev->direction > 0 ? "up" : "down";
+	else if (ev->kind == DETECT_RANGE)
+		direction = ev->direction > 0 ? "above" : "below";
+
+	lwsl_notice("THREAD_SENSOR: %s %s %s%s: %.3f (%.3f)\n",
+		    sensor_channel_name(ev->channel), detector_kind_name(ev->kind),
+		    direction, ev->cleared ? " cleared" : "", ev->value, ev->reference);
+
+	if (!ring_wanted(vhd))
+		return;
+
+	amsg.payload = malloc(RING_PRE + DETECTOR_EVENT_LEN);
+	if (!amsg.payload) {
+		lwsl_user("OOM: dropping\n");
+		return;
+	}
+
+	amsg.len = lws_snprintf((char *)amsg.payload + RING_PRE, DETECTOR_EVENT_LEN,
+				"{\"event\":{\"channel\":\"%s\",\"type\":\"%s\","
+				"\"direction\":\"%s\",\"cleared\":%d,"
+				"\"value\":%.3f,\"reference\":%.3f}}",
+				sensor_channel_name(ev->channel),
+				detector_kind_name(ev->kind), direction, ev->cleared,
+				ev->value, ev->reference);
+
+	ring_publish(vhd, &amsg);
+}
+
+/*
+ * This runs under the lws service thread context only, at init and destroy.
+ */
+
+static void
+sensor_acq_init(struct per_vhost_data__minimal *vhd, struct sensor_acq *acq)
+{
+	const struct sensor_instance *inst;
+	struct sensor_extra *ex;
+	int n;
+
+	memset(acq, 0, sizeof(*acq));
+
+	acq->hs3001 = sensor_config_primary(&vhd->sensors, SENSOR_HS3001);
+	acq->ob1203 = sensor_config_primary(&vhd->sensors, SENSOR_OB1203);
+	acq->hs3001_bus = &vhd->i2c[acq->hs3001->bus];
+	acq->ob1203_bus = &vhd->i2c[acq->ob1203->bus];
+
+	i2c_completion_init(&acq->c_hs3001);
+	i2c_completion_init(&acq->c_ls);
+	i2c_completion_init(&acq->c_ps);
+
+	sensor_health_init(&acq->health_hs3001, "HS3001");
+	sensor_health_init(&acq->health_ob1203, "OB1203");
+
+	for (n = 0; n < vhd->sensors.count; n++) {
+		inst = &vhd->sensors.instances[n];
+		if (inst == acq->hs3001 || inst == acq->ob1203)
+			continue;
+		ex = &acq->extras[acq->extra_count++];
+		ex->inst = inst;
+		ex->bus = &vhd->i2c[inst->bus];
+		i2c_completion_init(&ex->c);
+		sensor_health_init(&ex->health, inst->name);
+	}
+
+	align_clock_sync(&acq->clock);
+	align_init(&acq->align, resample_mode,
+		   resample_grid ? resample_grid : read_sensor_data_interval);
+
+	vclock_gettime(CLOCK_MONOTONIC, &acq->report_time);
+	acq->summary_time = acq->report_time;
+}
+
+static void
+sensor_acq_destroy(struct sensor_acq *acq)
+{
+	int n;
+
+	i2c_completion_destroy(&acq->c_hs3001);
+	i2c_completion_destroy(&acq->c_ls);
+	i2c_completion_destroy(&acq->c_ps);
+
+	for (n = 0; n < acq->extra_count; n++)
+		i2c_completion_destroy(&acq->extras[n].c);
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Queue the reading of another instance on its bus. An HS3001 gets its
+ * measurement fetched and the next one requested, as the primary one. An
+ * OB1203 is enabled by its first cycle and its data counts from its first
+ * conversion, it is not worth a warm-up of its own.
+ */
+
+static void
+sensor_extra_queue(struct per_vhost_data__minimal *vhd, struct sensor_extra *ex, long now)
+{
+	uint16_t address = ex->inst->address;
+
+	ex->ok = sensor_health_allow(&ex->health, now);
+	if (!ex->ok)
+		return;
+
+	switch (ex->inst->type) {
+	case SENSOR_HS3001:
+		if (ex->measuring)
+			hs3001_queue_fetch(ex->bus, address, &ex->hs3001_req, &ex->c);
+		hs3001_queue_measurement(ex->bus, address, &ex->hs3001_req, &ex->c);
+		break;
+	case SENSOR_OB1203:
+		if (!ex->armed) {
+			if (sensor_enable(vhd, ex->inst, 1)) {
+				lwsl_err("THREAD_SENSOR: ERROR failed to arm %s\n", ex->inst->name);
+				sensor_report(ex->bus, &ex->health, 0, now);
+				ex->ok = 0;
+				return;
+			}
+			ex->armed = 1;
+		}
+		ob1203_queue_status(ex->bus, address, &ex->ob1203_req, 0, &ex->c);
+		ob1203_queue_light(ex->bus, address, &ex->ob1203_req, &ex->c);
+		ob1203_queue_proximity(ex->bus, address, &ex->ob1203_req, &ex->c);
+		break;
+	}
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Wait for the reading queued by sensor_extra_queue() and decode it.
+ */
+
+static void
+sensor_extra_complete(struct sensor_extra *ex, long now)
+{
+	int ret;
+
+	if (!ex->ok)
+		return;
+
+	ret = i2c_completion_wait(&ex->c);
+
+	switch (ex->inst->type) {
+	case SENSOR_HS3001:
+		if (!ret && ex->measuring)
+			ret = hs3001_decode(&ex->hs3001_req, &ex->hs3001_data);
+		if (!ret && ex->measuring)
+			ex->valid = 1;
+		/* the measurement request may be lost too, start over */
+		ex->measuring = !ret;
+		break;
+	case SENSOR_OB1203:
+		if (ret)
+			break;
+		ex->ready |= ex->ob1203_req.ls_status & OB1203_STATUS_NEW_DATA;
+		if (!ex->ready)
+			break;
+		ob1203_decode_light(&ex->ob1203_req, &ex->ob1203_data);
+		ob1203_decode_proximity(&ex->ob1203_req, &ex->ob1203_data);
+		ex->valid = 1;
+		break;
+	}
+
+	if (ret)
+		lwsl_err("THREAD_SENSOR: ERROR failed to read data from %s\n", ex->inst->name);
+
+	/* the engines are armed again once the sensor answers a probe */
+	if (sensor_report(ex->bus, &ex->health, !ret, now) == HEALTH_EVENT_OPENED)
+		ex->armed = 0;
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Publish the last reading of another instance, tagged with its name.
+ */
+
+static void
+sensor_extra_publish(struct per_vhost_data__minimal *vhd, const struct sensor_extra *ex)
+{
+	int len = 256, active = sensor_health_active(&ex->health);
+	struct msg amsg;
+
+	if (!ex->valid)
+		return;
+
+	amsg.payload = malloc(RING_PRE + len);
+	if (!amsg.payload) {
+		lwsl_user("OOM: dropping\n");
+		return;
+	}
+
+	TRACE_BEGIN(serialise);
+	if (ex->inst->type == SENSOR_HS3001)
+		amsg.len = lws_snprintf((char *)amsg.payload + RING_PRE, len,
+			SENSOR_HS3001_JSON_FORMAT, ex->inst->name,
+			ex->hs3001_data.temperature, active,
+			ex->hs3001_data.humidity, active);
+	else
+		amsg.len = lws_snprintf((char *)amsg.payload + RING_PRE, len,
+			SENSOR_OB1203_JSON_FORMAT, ex->inst->name,
+			ex->ob1203_data.light, active,
+			ex->ob1203_data.proximity, active);
+	TRACE_END(serialise, "serialise instance");
+
+	ring_publish(vhd, &amsg);
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Publish the grid points of the resampler covered by the readings so
+ * far, the channels without a reading around a point are left out.
+ */
+
+static void
+publish_aligned(struct per_vhost_data__minimal *vhd, struct sensor_acq *acq,
+		int64_t now)
+{
+	struct align_sample as;
+	struct msg amsg;
+	int len = 256, n;
+	char *p;
+
+	while (align_next(&acq->align, now, &as)) {
+		if (!ring_wanted(vhd))
+			continue;
+
+		amsg.payload = malloc(RING_PRE + len);
+		if (!amsg.payload) {
+			lwsl_user("OOM: dropping\n");
+			continue;
+		}
+
+		TRACE_BEGIN(serialise);
+		p = (char *)amsg.payload + RING_PRE;
+		n = lws_snprintf(p, len, "{\"aligned\":{\"time\":\"%lld\"",
+				 (long long)align_wall_ms(&acq->clock, as.time_ns));
+		if (as.valid[CHANNEL_TEMP])
+			n += lws_snprintf(p + n, len - n, ",\"temp\":\"%2.3f\"",
+					  as.value[CHANNEL_TEMP]);
+		if (as.valid[CHANNEL_HUMM])
+			n += lws_snprintf(p + n, len - n, ",\"humm\":\"%2.3f\"",
+					  as.value[CHANNEL_HUMM]);
+		if (as.valid[CHANNEL_LIGHT])
+			n += lws_snprintf(p + n, len - n, ",\"light\":\"%d\"",
+					  (int)as.value[CHANNEL_LIGHT]);
+		if (as.valid[CHANNEL_PROXIMITY])
+			n += lws_snprintf(p + n, len - n, ",\"proximity\":\"%d\"",
+					  (int)as.value[CHANNEL_PROXIMITY]);
+		if (as.dewpoint_valid)
+			n += lws_snprintf(p + n, len - n, ",\"dewpoint\":\"%2.3f\"",
+					  as.dewpoint);
+		n += lws_snprintf(p + n, len - n, "}}");
+		amsg.len = n;
+		TRACE_END(serialise, "serialise aligned");
+
+		ring_publish(vhd, &amsg);
+	}
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Whether temp and humm are due at now without a HS3001 measurement
+ * pending: after an idle period, for a probe, or when their period was
+ * shortened. The caller requests one and lets it convert first.
+ */
+
+static int
+hs3001_unprepared(struct per_vhost_data__minimal *vhd, struct sensor_acq *acq, long now)
+{
+	int due;
+
+	if (acq->hs3001_measuring || !acq->hs3001_ok)
+		return 0;
+
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	due = sampling_due(&vhd->sampling, CHANNEL_TEMP, now) ||
+	      sampling_due(&vhd->sampling, CHANNEL_HUMM, now);
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+	return due;
+}
+
+/*
+ * This runs under the "sensor thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * One acquisition cycle started at start_time, once the sensors are armed
+ * and the HS3001 has a measurement pending if temp and humm are due: read
+ * the channels due, request the next HS3001 measurement if needed, read the
+ * other instances, publish the samples and log the I2C statistics. Each
+ * bus is flushed before any completion is waited for, so with a bus
+ * thread per bus the buses transfer in parallel. Returns when the next
+ * channel is due, in ms of CLOCK_MONOTONIC.
+ */
+
+static long
+sensor_cycle(struct per_vhost_data__minimal *vhd, struct sensor_acq *acq,
+	     const struct timespec *start_time)
+{
+	struct msg amsg;
+	struct sensor_sample sample;
+	struct sensor_message message;
+	int len = SENSOR_SAMPLE_JSON_MAX, n, ret = 0;
+	int temp_is_active, humm_is_active, light_is_active, proximity_is_active;
+	int ob1203_read, hs3001_read;
+	int due[CHANNEL_COUNT], period[CHANNEL_COUNT];
+	struct timespec end_time;
+	struct i2c_sched_stats stats, *last;
+	struct detector_event events[CHANNEL_COUNT * DETECTOR_EVENTS_MAX];
+	int nevents;
+	long now, until, hs3001_due, other_due;
+	int64_t flushed, wall_ms[CHANNEL_COUNT];
+	double elapsed;
+	TRACE_SCOPE("sensor cycle");
+
+	now = start_time->tv_sec * LWS_US_PER_MS +
+	      start_time->tv_nsec / (LWS_US_PER_MS * LWS_NS_PER_US);
+
+	acq->ob1203_ok = acq->ob1203_ok && acq->armed;
+
+	/* read only the sensors with a channel due, the HS3001 gives both of its */
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	for (n = 0; n < CHANNEL_COUNT; n++)
+		due[n] = sampling_due(&vhd->sampling, n, now);
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+	due[CHANNEL_TEMP] = due[CHANNEL_HUMM] = due[CHANNEL_TEMP] || due[CHANNEL_HUMM];
+
+	/*
+	 * One I2C_RDWR up to the HS3001 fetch STOP. The fetch returns the
+	 * measurement requested by an earlier cycle, see below.
+	 */
+	ob1203_read = 0;
+	if (due[CHANNEL_LIGHT] && acq->ob1203_ok) {
+		ob1203_queue_light(acq->ob1203_bus, acq->ob1203->address,
+				   &acq->ob1203_req, &acq->c_ls);
+		ob1203_read = 1;
+	}
+	if (due[CHANNEL_PROXIMITY] && !ppg_mode && acq->ob1203_ok) {
+		ob1203_queue_proximity(acq->ob1203_bus, acq->ob1203->address,
+				       &acq->ob1203_req, &acq->c_ps);
+		ob1203_read = 1;
+	}
+	hs3001_read = due[CHANNEL_TEMP] && acq->hs3001_ok;
+	if (hs3001_read)
+		hs3001_queue_fetch(acq->hs3001_bus, acq->hs3001->address,
+				   &acq->hs3001_req, &acq->c_hs3001);
+	for (n = 0; n < acq->extra_count; n++)
+		sensor_extra_queue(vhd, &acq->extras[n], now);
+	for (n = 0; n < vhd->i2c_count; n++)
+		i2c_sched_flush(&vhd->i2c[n]);
+	flushed = align_now_ns();
+
+	/* the HS3001 data is the measurement pending since hs3001_requested */
+	ret = i2c_completion_wait(&acq->c_hs3001);
+	if (ret == 0 && hs3001_read)
+		ret = hs3001_decode(&acq->hs3001_req, &acq->hs3001_data);
+	if (ret == 0 && hs3001_read)
+		acq->time_ns[CHANNEL_TEMP] = acq->time_ns[CHANNEL_HUMM] =
+			acq->hs3001_requested ? acq->hs3001_requested : flushed;
+	if (ret != 0)
+		lwsl_err("THREAD_SENSOR: ERROR failed to read data from the HS3001 sensor\n");
+	if (hs3001_read) {
+		acq->hs3001_measuring = 0;
+		sensor_report(acq->hs3001_bus, &acq->health_hs3001, !ret, now);
+	}
+
+	ret = i2c_completion_wait(&acq->c_ls);
+	if (ret == 0 && due[CHANNEL_LIGHT] && acq->ob1203_ok) {
+		ob1203_decode_light(&acq->ob1203_req, &acq->ob1203_data);
+		acq->time_ns[CHANNEL_LIGHT] = align_now_ns();
+	} else if (ret != 0)
+		lwsl_err("THREAD_SENSOR: ERROR failed to read light data from the OB1203 sensor\n");
+
+	n = i2c_completion_wait(&acq->c_ps);
+	if (n == 0 && due[CHANNEL_PROXIMITY] && !ppg_mode && acq->ob1203_ok) {
+		ob1203_decode_proximity(&acq->ob1203_req, &acq->ob1203_data);
+		acq->time_ns[CHANNEL_PROXIMITY] = align_now_ns();
+	} else if (n != 0)
+		lwsl_err("THREAD_SENSOR: ERROR failed to read proximity data from the OB1203 sensor\n");
+
+	/* the engines are armed again once the sensor answers a probe */
+	if (ob1203_read &&
+	    sensor_report(acq->ob1203_bus, &acq->health_ob1203, !ret && !n,
+			  now) == HEALTH_EVENT_OPENED)
+		acq->armed = 0;
+
+	for (n = 0; n < acq->extra_count; n++)
+		sensor_extra_complete(&acq->extras[n], now);
+
+	/* a sensor is active while its last access succeeded */
+	temp_is_active = humm_is_active = sensor_health_active(&acq->health_hs3001);
+	light_is_active = sensor_health_active(&acq->health_ob1203);
+	/* PPG and PS share the engine, the PPG drain owns it */
+	proximity_is_active = light_is_active && !ppg_mode;
+
+	sample.value[CHANNEL_TEMP] = acq->hs3001_data.temperature;
+	sample.is_active[CHANNEL_TEMP] = temp_is_active;
+	sample.value[CHANNEL_HUMM] = acq->hs3001_data.humidity;
+	sample.is_active[CHANNEL_HUMM] = humm_is_active;
+	sample.value[CHANNEL_LIGHT] = (float)acq->ob1203_data.light;
+	sample.is_active[CHANNEL_LIGHT] = light_is_active;
+	sample.value[CHANNEL_PROXIMITY] = (float)acq->ob1203_data.proximity;
+	sample.is_active[CHANNEL_PROXIMITY] = proximity_is_active;
+	memcpy(sample.time_ns, acq->time_ns, sizeof(sample.time_ns));
+
+	/* the wall clock of the readings, followed for its steps and slew */
+	align_clock_sync(&acq->clock);
+	for (n = 0; n < CHANNEL_COUNT; n++)
+		wall_ms[n] = acq->time_ns[n] ? align_wall_ms(&acq->clock, acq->time_ns[n]) : 0;
+
+	/* retime the channels just read from their new values */
+	pthread_mutex_lock(&vhd->lock_sampling); /* --------- sampling lock { */
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (due[n])
+			sampling_update(&vhd->sampling, n, sample.value[n], now);
+		period[n] = vhd->sampling.ch[n].period;
+	}
+	until = sampling_next_due(&vhd->sampling);
+	hs3001_due = vhd->sampling.ch[CHANNEL_TEMP].due;
+	if (vhd->sampling.ch[CHANNEL_HUMM].due < hs3001_due)
+		hs3001_due = vhd->sampling.ch[CHANNEL_HUMM].due;
+	other_due = vhd->sampling.ch[CHANNEL_LIGHT].due;
+	if (vhd->sampling.ch[CHANNEL_PROXIMITY].due < other_due)
+		other_due = vhd->sampling.ch[CHANNEL_PROXIMITY].due;
+	pthread_mutex_unlock(&vhd->lock_sampling); /* } sampling lock ------- */
+
+	/*
+	 * Request the next HS3001 measurement in the last cycle before temp
+	 * and humm are due that leaves it the time to convert: it is fresh
+	 * when fetched, and the HS3001 isn't accessed in the other cycles.
+	 */
+	if (acq->hs3001_ok && !acq->hs3001_measuring &&
+	    other_due + HS3001_WAIT_TIME / LWS_US_PER_MS > hs3001_due) {
+		hs3001_queue_measurement(acq->hs3001_bus, acq->hs3001->address,
+					 &acq->hs3001_req, &acq->c_hs3001);
+		i2c_sched_flush(acq->hs3001_bus);
+		if (!i2c_completion_wait(&acq->c_hs3001)) {
+			acq->hs3001_measuring = 1;
+			acq->hs3001_requested = align_now_ns();
+		} else {
+			lwsl_err("THREAD_SENSOR: ERROR failed to request a HS3001 measurement\n");
+			sensor_report(acq->hs3001_bus, &acq->health_hs3001, 0, now);
+		}
+	}
+
+	/* only the readings of this cycle, a channel not due repeats its value */
+	nevents = 0;
+	pthread_mutex_lock(&vhd->lock_rolling); /* --------- rolling lock { */
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (!due[n] || !sample.is_active[n])
+			continue;
+		rolling_update(vhd->rolling, n, sample.value[n], now);
+		if (vhd->detector.enabled)
+			nevents += detector_update(&vhd->detector, n, sample.value[n],
+						   &events[nevents]);
+	}
+	pthread_mutex_unlock(&vhd->lock_rolling); /* } rolling lock ------- */
+
+	for (n = 0; n < nevents; n++)
+		publish_detector_event(vhd, &events[n]);
+
+	if (acq->align.mode != ALIGN_OFF) {
+		for (n = 0; n < CHANNEL_COUNT; n++)
+			if (due[n] && sample.is_active[n] && acq->time_ns[n])
+				align_add(&acq->align, n, acq->time_ns[n], sample.value[n]);
+		publish_aligned(vhd, acq, align_now_ns());
+	}
+
+	if (vhd->feed)
+		sample_feed_publish(vhd->feed, &sample,
+				    start_time->tv_sec * (LWS_US_PER_SEC * LWS_NS_PER_US) +
+				    start_time->tv_nsec);
+
+	apply_rules(vhd, &sample, due);
+
+	/* don't generate output if nobody connected nor may resume */
+	if (!ring_wanted(vhd))
+		goto report;
+
+	amsg.payload = malloc(RING_PRE + len);
+	if (!amsg.payload) {
+		lwsl_user("OOM: dropping\n");
+		goto report;
+	}
+
+	message.temp = acq->hs3001_data.temperature;
+	message.humm = acq->hs3001_data.humidity;
+	message.light = acq->ob1203_data.light;
+	message.proximity = acq->ob1203_data.proximity;
+	memcpy(message.is_active, sample.is_active, sizeof(message.is_active));
+	memcpy(message.period, period, sizeof(message.period));
+	memcpy(message.time_ms, wall_ms, sizeof(message.time_ms));
+
+	TRACE_BEGIN(serialise);
+	n = sensor_sample_json((char *)amsg.payload + RING_PRE, len, &message);
+	TRACE_END(serialise, "serialise sample");
+	if (n < 0) {
+		lwsl_err("THREAD_SENSOR: sample message too long, dropping\n");
+		free(amsg.payload);
+		goto report;
+	}
+	amsg.len = n;
+
+	ring_publish(vhd, &amsg);
+
+	for (n = 0; n < acq->extra_count; n++)
+		sensor_extra_publish(vhd, &acq->extras[n]);
+
+report:
+	vclock_gettime(CLOCK_MONOTONIC, &end_time);
+
+	elapsed = (end_time.tv_sec - acq->report_time.tv_sec) +
+		  (end_time.tv_nsec - acq->report_time.tv_nsec) / 1e9;
+	for (n = 0; elapsed >= I2C_REPORT_INTERVAL && n < vhd->i2c_count; n++) {
+		last = &acq->report_stats[n];
+		i2c_sched_get_stats(&vhd->i2c[n], &stats, NULL);
+		lwsl_notice("THREAD_SENSOR: I2C %s: %lu I2C_RDWR for %lu flushes, %lu msgs, "
+			    "bus occupancy %.2f%% (%.2f%% in I2C_RDWR), "
+			    "%lu isolated, %lu unreplayed, %lu recoveries\n", vhd->sensors.buses[n],
+			    stats.syscalls - last->syscalls, stats.cycles - last->cycles,
+			    stats.msgs - last->msgs,
+			    100.0 * (stats.bus_bits - last->bus_bits) /
+					(I2C_BUS_HZ * elapsed),
+			    (stats.busy_ns - last->busy_ns) / (1e7 * elapsed),
+			    stats.isolated - last->isolated,
+			    stats.unreplayed - last->unreplayed,
+			    stats.recoveries - last->recoveries);
+		*last = stats;
+	}
+	if (elapsed >= I2C_REPORT_INTERVAL)
+		acq->report_time = end_time;
+
+	if (end_time.tv_sec - acq->summary_time.tv_sec >= STATS_SUMMARY_INTERVAL) {
+		if (ring_wanted(vhd))
+			publish_rolling_stats(vhd, now);
+		acq->summary_time = end_time;
+	}
+
+	return until;
+}
+
+/*
+ * This runs under the "ppg thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Enable the OB1203 PPG mode before the first drain.
+ */
+
+static int
+ppg_enable(struct per_vhost_data__minimal *vhd)
+{
+	if (set_ppg_mode(vhd->sensors.buses[vhd->acq.ob1203->bus], vhd->acq.ob1203->address)) {
+		lwsl_err("THREAD_PPG: ERROR failed to enable the OB1203 PPG mode\n");
+		return -1;
+	}
+
+	vclock_gettime(CLOCK_MONOTONIC, &vhd->ppg.report_time);
+	vhd->ppg.drained_ns = align_now_ns();
+
+	return 0;
+}
+
+/*
+ * This runs under the "ppg thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Drain the OB1203 PPG FIFO once and queue the samples as a binary batch,
+ * the rate and the bus utilisation are logged every PPG_REPORT_INTERVAL.
+ */
+
+static void
+ppg_drain(struct per_vhost_data__minimal *vhd)
+{
+	struct ppg_state *st = &vhd->ppg;
+	struct ob1203_ppg_data ppg;
+	struct ppg_batch_header *hdr;
+	struct msg amsg;
+	struct timespec end_time;
+	int64_t now = align_now_ns();
+	double elapsed;
+	int n, queued = 0;
+
+	/* half the FIFO produced since the last drain, equal pointers are full */
+	n = read_ppg_fifo(vhd->acq.ob1203_bus, vhd->acq.ob1203->address, &ppg,
+			  now - st->drained_ns >=
+				(int64_t)OB1203_FIFO_DEPTH / 2 * 1000000000 / OB1203_PPG_RATE_HZ);
+	st->drained_ns = now;
+	if (n < 0) {
+		lwsl_err("THREAD_PPG: ERROR failed to drain the OB1203 FIFO\n");
+		goto report;
+	}
+
+	st->samples += n;
+	st->lost += ppg.overflow;
+	st->bus_bits += ppg.bus_bits;
+	st->index += ppg.overflow;
+
+	/* the FIFO held the samples of the last n periods */
+	capture_feed(vhd, ppg.samples, n, align_now_ns(),
+		     1000000000 / OB1203_PPG_RATE_HZ);
+
+	/* don't generate output if nobody subscribed */
+	if (!n || !vhd->ppg_subscribers) {
+		st->index += n;
+		goto report;
+	}
+
+	amsg.len = sizeof(*hdr) + n * sizeof(uint32_t);
+	amsg.payload = malloc(LWS_PRE + amsg.len);
+	if (!amsg.payload) {
+		lwsl_user("THREAD_PPG: OOM: dropping\n");
+		st->index += n;
+		goto report;
+	}
+	amsg.queued = lws_now_usecs();
+
+	hdr = (struct ppg_batch_header *)((char *)amsg.payload + LWS_PRE);
+	hdr->type = PPG_BATCH_TYPE;
+	hdr->count = n;
+	hdr->index = st->index;
+	memcpy(hdr + 1, ppg.samples, n * sizeof(uint32_t));
+	st->index += n;
+
+	TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+	if (lws_ring_insert(vhd->ring_ppg, &amsg, 1) != 1) {
+		__minimal_destroy_message(&amsg);
+		lwsl_user("THREAD_PPG: dropping!\n");
+	} else
+		queued = 1;
+
+	pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+
+	if (queued)
+		sessions_notify(vhd);
+
+report:
+	vclock_gettime(CLOCK_MONOTONIC, &end_time);
+	elapsed = (end_time.tv_sec - st->report_time.tv_sec) +
+		  (end_time.tv_nsec - st->report_time.tv_nsec) / 1e9;
+	if (elapsed >= PPG_REPORT_INTERVAL) {
+		lwsl_notice("THREAD_PPG: %.1f samples/s, %lu lost, bus utilisation %.2f%%\n",
+			    st->samples / elapsed, st->lost,
+			    100.0 * st->bus_bits / (I2C_BUS_HZ * elapsed));
+		st->samples = 0;
+		st->lost = 0;
+		st->bus_bits = 0;
+		st->report_time = end_time;
+	}
+}
+
+/*
+ * This runs under the "led thread" context, or the lws service thread
+ * context in event loop mode.
+ *
+ * Apply a command of a client: {"led": "on"|"off"}, {"rules": "..."} or
+ * {"sampling": {...}}.
+ */
+
+static void
+apply_command(struct per_vhost_data__minimal *vhd, const void *in, size_t len)
+{
+	json_t *root;
+	json_t *ledstate;
+	json_t *rules;
+	json_t *sampling;
+	json_error_t error;
+	int ret = 0;
+
+	root = json_loadb(in, len, 0, &error);
+	if (!root) {
+		lwsl_err("THREAD_LED: ERROR json parse error on line %d: %s\n", error.line, error.text);
+		return;
+	}
+	if (!json_is_object(root)) {
+		lwsl_err("THREAD_LED: ERROR json top is not an object\n");
+		goto done;
+	}
+
+	sampling = json_object_get(root, "sampling");
+	if (json_is_object(sampling)) {
+		configure_sampling(vhd, sampling);
+		goto done;
+	}
+
+	rules = json_object_get(root, "rules");
+	if (json_is_string(rules)) {
+		load_rules(vhd, json_string_value(rules));
+		goto done;
+	}
+
+	ledstate = json_object_get(root, "led");
+	if (!json_is_string(ledstate)) {
+		lwsl_err("THREAD_LED: ERROR json has no key \"led\" with string value\n");
+		goto done;
+	}
+	lwsl_user("THREAD_LED: led: %s\n", json_string_value(ledstate));
+	if (strcmp(json_string_value(ledstate), "on") == 0) {
+		ret = led_on();
+		if(ret != 0) {
+			lwsl_err("%s\n", strerror(ret));
+		}
+	} else if (strcmp(json_string_value(ledstate), "off") == 0) {
+		ret = led_off();
+		if(ret != 0) {
+			lwsl_err("%s\n", strerror(ret));
+		}
+	} else {
+		lwsl_err("THREAD_LED: ERROR unknown value \"%s\" to the key \"led\"\n", json_string_value(ledstate));
+	}
+
+done:
+	json_decref(root);
+}
+
+#if defined(SENSOR_EVENT_LOOP)
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Event loop mode: enable the OB1203 engines, then poll their data status
+ * once per call until the first conversion, the non-blocking counterpart
+ * of sensor_arm(). Returns 1 while warming up, 0 once armed and -1 on
+ * failure.
+ */
+
+static int
+sensor_warm_up(struct per_vhost_data__minimal *vhd, struct sensor_acq *acq, long now)
+{
+	if (!acq->warmup_start) {
+		if (sensor_enable(vhd, acq->ob1203, !ppg_mode))
+			goto fail;
+		acq->warmup_start = now;
+		acq->ls_ready = 0;
+		acq->ps_ready = ppg_mode;
+		return 1;
+	}
+
+	ob1203_queue_status(acq->ob1203_bus, acq->ob1203->address, &acq->ob1203_req,
+			    !ppg_mode, &acq->c_ls);
+	i2c_sched_flush(acq->ob1203_bus);
+	if (i2c_completion_wait(&acq->c_ls))
+		goto fail;
+
+	/* the "new data" flags clear on read, remember them */
+	acq->ls_ready |= acq->ob1203_req.ls_status & OB1203_STATUS_NEW_DATA;
+	if (!ppg_mode)
+		acq->ps_ready |= acq->ob1203_req.ps_status & OB1203_STATUS_NEW_DATA;
+
+	if (!acq->ls_ready || !acq->ps_ready) {
+		if ((now - acq->warmup_start) * LWS_US_PER_MS < OB1203_WARMUP_TIMEOUT)
+			return 1;
+		lwsl_err("THREAD_SENSOR: ERROR OB1203 data not ready after %ldms\n",
+			 now - acq->warmup_start);
+		goto fail;
+	}
+
+	lwsl_user("THREAD_SENSOR: sensors armed, warm-up %ldms\n", now - acq->warmup_start);
+	acq->warmup_start = 0;
+	acq->armed = 1;
+
+	return 0;
+
+fail:
+	lwsl_err("THREAD_SENSOR: ERROR failed to arm the OB1203 sensor\n");
+	acq->warmup_start = 0;
+	sensor_report(acq->ob1203_bus, &acq->health_ob1203, 0, now);
+
+	return -1;
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Event loop mode: the loop of thread_sensor as a state machine on an lws
+ * timer. Each step does what it can without blocking and schedules the
+ * next one: the standby after the grace period, the next warm-up poll,
+ * the end of the first HS3001 conversion or the next channel due. The I2C
+ * transfers are issued inline, a cycle is a couple of ms of bus time.
+ */
+
+static void
+sensor_step(lws_sorted_usec_list_t *sul)
+{
+	struct per_vhost_data__minimal *vhd = lws_container_of(sul,
+			struct per_vhost_data__minimal, acq.sul);
+	struct sensor_acq *acq = &vhd->acq;
+	struct timespec start_time;
+	long now, until;
+
+	vclock_gettime(CLOCK_MONOTONIC, &start_time);
+	now = start_time.tv_sec * LWS_US_PER_MS +
+	      start_time.tv_nsec / (LWS_US_PER_MS * LWS_NS_PER_US);
+
+	/* nothing to do if nobody connected nor may resume, no rule and no feed */
+	if (!ring_wanted(vhd) && !vhd->rules.count && !vhd->feed) {
+		if (!acq->idle) {
+			acq->idle = 1;
+			acq->idle_since = now;
+		}
+		sensor_acq_idle(acq);
+
+		/* as sensor_idle(), armed for standby_grace ms then standby */
+		if (!acq->armed && !acq->warmup_start)
+			return;
+		if (now - acq->idle_since < standby_grace) {
+			sensor_schedule(vhd, (lws_usec_t)(acq->idle_since + standby_grace - now) *
+					     LWS_US_PER_MS);
+			return;
+		}
+		sensor_standby(vhd);
+		acq->armed = 0;
+		acq->warmup_start = 0;
+		return;
+	}
+	acq->idle = 0;
+
+	/* woken up during the first HS3001 conversion, let it end */
+	if (acq->convert_until > now) {
+		sensor_schedule(vhd, (lws_usec_t)(acq->convert_until - now) * LWS_US_PER_MS);
+		return;
+	}
+
+	/* a sensor whose breaker is open is left alone until its next probe */
+	acq->hs3001_ok = sensor_health_allow(&acq->health_hs3001, now);
+	acq->ob1203_ok = sensor_health_allow(&acq->health_ob1203, now);
+
+	/* the sensors start in standby, armed on demand */
+	if (!acq->armed && acq->ob1203_ok && sensor_warm_up(vhd, acq, now) > 0) {
+		sensor_schedule(vhd, OB1203_WARMUP_POLL_TIME);
+		return;
+	}
+
+	/* a measurement is normally requested ahead, see sensor_cycle() */
+	if (hs3001_unprepared(vhd, acq, now)) {
+		hs3001_queue_measurement(acq->hs3001_bus, acq->hs3001->address,
+					 &acq->hs3001_req, &acq->c_hs3001);
+		i2c_sched_flush(acq->hs3001_bus);
+		if (!i2c_completion_wait(&acq->c_hs3001)) {
+			acq->hs3001_measuring = 1;
+			acq->hs3001_requested = align_now_ns();
+			acq->convert_until = now + HS3001_WAIT_TIME / LWS_US_PER_MS;
+			sensor_schedule(vhd, HS3001_WAIT_TIME);
+			return;
+		}
+	}
+
+	until = sensor_cycle(vhd, acq, &start_time);
+
+	vclock_gettime(CLOCK_MONOTONIC, &start_time);
+	now = start_time.tv_sec * LWS_US_PER_MS +
+	      start_time.tv_nsec / (LWS_US_PER_MS * LWS_NS_PER_US);
+	sensor_schedule(vhd, until > now ? (lws_usec_t)(until - now) * LWS_US_PER_MS : 1);
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Event loop mode: drain the PPG FIFO every PPG_POLL_INTERVAL ms.
+ */
+
+static void
+ppg_step(lws_sorted_usec_list_t *sul)
+{
+	struct per_vhost_data__minimal *vhd = lws_container_of(sul,
+			struct per_vhost_data__minimal, ppg.sul);
+
+	lws_sul_schedule(vhd->context, 0, &vhd->ppg.sul, ppg_step,
+			 vclock_real_us(PPG_POLL_INTERVAL * LWS_US_PER_MS));
+
+	ppg_drain(vhd);
+}
+
+#else
+
+/*
+ * This runs under the "sensor thread" thread context only.
+ *
+ * We spawn one thread that generate messages with this.
+ *
+ */
+
+static void *
+thread_sensor(void *d)
+{
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)d;
+	struct sensor_acq *acq = &vhd->acq;
+	struct timespec start_time;
+	long now, until;
+
+	TRACE_THREAD("sensor");
+
+	do {
+		vclock_gettime(CLOCK_MONOTONIC, &start_time);
+		now = start_time.tv_sec * LWS_US_PER_MS +
+		      start_time.tv_nsec / (LWS_US_PER_MS * LWS_NS_PER_US);
+
+		/* nothing to do if nobody connected nor may resume, no rule and no feed */
+		if (!ring_wanted(vhd) && !vhd->rules.count && !vhd->feed) {
+			acq->armed = sensor_idle(vhd, acq->armed);
+			sensor_acq_idle(acq);
+			continue;
+		}
+
+		/* a sensor whose breaker is open is left alone until its next probe */
+		acq->hs3001_ok = sensor_health_allow(&acq->health_hs3001, now);
+		acq->ob1203_ok = sensor_health_allow(&acq->health_ob1203, now);
+
+		/* the sensors start in standby, armed on demand */
+		if (!acq->armed && acq->ob1203_ok) {
+			if (!sensor_arm(vhd))
+				acq->armed = 1;
+			else
+				sensor_report(acq->ob1203_bus, &acq->health_ob1203, 0, now);
+		}
+
+		/*
+		 * The HS3001 measurement is requested by the last cycle before
+		 * temp and humm are due, only the first cycle after an idle
+		 * period or a shortened period waits for the conversion.
+		 */
+		if (hs3001_unprepared(vhd, acq, now)) {
+			hs3001_queue_measurement(acq->hs3001_bus, acq->hs3001->address,
+						 &acq->hs3001_req, &acq->c_hs3001);
+			i2c_sched_flush(acq->hs3001_bus);
+			if (!i2c_completion_wait(&acq->c_hs3001)) {
+				TRACE_BEGIN(conversion);
+				acq->hs3001_measuring = 1;
+				acq->hs3001_requested = align_now_ns();
+				vclock_usleep(HS3001_WAIT_TIME);
+				TRACE_END(conversion, "hs3001 conversion sleep");
+			}
+		}
+
+		until = sensor_cycle(vhd, acq, &start_time);
+
+		sensor_sleep(vhd, until);
+
+	} while (!vhd->finished);
+
+	lwsl_notice("thread_spam %p exiting\n", (void *)pthread_self());
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/*
+ * This runs under the "ppg thread" thread context only.
+ *
+ * We spawn one thread that drains the OB1203 PPG FIFO with this when the
+ * PPG mode is enabled, and queues the samples as binary batches.
+ */
+
+static void *
+thread_ppg(void *d)
+{
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)d;
+	struct timespec start_time;
+	struct timespec end_time;
+	long tmp_start_time = 0, tmp_end_time = 0, diff_time = 0;
+
+	TRACE_THREAD("ppg");
+
+	if (ppg_enable(vhd)) {
+		pthread_exit(NULL);
+		return NULL;
+	}
+
+	do {
+		vclock_gettime(CLOCK_MONOTONIC, &start_time);
+
+		ppg_drain(vhd);
+
+		vclock_gettime(CLOCK_MONOTONIC, &end_time);
+
+		tmp_start_time = start_time.tv_sec * (LWS_US_PER_SEC * LWS_NS_PER_US) + start_time.tv_nsec;
+		tmp_end_time = end_time.tv_sec * (LWS_US_PER_SEC * LWS_NS_PER_US) + end_time.tv_nsec;
+
+		diff_time = (PPG_POLL_INTERVAL * LWS_US_PER_MS) - ((tmp_end_time - tmp_start_time) / LWS_NS_PER_US);
+
+		if (diff_time > 0) {
+			TRACE_BEGIN(sleep);
+			vclock_usleep(diff_time);
+			TRACE_END(sleep, "ppg sleep");
+		}
+
+	} while (!vhd->finished);
+
+	lwsl_notice("thread_ppg %p exiting\n", (void *)pthread_self());
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/*
+ * This runs under the "led thread" thread context only.
+ *
+ * We spawn one thread that controll led's GPIO.
+ *
+ */
+
+static void *
+thread_led(void *d)
+{
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)d;
+	const struct msg *pmsg;
+	struct msg amsg;
+
+	TRACE_THREAD("led");
+
+	do {
+		TRACE_LOCK(&vhd->lock_ring_receive, "lock_ring_receive"); /* --------- ring lock { */
+
+		for (;;) {
+			pmsg = lws_ring_get_element(vhd->ring_receive, &vhd->tail_receive);
+			if (pmsg) {
+				break;
+			} else if (vhd->finished) {
+				break;
+			}
+
+			pthread_cond_wait(&vhd->cond_wake_receive, &vhd->lock_ring_receive);
+		}
+
+		if (vhd->finished) {
+			break;
+		}
+
+		amsg.len = pmsg->len;
+		amsg.payload = malloc(LWS_PRE + amsg.len);
+		if (!amsg.payload) {
+			lwsl_user("THREAD_LED: OOM: dropping\n");
+			pthread_mutex_unlock(&vhd->lock_ring_receive); /* } ring lock ------- */
+			continue;
+		}
+		memcpy(amsg.payload + LWS_PRE, pmsg->payload + LWS_PRE, amsg.len);
+
+		lws_ring_consume(
+			vhd->ring_receive,	/* lws_ring object */
+			&vhd->tail_receive,	/* tail of guy doing the consuming */
+			NULL,			/* no destination but just delete */
+			1			/* number of payload objects being consumed */
+		);
+		lws_ring_update_oldest_tail(
+			vhd->ring_receive,	/* lws_ring object */
+			vhd->tail_receive	/* single tail */
+		);
+
+		pthread_mutex_unlock(&vhd->lock_ring_receive); /* } ring lock ------- */
+
+		apply_command(vhd, (char *)amsg.payload + LWS_PRE, amsg.len);
+		free(amsg.payload);
+
+	} while (!vhd->finished);
+
+	lwsl_notice("thread_led %p exiting\n", (void *)pthread_self());
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+#endif
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * Send the next PPG batch to a subscribed session. Sessions that are not
+ * subscribed just skip all the pending batches.
+ */
+
+static int
+send_ppg(struct per_vhost_data__minimal *vhd,
+	 struct per_session_data__minimal *pss)
+{
+	const struct msg *pmsg;
+	size_t count = 1;
+	int m;
+
+	pmsg = lws_ring_get_element(vhd->ring_ppg, &pss->tail_ppg);
+	if (!pmsg)
+		return 0;
+
+	if (pss->ppg) {
+		TRACE_BEGIN(write);
+		m = lws_write(pss->wsi, ((unsigned char *)pmsg->payload) + LWS_PRE,
+			      pmsg->len, LWS_WRITE_BINARY);
+		TRACE_END(write, "lws_write ppg");
+		if (m < (int)pmsg->len) {
+			lwsl_err("ERROR %d writing to ws socket\n", m);
+			return -1;
+		}
+	} else
+		count = lws_ring_get_count_waiting_elements(vhd->ring_ppg,
+							    &pss->tail_ppg);
+
+	lws_ring_consume_and_update_oldest_tail(
+		vhd->ring_ppg,	/* lws_ring object */
+		struct per_session_data__minimal, /* type of objects with tails */
+		&pss->tail_ppg,	/* tail of guy doing the consuming */
+		count,		/* number of payload objects being consumed */
+		vhd->pss_list,	/* head of list of objects with tails */
+		tail_ppg,	/* member name of tail in objects with tails */
+		pss_list	/* member name of next object in objects with tails */
+	);
+
+	return 0;
+}
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * The same for the triggered captures, one binary message each.
+ */
+
+static int
+send_capture(struct per_vhost_data__minimal *vhd,
+	     struct per_session_data__minimal *pss)
+{
+	const struct msg *pmsg;
+	size_t count = 1;
+	int m;
+
+	pmsg = lws_ring_get_element(vhd->ring_capture, &pss->tail_capture);
+	if (!pmsg)
+		return 0;
+
+	if (pss->capture) {
+		TRACE_BEGIN(write);
+		m = lws_write(pss->wsi, ((unsigned char *)pmsg->payload) + LWS_PRE,
+			      pmsg->len, LWS_WRITE_BINARY);
+		TRACE_END(write, "lws_write capture");
+		if (m < (int)pmsg->len) {
+			lwsl_err("ERROR %d writing to ws socket\n", m);
+			return -1;
+		}
+	} else
+		count = lws_ring_get_count_waiting_elements(vhd->ring_capture,
+							    &pss->tail_capture);
+
+	lws_ring_consume_and_update_oldest_tail(
+		vhd->ring_capture,
+		struct per_session_data__minimal,
+		&pss->tail_capture,
+		count,
+		vhd->pss_list,
+		tail_capture,
+		pss_list
+	);
+
+	return 0;
+}
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * Get the next message of the sample ring for a session, the ones of the
+ * topics it unsubscribed from are consumed on the way. NULL if none waits.
+ */
+
+static const struct msg *
+session_next(struct per_vhost_data__minimal *vhd,
+	     struct per_session_data__minimal *pss)
+{
+	const struct msg *pmsg;
+
+	while ((pmsg = lws_ring_get_element(vhd->ring, &pss->tail)) &&
+	       (pss->muted & (1 << pmsg->topic)))
+		lws_ring_consume_and_update_oldest_tail(
+			vhd->ring,
+			struct per_session_data__minimal,
+			&pss->tail,
+			1,
+			vhd->pss_list,
+			tail,
+			pss_list
+		);
+
+	return pmsg;
+}
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * Account the message a session just wrote and consume it.
+ */
+
+static void
+session_sent(struct per_vhost_data__minimal *vhd,
+	     struct per_session_data__minimal *pss, const struct msg *pmsg)
+{
+	lws_usec_t lat;
+
+	pss->sent++;
+
+	if (pmsg->queued) {
+		lat = lws_now_usecs() - pmsg->queued;
+		vhd->latency_count++;
+		vhd->latency_sum += lat;
+		if (lat > vhd->latency_max)
+			vhd->latency_max = lat;
+	}
+
+	lws_ring_consume_and_update_oldest_tail(
+		vhd->ring,	/* lws_ring object */
+		struct per_session_data__minimal, /* type of objects with tails */
+		&pss->tail,	/* tail of guy doing the consuming */
+		1,		/* number of payload objects being consumed */
+		vhd->pss_list,	/* head of list of objects with tails */
+		tail,		/* member name of tail in objects with tails */
+		pss_list	/* member name of next object in objects with tails */
+	);
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * The ring only frees a message once every session wrote it. A session
+ * lagging more than half the ring skips the samples up to the newest one,
+ * the latest value wins, so one stalled browser doesn't make thread_sensor
+ * drop the samples of all the others. The skip stops at the first message
+ * no newer one supersedes, an event say, unless the session lags more than
+ * 3/4 of the ring: those are then skipped too and accounted as lost. With
+ * --max-lag a session which couldn't write its pending messages for that
+ * long is closed.
+ */
+
+static void
+session_skip(struct per_vhost_data__minimal *vhd,
+	     struct per_session_data__minimal *pss, uint32_t count, int lose)
+{
+	const struct msg *pmsg;
+	uint32_t tail = pss->tail, n;
+
+	for (n = 0; n < count; n++) {
+		pmsg = lws_ring_get_element(vhd->ring, &tail);
+		if (!pmsg)
+			break;
+		if (!((1 << pmsg->topic) & (TOPICS_SUPERSEDED | pss->muted))) {
+			if (!lose)
+				break;
+			pss->lost++;
+		}
+		lws_ring_consume(vhd->ring, &tail, NULL, 1);
+	}
+
+	if (!n)
+		return;
+
+	pss->skipped += n;
+	lws_ring_consume_and_update_oldest_tail(
+		vhd->ring,
+		struct per_session_data__minimal,
+		&pss->tail,
+		n,
+		vhd->pss_list,
+		tail,
+		pss_list
+	);
+}
+
+static void
+sessions_check_lag(struct per_vhost_data__minimal *vhd)
+{
+	struct per_session_data__minimal *pss;
+	lws_usec_t now = lws_now_usecs();
+	uint32_t lag;
+
+	TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+	lws_start_foreach_llp(struct per_session_data__minimal **,
+			      ppss, vhd->pss_list) {
+		pss = *ppss;
+
+		lag = (uint32_t)lws_ring_get_count_waiting_elements(vhd->ring, &pss->tail);
+		if (lag > pss->max_lag)
+			pss->max_lag = lag;
+		if (lag && !pss->pending_since)
+			pss->pending_since = now;
+
+		if (lag > vhd->ring_elements / 2) {
+			if (!pss->skipped)
+				lwsl_notice("%s: session %u lagging, skipping to the newest sample\n",
+					    __func__, pss->id);
+			session_skip(vhd, pss, lag - 1, lag > vhd->ring_elements * 3 / 4);
+		}
+
+		if (max_lag && pss->pending_since && !pss->closing &&
+		    now - pss->pending_since > (lws_usec_t)max_lag * LWS_US_PER_MS) {
+			lwsl_notice("%s: session %u stalled for %dms, closing\n",
+				    __func__, pss->id, max_lag);
+			pss->closing = 1;
+			lws_set_timeout(pss->wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+		}
+	} lws_end_foreach_llp(ppss, pss_list);
+
+	pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Schedule a writable callback for all the connected clients, after
+ * skipping the lagging ones to the newest sample.
+ */
+
+static void
+sessions_writable(struct per_vhost_data__minimal *vhd)
+{
+	sessions_check_lag(vhd);
+
+	lws_start_foreach_llp(struct per_session_data__minimal **,
+			      ppss, vhd->pss_list) {
+		lws_callback_on_writable((*ppss)->wsi);
+	} lws_end_foreach_llp(ppss, pss_list);
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Format the ring and per session counters served on /stats, returns a
+ * malloc'd buffer with LWS_PRE bytes before the JSON.
+ */
+
+static char *
+sessions_stats(struct per_vhost_data__minimal *vhd, size_t *len)
+{
+	struct per_session_data__minimal *pss;
+	struct i2c_sched_stats total, last;
+	lws_usec_t now = lws_now_usecs();
+	char peer[64], *buf, *p, *end;
+	struct rusage ru;
+	size_t size = 800 + vhd->i2c_count * STATS_I2C_LEN;
+	int n = 0;
+
+	lws_start_foreach_llp(struct per_session_data__minimal **,
+			      ppss, vhd->pss_list) {
+		size += STATS_SESSION_LEN;
+	} lws_end_foreach_llp(ppss, pss_list);
+
+	buf = malloc(LWS_PRE + size);
+	if (!buf)
+		return NULL;
+	p = buf + LWS_PRE;
+	end = p + size;
+
+	/* the CPU time and context switches of the whole server, all threads */
+	getrusage(RUSAGE_SELF, &ru);
+	p += lws_snprintf(p, lws_ptr_diff(end, p),
+			  "{\"mode\":\"%s\",\"cpu\":{\"user_ms\":%ld,\"system_ms\":%ld,"
+			  "\"voluntary_switches\":%ld,\"involuntary_switches\":%ld},"
+			  "\"latency_us\":{\"messages\":%llu,\"mean\":%llu,\"max\":%llu},"
+			  "\"deflate\":{\"default\":%d,\"messages\":%llu,\"uncompressed\":%llu,"
+			  "\"in\":%llu,\"out\":%llu,\"ratio\":%.3f,\"busy_us\":%llu,"
+			  "\"us_per_kb\":%.1f},",
+			  ACQUISITION_MODE,
+			  (long)(ru.ru_utime.tv_sec * LWS_US_PER_MS + ru.ru_utime.tv_usec / LWS_US_PER_MS),
+			  (long)(ru.ru_stime.tv_sec * LWS_US_PER_MS + ru.ru_stime.tv_usec / LWS_US_PER_MS),
+			  ru.ru_nvcsw, ru.ru_nivcsw,
+			  (unsigned long long)vhd->latency_count,
+			  (unsigned long long)(vhd->latency_count ?
+				vhd->latency_sum / vhd->latency_count : 0),
+			  (unsigned long long)vhd->latency_max,
+			  deflate_default, (unsigned long long)vhd->deflate_messages,
+			  (unsigned long long)vhd->deflate_raw,
+			  (unsigned long long)vhd->deflate_in,
+			  (unsigned long long)vhd->deflate_out,
+			  vhd->deflate_in ? (double)vhd->deflate_out / vhd->deflate_in : 1.0,
+			  (unsigned long long)vhd->deflate_busy,
+			  vhd->deflate_in ? vhd->deflate_busy * 1024.0 / vhd->deflate_in : 0.0);
+
+	/* the transfers of each bus since the start, and of its last flush */
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "\"i2c\":[");
+	for (n = 0; n < vhd->i2c_count; n++) {
+		i2c_sched_get_stats(&vhd->i2c[n], &total, &last);
+		p += lws_snprintf(p, lws_ptr_diff(end, p),
+				  "%s{\"bus\":\"%s\",\"flushes\":%lu,\"syscalls\":%lu,"
+				  "\"requests\":%lu,\"msgs\":%lu,\"bus_bits\":%lu,"
+				  "\"busy_us\":%ld,\"isolated\":%lu,\"unreplayed\":%lu,"
+				  "\"recoveries\":%lu,"
+				  "\"last\":{\"syscalls\":%lu,\"requests\":%lu,\"msgs\":%lu,"
+				  "\"bus_bits\":%lu,\"busy_us\":%ld,\"isolated\":%lu,"
+				  "\"unreplayed\":%lu}}",
+				  n ? "," : "", vhd->sensors.buses[n], total.cycles,
+				  total.syscalls, total.requests, total.msgs, total.bus_bits,
+				  (long)(total.busy_ns / LWS_NS_PER_US), total.isolated,
+				  total.unreplayed, total.recoveries,
+				  last.syscalls, last.requests, last.msgs, last.bus_bits,
+				  (long)(last.busy_ns / LWS_NS_PER_US), last.isolated,
+				  last.unreplayed);
+	}
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "],");
+	n = 0;
+
+	TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p),
+			  "\"ring\":{\"elements\":%u,\"waiting\":%u,\"dropped\":%llu,"
+			  "\"published\":%llu,\"epoch\":%llu},"
+			  "\"history\":{\"size\":%zu,\"bytes\":%zu,\"first\":%llu,"
+			  "\"messages\":%llu,\"resumed\":%llu,\"gaps\":%llu},"
+			  "\"max_lag\":%d,\"sessions\":[",
+			  vhd->ring_elements,
+			  (unsigned int)lws_ring_get_count_waiting_elements(vhd->ring, NULL),
+			  (unsigned long long)vhd->dropped,
+			  (unsigned long long)vhd->published,
+			  (unsigned long long)vhd->epoch,
+			  vhd->history.size, vhd->history.used,
+			  (unsigned long long)vhd->history.first,
+			  (unsigned long long)(vhd->history.next - vhd->history.first),
+			  (unsigned long long)vhd->resumed,
+			  (unsigned long long)vhd->resume_gaps, max_lag);
+
+	lws_start_foreach_llp(struct per_session_data__minimal **,
+			      ppss, vhd->pss_list) {
+		pss = *ppss;
+		peer[0] = '\0';
+		lws_get_peer_simple(pss->wsi, peer, sizeof(peer));
+		p += lws_snprintf(p, lws_ptr_diff(end, p),
+				  "%s{\"id\":%u,\"peer\":\"%s\",\"lag\":%u,\"max_lag\":%u,"
+				  "\"sent\":%llu,\"skipped\":%llu,\"lost\":%llu,\"stalled_ms\":%llu,"
+				  "\"deflate\":%d,\"transport\":\"%s\",\"muted\":%u}",
+				  n++ ? "," : "", pss->id, peer,
+				  (unsigned int)lws_ring_get_count_waiting_elements(vhd->ring, &pss->tail),
+				  pss->max_lag, (unsigned long long)pss->sent,
+				  (unsigned long long)pss->skipped, (unsigned long long)pss->lost,
+				  (unsigned long long)(pss->pending_since ?
+					(now - pss->pending_since) / LWS_US_PER_MS : 0),
+				  pss->deflate ? pss->deflate_min : DEFLATE_OFF,
+				  pss->sse ? "sse" : "ws", pss->muted);
+	} lws_end_foreach_llp(ppss, pss_list);
+
+	pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "]}");
+	*len = lws_ptr_diff(p, buf + LWS_PRE);
+
+	return buf;
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Format the channel statistics served on /stats/channels, returns a
+ * malloc'd buffer with LWS_PRE bytes before the JSON.
+ */
+
+static char *
+channels_stats(struct per_vhost_data__minimal *vhd, size_t *len)
+{
+	char *buf;
+
+	buf = malloc(LWS_PRE + STATS_SUMMARY_LEN);
+	if (!buf)
+		return NULL;
+
+	pthread_mutex_lock(&vhd->lock_rolling); /* --------- rolling lock { */
+	*len = rolling_stats_json(vhd, sampling_now_ms(),
+				  buf + LWS_PRE, STATS_SUMMARY_LEN);
+	pthread_mutex_unlock(&vhd->lock_rolling); /* } rolling lock ------- */
+
+	return buf;
+}
+
+#if defined(SENSOR_TRACE)
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Dump the trace events served on /stats/trace, returns a malloc'd buffer
+ * with LWS_PRE bytes before the JSON.
+ */
+
+static char *
+trace_stats(size_t *len)
+{
+	char pre[LWS_PRE] = { 0 };
+	char *buf = NULL;
+	size_t size;
+	FILE *fp;
+	int ret;
+
+	fp = open_memstream(&buf, &size);
+	if (!fp)
+		return NULL;
+
+	fwrite(pre, 1, sizeof(pre), fp);
+	ret = trace_dump(fp);
+	if (fclose(fp) || ret) {
+		free(buf);
+		return NULL;
+	}
+
+	*len = size - LWS_PRE;
+
+	return buf;
+}
+#endif
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Gateway mode: (re)connect to an upstream board, and schedule the next
+ * attempt with an exponential backoff, jittered so the boards lost at
+ * the same time aren't all retried at the same time.
+ */
+
+static void
+upstream_retry(struct upstream *up);
+
+static void
+upstream_connect(lws_sorted_usec_list_t *sul)
+{
+	struct upstream *up = lws_container_of(sul, struct upstream, sul);
+	struct lws_client_connect_info i;
+
+	up->retrying = 0;
+
+	memset(&i, 0, sizeof(i));
+	i.context = up->vhd->context;
+	i.vhost = up->vhd->vhost;
+	i.address = up->board.address;
+	i.port = up->board.port;
+	i.path = up->board.path;
+	i.host = up->board.address;
+	i.origin = up->board.address;
+	i.protocol = "graph-update";
+	i.local_protocol_name = "graph-update";
+	i.opaque_user_data = up;
+	i.pwsi = &up->wsi;
+
+	lwsl_user("GATEWAY: %s: connecting to %s:%d\n", up->board.id,
+		  up->board.address, up->board.port);
+
+	if (!lws_client_connect_via_info(&i)) {
+		up->wsi = NULL;
+		upstream_retry(up);
+	}
+}
+
+static void
+upstream_retry(struct upstream *up)
+{
+	int delay;
+
+	/*
+	 * A connection failing at once is also reported to the callback, by
+	 * then the retry is scheduled already.
+	 */
+	if (up->vhd->finished || up->retrying)
+		return;
+
+	up->retrying = 1;
+	delay = up->backoff + rand() % (up->backoff / 4 + 1);
+	up->backoff *= 2;
+	if (up->backoff > UPSTREAM_BACKOFF_MAX)
+		up->backoff = UPSTREAM_BACKOFF_MAX;
+
+	lwsl_user("GATEWAY: %s: reconnecting in %dms\n", up->board.id, delay);
+
+	lws_sul_schedule(up->vhd->context, 0, &up->sul, upstream_connect,
+			 (lws_usec_t)delay * LWS_US_PER_MS);
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Gateway mode: tag the message just reassembled from a board with its
+ * id and broadcast it through the same ring as the local samples.
+ */
+
+static void
+upstream_publish(struct per_vhost_data__minimal *vhd, struct upstream *up)
+{
+	struct msg amsg;
+	char tag[GATEWAY_ID_MAX + 16];
+	const char *rx = up->rx;
+	size_t rx_len = up->rx_len;
+	int n;
+
+	/* {"temp":...} becomes {"board":"<id>","temp":...} */
+	if (rx_len < 2 || rx[0] != '{') {
+		lwsl_err("GATEWAY: %s: ERROR unexpected message\n", up->board.id);
+		return;
+	}
+
+	/* the board's seq and epoch are its own, the message gets ours */
+	n = message_stamp(rx, rx_len);
+	rx += n;
+	rx_len -= n;
+
+	n = lws_snprintf(tag, sizeof(tag), "{\"board\":\"%s\",", up->board.id);
+
+	amsg.len = n + rx_len - 1;
+	amsg.payload = malloc(RING_PRE + amsg.len);
+	if (!amsg.payload) {
+		lwsl_user("GATEWAY: OOM: dropping\n");
+		return;
+	}
+	memcpy((char *)amsg.payload + RING_PRE, tag, n);
+	memcpy((char *)amsg.payload + RING_PRE + n, rx + 1, rx_len - 1);
+
+	n = ring_insert(vhd, &amsg);
+	if (n < 0)
+		lwsl_user("GATEWAY: dropping!\n");
+	else if (n)
+		sessions_writable(vhd);
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Gateway mode: forward a command of a client to the board named by its
+ * "board" member, or to every board without one. The commands changing
+ * the state of a board need its name, a page showing one board must not
+ * change the others. The commands wait in the upstream ring while the
+ * board is disconnected.
+ */
+
+static const char * const upstream_board_only[] = { "sampling", "rules", "led" };
+
+static void
+upstream_forward(struct per_vhost_data__minimal *vhd, const void *in, size_t len)
+{
+	struct upstream *up;
+	struct msg amsg;
+	const char *board = NULL;
+	json_t *root;
+	json_t *value;
+	int n;
+
+	root = json_loadb(in, len, 0, NULL);
+	value = json_object_get(root, "board");
+	if (json_is_string(value))
+		board = json_string_value(value);
+
+	for (n = 0; !board && n < (int)LWS_ARRAY_SIZE(upstream_board_only); n++)
+		if (json_object_get(root, upstream_board_only[n])) {
+			lwsl_warn("GATEWAY: \"%s\" without \"board\": dropping command\n",
+				  upstream_board_only[n]);
+			json_decref(root);
+			return;
+		}
+
+	for (n = 0; n < vhd->upstream_count; n++) {
+		up = &vhd->upstreams[n];
+		if (board && strcmp(board, up->board.id))
+			continue;
+
+		amsg.len = len;
+		amsg.payload = malloc(LWS_PRE + len);
+		if (!amsg.payload) {
+			lwsl_user("GATEWAY: OOM: dropping\n");
+			break;
+		}
+		memcpy((char *)amsg.payload + LWS_PRE, in, len);
+
+		if (!lws_ring_get_count_free_elements(up->ring_tx) ||
+		    lws_ring_insert(up->ring_tx, &amsg, 1) != 1) {
+			__minimal_destroy_message(&amsg);
+			lwsl_user("GATEWAY: %s: dropping command\n", up->board.id);
+			continue;
+		}
+
+		if (up->wsi)
+			lws_callback_on_writable(up->wsi);
+	}
+
+	json_decref(root);
+}
+
+/*
+ * Format the event of a message in buf, a data line per line of the
+ * message. Returns its length, or -1 if it doesn't fit.
+ */
+
+static int
+sse_event(char *buf, size_t size, uint64_t epoch, uint64_t seq,
+	  const char *data, size_t len)
+{
+	const char *data_end = data + len, *q;
+	char *p = buf, *end = buf + size;
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "id: %llu-%llu\n",
+			  (unsigned long long)epoch, (unsigned long long)seq);
+
+	while (data < data_end) {
+		q = memchr(data, '\n', lws_ptr_diff(data_end, data));
+		if (!q)
+			q = data_end;
+		if (lws_ptr_diff(end, p) < lws_ptr_diff(q, data) + 8)
+			return -1;
+		memcpy(p, "data: ", 6);
+		memcpy(p + 6, data, lws_ptr_diff(q, data));
+		p += 6 + lws_ptr_diff(q, data);
+		*p++ = '\n';
+		data = q + 1;
+	}
+	*p++ = '\n';
+
+	return lws_ptr_diff(p, buf);
+}
+
+/* the room sse_event() needs for a message */
+
+static size_t
+sse_event_size(const char *data, size_t len)
+{
+	const char *q = data;
+	size_t lines = 1;
+
+	while ((q = memchr(q, '\n', lws_ptr_diff(data + len, q)))) {
+		lines++;
+		q++;
+	}
+
+	/* "id: <epoch>-<seq>\n", "data: <line>\n" each and the blank line */
+	return 48 + len + 7 * lines;
+}
+
+/*
+ * A resume token, "<epoch>-<seq>" of the last message a client received,
+ * or just its seq in this run. Returns -1 if invalid.
+ */
+
+static int
+resume_token(struct per_vhost_data__minimal *vhd, const char *token,
+	     uint64_t *epoch, uint64_t *last)
+{
+	char *end;
+
+	*epoch = vhd->epoch;
+	*last = strtoull(token, &end, 10);
+	if (end != token && *end == '-') {
+		*epoch = *last;
+		token = end + 1;
+		*last = strtoull(token, &end, 10);
+	}
+
+	return end == token || *end ? -1 : 0;
+}
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * Start a session resuming after the message last of the run epoch: it
+ * skips the messages in the ring, the ones it missed come from the
+ * history, in one frame written before anything else
+ *
+ *   {"resume":{"epoch":E,"from":F,"to":T},"messages":[...]}
+ *
+ * with the messages F to T, none if T < F, but those of its muted topics.
+ * "gap":{"from":A,"to":B} is added when the messages A to B are lost, and
+ * "restarted":true for a client of an earlier run, which gets the whole
+ * history of this one. An event stream gets a "resume" event with the
+ * same header, then the events of the messages.
+ *
+ * Without history, the session only skips the messages of the ring it
+ * received already.
+ */
+
+static void
+session_resume(struct per_vhost_data__minimal *vhd,
+	       struct per_session_data__minimal *pss, uint64_t epoch, uint64_t last)
+{
+	const struct history_entry *e;
+	const struct msg *pmsg;
+	uint64_t from, seq, gap = 0;
+	int restarted = epoch != vhd->epoch;
+	size_t size = RESUME_HEADER_MAX;
+	char *start, *p, *end;
+	int n = 0, m;
+
+	if (restarted || last > vhd->published)
+		last = 0;
+
+	if (!vhd->history.buf) {
+		while ((pmsg = lws_ring_get_element(vhd->ring, &pss->tail)) &&
+		       pmsg->seq <= last)
+			lws_ring_consume_and_update_oldest_tail(
+				vhd->ring,
+				struct per_session_data__minimal,
+				&pss->tail,
+				1,
+				vhd->pss_list,
+				tail,
+				pss_list
+			);
+		return;
+	}
+
+	lws_ring_consume_and_update_oldest_tail(
+		vhd->ring,
+		struct per_session_data__minimal,
+		&pss->tail,
+		lws_ring_get_count_waiting_elements(vhd->ring, &pss->tail),
+		vhd->pss_list,
+		tail,
+		pss_list
+	);
+
+	from = last + 1;
+	if (from < vhd->history.first) {
+		gap = vhd->history.first - 1;
+		from = vhd->history.first;
+	}
+
+	for (seq = from; seq <= vhd->published; seq++) {
+		e = history_get(&vhd->history, seq);
+		if (e && !(pss->muted & (1 << e->tag)))
+			size += pss->sse ? sse_event_size(history_data(&vhd->history, e), e->len) :
+					   e->len + 1;
+	}
+
+	pss->resume = malloc(LWS_PRE + size);
+	if (!pss->resume) {
+		lwsl_err("%s: OOM, session %u resumes without its missed messages\n",
+			 __func__, pss->id);
+		return;
+	}
+	start = p = (char *)pss->resume + LWS_PRE;
+	end = p + size;
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p),
+			  "%s{\"resume\":{\"epoch\":%llu,\"from\":%llu,\"to\":%llu",
+			  pss->sse ? "event: resume\ndata: " : "",
+			  (unsigned long long)vhd->epoch, (unsigned long long)from,
+			  (unsigned long long)vhd->published);
+	if (gap)
+		p += lws_snprintf(p, lws_ptr_diff(end, p),
+				  ",\"gap\":{\"from\":%llu,\"to\":%llu}",
+				  (unsigned long long)(last + 1), (unsigned long long)gap);
+	if (restarted)
+		p += lws_snprintf(p, lws_ptr_diff(end, p), ",\"restarted\":true");
+	p += lws_snprintf(p, lws_ptr_diff(end, p), pss->sse ? "}}\n\n" : "},\"messages\":[");
+
+	for (seq = from; seq <= vhd->published; seq++) {
+		e = history_get(&vhd->history, seq);
+		if (!e || (pss->muted & (1 << e->tag)))
+			continue;
+		if (pss->sse) {
+			m = sse_event(p, lws_ptr_diff(end, p), vhd->epoch, seq,
+				      history_data(&vhd->history, e), e->len);
+			if (m < 0)
+				lwsl_err("%s: event %llu too long, skipped\n", __func__,
+					 (unsigned long long)seq);
+			else
+				p += m;
+			continue;
+		}
+		if (n++)
+			*p++ = ',';
+		memcpy(p, history_data(&vhd->history, e), e->len);
+		p += e->len;
+	}
+
+	if (!pss->sse)
+		p += lws_snprintf(p, lws_ptr_diff(end, p), "]}");
+	pss->resume_len = lws_ptr_diff(p, start);
+
+	vhd->resumed++;
+	if (gap)
+		vhd->resume_gaps++;
+	lwsl_notice("%s: session %u resumed after %llu, %llu to %llu%s\n", __func__,
+		    pss->id, (unsigned long long)last, (unsigned long long)from,
+		    (unsigned long long)vhd->published, gap ? " with a gap" : "");
+}
+
+/*
+ * This runs under the lws service thread context only, with lock_ring held.
+ *
+ * Write the resume frame of a session, before the messages of the ring
+ * which follow it. Returns -1 on error.
+ */
+
+static int
+session_write_resume(struct per_session_data__minimal *pss)
+{
+	int m;
+
+	TRACE_BEGIN(write);
+	m = lws_write(pss->wsi, (unsigned char *)pss->resume + LWS_PRE, pss->resume_len,
+		      pss->sse ? LWS_WRITE_HTTP : LWS_WRITE_TEXT);
+	TRACE_END(write, "lws_write resume");
+
+	free(pss->resume);
+	pss->resume = NULL;
+
+	if (m < (int)pss->resume_len) {
+		lwsl_err("ERROR %d writing the resume frame\n", m);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Subscribe a session to the PPG batches, the captures or to a topic of
+ * the sample ring, or unsubscribe it. Returns 1 if name is one of them.
+ */
+
+static int
+session_subscribe(struct per_vhost_data__minimal *vhd,
+		  struct per_session_data__minimal *pss, const char *name, int on)
+{
+	int topic;
+
+	if (!strcmp(name, "ppg")) {
+		if (on && !pss->ppg)
+			vhd->ppg_subscribers++;
+		if (!on && pss->ppg)
+			vhd->ppg_subscribers--;
+		pss->ppg = (char)on;
+		return 1;
+	}
+
+	if (!strcmp(name, "capture")) {
+		if (on && !pss->capture)
+			vhd->capture_subscribers++;
+		if (!on && pss->capture)
+			vhd->capture_subscribers--;
+		pss->capture = (char)on;
+		return 1;
+	}
+
+	topic = topic_lookup(name, strlen(name));
+	if (topic < 0)
+		return 0;
+
+	if (on)
+		pss->muted &= (uint8_t)~(1 << topic);
+	else
+		pss->muted |= (uint8_t)(1 << topic);
+
+	return 1;
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Handle the commands that only concern the sending session, such as
+ * {"subscribe": "ppg"} or {"unsubscribe": "stats"}. Returns 1 if the
+ * message was one of them.
+ */
+
+static int
+session_command(struct per_vhost_data__minimal *vhd,
+		struct per_session_data__minimal *pss, const void *in, size_t len)
+{
+	json_t *root;
+	json_t *value;
+	int handled = 0;
+
+	root = json_loadb(in, len, 0, NULL);
+	if (!json_is_object(root)) {
+		json_decref(root);
+		return 0;
+	}
+
+	value = json_object_get(root, "subscribe");
+	if (json_is_string(value))
+		handled |= session_subscribe(vhd, pss, json_string_value(value), 1);
+
+	value = json_object_get(root, "unsubscribe");
+	if (json_is_string(value))
+		handled |= session_subscribe(vhd, pss, json_string_value(value), 0);
+
+	/* the capture triggered is sent to the requesting session too */
+	value = json_object_get(root, "capture");
+	if (json_is_string(value) && !strcmp(json_string_value(value), "trigger")) {
+		if (vhd->capture) {
+			session_subscribe(vhd, pss, "capture", 1);
+			TRACE_LOCK(&vhd->lock_capture, "lock_capture"); /* --------- capture lock { */
+			capture_force(vhd->capture);
+			pthread_mutex_unlock(&vhd->lock_capture); /* } capture lock ------- */
+		} else
+			lwsl_notice("%s: no capture, see --capture\n", __func__);
+		handled = 1;
+	}
+
+	json_decref(root);
+
+	return handled;
+}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * Apply the memory bounds to the compressor of a session, lws creates it
+ * on the first message compressed. These server side settings need no
+ * agreement from the client: a stream not reusing the previous messages,
+ * or using a smaller window, inflates the same.
+ */
+
+static void
+deflate_configure(struct lws *wsi)
+{
+	char bits[4];
+
+	if (deflate_no_takeover)
+		lws_set_extension_option(wsi, "permessage-deflate",
+					 "server_no_context_takeover", "1");
+
+	if (deflate_window_bits) {
+		lws_snprintf(bits, sizeof(bits), "%d", deflate_window_bits);
+		lws_set_extension_option(wsi, "permessage-deflate",
+					 "server_max_window_bits", bits);
+		/* zlib sizes its hash table like the window at mem_level bits - 7 */
+		lws_snprintf(bits, sizeof(bits), "%d", deflate_window_bits - 7);
+		lws_set_extension_option(wsi, "permessage-deflate",
+					 "mem_level", bits);
+	}
+}
+
+/* this runs under the lws service thread context only */
+
+static int
+callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
+			void *user, void *in, size_t len)
+{
+	struct per_session_data__minimal *pss =
+			(struct per_session_data__minimal *)user;
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)
+			lws_protocol_vh_priv_get(lws_get_vhost(wsi),
+					lws_get_protocol(wsi));
+	const struct lws_protocol_vhost_options *pvo;
+	const struct msg *pmsg;
+#if !defined(SENSOR_EVENT_LOOP)
+	struct msg amsg;
+#endif
+	struct gateway_config *gw = NULL;
+	struct upstream *up;
+	pthread_condattr_t cattr;
+	struct timespec ts;
+	uint64_t epoch, last;
+	const char *arg;
+	char buf[48];
+	void *retval;
+	int n, m, r = 0;
+
+	switch (reason) {
+	case LWS_CALLBACK_PROTOCOL_INIT:
+		/* create our per-vhost struct */
+		vhd = lws_protocol_vh_priv_zalloc(lws_get_vhost(wsi),
+				lws_get_protocol(wsi),
+				sizeof(struct per_vhost_data__minimal));
+		if (!vhd)
+			return 1;
+
+		TRACE_THREAD("lws service");
+
+		/* the gateway mode relays other boards, not the local sensors */
+		if (!gateway_file && led_prepare()) {
+			lwsl_err("%s: Can't export pmodled's GPIO\n", __func__);
+			return 1;
+		}
+
+		pthread_mutex_init(&vhd->lock_ring, NULL);
+
+		pthread_mutex_init(&vhd->lock_ring_receive, NULL);
+
+		pthread_mutex_init(&vhd->lock_rules, NULL);
+
+		pthread_mutex_init(&vhd->lock_rolling, NULL);
+
+		pthread_mutex_init(&vhd->lock_capture, NULL);
+
+		pthread_mutex_init(&vhd->lock_sampling, NULL);
+		pthread_condattr_init(&cattr);
+		pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+		pthread_cond_init(&vhd->cond_wake_sensor, &cattr);
+		pthread_condattr_destroy(&cattr);
+
+		sampling_init(&vhd->sampling, read_sensor_data_interval);
+		if (adaptive_sampling) {
+			struct sampling_config c = { 1, -1, max_sampling_period, -1.0f, -1.0f };
+
+			if (sampling_configure(&vhd->sampling, -1, &c)) {
+				lwsl_err("%s: Invalid maximum sampling period %d\n", __func__,
+					 max_sampling_period);
+				return 1;
+			}
+		}
+
+		detector_init(&vhd->detector);
+		if (detector_file && detector_load_file(detector_file, &vhd->detector)) {
+			lwsl_err("%s: Can't load detectors from %s\n", __func__, detector_file);
+			return 1;
+		}
 
-		pthread_mutex_init(&vhd->lock_ring_receive, NULL);
+		if (rules_file && rules_load_file(rules_file, &vhd->rules)) {
+			lwsl_err("%s: Can't load rules from %s\n", __func__, rules_file);
+			return 1;
+		}
 
 		/* recover the pointer to the globals struct */
 		pvo = lws_pvo_search(
@@ -370,10 +3477,57 @@ callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
 		vhd->protocol = lws_get_protocol(wsi);
 		vhd->vhost = lws_get_vhost(wsi);
 
-		vhd->ring = lws_ring_create(sizeof(struct msg), 8,
+		if (gateway_file) {
+			gw = malloc(sizeof(*gw));
+			if (!gw || gateway_load_file(gateway_file, gw)) {
+				lwsl_err("%s: Can't load the boards from %s\n", __func__,
+					 gateway_file);
+				free(gw);
+				return 1;
+			}
+			/* the samples of the boards aren't decoded */
+			if (feed_name) {
+				lwsl_err("%s: --feed needs local sensors, not --gateway\n",
+					 __func__);
+				free(gw);
+				return 1;
+			}
+		}
+
+		if (!gw && sensors_file) {
+			if (sensor_config_load_file(sensors_file, &vhd->sensors)) {
+				lwsl_err("%s: Can't load the sensors from %s\n", __func__,
+					 sensors_file);
+				return 1;
+			}
+		} else
+			sensor_config_default(&vhd->sensors);
+
+		/* a cycle publishes one message per instance but for the primary OB1203 */
+		/* room for the aligned messages too when resampling */
+		vhd->ring_elements = gw ? 8 * gw->count :
+				     8 * (vhd->sensors.count - 1 + (resample_mode != ALIGN_OFF));
+		vhd->ring = lws_ring_create(sizeof(struct msg), vhd->ring_elements,
 					    __minimal_destroy_message);
 		if (!vhd->ring) {
 			lwsl_err("%s: failed to create ring\n", __func__);
+			free(gw);
+			return 1;
+		}
+
+		vhd->ring_ppg = lws_ring_create(sizeof(struct msg), 16,
+					    __minimal_destroy_message);
+		if (!vhd->ring_ppg) {
+			lwsl_err("%s: failed to create ring\n", __func__);
+			free(gw);
+			return 1;
+		}
+
+		vhd->ring_capture = lws_ring_create(sizeof(struct msg), 4,
+					    __minimal_destroy_message);
+		if (!vhd->ring_capture) {
+			lwsl_err("%s: failed to create ring\n", __func__);
+			free(gw);
 			return 1;
 		}
 
@@ -381,11 +3535,130 @@ callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
 					    __minimal_destroy_message);
 		if (!vhd->ring_receive) {
 			lwsl_err("%s: failed to create ring\n", __func__);
+			free(gw);
+			return 1;
+		}
+
+		/* the seq restart from 1 with each run, told apart by the epoch */
+		vclock_gettime(CLOCK_REALTIME, &ts);
+		vhd->epoch = (uint64_t)ts.tv_sec * LWS_US_PER_MS +
+			     (uint64_t)ts.tv_nsec / (LWS_US_PER_MS * LWS_NS_PER_US);
+		if (history_size && history_init(&vhd->history, history_size)) {
+			lwsl_err("%s: Can't retain %zu bytes of history\n", __func__,
+				 history_size);
+			free(gw);
 			return 1;
 		}
 
 		pthread_cond_init(&vhd->cond_wake_receive, NULL);
 
+		if (gw) {
+			vhd->upstreams = calloc(gw->count, sizeof(*vhd->upstreams));
+			if (!vhd->upstreams) {
+				free(gw);
+				return 1;
+			}
+
+			for (n = 0; n < gw->count; n++) {
+				up = &vhd->upstreams[n];
+				up->vhd = vhd;
+				up->board = gw->boards[n];
+				up->backoff = UPSTREAM_BACKOFF_MIN;
+				up->ring_tx = lws_ring_create(sizeof(struct msg), 8,
+							      __minimal_destroy_message);
+				if (!up->ring_tx) {
+					lwsl_err("%s: failed to create ring\n", __func__);
+					free(gw);
+					return 1;
+				}
+				vhd->upstream_count++;
+
+				lws_sul_schedule(vhd->context, 0, &up->sul,
+						 upstream_connect, 1);
+			}
+			lwsl_user("GATEWAY: relaying %d boards\n", gw->count);
+			free(gw);
+
+			/* no local sensor, the threads are not needed */
+			break;
+		}
+
+		if (feed_name) {
+			vhd->feed = sample_feed_create(feed_name);
+			if (!vhd->feed) {
+				lwsl_err("%s: Can't create the sample feed %s\n", __func__, feed_name);
+				return 1;
+			}
+		}
+
+		vhd->rolling = malloc(sizeof(*vhd->rolling));
+		if (!vhd->rolling) {
+			lwsl_err("%s: OOM\n", __func__);
+			return 1;
+		}
+		rolling_init(vhd->rolling, sampling_now_ms());
+
+		/*
+		 * the PPG FIFO has every sample, the proximity channel one per
+		 * cycle: its ring would hold minutes around a trigger of 1ms
+		 */
+		if (capture_enabled && !ppg_mode) {
+			lwsl_err("%s: --capture needs --ppg\n", __func__);
+			return 1;
+		}
+		if (capture_enabled) {
+			vhd->capture = malloc(sizeof(*vhd->capture));
+			if (!vhd->capture) {
+				lwsl_err("%s: OOM\n", __func__);
+				return 1;
+			}
+			capture_init(vhd->capture, &capture_config, CAPTURE_SOURCE_PPG);
+		}
+
+		/* the lookup tables of CONVERT_WITH_LUT, before the first reading */
+		convert_init();
+
+		/* one scheduler per bus, their transfers don't wait for each other */
+		for (n = 0; n < vhd->sensors.bus_count; n++) {
+#if defined(SENSOR_EVENT_LOOP)
+			/* no bus thread either, the transfers are issued on flush */
+			if (i2c_sched_init_inline(&vhd->i2c[n], vhd->sensors.buses[n])) {
+#else
+			if (i2c_sched_init(&vhd->i2c[n], vhd->sensors.buses[n])) {
+#endif
+				lwsl_err("%s: Can't start the I2C scheduler of %s\n", __func__,
+					 vhd->sensors.buses[n]);
+				while (vhd->i2c_count)
+					i2c_sched_destroy(&vhd->i2c[--vhd->i2c_count]);
+				return 1;
+			}
+			vhd->i2c_count++;
+
+			/* a dead sensor must not hold the bus for the default 1s+ */
+			if (i2c_sched_set_timeout(&vhd->i2c[n], i2c_timeout, i2c_retries))
+				lwsl_warn("%s: keeping the default I2C timeout of %s\n", __func__,
+					  vhd->sensors.buses[n]);
+		}
+		vhd->i2c_ready = 1;
+		sensor_acq_init(vhd, &vhd->acq);
+
+		for (n = 0; n < vhd->sensors.count; n++)
+			lwsl_user("%s: %s: %s at 0x%02x on %s\n", __func__,
+				  vhd->sensors.instances[n].name,
+				  sensor_type_name(vhd->sensors.instances[n].type),
+				  vhd->sensors.instances[n].address,
+				  vhd->sensors.buses[vhd->sensors.instances[n].bus]);
+		if (vclock_speed() > 1)
+			lwsl_user("%s: sampling clock %dx the real time\n", __func__,
+				  vclock_speed());
+
+#if defined(SENSOR_EVENT_LOOP)
+		/* no thread, the acquisition runs from lws timers */
+		lwsl_user("%s: event loop mode\n", __func__);
+		sensor_schedule(vhd, 1);
+		if (ppg_mode && !ppg_enable(vhd))
+			lws_sul_schedule(vhd->context, 0, &vhd->ppg.sul, ppg_step, 1);
+#else
 		/* start the content-creating threads */
 
 		for (n = 0; n < (int)LWS_ARRAY_SIZE(vhd->pthread_sensor); n++)
@@ -403,12 +3676,28 @@ callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
 				r = 1;
 				goto init_fail;
 			}
+
+		for (n = 0; ppg_mode && n < (int)LWS_ARRAY_SIZE(vhd->pthread_ppg); n++)
+			if (pthread_create(&vhd->pthread_ppg[n], NULL,
+					   thread_ppg, vhd)) {
+				lwsl_err("thread creation failed\n");
+				r = 1;
+				goto init_fail;
+			}
+#endif
 		break;
 
 	case LWS_CALLBACK_PROTOCOL_DESTROY:
+#if !defined(SENSOR_EVENT_LOOP)
 init_fail:
+#endif
 		vhd->finished = 1;
+#if defined(SENSOR_EVENT_LOOP)
+		lws_sul_cancel(&vhd->acq.sul);
+		lws_sul_cancel(&vhd->ppg.sul);
+#endif
 		pthread_cond_signal(&vhd->cond_wake_receive); /* wake up pthread_led */
+		wake_sensor(vhd); /* wake up pthread_sensor */
 		for (n = 0; n < (int)LWS_ARRAY_SIZE(vhd->pthread_sensor); n++)
 			if (vhd->pthread_sensor[n])
 				pthread_join(vhd->pthread_sensor[n], &retval);
@@ -417,63 +3706,153 @@ init_fail:
 			if (vhd->pthread_led[n])
 				pthread_join(vhd->pthread_led[n], &retval);
 
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(vhd->pthread_ppg); n++)
+			if (vhd->pthread_ppg[n])
+				pthread_join(vhd->pthread_ppg[n], &retval);
+
+		if (vhd->i2c_ready) {
+			for (n = 0; n < vhd->i2c_count; n++)
+				i2c_sched_destroy(&vhd->i2c[n]);
+			sensor_acq_destroy(&vhd->acq);
+		}
+
+		for (n = 0; n < vhd->upstream_count; n++) {
+			up = &vhd->upstreams[n];
+			lws_sul_cancel(&up->sul);
+			if (up->wsi)
+				lws_set_opaque_user_data(up->wsi, NULL);
+			lws_ring_destroy(up->ring_tx);
+		}
+		free(vhd->upstreams);
+
+		sample_feed_destroy(vhd->feed);
+		free(vhd->rolling);
+		free(vhd->capture);
+
 		if (vhd->ring)
 			lws_ring_destroy(vhd->ring);
 
+		if (vhd->ring_ppg)
+			lws_ring_destroy(vhd->ring_ppg);
+
+		if (vhd->ring_capture)
+			lws_ring_destroy(vhd->ring_capture);
+
 		if (vhd->ring_receive)
 			lws_ring_destroy(vhd->ring_receive);
 
+		history_destroy(&vhd->history);
+
 		pthread_mutex_destroy(&vhd->lock_ring);
 		pthread_mutex_destroy(&vhd->lock_ring_receive);
+		pthread_mutex_destroy(&vhd->lock_rules);
+		pthread_mutex_destroy(&vhd->lock_rolling);
+		pthread_mutex_destroy(&vhd->lock_capture);
+		pthread_mutex_destroy(&vhd->lock_sampling);
+		pthread_cond_destroy(&vhd->cond_wake_sensor);
 		pthread_cond_destroy(&vhd->cond_wake_receive);
 
 		break;
 
 	case LWS_CALLBACK_ESTABLISHED:
+		pss->wsi = wsi;
+		pss->id = ++vhd->session_ids;
+
 		/* add ourselves to the list of live pss held in the vhd */
+		TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
 		lws_ll_fwd_insert(pss, pss_list, vhd->pss_list);
 		pss->tail = lws_ring_get_oldest_tail(vhd->ring);
-		pss->wsi = wsi;
+		pss->tail_ppg = lws_ring_get_oldest_tail(vhd->ring_ppg);
+		pss->tail_capture = lws_ring_get_oldest_tail(vhd->ring_capture);
+		/* ?resume=<epoch>-<seq>: a client reconnecting after that message */
+		arg = lws_get_urlarg_by_name(wsi, "resume=", buf, sizeof(buf));
+		if (arg && !resume_token(vhd, arg, &epoch, &last))
+			session_resume(vhd, pss, epoch, last);
+		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+
+		if (pss->deflate)
+			deflate_configure(wsi);
+		if (pss->resume)
+			lws_callback_on_writable(wsi);
+		wake_sensor(vhd); /* it may be idle */
+		break;
+
+	case LWS_CALLBACK_CONFIRM_EXTENSION_OKAY:
+		/* permessage-deflate offered, the client may pick its policy */
+		pss->deflate_min = deflate_default;
+		arg = lws_get_urlarg_by_name(wsi, "deflate=", buf, sizeof(buf));
+		if (arg) {
+			n = deflate_policy(arg);
+			if (n != DEFLATE_INVALID)
+				pss->deflate_min = n;
+		}
+		if (pss->deflate_min == DEFLATE_OFF)
+			return 1; /* refused, the session goes uncompressed */
+		pss->deflate = 1;
 		break;
 
 	case LWS_CALLBACK_CLOSED:
+		if (pss->ppg)
+			vhd->ppg_subscribers--;
+		if (pss->capture)
+			vhd->capture_subscribers--;
+		free(pss->resume);
 		/* remove our closing pss from the list of live pss */
 		lws_ll_fwd_remove(struct per_session_data__minimal, pss_list,
 				  pss, vhd->pss_list);
+		/* its client may be back, the history goes on for it */
+		if (!vhd->pss_list)
+			vhd->sessions_left = vclock_now_ns() / LWS_NS_PER_US;
 		break;
 
 	case LWS_CALLBACK_SERVER_WRITEABLE:
-		pthread_mutex_lock(&vhd->lock_ring); /* --------- ring lock { */
+		TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
 
-		pmsg = lws_ring_get_element(vhd->ring, &pss->tail);
-		if (!pmsg) {
+		/* the messages missed while disconnected come first */
+		if (pss->resume) {
+			n = session_write_resume(pss);
 			pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+			if (n)
+				return -1;
+			lws_callback_on_writable(wsi);
 			break;
 		}
 
-		/* notice we allowed for LWS_PRE in the payload already */
-		m = lws_write(wsi, ((unsigned char *)pmsg->payload) + LWS_PRE,
+		pmsg = session_next(vhd, pss);
+		if (!pmsg) {
+			/* no sensor data pending, send a PPG batch or a capture if any */
+			if (lws_ring_get_element(vhd->ring_ppg, &pss->tail_ppg))
+				n = send_ppg(vhd, pss);
+			else
+				n = send_capture(vhd, pss);
+			if (n) {
+				pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+				return -1;
+			}
+			goto more;
+		}
+
+		/* notice we allowed for LWS_PRE before the stamp already */
+		TRACE_BEGIN(write);
+		m = lws_write(wsi, ((unsigned char *)pmsg->payload) + pmsg->start,
 			      pmsg->len, LWS_WRITE_TEXT);
+		TRACE_END(write, "lws_write");
 		if (m < (int)pmsg->len) {
 			pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
 			lwsl_err("ERROR %d writing to ws socket\n", m);
 			return -1;
 		}
+		session_sent(vhd, pss, pmsg);
 
-		lws_ring_consume_and_update_oldest_tail(
-			vhd->ring,	/* lws_ring object */
-			struct per_session_data__minimal, /* type of objects with tails */
-			&pss->tail,	/* tail of guy doing the consuming */
-			1,		/* number of payload objects being consumed */
-			vhd->pss_list,	/* head of list of objects with tails */
-			tail,		/* member name of tail in objects with tails */
-			pss_list	/* member name of next object in objects with tails */
-		);
-
+more:
 		/* more to do? */
-		if (lws_ring_get_element(vhd->ring, &pss->tail))
+		if (lws_ring_get_element(vhd->ring, &pss->tail) ||
+		    lws_ring_get_element(vhd->ring_ppg, &pss->tail_ppg) ||
+		    lws_ring_get_element(vhd->ring_capture, &pss->tail_capture))
 			/* come back as soon as we can write more */
 			lws_callback_on_writable(pss->wsi);
+		if (!lws_ring_get_element(vhd->ring, &pss->tail))
+			pss->pending_since = 0; /* caught up */
 
 		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
 		break;
@@ -490,6 +3869,19 @@ init_fail:
 			lwsl_user("LWS_CALLBACK_RECEIVE: %.*s\n", (int)len, (const char *)in);
 		}
 
+		if (session_command(vhd, pss, in, len))
+			break;
+
+		if (vhd->upstreams) {
+			/* gateway mode, the commands are for the boards */
+			upstream_forward(vhd, in, len);
+			break;
+		}
+
+#if defined(SENSOR_EVENT_LOOP)
+		/* no led thread, the command is applied before we return */
+		apply_command(vhd, in, len);
+#else
 		amsg.len = len;
 		/* notice we over-allocate by LWS_PRE */
 		amsg.payload = malloc(LWS_PRE + len);
@@ -500,7 +3892,7 @@ init_fail:
 
 		memcpy((char *)amsg.payload + LWS_PRE, in, len);
 
-		pthread_mutex_lock(&vhd->lock_ring_receive); /* --------- ring lock { */
+		TRACE_LOCK(&vhd->lock_ring_receive, "lock_ring_receive"); /* --------- ring lock { */
 
 		n = (int)lws_ring_get_count_free_elements(vhd->ring_receive);
 		if (!n) {
@@ -520,7 +3912,78 @@ init_fail:
 
 		pthread_cond_signal(&vhd->cond_wake_receive); /* wake up pthread_led */
 		pthread_mutex_unlock(&vhd->lock_ring_receive); /* } ring lock ------- */
+#endif
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		up = lws_get_opaque_user_data(wsi);
+		if (!up)
+			break;
+		lwsl_user("GATEWAY: %s: connected\n", up->board.id);
+		up->backoff = UPSTREAM_BACKOFF_MIN;
+		up->rx_len = 0;
+		up->rx_overflow = 0;
+		if (lws_ring_get_element(up->ring_tx, &up->tail_tx))
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		up = lws_get_opaque_user_data(wsi);
+		if (!up || lws_frame_is_binary(wsi))
+			break; /* the PPG batches are not relayed */
+
+		if (up->rx_len + len > sizeof(up->rx))
+			up->rx_overflow = 1;
+		else {
+			memcpy(up->rx + up->rx_len, in, len);
+			up->rx_len += len;
+		}
+
+		if (!lws_is_final_fragment(wsi) || lws_remaining_packet_payload(wsi))
+			break;
+
+		if (up->rx_overflow)
+			lwsl_err("GATEWAY: %s: ERROR message too long\n", up->board.id);
+		else
+			upstream_publish(vhd, up);
+		up->rx_len = 0;
+		up->rx_overflow = 0;
+		break;
+
+	case LWS_CALLBACK_CLIENT_WRITEABLE:
+		up = lws_get_opaque_user_data(wsi);
+		if (!up)
+			break;
+
+		pmsg = lws_ring_get_element(up->ring_tx, &up->tail_tx);
+		if (!pmsg)
+			break;
+
+		TRACE_BEGIN(upstream_write);
+		m = lws_write(wsi, ((unsigned char *)pmsg->payload) + LWS_PRE,
+			      pmsg->len, LWS_WRITE_TEXT);
+		TRACE_END(upstream_write, "lws_write upstream");
+		if (m < (int)pmsg->len) {
+			lwsl_err("ERROR %d writing to ws socket\n", m);
+			return -1;
+		}
+
+		lws_ring_consume_single_tail(up->ring_tx, &up->tail_tx, 1);
 
+		if (lws_ring_get_element(up->ring_tx, &up->tail_tx))
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		up = lws_get_opaque_user_data(wsi);
+		if (!up)
+			break;
+		lwsl_user("GATEWAY: %s: %s\n", up->board.id,
+			  reason == LWS_CALLBACK_CLIENT_CLOSED ? "disconnected" :
+			  (in ? (const char *)in : "connection error"));
+		up->wsi = NULL;
+		upstream_retry(up);
 		break;
 
 	case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
@@ -532,12 +3995,10 @@ init_fail:
 		 * using lws_cancel_service().
 		 *
 		 * We respond by scheduling a writable callback for all
-		 * connected clients.
+		 * connected clients, after skipping the lagging ones to
+		 * the newest sample.
 		 */
-		lws_start_foreach_llp(struct per_session_data__minimal **,
-				      ppss, vhd->pss_list) {
-			lws_callback_on_writable((*ppss)->wsi);
-		} lws_end_foreach_llp(ppss, pss_list);
+		sessions_writable(vhd);
 		break;
 
 	default:
@@ -556,12 +4017,373 @@ init_fail:
 		0, NULL, 0 \
 	}
 
+/*
+ * The counters of the sessions, served as JSON on the mount "/stats", and
+ * the channel statistics on "/stats/channels".
+ */
+
+struct per_session_data__stats {
+	char *body; /* LWS_PRE bytes then the JSON, NULL once sent */
+	size_t len;
+};
+
+static int
+callback_stats(struct lws *wsi, enum lws_callback_reasons reason,
+			void *user, void *in, size_t len)
+{
+	struct per_session_data__stats *pss =
+			(struct per_session_data__stats *)user;
+	struct lws_vhost *vhost = lws_get_vhost(wsi);
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)
+			lws_protocol_vh_priv_get(vhost,
+				lws_vhost_name_to_protocol(vhost, "graph-update"));
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (!vhd)
+			return lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+
+		if (in && !strcmp((const char *)in, "/channels")) {
+			if (!vhd->rolling)
+				return lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+			pss->body = channels_stats(vhd, &pss->len);
+		} else if (in && !strcmp((const char *)in, "/trace")) {
+#if defined(SENSOR_TRACE)
+			pss->body = trace_stats(&pss->len);
+#else
+			return lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+#endif
+		} else
+			pss->body = sessions_stats(vhd, &pss->len);
+		if (!pss->body)
+			return 1;
+
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+				"application/json", pss->len, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		lws_callback_on_writable(wsi);
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!pss->body)
+			break;
+
+		if (lws_write(wsi, (unsigned char *)pss->body + LWS_PRE, pss->len,
+			      LWS_WRITE_HTTP_FINAL) != (int)pss->len)
+			return 1;
+
+		free(pss->body);
+		pss->body = NULL;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+		return 0;
+
+	case LWS_CALLBACK_CLOSED_HTTP:
+		free(pss->body);
+		pss->body = NULL;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+#define LWS_PLUGIN_PROTOCOL_STATS \
+	{ \
+		"graph-stats", \
+		callback_stats, \
+		sizeof(struct per_session_data__stats), \
+		0, \
+		0, NULL, 0 \
+	}
+
+/*
+ * The sample ring as Server-Sent Events on the mount "/events", for the
+ * clients that can't speak ws. A stream is a session of the ring like a ws
+ * one, lagging and counted the same, whose only memory is its
+ * per_session_data__minimal: each event is formatted on the stack as it
+ * is written but for the resume. The id of an event is the resume token
+ * of its message, the browsers reconnect with it as Last-Event-ID.
+ * ?topics=samples,events streams these topics only.
+ */
+
+static int
+callback_events(struct lws *wsi, enum lws_callback_reasons reason,
+			void *user, void *in, size_t len)
+{
+	struct per_session_data__minimal *pss =
+			(struct per_session_data__minimal *)user;
+	struct lws_vhost *vhost = lws_get_vhost(wsi);
+	struct per_vhost_data__minimal *vhd =
+			(struct per_vhost_data__minimal *)
+			lws_protocol_vh_priv_get(vhost,
+				lws_vhost_name_to_protocol(vhost, "graph-update"));
+	uint8_t buf[LWS_PRE + SSE_EVENT_MAX], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	const struct msg *pmsg;
+	const char *arg;
+	char value[128];
+	uint64_t epoch, last;
+	int n, m, topic;
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (!vhd)
+			return lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+
+		/* ?topics=samples,events: the topics streamed, all by default */
+		arg = lws_get_urlarg_by_name(wsi, "topics=", value, sizeof(value));
+		if (arg) {
+			pss->muted = (1 << TOPIC_COUNT) - 1;
+			for (; *arg; arg += n + !!arg[n]) {
+				n = (int)strcspn(arg, ",");
+				topic = topic_lookup(arg, n);
+				if (topic < 0)
+					return lws_return_http_status(wsi,
+						HTTP_STATUS_BAD_REQUEST, "unknown topic");
+				pss->muted &= (uint8_t)~(1 << topic);
+			}
+		}
+
+		/*
+		 * The browsers send the id of the last event received when they
+		 * reconnect, a page can pass it as ?last-event-id= too
+		 */
+		if (lws_hdr_custom_copy(wsi, value, sizeof(value), "last-event-id:", 14) > 0)
+			arg = value;
+		else
+			arg = lws_get_urlarg_by_name(wsi, "last-event-id=", value, sizeof(value));
+		if (arg && resume_token(vhd, arg, &epoch, &last))
+			arg = NULL; /* not ours, a new stream */
+
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+				"text/event-stream", LWS_ILLEGAL_HTTP_CONTENT_LEN, &p, end))
+			return 1;
+		if (lws_add_http_header_by_name(wsi, (const unsigned char *)"cache-control:",
+				(const unsigned char *)"no-cache", 8, &p, end))
+			return 1;
+		/* nginx would buffer the stream otherwise */
+		if (lws_add_http_header_by_name(wsi, (const unsigned char *)"x-accel-buffering:",
+				(const unsigned char *)"no", 2, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		/* no timeout, the stream lasts until the client leaves */
+		lws_http_mark_sse(wsi);
+		lws_set_timeout(wsi, NO_PENDING_TIMEOUT, 0);
+
+		pss->wsi = wsi;
+		pss->id = ++vhd->session_ids;
+		pss->sse = 1;
+
+		/* add ourselves to the list of live pss held in the vhd */
+		TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+		lws_ll_fwd_insert(pss, pss_list, vhd->pss_list);
+		pss->tail = lws_ring_get_oldest_tail(vhd->ring);
+		pss->tail_ppg = lws_ring_get_oldest_tail(vhd->ring_ppg);
+		pss->tail_capture = lws_ring_get_oldest_tail(vhd->ring_capture);
+		if (arg)
+			session_resume(vhd, pss, epoch, last);
+		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+
+		lws_set_timer_usecs(wsi, SSE_KEEPALIVE * LWS_US_PER_SEC);
+		wake_sensor(vhd); /* it may be idle */
+		lws_callback_on_writable(wsi);
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!pss->sse)
+			break;
+
+		TRACE_LOCK(&vhd->lock_ring, "lock_ring"); /* --------- ring lock { */
+
+		/* the messages missed while disconnected come first */
+		if (pss->resume) {
+			n = session_write_resume(pss);
+			pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+			if (n)
+				return -1;
+			lws_callback_on_writable(wsi);
+			return 0;
+		}
+
+		pmsg = session_next(vhd, pss);
+		if (!pmsg) {
+			/* the PPG batches and the captures are binary, the stream skips them */
+			send_ppg(vhd, pss);
+			send_capture(vhd, pss);
+			if (!pss->keepalive)
+				goto more;
+			/* a comment, for the proxies closing idle connections */
+			memcpy(start, ":\n\n", 3);
+			n = 3;
+		} else {
+			n = sse_event((char *)start, SSE_EVENT_MAX, vhd->epoch, pmsg->seq,
+				      (const char *)pmsg->payload + pmsg->start, pmsg->len);
+			if (n < 0) {
+				lwsl_err("%s: event %llu too long, skipped\n", __func__,
+					 (unsigned long long)pmsg->seq);
+				pss->skipped++;
+				lws_ring_consume_and_update_oldest_tail(
+					vhd->ring,
+					struct per_session_data__minimal,
+					&pss->tail,
+					1,
+					vhd->pss_list,
+					tail,
+					pss_list
+				);
+				goto more;
+			}
+		}
+
+		TRACE_BEGIN(write);
+		m = lws_write(wsi, start, n, LWS_WRITE_HTTP);
+		TRACE_END(write, "lws_write event");
+		if (m < n) {
+			pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+			lwsl_err("ERROR %d writing to event stream\n", m);
+			return -1;
+		}
+		if (pmsg)
+			session_sent(vhd, pss, pmsg);
+		pss->keepalive = 0;
+		lws_set_timer_usecs(wsi, SSE_KEEPALIVE * LWS_US_PER_SEC);
+
+more:
+		/* more to do? */
+		if (lws_ring_get_element(vhd->ring, &pss->tail))
+			/* come back as soon as we can write more */
+			lws_callback_on_writable(wsi);
+		else
+			pss->pending_since = 0; /* caught up */
+
+		pthread_mutex_unlock(&vhd->lock_ring); /* } ring lock ------- */
+		return 0;
+
+	case LWS_CALLBACK_TIMER:
+		if (!pss->sse)
+			break;
+		pss->keepalive = 1;
+		lws_callback_on_writable(wsi);
+		return 0;
+
+	case LWS_CALLBACK_CLOSED_HTTP:
+		if (!pss->sse)
+			break;
+		free(pss->resume);
+		pss->resume = NULL;
+		/* remove our closing pss from the list of live pss */
+		lws_ll_fwd_remove(struct per_session_data__minimal, pss_list,
+				  pss, vhd->pss_list);
+		if (!vhd->pss_list)
+			vhd->sessions_left = vclock_now_ns() / LWS_NS_PER_US;
+		pss->sse = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+#define LWS_PLUGIN_PROTOCOL_EVENTS \
+	{ \
+		"graph-events", \
+		callback_events, \
+		sizeof(struct per_session_data__minimal), \
+		0, \
+		0, NULL, 0 \
+	}
+
+/*
+ * This runs under the lws service thread context only.
+ *
+ * permessage-deflate as implemented by lws, with the threshold of the
+ * session applied and the compression accounted. With --uncompressed-small
+ * a message smaller than the threshold skips the compressor: lws should
+ * only set RSV1 on the frames it compressed, and RFC 7692 lets any message
+ * go uncompressed.
+ */
+
+static int
+deflate_extension(struct lws_context *context, const struct lws_extension *ext,
+		  struct lws *wsi, enum lws_extension_callback_reasons reason,
+		  void *user, void *in, size_t len)
+{
+	struct lws_ext_pm_deflate_rx_ebufs *pmdrx =
+			(struct lws_ext_pm_deflate_rx_ebufs *)in;
+	struct per_session_data__minimal *pss = NULL;
+	struct per_vhost_data__minimal *vhd;
+	lws_usec_t start;
+	int n, first;
+
+	if (reason != LWS_EXT_CB_PAYLOAD_TX)
+		return lws_extension_callback_pm_deflate(context, ext, wsi,
+							 reason, user, in, len);
+
+	vhd = (struct per_vhost_data__minimal *)
+		lws_protocol_vh_priv_get(lws_get_vhost(wsi), lws_get_protocol(wsi));
+	if (!vhd || vhd->protocol != lws_get_protocol(wsi))
+		return lws_extension_callback_pm_deflate(context, ext, wsi,
+							 reason, user, in, len);
+	if (!lws_get_opaque_user_data(wsi)) /* not a gateway upstream */
+		pss = (struct per_session_data__minimal *)lws_wsi_user(wsi);
+
+	/* len is the lws_write() protocol, the drain of a message has no input */
+	first = pmdrx->eb_in.token && pmdrx->eb_in.len &&
+		(len & 0xf) != LWS_WRITE_CONTINUATION;
+
+	if (first && pss && pss->deflate &&
+	    pmdrx->eb_in.len < pss->deflate_min) {
+		pmdrx->eb_out = pmdrx->eb_in;
+		vhd->deflate_raw++;
+		return 0;
+	}
+
+	if (first) {
+		vhd->deflate_messages++;
+		vhd->deflate_in += (unsigned int)pmdrx->eb_in.len;
+	}
+
+	start = lws_now_usecs();
+	n = lws_extension_callback_pm_deflate(context, ext, wsi, reason,
+					      user, in, len);
+	vhd->deflate_busy += lws_now_usecs() - start;
+	if (n >= 0)
+		vhd->deflate_out += (unsigned int)pmdrx->eb_out.len;
+
+	return n;
+}
+
+static const struct lws_extension extensions[] = {
+	{
+		"permessage-deflate",
+		deflate_extension,
+		"permessage-deflate; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+};
+
 #if !defined (LWS_PLUGIN_STATIC)
 
 /* boilerplate needed if we are built as a dynamic plugin */
 
 static const struct lws_protocols protocols[] = {
-	LWS_PLUGIN_PROTOCOL_MINIMAL
+	LWS_PLUGIN_PROTOCOL_MINIMAL,
+	LWS_PLUGIN_PROTOCOL_STATS,
+	LWS_PLUGIN_PROTOCOL_EVENTS
 };
 
 LWS_EXTERN LWS_VISIBLE int
@@ -576,8 +4398,8 @@ init_protocol_minimal(struct lws_context *context,
 
 	c->protocols = protocols;
 	c->count_protocols = LWS_ARRAY_SIZE(protocols);
-	c->extensions = NULL;
-	c->count_extensions = 0;
+	c->extensions = extensions;
+	c->count_extensions = LWS_ARRAY_SIZE(extensions) - 1;
 
 	return 0;
 }
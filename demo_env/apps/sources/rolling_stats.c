@@ -0,0 +1,318 @@
+/*
+ * Source of the rolling statistics of each channel over fixed windows.
+ *
+ * Every update is O(1): the sample goes into the moments, the min/max and
+ * the histogram of the current slice of each window. When the window moves
+ * by a slice, the slice closed is merged into the window and the slice
+ * leaving it is taken out, so nothing is ever recomputed from the samples
+ * and the memory is fixed.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "rolling_stats.h"
+
+static const long window_slice_ms[ROLLING_WINDOW_COUNT] = {
+	[ROLLING_1M] = 1000,
+	[ROLLING_15M] = 15000,
+	[ROLLING_1H] = 60000,
+};
+
+static const char *const window_names[ROLLING_WINDOW_COUNT] = {
+	[ROLLING_1M] = "1m",
+	[ROLLING_15M] = "15m",
+	[ROLLING_1H] = "1h",
+};
+
+/*
+ * Histogram ranges, values outside fall in the first or last bin. The
+ * temperature covers the indoor range at 0.6degC per bin, light and
+ * proximity span decades and get log bins.
+ */
+
+static const struct rolling_scale default_scale[CHANNEL_COUNT] = {
+	[CHANNEL_TEMP] = { -20.0f, 60.0f, 0 },
+	[CHANNEL_HUMM] = { 0.0f, 100.0f, 0 },
+	[CHANNEL_LIGHT] = { 0.0f, 16777216.0f, 1 },
+	[CHANNEL_PROXIMITY] = { 0.0f, 65536.0f, 1 },
+};
+
+const char *rolling_window_name(int window) {
+	return window_names[window];
+}
+
+/* continuous position of value in the histogram, 0 to ROLLING_BINS */
+static double scale_position(const struct rolling_scale *s, float value) {
+	double pos;
+
+	if (s->log) {
+		pos = log2(1.0 + fmax(value - s->lo, 0.0)) / log2(1.0 + s->hi - s->lo);
+	} else {
+		pos = (value - s->lo) / (s->hi - s->lo);
+	}
+
+	return pos * ROLLING_BINS;
+}
+
+static float scale_value(const struct rolling_scale *s, double pos) {
+	pos /= ROLLING_BINS;
+
+	if (s->log) {
+		return s->lo + exp2(pos * log2(1.0 + s->hi - s->lo)) - 1.0;
+	}
+
+	return s->lo + pos * (s->hi - s->lo);
+}
+
+static int scale_bin(const struct rolling_scale *s, float value) {
+	double pos = scale_position(s, value);
+
+	if (pos < 0) {
+		return 0;
+	}
+	if (pos >= ROLLING_BINS) {
+		return ROLLING_BINS - 1;
+	}
+
+	return (int)pos;
+}
+
+static void moments_add(struct rolling_moments *m, double value) {
+	double delta = value - m->mean;
+
+	m->n++;
+	m->mean += delta / m->n;
+	m->m2 += delta * (value - m->mean);
+}
+
+static void moments_merge(struct rolling_moments *a, const struct rolling_moments *b) {
+	uint32_t n = a->n + b->n;
+	double delta;
+
+	if (!b->n) {
+		return;
+	}
+	if (!a->n) {
+		*a = *b;
+		return;
+	}
+
+	delta = b->mean - a->mean;
+	a->mean += delta * b->n / n;
+	a->m2 += b->m2 + delta * delta * ((double)a->n * b->n / n);
+	a->n = n;
+}
+
+/* the inverse of moments_merge(), b must have been merged into a */
+static void moments_unmerge(struct rolling_moments *a, const struct rolling_moments *b) {
+	uint32_t n = a->n - b->n;
+	double mean, delta;
+
+	if (!b->n) {
+		return;
+	}
+	if (!n) {
+		memset(a, 0, sizeof(*a));
+		return;
+	}
+
+	mean = (a->mean * a->n - b->mean * b->n) / n;
+	delta = b->mean - mean;
+	a->m2 -= b->m2 + delta * delta * ((double)n * b->n / a->n);
+	if (a->m2 < 0) {
+		a->m2 = 0; /* rounding */
+	}
+	a->mean = mean;
+	a->n = n;
+}
+
+static struct rolling_slice *slice_of(struct rolling_window_stats *w, long id) {
+	return &w->slices[id % ROLLING_SLICES];
+}
+
+static void window_reset(struct rolling_window_stats *w, long id) {
+	long slice_ms = w->slice_ms;
+
+	memset(w, 0, sizeof(*w));
+	w->slice_ms = slice_ms;
+	w->current = id;
+}
+
+/* the current slice joins the closed ones and the min/max deques */
+static void window_close(struct rolling_window_stats *w) {
+	const struct rolling_slice *s = slice_of(w, w->current);
+	int back;
+
+	if (!s->m.n) {
+		return;
+	}
+
+	moments_merge(&w->closed, &s->m);
+
+	while (w->min_count) {
+		back = (w->min_first + w->min_count - 1) % ROLLING_SLICES;
+		if (slice_of(w, w->min_q[back])->min < s->min) {
+			break;
+		}
+		w->min_count--;
+	}
+	w->min_q[(w->min_first + w->min_count++) % ROLLING_SLICES] = w->current;
+
+	while (w->max_count) {
+		back = (w->max_first + w->max_count - 1) % ROLLING_SLICES;
+		if (slice_of(w, w->max_q[back])->max > s->max) {
+			break;
+		}
+		w->max_count--;
+	}
+	w->max_q[(w->max_first + w->max_count++) % ROLLING_SLICES] = w->current;
+}
+
+/* the slot of slice id is reused, the slice it held leaves the window */
+static void window_expire(struct rolling_window_stats *w, long id) {
+	struct rolling_slice *s = slice_of(w, id);
+	int n;
+
+	id -= ROLLING_SLICES;
+
+	if (s->m.n) {
+		moments_unmerge(&w->closed, &s->m);
+		for (n = 0; n < ROLLING_BINS; n++) {
+			w->hist[n] -= s->hist[n];
+		}
+		if (w->min_count && w->min_q[w->min_first] == id) {
+			w->min_first = (w->min_first + 1) % ROLLING_SLICES;
+			w->min_count--;
+		}
+		if (w->max_count && w->max_q[w->max_first] == id) {
+			w->max_first = (w->max_first + 1) % ROLLING_SLICES;
+			w->max_count--;
+		}
+	}
+
+	memset(s, 0, sizeof(*s));
+}
+
+/* move the window to the slice of now, at most ROLLING_SLICES steps */
+static void window_advance(struct rolling_window_stats *w, long now) {
+	long id = now / w->slice_ms, k;
+
+	if (id <= w->current) {
+		return;
+	}
+
+	if (id - w->current >= ROLLING_SLICES) {
+		window_reset(w, id);
+		return;
+	}
+
+	window_close(w);
+	for (k = w->current + 1; k <= id; k++) {
+		window_expire(w, k);
+	}
+	w->current = id;
+}
+
+void rolling_init(struct rolling_stats *r, long now) {
+	int n, m;
+
+	memset(r, 0, sizeof(*r));
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		r->ch[n].scale = default_scale[n];
+		for (m = 0; m < ROLLING_WINDOW_COUNT; m++) {
+			r->ch[n].w[m].slice_ms = window_slice_ms[m];
+			r->ch[n].w[m].current = now / window_slice_ms[m];
+		}
+	}
+}
+
+/* account one reading of a channel, now in ms of CLOCK_MONOTONIC */
+void rolling_update(struct rolling_stats *r, int channel, float value, long now) {
+	struct rolling_channel *ch = &r->ch[channel];
+	struct rolling_window_stats *w;
+	struct rolling_slice *s;
+	int bin = scale_bin(&ch->scale, value), n;
+
+	for (n = 0; n < ROLLING_WINDOW_COUNT; n++) {
+		w = &ch->w[n];
+		window_advance(w, now);
+
+		s = slice_of(w, w->current);
+		if (!s->m.n || value < s->min) {
+			s->min = value;
+		}
+		if (!s->m.n || value > s->max) {
+			s->max = value;
+		}
+		moments_add(&s->m, value);
+		s->hist[bin]++;
+		w->hist[bin]++;
+	}
+}
+
+/* value under which ROLLING_QUANTILE of the window falls, interpolated in its bin */
+static float window_quantile(const struct rolling_window_stats *w,
+			     const struct rolling_scale *scale, uint32_t count) {
+	double target = ROLLING_QUANTILE * count, cum = 0;
+	int n;
+
+	for (n = 0; n < ROLLING_BINS; n++) {
+		if (w->hist[n] && cum + w->hist[n] >= target) {
+			return scale_value(scale, n + (target - cum) / w->hist[n]);
+		}
+		cum += w->hist[n];
+	}
+
+	return scale_value(scale, ROLLING_BINS);
+}
+
+void rolling_summary(struct rolling_stats *r, int channel, int window, long now,
+		     struct rolling_summary *out) {
+	struct rolling_channel *ch = &r->ch[channel];
+	struct rolling_window_stats *w = &ch->w[window];
+	const struct rolling_slice *s, *q;
+	struct rolling_moments m;
+
+	window_advance(w, now);
+
+	memset(out, 0, sizeof(*out));
+
+	s = slice_of(w, w->current);
+	m = w->closed;
+	moments_merge(&m, &s->m);
+	if (!m.n) {
+		return;
+	}
+
+	out->n = m.n;
+	out->mean = m.mean;
+	out->stddev = m.n > 1 ? sqrt(m.m2 / (m.n - 1)) : 0;
+
+	out->min = s->m.n ? s->min : INFINITY;
+	out->max = s->m.n ? s->max : -INFINITY;
+	if (w->min_count) {
+		q = slice_of(w, w->min_q[w->min_first]);
+		if (q->min < out->min) {
+			out->min = q->min;
+		}
+	}
+	if (w->max_count) {
+		q = slice_of(w, w->max_q[w->max_first]);
+		if (q->max > out->max) {
+			out->max = q->max;
+		}
+	}
+
+	/* the histogram clamps, the extremes don't */
+	out->quantile = window_quantile(w, &ch->scale, m.n);
+	if (out->quantile < out->min) {
+		out->quantile = out->min;
+	}
+	if (out->quantile > out->max) {
+		out->quantile = out->max;
+	}
+}
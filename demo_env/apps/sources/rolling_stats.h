@@ -0,0 +1,96 @@
+/*
+ * Header of the rolling statistics of each channel over fixed windows.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _ROLLING_STATS_H_
+#define _ROLLING_STATS_H_
+
+#include <stdint.h>
+
+#include "sensor_sample.h"
+
+#define ROLLING_SLICES 60 /* slices per window, the window moves by one slice */
+#define ROLLING_BINS 128 /* bins of the quantile histogram */
+#define ROLLING_QUANTILE 0.95 /* quantile reported */
+
+/* windows kept for each channel, 60 slices of 1s, 15s and 60s */
+
+enum rolling_window {
+	ROLLING_1M,
+	ROLLING_15M,
+	ROLLING_1H,
+
+	ROLLING_WINDOW_COUNT
+};
+
+/* count, mean and sum of squared deviations, merged with Chan et al. */
+
+struct rolling_moments {
+	uint32_t n;
+	double mean;
+	double m2;
+};
+
+struct rolling_slice {
+	struct rolling_moments m;
+	float min;
+	float max;
+	uint16_t hist[ROLLING_BINS];
+};
+
+/*
+ * One window: the current slice plus the ROLLING_SLICES - 1 closed slices
+ * before it, in a ring indexed by slice id. The moments and the histogram
+ * of the closed slices are kept merged, a slice leaving the window is
+ * taken out of them. The closed slices with the smallest and largest
+ * values are kept in monotonic deques of slice ids.
+ */
+
+struct rolling_window_stats {
+	long slice_ms;
+	long current; /* id of the current slice, ms / slice_ms */
+	struct rolling_slice slices[ROLLING_SLICES];
+	struct rolling_moments closed;
+	uint32_t hist[ROLLING_BINS]; /* of every slice in the window */
+
+	long min_q[ROLLING_SLICES]; /* slice ids, their min increasing */
+	long max_q[ROLLING_SLICES]; /* slice ids, their max decreasing */
+	int min_first, min_count;
+	int max_first, max_count;
+};
+
+/* value range of the histogram of a channel, log scaled for wide ranges */
+
+struct rolling_scale {
+	float lo;
+	float hi;
+	int log;
+};
+
+struct rolling_channel {
+	struct rolling_scale scale;
+	struct rolling_window_stats w[ROLLING_WINDOW_COUNT];
+};
+
+struct rolling_stats {
+	struct rolling_channel ch[CHANNEL_COUNT];
+};
+
+struct rolling_summary {
+	uint32_t n;
+	float min;
+	float max;
+	double mean;
+	double stddev;
+	float quantile; /* ROLLING_QUANTILE, to the histogram resolution */
+};
+
+void rolling_init(struct rolling_stats *r, long now);
+void rolling_update(struct rolling_stats *r, int channel, float value, long now);
+void rolling_summary(struct rolling_stats *r, int channel, int window, long now,
+		     struct rolling_summary *out);
+const char *rolling_window_name(int window);
+
+#endif /* _ROLLING_STATS_H_ */
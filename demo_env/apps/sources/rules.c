@@ -0,0 +1,224 @@
+/*
+ * Source of the rule engine switching the LED from the sensor samples.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_file.h"
+#include "rules.h"
+
+/*
+ * Compile one line of the form
+ *
+ *   <channel> <op> <threshold> [for <n>] [hysteresis <h>] -> led <on|off>
+ *
+ * where <op> is one of ">", ">=", "<", "<=".
+ */
+static int compile_line(char *line, struct rule *rule) {
+	char *token, *save = NULL;
+	char *end;
+	float threshold, hysteresis = 0.0f;
+	long count = 1;
+	int channel;
+
+	memset(rule, 0, sizeof(*rule));
+
+	token = strtok_r(line, " \t", &save);
+	channel = sensor_channel_lookup(token);
+	if (channel == -1) {
+		fprintf(stderr, "Error: rule has unknown channel \"%s\"\n", token);
+		return -1;
+	}
+	rule->channel = channel;
+
+	token = strtok_r(NULL, " \t", &save);
+	if (token == NULL) {
+		fprintf(stderr, "Error: rule has no operator\n");
+		return -1;
+	}
+	if (strcmp(token, ">") == 0) {
+		rule->above = 1;
+	} else if (strcmp(token, ">=") == 0) {
+		rule->above = 1;
+		rule->inclusive = 1;
+	} else if (strcmp(token, "<") == 0) {
+		rule->above = 0;
+	} else if (strcmp(token, "<=") == 0) {
+		rule->above = 0;
+		rule->inclusive = 1;
+	} else {
+		fprintf(stderr, "Error: rule has unknown operator \"%s\"\n", token);
+		return -1;
+	}
+
+	token = strtok_r(NULL, " \t", &save);
+	if (token == NULL) {
+		fprintf(stderr, "Error: rule has no threshold\n");
+		return -1;
+	}
+	threshold = strtof(token, &end);
+	if (*end != '\0') {
+		fprintf(stderr, "Error: rule has invalid threshold \"%s\"\n", token);
+		return -1;
+	}
+
+	for (token = strtok_r(NULL, " \t", &save); token;
+	     token = strtok_r(NULL, " \t", &save)) {
+		if (strcmp(token, "for") == 0) {
+			token = strtok_r(NULL, " \t", &save);
+			count = token ? strtol(token, &end, 10) : 0;
+			if (!token || *end != '\0' || count < 1 || count > 255) {
+				fprintf(stderr, "Error: rule has invalid sample count\n");
+				return -1;
+			}
+		} else if (strcmp(token, "hysteresis") == 0) {
+			token = strtok_r(NULL, " \t", &save);
+			hysteresis = token ? strtof(token, &end) : -1.0f;
+			if (!token || *end != '\0' || hysteresis < 0.0f) {
+				fprintf(stderr, "Error: rule has invalid hysteresis\n");
+				return -1;
+			}
+		} else if (strcmp(token, "->") == 0) {
+			break;
+		} else {
+			fprintf(stderr, "Error: rule has unknown keyword \"%s\"\n", token);
+			return -1;
+		}
+	}
+
+	token = strtok_r(NULL, " \t", &save);
+	if (token == NULL || strcmp(token, "led") != 0) {
+		fprintf(stderr, "Error: rule has no \"-> led\" action\n");
+		return -1;
+	}
+
+	token = strtok_r(NULL, " \t", &save);
+	if (token == NULL) {
+		fprintf(stderr, "Error: rule has no led state\n");
+		return -1;
+	}
+	if (strcmp(token, "on") == 0) {
+		rule->led_on = 1;
+	} else if (strcmp(token, "off") == 0) {
+		rule->led_on = 0;
+	} else {
+		fprintf(stderr, "Error: rule has unknown led state \"%s\"\n", token);
+		return -1;
+	}
+
+	token = strtok_r(NULL, " \t", &save);
+	if (token != NULL) {
+		fprintf(stderr, "Error: rule has trailing \"%s\"\n", token);
+		return -1;
+	}
+
+	rule->count = (uint8_t)count;
+	rule->set_level = threshold;
+	rule->clear_level = rule->above ? threshold - hysteresis :
+					  threshold + hysteresis;
+
+	return 0;
+}
+
+/* config_line_cb appending the rule of a line to the set being compiled */
+static int add_line(char *line, void *arg) {
+	struct rule_set *set = arg;
+
+	if (set->count == RULES_MAX) {
+		fprintf(stderr, "Error: more than %d rules\n", RULES_MAX);
+		return -1;
+	}
+
+	if (compile_line(line, &set->rules[set->count])) {
+		return -1;
+	}
+	set->count++;
+
+	return 0;
+}
+
+/*
+ * Compile newline separated rules into set, '#' starts a comment. On error
+ * set is left untouched.
+ */
+int rules_compile(const char *text, struct rule_set *set) {
+	struct rule_set tmp;
+
+	if (text == NULL || set == NULL) {
+		return -1;
+	}
+
+	memset(&tmp, 0, sizeof(tmp));
+	if (config_text_lines(text, "rules", add_line, &tmp)) {
+		return -1;
+	}
+	*set = tmp;
+
+	return 0;
+}
+
+int rules_load_file(const char *path, struct rule_set *set) {
+	struct rule_set tmp;
+
+	memset(&tmp, 0, sizeof(tmp));
+	if (config_file_lines(path, "rules", add_line, &tmp)) {
+		return -1;
+	}
+	*set = tmp;
+
+	return 0;
+}
+
+static inline int rule_holds(const struct rule *rule, float value, float level) {
+	if (rule->above) {
+		return rule->inclusive ? value >= level : value > level;
+	}
+
+	return rule->inclusive ? value <= level : value < level;
+}
+
+/*
+ * Advance the rules whose channel was read, fresh[channel] not 0, by one
+ * sample: a value repeated by a cycle not reading it isn't a new sample.
+ * Returns the led state requested by the last rule that changed state, or
+ * RULE_LED_NONE if nothing changed.
+ */
+int rules_evaluate(struct rule_set *set, const struct sensor_sample *sample, const int *fresh) {
+	struct rule *rule;
+	int n, result = RULE_LED_NONE;
+	float value;
+
+	for (n = 0; n < set->count; n++) {
+		rule = &set->rules[n];
+
+		if (!fresh[rule->channel]) {
+			continue;
+		}
+		if (!sample->is_active[rule->channel]) {
+			rule->run = 0;
+			continue;
+		}
+		value = sample->value[rule->channel];
+
+		if (!rule->asserted) {
+			rule->run = rule_holds(rule, value, rule->set_level) ?
+				    rule->run + 1 : 0;
+		} else {
+			/* released once the value is back past the hysteresis band */
+			rule->run = !rule_holds(rule, value, rule->clear_level) ?
+				    rule->run + 1 : 0;
+		}
+
+		if (rule->run >= rule->count) {
+			rule->run = 0;
+			rule->asserted = !rule->asserted;
+			result = rule->asserted ? rule->led_on : !rule->led_on;
+		}
+	}
+
+	return result;
+}
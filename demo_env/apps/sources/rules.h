@@ -0,0 +1,57 @@
+/*
+ * Header of the rule engine switching the LED from the sensor samples.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sensor_sample.h"
+
+#define RULES_MAX 8
+
+/* result of rules_evaluate() */
+
+#define RULE_LED_NONE -1
+#define RULE_LED_OFF 0
+#define RULE_LED_ON 1
+
+/*
+ * One compiled rule, for example
+ *
+ *   proximity > 300 for 3 hysteresis 20 -> led on
+ *
+ * The rule asserts once the condition holds for "count" consecutive samples
+ * and releases once the value went back past "clear_level" for the same
+ * number of samples. The thresholds are resolved at compile time so the
+ * evaluation is two compares per sample.
+ */
+
+struct rule {
+	uint8_t channel;
+	uint8_t above; /* 1: value > set_level, 0: value < set_level */
+	uint8_t inclusive; /* 1: ">=" / "<=" */
+	uint8_t led_on; /* led state while the rule is asserted */
+	uint8_t count;
+	float set_level;
+	float clear_level;
+
+	/* evaluation state */
+	uint8_t run;
+	uint8_t asserted;
+};
+
+struct rule_set {
+	struct rule rules[RULES_MAX];
+	int count;
+};
+
+int rules_compile(const char *text, struct rule_set *set);
+int rules_load_file(const char *path, struct rule_set *set);
+int rules_evaluate(struct rule_set *set, const struct sensor_sample *sample, const int *fresh);
+
+#endif /* _RULES_H_ */
@@ -0,0 +1,286 @@
+/*
+ * Source of the shared memory sample feed for local consumer processes.
+ *
+ * The server publishes each sample in a POSIX shared memory ring of
+ * seqlock protected slots. Readers map it, copy the slots without any
+ * syscall and detect being lapped by the producer from the sequence
+ * numbers. Blocking readers sleep on a futex in the mapping. The readers
+ * map it read-only, they can't disturb the producer nor each other.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "sample_feed.h"
+
+#define SAMPLE_FEED_SPIN 1000 /* retries of a slot being written */
+
+static long futex(_Atomic uint32_t *word, int op, uint32_t val, const struct timespec *timeout) {
+	return syscall(SYS_futex, (uint32_t *)word, op, val, timeout, NULL, 0);
+}
+
+static struct sample_feed *feed_map(const char *name, int fd, int owner) {
+	struct sample_feed *feed;
+	void *p;
+
+	feed = calloc(1, sizeof(*feed));
+	if (feed == NULL) {
+		fprintf(stderr, "Error: sample feed allocation failed\n");
+		return NULL;
+	}
+
+	p = mmap(NULL, sizeof(struct sample_feed_header), owner ? PROT_READ | PROT_WRITE : PROT_READ,
+		 MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Error: can't map %s: %s\n", name, strerror(errno));
+		free(feed);
+		return NULL;
+	}
+
+	feed->hdr = p;
+	feed->owner = owner;
+	snprintf(feed->name, sizeof(feed->name), "%s", name);
+
+	return feed;
+}
+
+/*
+ * Create the shared memory object, writable by the owner and readable by
+ * its group.
+ */
+struct sample_feed *sample_feed_create(const char *name) {
+	struct sample_feed *feed;
+	struct sample_feed_header *hdr;
+	int fd;
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0640);
+	if (fd == -1) {
+		fprintf(stderr, "Error: can't create %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	if (fchmod(fd, 0640) == -1 || ftruncate(fd, sizeof(struct sample_feed_header)) == -1) {
+		fprintf(stderr, "Error: can't size %s: %s\n", name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	feed = feed_map(name, fd, 1);
+	close(fd);
+	if (feed == NULL) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	/* a previous server may have left its feed, start over */
+	hdr = feed->hdr;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->version = SAMPLE_FEED_VERSION;
+	hdr->slots = SAMPLE_FEED_SLOTS;
+	hdr->record_size = sizeof(struct sample_feed_record);
+	atomic_thread_fence(memory_order_release);
+	hdr->magic = SAMPLE_FEED_MAGIC;
+
+	return feed;
+}
+
+void sample_feed_publish(struct sample_feed *feed, const struct sensor_sample *sample,
+			 int64_t timestamp_ns) {
+	struct sample_feed_header *hdr = feed->hdr;
+	struct sample_feed_slot *slot;
+	uint64_t seq;
+	uint32_t lock;
+
+	seq = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+	slot = &hdr->slot[seq & (SAMPLE_FEED_SLOTS - 1)];
+
+	lock = atomic_load_explicit(&slot->lock, memory_order_relaxed);
+	atomic_store_explicit(&slot->lock, lock + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->record.seq = seq;
+	slot->record.timestamp_ns = timestamp_ns;
+	slot->record.sample = *sample;
+
+	atomic_store_explicit(&slot->lock, lock + 2, memory_order_release);
+	atomic_store_explicit(&hdr->head, seq + 1, memory_order_release);
+
+	/* the readers can't tell they wait, wake them each time */
+	atomic_fetch_add(&hdr->futex, 1);
+	futex(&hdr->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+void sample_feed_destroy(struct sample_feed *feed) {
+	if (feed == NULL) {
+		return;
+	}
+
+	munmap(feed->hdr, sizeof(struct sample_feed_header));
+	if (feed->owner) {
+		shm_unlink(feed->name);
+	}
+	free(feed);
+}
+
+struct sample_feed *sample_feed_open(const char *name) {
+	struct sample_feed *feed;
+	struct sample_feed_header *hdr;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Error: can't open %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct sample_feed_header)) {
+		fprintf(stderr, "Error: %s is not a sample feed\n", name);
+		close(fd);
+		return NULL;
+	}
+
+	feed = feed_map(name, fd, 0);
+	close(fd);
+	if (feed == NULL) {
+		return NULL;
+	}
+
+	hdr = feed->hdr;
+	if (hdr->magic != SAMPLE_FEED_MAGIC || hdr->version != SAMPLE_FEED_VERSION ||
+	    hdr->slots != SAMPLE_FEED_SLOTS ||
+	    hdr->record_size != sizeof(struct sample_feed_record)) {
+		fprintf(stderr, "Error: %s has an incompatible layout\n", name);
+		sample_feed_destroy(feed);
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	return feed;
+}
+
+void sample_feed_close(struct sample_feed *feed) {
+	sample_feed_destroy(feed);
+}
+
+/*
+ * Copy the record of seq out of its slot. Returns 0, -1 if the slot already
+ * holds a later record, -2 if the producer didn't finish writing it.
+ */
+static int read_slot(struct sample_feed_header *hdr, uint64_t seq, struct sample_feed_record *record) {
+	struct sample_feed_slot *slot = &hdr->slot[seq & (SAMPLE_FEED_SLOTS - 1)];
+	uint32_t before, after;
+	int n;
+
+	for (n = 0; n < SAMPLE_FEED_SPIN; n++) {
+		before = atomic_load_explicit(&slot->lock, memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+
+		memcpy(record, &slot->record, sizeof(*record));
+		atomic_thread_fence(memory_order_acquire);
+
+		after = atomic_load_explicit(&slot->lock, memory_order_relaxed);
+		if (before == after) {
+			return record->seq == seq ? 0 : -1;
+		}
+	}
+
+	return -2;
+}
+
+/* the last sample published, returns 1 if there is one */
+int sample_feed_latest(struct sample_feed *feed, struct sample_feed_record *record) {
+	uint64_t head;
+	int ret;
+
+	do {
+		head = atomic_load_explicit(&feed->hdr->head, memory_order_acquire);
+		if (head == 0) {
+			return 0;
+		}
+		ret = read_slot(feed->hdr, head - 1, record);
+	} while (ret == -1);
+
+	return ret == 0;
+}
+
+/* start reading from the next sample published */
+void sample_feed_reader_init(struct sample_feed_reader *reader, struct sample_feed *feed) {
+	reader->feed = feed;
+	reader->next = atomic_load_explicit(&feed->hdr->head, memory_order_acquire);
+	reader->lost = 0;
+}
+
+/*
+ * Read the next sample in order, returns 1 if one was read and 0 if the
+ * reader caught up. A reader too slow to keep up skips to the oldest
+ * sample still in the ring, the samples skipped are added to "lost".
+ */
+int sample_feed_read(struct sample_feed_reader *reader, struct sample_feed_record *record) {
+	struct sample_feed_header *hdr = reader->feed->hdr;
+	uint64_t head;
+	int ret;
+
+	for (;;) {
+		head = atomic_load_explicit(&hdr->head, memory_order_acquire);
+		if (reader->next >= head) {
+			return 0;
+		}
+
+		if (head - reader->next > SAMPLE_FEED_SLOTS) {
+			/* keep a slot of margin from the producer */
+			reader->lost += head - SAMPLE_FEED_SLOTS + 1 - reader->next;
+			reader->next = head - SAMPLE_FEED_SLOTS + 1;
+		}
+
+		ret = read_slot(hdr, reader->next, record);
+		if (ret == 0) {
+			reader->next++;
+			return 1;
+		}
+		if (ret == -2) {
+			return 0;
+		}
+		/* lapped during the copy, resync from the new head */
+	}
+}
+
+/*
+ * Block until a sample is available to reader, for at most timeout_ms
+ * (forever if negative). Returns 1 if a sample is available, 0 otherwise.
+ */
+int sample_feed_wait(struct sample_feed_reader *reader, int timeout_ms) {
+	struct sample_feed_header *hdr = reader->feed->hdr;
+	struct timespec ts;
+	uint32_t val;
+	int ret;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+	/* a publish after the load of val changes it, FUTEX_WAIT returns at once */
+	val = atomic_load(&hdr->futex);
+	ret = atomic_load(&hdr->head) > reader->next;
+	if (!ret) {
+		futex(&hdr->futex, FUTEX_WAIT, val, timeout_ms < 0 ? NULL : &ts);
+		ret = atomic_load(&hdr->head) > reader->next;
+	}
+
+	return ret;
+}
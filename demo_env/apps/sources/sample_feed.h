@@ -0,0 +1,89 @@
+/*
+ * Header of the shared memory sample feed for local consumer processes.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SAMPLE_FEED_H_
+#define _SAMPLE_FEED_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "sensor_sample.h"
+
+#define SAMPLE_FEED_NAME "/rzfive-sensor-feed" /* shm_open() name */
+#define SAMPLE_FEED_MAGIC 0x31444653 /* "SFD1" */
+#define SAMPLE_FEED_VERSION 3
+#define SAMPLE_FEED_SLOTS 64 /* power of 2 */
+
+/* one published sample */
+
+struct sample_feed_record {
+	uint64_t seq; /* 0 for the first sample published */
+	int64_t timestamp_ns; /* CLOCK_MONOTONIC */
+	struct sensor_sample sample;
+};
+
+/*
+ * Each slot is protected by a seqlock: the producer makes "lock" odd while
+ * it rewrites the record, a reader retries when it saw an odd value or
+ * when the value changed during its copy. The producer never waits for
+ * the readers.
+ */
+
+struct sample_feed_slot {
+	_Atomic uint32_t lock;
+	uint32_t reserved;
+	struct sample_feed_record record;
+};
+
+/*
+ * The shared memory object: this header followed by the slots. "head" is
+ * the number of samples published, the last one is in slot
+ * (head - 1) % SAMPLE_FEED_SLOTS. "futex" changes on each publish, which
+ * wakes the readers waiting on it. Only the producer writes the object.
+ */
+
+struct sample_feed_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t record_size;
+	_Atomic uint64_t head;
+	_Atomic uint32_t futex;
+	uint32_t reserved;
+	struct sample_feed_slot slot[SAMPLE_FEED_SLOTS];
+};
+
+struct sample_feed {
+	struct sample_feed_header *hdr;
+	char name[64];
+	int owner; /* created by sample_feed_create(), unlinked on destroy */
+};
+
+/* reader position of one consumer */
+
+struct sample_feed_reader {
+	struct sample_feed *feed;
+	uint64_t next; /* seq of the next record to read */
+	uint64_t lost; /* records overwritten before they were read */
+};
+
+/* producer side, the server */
+
+struct sample_feed *sample_feed_create(const char *name);
+void sample_feed_publish(struct sample_feed *feed, const struct sensor_sample *sample,
+			 int64_t timestamp_ns);
+void sample_feed_destroy(struct sample_feed *feed);
+
+/* consumer side, lock-free and without syscall unless waiting */
+
+struct sample_feed *sample_feed_open(const char *name);
+void sample_feed_close(struct sample_feed *feed);
+int sample_feed_latest(struct sample_feed *feed, struct sample_feed_record *record);
+void sample_feed_reader_init(struct sample_feed_reader *reader, struct sample_feed *feed);
+int sample_feed_read(struct sample_feed_reader *reader, struct sample_feed_record *record);
+int sample_feed_wait(struct sample_feed_reader *reader, int timeout_ms);
+
+#endif /* _SAMPLE_FEED_H_ */
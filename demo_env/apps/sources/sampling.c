@@ -0,0 +1,159 @@
+/*
+ * Source of the adaptive sampling rate controller.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sampling.h"
+
+/* default thresholds, above the noise of the sensors */
+
+static const float default_delta[CHANNEL_COUNT] = {
+	[CHANNEL_TEMP] = 0.2f, /* degC */
+	[CHANNEL_HUMM] = 1.0f, /* %RH */
+	[CHANNEL_LIGHT] = 20.0f,
+	[CHANNEL_PROXIMITY] = 100.0f,
+};
+
+static const float default_stddev[CHANNEL_COUNT] = {
+	[CHANNEL_TEMP] = 0.2f,
+	[CHANNEL_HUMM] = 1.0f,
+	[CHANNEL_LIGHT] = 15.0f,
+	[CHANNEL_PROXIMITY] = 60.0f,
+};
+
+/* start with every channel read each period, not adaptive */
+void sampling_init(struct sampling *s, int period) {
+	int n;
+
+	memset(s, 0, sizeof(*s));
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		s->ch[n].min_period = period;
+		s->ch[n].max_period = period > SAMPLING_MAX_PERIOD ? period : SAMPLING_MAX_PERIOD;
+		s->ch[n].delta = default_delta[n];
+		s->ch[n].stddev = default_stddev[n];
+		s->ch[n].period = period;
+	}
+}
+
+static int configure_channel(struct sampling_channel *ch, const struct sampling_config *config) {
+	int min_period = config->min_period >= 0 ? config->min_period : ch->min_period;
+	int max_period = config->max_period >= 0 ? config->max_period : ch->max_period;
+
+	if (min_period < SAMPLING_PERIOD_FLOOR || max_period < min_period) {
+		fprintf(stderr, "Error: invalid sampling periods %d..%d ms\n", min_period, max_period);
+		return -1;
+	}
+
+	ch->min_period = min_period;
+	ch->max_period = max_period;
+	if (config->delta >= 0) {
+		ch->delta = config->delta;
+	}
+	if (config->stddev >= 0) {
+		ch->stddev = config->stddev;
+	}
+	if (ch->period < min_period) {
+		ch->period = min_period;
+	}
+	if (ch->period > max_period) {
+		ch->period = max_period;
+	}
+	if (config->adaptive >= 0) {
+		ch->adaptive = config->adaptive;
+		ch->period = min_period;
+		ch->primed = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Apply config to one channel, or to all of them for channel -1. Turning
+ * the adaptation on or off restarts it from min_period, for those
+ * channels only.
+ */
+int sampling_configure(struct sampling *s, int channel, const struct sampling_config *config) {
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (channel != -1 && channel != n) {
+			continue;
+		}
+		if (configure_channel(&s->ch[n], config)) {
+			return -1;
+		}
+		s->ch[n].due = 0; /* retimed by the next reading */
+	}
+
+	return 0;
+}
+
+int sampling_due(const struct sampling *s, int channel, long now) {
+	return now >= s->ch[channel].due;
+}
+
+long sampling_next_due(const struct sampling *s) {
+	long due = s->ch[0].due;
+	int n;
+
+	for (n = 1; n < CHANNEL_COUNT; n++) {
+		if (s->ch[n].due < due) {
+			due = s->ch[n].due;
+		}
+	}
+
+	return due;
+}
+
+/*
+ * Account a reading of the channel taken at now (ms) and schedule the
+ * next one. Returns the effective period.
+ */
+int sampling_update(struct sampling *s, int channel, float value, long now) {
+	struct sampling_channel *ch = &s->ch[channel];
+	float diff, change;
+
+	if (!ch->adaptive) {
+		ch->period = ch->min_period;
+		goto schedule;
+	}
+
+	if (!ch->primed) {
+		ch->last = value;
+		ch->mean = value;
+		ch->var = 0.0f;
+		ch->primed = 1;
+		ch->period = ch->min_period;
+		goto schedule;
+	}
+
+	change = value - ch->last;
+	if (change < 0.0f) {
+		change = -change;
+	}
+	ch->last = value;
+
+	/* exponentially weighted mean and variance */
+	diff = value - ch->mean;
+	ch->mean += SAMPLING_ALPHA * diff;
+	ch->var = (1.0f - SAMPLING_ALPHA) * (ch->var + SAMPLING_ALPHA * diff * diff);
+
+	if (change > ch->delta || ch->var > ch->stddev * ch->stddev) {
+		ch->period = ch->min_period;
+	} else {
+		ch->period += ch->period / SAMPLING_BACKOFF + 1;
+		if (ch->period > ch->max_period) {
+			ch->period = ch->max_period;
+		}
+	}
+
+schedule:
+	ch->due = now + ch->period;
+
+	return ch->period;
+}
@@ -0,0 +1,60 @@
+/*
+ * Header of the adaptive sampling rate controller.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include "sensor_sample.h"
+
+#define SAMPLING_PERIOD_FLOOR 50 /* ms, the OB1203 PS measurement period, shortest interval */
+#define SAMPLING_MAX_PERIOD 4000 /* ms, default slowest period */
+#define SAMPLING_ALPHA 0.25f /* weight of a reading in the mean and variance */
+#define SAMPLING_BACKOFF 4 /* a stable reading stretches the period by 1/4 */
+
+/*
+ * Sampling controller of one channel. A reading that moved by more than
+ * "delta" since the previous one, or a running standard deviation above
+ * "stddev", drops the period to min_period right away. Each stable reading
+ * then stretches it back towards max_period.
+ */
+
+struct sampling_channel {
+	int adaptive; /* 0: read each min_period */
+	int min_period; /* ms */
+	int max_period; /* ms */
+	float delta;
+	float stddev;
+
+	/* controller state */
+	int period; /* ms, effective period */
+	long due; /* ms, CLOCK_MONOTONIC time of the next reading */
+	float last;
+	float mean;
+	float var;
+	int primed;
+};
+
+struct sampling {
+	struct sampling_channel ch[CHANNEL_COUNT];
+};
+
+/* tunables of sampling_configure(), negative for unchanged */
+
+struct sampling_config {
+	int adaptive;
+	int min_period;
+	int max_period;
+	float delta;
+	float stddev;
+};
+
+void sampling_init(struct sampling *s, int period);
+int sampling_configure(struct sampling *s, int channel, const struct sampling_config *config);
+int sampling_due(const struct sampling *s, int channel, long now);
+long sampling_next_due(const struct sampling *s);
+int sampling_update(struct sampling *s, int channel, float value, long now);
+
+#endif /* _SAMPLING_H_ */
@@ -0,0 +1,207 @@
+/*
+ * Source of the sensor instances list: which sensors sit on which bus.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_file.h"
+#include "sensor_config.h"
+#include "i2c_bus.h"
+#include "hs3001.h"
+#include "ob1203.h"
+
+static const char *const type_names[SENSOR_TYPE_COUNT] = {
+	[SENSOR_HS3001] = "hs3001",
+	[SENSOR_OB1203] = "ob1203",
+};
+
+static const uint16_t default_address[SENSOR_TYPE_COUNT] = {
+	[SENSOR_HS3001] = HS3001_SLAVE_ADDRESS,
+	[SENSOR_OB1203] = OB1203_SLAVE_ADDRESS,
+};
+
+const char *sensor_type_name(int type) {
+	return type_names[type];
+}
+
+static int type_lookup(const char *name) {
+	int n;
+
+	for (n = 0; n < SENSOR_TYPE_COUNT; n++) {
+		if (strcmp(name, type_names[n]) == 0) {
+			return n;
+		}
+	}
+
+	return -1;
+}
+
+/* index of the bus path, added when new */
+static int bus_lookup(struct sensor_config *config, const char *path) {
+	int n;
+
+	for (n = 0; n < config->bus_count; n++) {
+		if (strcmp(config->buses[n], path) == 0) {
+			return n;
+		}
+	}
+
+	if (config->bus_count == SENSOR_BUSES_MAX) {
+		fprintf(stderr, "Error: more than %d buses\n", SENSOR_BUSES_MAX);
+		return -1;
+	}
+	if (strlen(path) >= SENSOR_BUS_PATH_MAX) {
+		fprintf(stderr, "Error: bus path \"%s\" too long\n", path);
+		return -1;
+	}
+	strcpy(config->buses[config->bus_count], path);
+
+	return config->bus_count++;
+}
+
+static void add_instance(struct sensor_config *config, int type, int bus, uint16_t address,
+			 const char *name) {
+	struct sensor_instance *s = &config->instances[config->count++];
+
+	snprintf(s->name, sizeof(s->name), "%s", name);
+	s->type = type;
+	s->bus = bus;
+	s->address = address;
+}
+
+/* the sensors of the board, both on I2C_DEVICE_FILE */
+void sensor_config_default(struct sensor_config *config) {
+	memset(config, 0, sizeof(*config));
+
+	bus_lookup(config, I2C_DEVICE_FILE);
+	add_instance(config, SENSOR_HS3001, 0, HS3001_SLAVE_ADDRESS, type_names[SENSOR_HS3001]);
+	add_instance(config, SENSOR_OB1203, 0, OB1203_SLAVE_ADDRESS, type_names[SENSOR_OB1203]);
+}
+
+/*
+ * Parse one line of the form
+ *
+ *   <type> <bus> [<address> [<name>]]
+ *
+ * The name defaults to the type, then "<type>-<n>" for the n-th next
+ * instance of the type. It goes verbatim in the JSON of the samples, see
+ * config_name_valid().
+ */
+static int parse_line(char *line, struct sensor_config *config) {
+	char *type_name, *bus_path, *address, *name, *end, *save = NULL;
+	char default_name[SENSOR_NAME_MAX];
+	int type, bus, n, same;
+	long a;
+
+	type_name = strtok_r(line, " \t", &save);
+	bus_path = strtok_r(NULL, " \t", &save);
+	address = strtok_r(NULL, " \t", &save);
+	name = strtok_r(NULL, " \t", &save);
+
+	type = type_lookup(type_name);
+	if (type == -1) {
+		fprintf(stderr, "Error: unknown sensor type \"%s\"\n", type_name);
+		return -1;
+	}
+
+	if (bus_path == NULL) {
+		fprintf(stderr, "Error: sensor \"%s\" has no bus\n", type_name);
+		return -1;
+	}
+
+	a = default_address[type];
+	if (address != NULL) {
+		a = strtol(address, &end, 0);
+		if (*end != '\0' || a < 0x03 || a > 0x77) {
+			fprintf(stderr, "Error: sensor has invalid address \"%s\"\n", address);
+			return -1;
+		}
+	}
+
+	if (name == NULL) {
+		for (n = 0, same = 0; n < config->count; n++) {
+			if (config->instances[n].type == type) {
+				same++;
+			}
+		}
+		if (same) {
+			snprintf(default_name, sizeof(default_name), "%s-%d", type_name, same);
+		} else {
+			snprintf(default_name, sizeof(default_name), "%s", type_name);
+		}
+		name = default_name;
+	}
+	if (!config_name_valid(name, SENSOR_NAME_MAX)) {
+		fprintf(stderr, "Error: invalid sensor name \"%s\"\n", name);
+		return -1;
+	}
+
+	bus = bus_lookup(config, bus_path);
+	if (bus == -1) {
+		return -1;
+	}
+
+	for (n = 0; n < config->count; n++) {
+		if (strcmp(config->instances[n].name, name) == 0) {
+			fprintf(stderr, "Error: duplicate sensor name \"%s\"\n", name);
+			return -1;
+		}
+		if (config->instances[n].bus == bus && config->instances[n].address == a) {
+			fprintf(stderr, "Error: two sensors at 0x%02lx on %s\n", a, bus_path);
+			return -1;
+		}
+	}
+
+	add_instance(config, type, bus, (uint16_t)a, name);
+
+	return 0;
+}
+
+/* config_line_cb adding the sensor of a line to the config */
+static int add_line(char *line, void *arg) {
+	struct sensor_config *config = arg;
+
+	if (config->count == SENSOR_INSTANCES_MAX) {
+		fprintf(stderr, "Error: more than %d sensors\n", SENSOR_INSTANCES_MAX);
+		return -1;
+	}
+
+	return parse_line(line, config);
+}
+
+/* one sensor per line, '#' starts a comment, one of each type at least */
+int sensor_config_load_file(const char *path, struct sensor_config *config) {
+	int n;
+
+	memset(config, 0, sizeof(*config));
+
+	if (config_file_lines(path, "sensor", add_line, config)) {
+		return -1;
+	}
+
+	for (n = 0; n < SENSOR_TYPE_COUNT; n++) {
+		if (sensor_config_primary(config, n) == NULL) {
+			fprintf(stderr, "Error: no %s in %s\n", type_names[n], path);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* first instance of a type, NULL when there is none */
+const struct sensor_instance *sensor_config_primary(const struct sensor_config *config, int type) {
+	int n;
+
+	for (n = 0; n < config->count; n++) {
+		if (config->instances[n].type == type) {
+			return &config->instances[n];
+		}
+	}
+
+	return NULL;
+}
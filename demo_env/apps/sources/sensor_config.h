@@ -0,0 +1,50 @@
+/*
+ * Header of the sensor instances list: which sensors sit on which bus.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SENSOR_CONFIG_H_
+#define _SENSOR_CONFIG_H_
+
+#include <stdint.h>
+
+#define SENSOR_INSTANCES_MAX 16
+#define SENSOR_BUSES_MAX 4
+#define SENSOR_NAME_MAX 32
+#define SENSOR_BUS_PATH_MAX 64
+
+enum sensor_type {
+	SENSOR_HS3001,
+	SENSOR_OB1203,
+
+	SENSOR_TYPE_COUNT
+};
+
+/* one sensor, a device at an address of a bus */
+
+struct sensor_instance {
+	char name[SENSOR_NAME_MAX]; /* tag of its samples */
+	int type;
+	int bus; /* index in buses */
+	uint16_t address;
+};
+
+/*
+ * The first instance of each type is the primary one, its samples are the
+ * untagged ones the rules, the detectors and the statistics work on.
+ */
+
+struct sensor_config {
+	char buses[SENSOR_BUSES_MAX][SENSOR_BUS_PATH_MAX];
+	int bus_count;
+	struct sensor_instance instances[SENSOR_INSTANCES_MAX];
+	int count;
+};
+
+void sensor_config_default(struct sensor_config *config);
+int sensor_config_load_file(const char *path, struct sensor_config *config);
+const struct sensor_instance *sensor_config_primary(const struct sensor_config *config, int type);
+const char *sensor_type_name(int type);
+
+#endif /* _SENSOR_CONFIG_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Source of the circuit breaker tracking the health of each sensor.
+ *
+ * A sensor failing HEALTH_FAILURES cycles in a row is no longer accessed
+ * every cycle, where each access would pay the bus timeout, but probed
+ * with an exponential backoff until it answers again.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <string.h>
+
+#include "sensor_health.h"
+
+void sensor_health_init(struct sensor_health *h, const char *name) {
+	memset(h, 0, sizeof(*h));
+	h->name = name;
+	h->state = HEALTH_CLOSED;
+	h->backoff = HEALTH_BACKOFF_MIN;
+}
+
+/* returns 1 if the sensor may be accessed this cycle */
+int sensor_health_allow(struct sensor_health *h, long now_ms) {
+	if (h->state == HEALTH_OPEN && now_ms >= h->next_probe) {
+		h->state = HEALTH_HALF_OPEN;
+	}
+
+	return h->state != HEALTH_OPEN;
+}
+
+/* account the result of an access allowed by sensor_health_allow() */
+enum health_event sensor_health_report(struct sensor_health *h, int ok, long now_ms) {
+	if (ok) {
+		h->failures = 0;
+		if (h->state == HEALTH_CLOSED) {
+			return HEALTH_EVENT_NONE;
+		}
+
+		h->state = HEALTH_CLOSED;
+		h->backoff = HEALTH_BACKOFF_MIN;
+		return HEALTH_EVENT_RECOVERED;
+	}
+
+	h->errors++;
+
+	if (h->state == HEALTH_HALF_OPEN) {
+		h->backoff *= 2;
+		if (h->backoff > HEALTH_BACKOFF_MAX) {
+			h->backoff = HEALTH_BACKOFF_MAX;
+		}
+		h->state = HEALTH_OPEN;
+		h->next_probe = now_ms + h->backoff;
+		return HEALTH_EVENT_PROBE_FAILED;
+	}
+
+	if (++h->failures < HEALTH_FAILURES) {
+		return HEALTH_EVENT_NONE;
+	}
+
+	h->state = HEALTH_OPEN;
+	h->opened++;
+	h->backoff = HEALTH_BACKOFF_MIN;
+	h->next_probe = now_ms + h->backoff;
+	return HEALTH_EVENT_OPENED;
+}
@@ -0,0 +1,52 @@
+/*
+ * Header of the circuit breaker tracking the health of each sensor.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SENSOR_HEALTH_H_
+#define _SENSOR_HEALTH_H_
+
+#define HEALTH_FAILURES 3 /* consecutive failures opening the breaker */
+#define HEALTH_BACKOFF_MIN 1000 /* first probe delay once open(ms) */
+#define HEALTH_BACKOFF_MAX 60000 /* longest probe delay(ms) */
+
+/*
+ * CLOSED: the sensor is read every cycle it is due. OPEN: it is left alone
+ * until the next probe. HALF_OPEN: one probe is allowed, its success
+ * closes the breaker and its failure doubles the probe delay.
+ */
+
+enum health_state {
+	HEALTH_CLOSED,
+	HEALTH_OPEN,
+	HEALTH_HALF_OPEN
+};
+
+enum health_event {
+	HEALTH_EVENT_NONE,
+	HEALTH_EVENT_OPENED,
+	HEALTH_EVENT_PROBE_FAILED,
+	HEALTH_EVENT_RECOVERED
+};
+
+struct sensor_health {
+	const char *name;
+	enum health_state state;
+	int failures; /* consecutive failures */
+	int backoff; /* current probe delay(ms) */
+	long next_probe; /* ms, CLOCK_MONOTONIC */
+	unsigned long errors; /* failures since init */
+	unsigned long opened; /* times the breaker opened */
+};
+
+void sensor_health_init(struct sensor_health *h, const char *name);
+int sensor_health_allow(struct sensor_health *h, long now_ms);
+enum health_event sensor_health_report(struct sensor_health *h, int ok, long now_ms);
+
+/* the last access succeeded, the sensor values can be trusted */
+static inline int sensor_health_active(const struct sensor_health *h) {
+	return h->state == HEALTH_CLOSED && !h->failures;
+}
+
+#endif /* _SENSOR_HEALTH_H_ */
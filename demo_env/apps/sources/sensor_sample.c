@@ -0,0 +1,190 @@
+/*
+ * Source of the sensor sample helpers.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sensor_sample.h"
+
+/* the names match the keys of the json message sent to the browser */
+
+static const char *channel_names[CHANNEL_COUNT] = {
+	[CHANNEL_TEMP] = "temp",
+	[CHANNEL_HUMM] = "humm",
+	[CHANNEL_LIGHT] = "light",
+	[CHANNEL_PROXIMITY] = "proximity",
+};
+
+const char *sensor_channel_name(int channel) {
+	if (channel < 0 || channel >= CHANNEL_COUNT) {
+		return NULL;
+	}
+
+	return channel_names[channel];
+}
+
+int sensor_channel_lookup(const char *name) {
+	int n;
+
+	if (name == NULL) {
+		return -1;
+	}
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (strcmp(name, channel_names[n]) == 0) {
+			return n;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * The JSON messages are formatted by appending constant fragments and
+ * numbers at p, each append checks the room left before writing.
+ */
+
+struct json_out {
+	char *p;
+	char *end;
+};
+
+static int append(struct json_out *o, const char *s, size_t len) {
+	if ((size_t)(o->end - o->p) < len) {
+		return -1;
+	}
+	memcpy(o->p, s, len);
+	o->p += len;
+
+	return 0;
+}
+
+#define APPEND_LITERAL(o, s) append(o, s, sizeof(s) - 1)
+
+/* %llu of v, digits written backwards into a 20 char buffer */
+static int append_u64(struct json_out *o, uint64_t v) {
+	char digits[20], *d = digits + sizeof(digits);
+
+	do {
+		*--d = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+
+	return append(o, d, (size_t)(digits + sizeof(digits) - d));
+}
+
+/* %d and %lld */
+static int append_i64(struct json_out *o, int64_t v) {
+	if (v < 0) {
+		if (APPEND_LITERAL(o, "-")) {
+			return -1;
+		}
+		return append_u64(o, -(uint64_t)v);
+	}
+
+	return append_u64(o, (uint64_t)v);
+}
+
+/*
+ * %2.3f of a float, which always takes more than 2 chars. The float is
+ * m * 2^e exactly, so v * 1000 is rounded to an integer like printf does,
+ * to nearest with ties to even, from m * 1000 shifted right by -e without
+ * any floating point operation. The values beyond 2^31 and the NaN and
+ * infinities, no sensor reading, go through snprintf.
+ */
+static int append_milli(struct json_out *o, float v) {
+	uint32_t bits, mantissa, exponent;
+	uint64_t q, rest, half;
+	char text[48];
+	int shift, len;
+
+	memcpy(&bits, &v, sizeof(bits));
+	exponent = (bits >> 23) & 0xff;
+	mantissa = bits & 0x7fffff;
+
+	if (exponent >= 127 + 31) {
+		len = snprintf(text, sizeof(text), "%2.3f", v);
+		return append(o, text, (size_t)len);
+	}
+
+	if (exponent) {
+		mantissa |= 1u << 23;
+		shift = 150 - (int)exponent; /* v = mantissa * 2^-shift */
+	} else {
+		shift = 149; /* subnormal */
+	}
+
+	q = (uint64_t)mantissa * 1000;
+	if (shift <= 0) {
+		q <<= -shift;
+	} else if (shift < 64) {
+		rest = q & ((1ull << shift) - 1);
+		half = 1ull << (shift - 1);
+		q >>= shift;
+		if (rest > half || (rest == half && (q & 1))) {
+			q++;
+		}
+	} else {
+		q = 0; /* below 0.0005 */
+	}
+
+	if ((bits >> 31) && APPEND_LITERAL(o, "-")) {
+		return -1;
+	}
+	if (append_u64(o, q / 1000) || APPEND_LITERAL(o, ".")) {
+		return -1;
+	}
+	text[0] = (char)('0' + q % 1000 / 100);
+	text[1] = (char)('0' + q % 100 / 10);
+	text[2] = (char)('0' + q % 10);
+
+	return append(o, text, 3);
+}
+
+static int append_channel(struct json_out *o, const struct sensor_message *m, int channel) {
+	int ret;
+
+	switch (channel) {
+	case CHANNEL_TEMP:
+		ret = APPEND_LITERAL(o, "{\"temp\":{\"value\":\"") || append_milli(o, m->temp);
+		break;
+	case CHANNEL_HUMM:
+		ret = APPEND_LITERAL(o, "\"humm\":{\"value\":\"") || append_milli(o, m->humm);
+		break;
+	case CHANNEL_LIGHT:
+		ret = APPEND_LITERAL(o, "\"light\":{\"value\":\"") || append_i64(o, m->light);
+		break;
+	default:
+		ret = APPEND_LITERAL(o, "\"proximity\":{\"value\":\"") ||
+		      append_i64(o, m->proximity);
+		break;
+	}
+
+	return ret ||
+	       APPEND_LITERAL(o, "\", \"isActive\":\"") || append_i64(o, m->is_active[channel]) ||
+	       APPEND_LITERAL(o, "\", \"period\":\"") || append_i64(o, m->period[channel]) ||
+	       APPEND_LITERAL(o, "\", \"time\":\"") || append_i64(o, m->time_ms[channel]) ||
+	       (channel == CHANNEL_COUNT - 1 ? APPEND_LITERAL(o, "\"}}") : APPEND_LITERAL(o, "\"},"));
+}
+
+/*
+ * Format a message of SENSOR_SAMPLE_JSON_FORMAT byte for byte, without
+ * the printf family and its float conversion. Returns its length, not
+ * terminated, or -1 if it doesn't fit in size.
+ */
+int sensor_sample_json(char *buf, size_t size, const struct sensor_message *m) {
+	struct json_out o = { buf, buf + size };
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (append_channel(&o, m, n)) {
+			return -1;
+		}
+	}
+
+	return (int)(o.p - buf);
+}
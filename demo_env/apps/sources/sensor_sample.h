@@ -0,0 +1,75 @@
+/*
+ * Header of the sensor sample shared by the acquisition thread and its consumers.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SENSOR_SAMPLE_H_
+#define _SENSOR_SAMPLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* channels carried by one acquisition cycle */
+
+enum sensor_channel {
+	CHANNEL_TEMP,
+	CHANNEL_HUMM,
+	CHANNEL_LIGHT,
+	CHANNEL_PROXIMITY,
+
+	CHANNEL_COUNT
+};
+
+/* retain the values of one acquisition cycle */
+
+struct sensor_sample {
+	float value[CHANNEL_COUNT];
+	int is_active[CHANNEL_COUNT];
+	int64_t time_ns[CHANNEL_COUNT]; /* CLOCK_MONOTONIC of the reading, 0 if never read */
+};
+
+/*
+ * JSON message of one sample sent to the browsers: value, active flag,
+ * sampling period(ms) and time of the reading(ms since the epoch) of temp,
+ * humm, light and proximity in this order.
+ */
+
+#define SENSOR_SAMPLE_JSON_FORMAT \
+	"{\"temp\":{\"value\":\"%2.3f\", \"isActive\":\"%d\", \"period\":\"%d\", \"time\":\"%lld\"}," \
+	"\"humm\":{\"value\":\"%2.3f\", \"isActive\":\"%d\", \"period\":\"%d\", \"time\":\"%lld\"}," \
+	"\"light\":{\"value\":\"%d\", \"isActive\":\"%d\", \"period\":\"%d\", \"time\":\"%lld\"}," \
+	"\"proximity\":{\"value\":\"%d\", \"isActive\":\"%d\", \"period\":\"%d\", \"time\":\"%lld\"}}"
+
+/*
+ * JSON messages of the other sensor instances, read every cycle: their
+ * name, then the value and active flag of their channels.
+ */
+
+#define SENSOR_HS3001_JSON_FORMAT \
+	"{\"instance\":\"%s\",\"temp\":{\"value\":\"%2.3f\", \"isActive\":\"%d\"}," \
+	"\"humm\":{\"value\":\"%2.3f\", \"isActive\":\"%d\"}}"
+
+#define SENSOR_OB1203_JSON_FORMAT \
+	"{\"instance\":\"%s\",\"light\":{\"value\":\"%d\", \"isActive\":\"%d\"}," \
+	"\"proximity\":{\"value\":\"%d\", \"isActive\":\"%d\"}}"
+
+#define SENSOR_SAMPLE_JSON_MAX 512 /* room for a message of SENSOR_SAMPLE_JSON_FORMAT */
+
+/* the arguments of SENSOR_SAMPLE_JSON_FORMAT, light and proximity are counts */
+
+struct sensor_message {
+	float temp;
+	float humm;
+	int light;
+	int proximity;
+	int is_active[CHANNEL_COUNT];
+	int period[CHANNEL_COUNT]; /* ms */
+	int64_t time_ms[CHANNEL_COUNT]; /* since the epoch */
+};
+
+const char *sensor_channel_name(int channel);
+int sensor_channel_lookup(const char *name);
+int sensor_sample_json(char *buf, size_t size, const struct sensor_message *m);
+
+#endif /* _SENSOR_SAMPLE_H_ */
@@ -0,0 +1,337 @@
+/*
+ * Source of the simulated HS3001 and OB1203 used when no sensor is attached.
+ *
+ * The devices are register level models good enough for the drivers:
+ * the HS3001 latches a new measurement on every measurement request and
+ * reports stale data on a second fetch, the OB1203 has a register file
+ * with auto increment, LS/PS data refreshed on every access once the engine
+ * was enabled for a measurement time, and a PPG FIFO filled at
+ * OB1203_PPG_RATE_HZ while the HR mode is enabled.
+ *
+ * Each bus path opened gets its own pair of devices, at their default
+ * addresses, reading a little apart from the ones of the other buses.
+ *
+ * SENSOR_SIM_FAULT=<address>:<from s>:<for s> makes the devices at that
+ * address stop answering for a while, counted from the first transfer,
+ * e.g. SENSOR_SIM_FAULT=0x44:10:30 for the HS3001s.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sensor_sim.h"
+#include "hs3001.h"
+#include "ob1203.h"
+#include "vclock.h"
+
+#define SIM_BUSES_MAX 8
+#define SIM_PATH_MAX 64
+
+#define SIM_PI 3.14159265f
+
+#define SIM_OB1203_MAIN_CTRL_0 0x15
+#define SIM_OB1203_LS_EN 0x01
+
+struct sim_hs3001 {
+	int fresh; /* a measurement was requested since the last fetch */
+	uint16_t humidity;
+	uint16_t temperature;
+};
+
+struct sim_ob1203 {
+	unsigned char regs[256];
+	unsigned char pointer; /* register address of the next access */
+	int fifo_byte; /* byte of the current sample read from FIFO_DATA */
+	uint32_t fifo[OB1203_FIFO_DEPTH];
+	int fifo_count;
+	uint64_t ppg_produced; /* samples pushed into the FIFO so far */
+	double ppg_start; /* time the PPG mode was enabled */
+	double ls_start; /* time the LS engine was enabled */
+	double ps_start; /* time the PS engine was enabled */
+};
+
+struct sim_fault {
+	int address; /* 0 for no fault */
+	double from; /* s after the start */
+	double length; /* s */
+};
+
+/* the devices of one bus */
+
+struct sim_bus {
+	char path[SIM_PATH_MAX];
+	struct sim_hs3001 hs3001;
+	struct sim_ob1203 ob1203;
+};
+
+static pthread_mutex_t lock_sim = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_bus buses[SIM_BUSES_MAX];
+static int bus_count;
+static struct sim_fault fault;
+static double sim_start;
+
+static double sim_now(void) {
+	struct timespec ts;
+
+	vclock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* slow daily-like drift plus a little noise */
+
+static void hs3001_measure(struct sim_hs3001 *hs, int bus, double t) {
+	float humidity = 50.0f - 2.0f * bus + 10.0f * sinf(2 * SIM_PI * (float)t / 600.0f);
+	float temperature = 23.0f + 0.5f * bus + 3.0f * sinf(2 * SIM_PI * (float)t / 900.0f);
+
+	humidity += (float)(rand() % 100) / 1000.0f;
+	temperature += (float)(rand() % 100) / 1000.0f;
+
+	hs->humidity = (uint16_t)(humidity / 100.0f * 16383.0f);
+	hs->temperature = (uint16_t)((temperature + 40.0f) / 165.0f * 16383.0f);
+	hs->fresh = 1;
+}
+
+static int hs3001_transfer(struct sim_hs3001 *hs, int bus, struct i2c_msg *msg) {
+	if (!(msg->flags & I2C_M_RD)) {
+		hs3001_measure(hs, bus, sim_now());
+		return 0;
+	}
+
+	if (msg->len >= 4) {
+		/* status bits 01: stale data */
+		msg->buf[0] = (unsigned char)((hs->humidity >> 8) | (hs->fresh ? 0x00 : 0x40));
+		msg->buf[1] = (unsigned char)hs->humidity;
+		msg->buf[2] = (unsigned char)(hs->temperature >> 6);
+		msg->buf[3] = (unsigned char)(hs->temperature << 2);
+	}
+	hs->fresh = 0;
+
+	return 0;
+}
+
+/* a hand passes in front of the sensor for 3 s every 20 s */
+
+static void ob1203_refresh_ls_ps(struct sim_ob1203 *ob, int bus, double t, int ps_enabled) {
+	int proximity = ((long)t + 5 * bus) % 20 < 3 ? 500 + rand() % 50 : 10 + rand() % 5;
+	int light = 60 + 10 * bus + (int)(40.0f * sinf(2 * SIM_PI * (float)t / 300.0f));
+
+	/* no data before the first conversion of an enabled engine */
+	ps_enabled = ps_enabled && (ob->regs[OB1203_REG_MAIN_CTRL_1] & OB1203_PPG_ENABLE) &&
+		     t - ob->ps_start >= OB1203_PS_MEASUREMRNT_TIME / 1e6;
+
+	if (!(ob->regs[SIM_OB1203_MAIN_CTRL_0] & SIM_OB1203_LS_EN) ||
+	    t - ob->ls_start < OB1203_LS_MEASUREMRNT_TIME / 1e6)
+		goto ps;
+
+	ob->regs[0x00] |= 0x01; /* LS_DATA_STATUS: new data */
+	ob->regs[0x07] = (unsigned char)(light + rand() % 4); /* green */
+	ob->regs[0x0A] = (unsigned char)(light / 2 + rand() % 4); /* blue */
+	ob->regs[0x0D] = (unsigned char)(light / 2 + rand() % 4); /* red */
+
+ps:
+	if (!ps_enabled)
+		return;
+
+	ob->regs[0x01] |= 0x01; /* PS_DATA_STATUS: new data */
+	ob->regs[0x02] = (unsigned char)proximity;
+	ob->regs[0x03] = (unsigned char)(proximity >> 8);
+}
+
+/* push the samples due since the PPG mode was enabled, rolling over when full */
+
+static void ob1203_fill_fifo(struct sim_ob1203 *ob, double t) {
+	uint64_t due = (uint64_t)((t - ob->ppg_start) * OB1203_PPG_RATE_HZ);
+	unsigned char *wr = &ob->regs[OB1203_REG_FIFO_WR_PTR];
+	unsigned char *rd = &ob->regs[OB1203_REG_FIFO_RD_PTR];
+	unsigned char *ovf = &ob->regs[OB1203_REG_FIFO_OVF_CNT];
+	float s;
+
+	for (; ob->ppg_produced < due; ob->ppg_produced++) {
+		if (ob->fifo_count == OB1203_FIFO_DEPTH) {
+			/* full: the oldest sample is lost */
+			*rd = (*rd + 1) & (OB1203_FIFO_DEPTH - 1);
+			ob->fifo_count--;
+			if (*ovf < 0xFF)
+				(*ovf)++;
+		}
+
+		/* 72 bpm pulse on a DC level */
+		s = (float)ob->ppg_produced / OB1203_PPG_RATE_HZ;
+		ob->fifo[*wr] = (uint32_t)(100000.0f + 2000.0f * sinf(2 * SIM_PI * 1.2f * s)) &
+				   OB1203_PPG_SAMPLE_MASK;
+		*wr = (*wr + 1) & (OB1203_FIFO_DEPTH - 1);
+		ob->fifo_count++;
+	}
+}
+
+static int ob1203_ppg_enabled(const struct sim_ob1203 *ob) {
+	unsigned char ctrl = ob->regs[OB1203_REG_MAIN_CTRL_1];
+
+	return (ctrl & OB1203_PPG_ENABLE) &&
+	       (ctrl & OB1203_PPG_MODE_MASK) == OB1203_PPG_MODE_HR;
+}
+
+static void ob1203_write_reg(struct sim_ob1203 *ob, unsigned char reg, unsigned char value,
+			     double t) {
+	int was_enabled = ob1203_ppg_enabled(ob);
+	unsigned char old = ob->regs[reg];
+
+	ob->regs[reg] = value;
+
+	if (reg == SIM_OB1203_MAIN_CTRL_0 && !(old & SIM_OB1203_LS_EN) && (value & SIM_OB1203_LS_EN))
+		ob->ls_start = t;
+	if (reg == OB1203_REG_MAIN_CTRL_1 && !(old & OB1203_PPG_ENABLE) && (value & OB1203_PPG_ENABLE))
+		ob->ps_start = t;
+
+	if (reg == OB1203_REG_MAIN_CTRL_1 && !was_enabled && ob1203_ppg_enabled(ob)) {
+		ob->ppg_start = t;
+		ob->ppg_produced = 0;
+	}
+	if (reg == OB1203_REG_FIFO_RD_PTR || reg == OB1203_REG_FIFO_WR_PTR) {
+		ob->fifo_byte = 0;
+		ob->fifo_count = (ob->regs[OB1203_REG_FIFO_WR_PTR] -
+				     ob->regs[OB1203_REG_FIFO_RD_PTR]) & (OB1203_FIFO_DEPTH - 1);
+	}
+}
+
+static unsigned char ob1203_read_reg(struct sim_ob1203 *ob) {
+	unsigned char *rd = &ob->regs[OB1203_REG_FIFO_RD_PTR];
+	unsigned char value;
+	uint32_t sample;
+
+	if (ob->pointer != OB1203_REG_FIFO_DATA) {
+		value = ob->regs[ob->pointer];
+		/* reading a status register clears its "new data" flag */
+		if (ob->pointer == 0x00 || ob->pointer == 0x01)
+			ob->regs[ob->pointer] &= ~0x01;
+		ob->pointer++;
+		return value;
+	}
+
+	/* FIFO_DATA doesn't auto increment, it pops 3 bytes per sample */
+	sample = ob->fifo[*rd];
+	value = (unsigned char)(sample >> (8 * (2 - ob->fifo_byte)));
+	if (++ob->fifo_byte == OB1203_PPG_SAMPLE_SIZE) {
+		ob->fifo_byte = 0;
+		if (ob->fifo_count) {
+			*rd = (*rd + 1) & (OB1203_FIFO_DEPTH - 1);
+			ob->fifo_count--;
+		}
+	}
+
+	return value;
+}
+
+static int ob1203_transfer(struct sim_ob1203 *ob, int bus, struct i2c_msg *msg) {
+	double t = sim_now();
+	int n;
+
+	if (ob1203_ppg_enabled(ob))
+		ob1203_fill_fifo(ob, t);
+	ob1203_refresh_ls_ps(ob, bus, t, !ob1203_ppg_enabled(ob));
+
+	if (msg->flags & I2C_M_RD) {
+		for (n = 0; n < msg->len; n++)
+			msg->buf[n] = ob1203_read_reg(ob);
+		return 0;
+	}
+
+	if (msg->len < 1)
+		return 0;
+
+	/* first byte is the register address, the rest are written from there */
+	ob->pointer = msg->buf[0];
+	for (n = 1; n < msg->len; n++)
+		ob1203_write_reg(ob, ob->pointer++, msg->buf[n], t);
+
+	return 0;
+}
+
+static void fault_init(void) {
+	const char *env = getenv("SENSOR_SIM_FAULT");
+
+	sim_start = sim_now();
+
+	if (env && sscanf(env, "%i:%lf:%lf", &fault.address, &fault.from, &fault.length) != 3) {
+		fprintf(stderr, "Error: SENSOR_SIM_FAULT must be <address>:<from s>:<for s>\n");
+		fault.address = 0;
+	}
+}
+
+/* the device doesn't acknowledge its address during the fault window */
+static int fault_active(int address) {
+	double t = sim_now() - sim_start;
+
+	return address == fault.address && t >= fault.from && t < fault.from + fault.length;
+}
+
+int sensor_sim_open(const char *path) {
+	int n;
+
+	pthread_mutex_lock(&lock_sim);
+
+	for (n = 0; n < bus_count; n++) {
+		if (strcmp(buses[n].path, path) == 0) {
+			break;
+		}
+	}
+
+	if (n == bus_count) {
+		if (bus_count == SIM_BUSES_MAX || strlen(path) >= SIM_PATH_MAX) {
+			fprintf(stderr, "Error: can't simulate bus %s\n", path);
+			errno = ENODEV;
+			n = -1;
+		} else {
+			strcpy(buses[bus_count++].path, path);
+		}
+	}
+
+	pthread_mutex_unlock(&lock_sim);
+
+	return n;
+}
+
+int sensor_sim_transfer(int bus, struct i2c_msg *msgs, int nmsgs) {
+	struct sim_bus *b = &buses[bus];
+	int n, ret = 0;
+
+	pthread_mutex_lock(&lock_sim);
+
+	if (sim_start == 0) {
+		fault_init();
+	}
+
+	for (n = 0; n < nmsgs && ret == 0; n++) {
+		if (fault_active(msgs[n].addr)) {
+			errno = ENXIO;
+			ret = -1;
+			break;
+		}
+
+		switch (msgs[n].addr) {
+		case HS3001_SLAVE_ADDRESS:
+			ret = hs3001_transfer(&b->hs3001, bus, &msgs[n]);
+			break;
+		case OB1203_SLAVE_ADDRESS:
+			ret = ob1203_transfer(&b->ob1203, bus, &msgs[n]);
+			break;
+		default:
+			errno = ENXIO;
+			ret = -1;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&lock_sim);
+
+	return ret == -1 ? -1 : nmsgs;
+}
@@ -0,0 +1,23 @@
+/*
+ * Header of the simulated HS3001 and OB1203 used when no sensor is attached.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _SENSOR_SIM_H_
+#define _SENSOR_SIM_H_
+
+#include <linux/i2c.h>
+
+/*
+ * sensor_sim_open() returns the simulated bus of a path, the same one for
+ * every open of the path, or -1. sensor_sim_transfer() serves one
+ * I2C_RDWR transfer from the devices of a bus. Returns the number of
+ * messages like the ioctl, or -1 with errno set to ENXIO when no simulated
+ * device answers the address.
+ */
+
+int sensor_sim_open(const char *path);
+int sensor_sim_transfer(int bus, struct i2c_msg *msgs, int nmsgs);
+
+#endif /* _SENSOR_SIM_H_ */
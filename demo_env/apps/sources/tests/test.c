@@ -0,0 +1,100 @@
+/*
+ * Behaviour tests of the modules without libwebsockets: the rules, the PPG
+ * FIFO drain, the I2C scheduler, the sampling controller, the sample feed,
+ * the gateway boards, the sensor health, the rolling statistics, the
+ * detectors, the sensor instances, the resampler, the capture and the
+ * history.
+ *
+ *   $ ./unit-tests [suite]...
+ *
+ * Runs the suites named, all of them without any, and prints a line per
+ * test. The exit status is 1 if a test failed. ctest runs one suite per
+ * test.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+static const struct {
+	const char *name;
+	const struct test_case *cases;
+} suites[] = {
+	{ "rules", test_rules_cases },
+	{ "ppg", test_ppg_cases },
+	{ "sched", test_sched_cases },
+	{ "sampling", test_sampling_cases },
+	{ "feed", test_feed_cases },
+	{ "gateway", test_gateway_cases },
+	{ "health", test_health_cases },
+	{ "rolling", test_rolling_cases },
+	{ "detector", test_detector_cases },
+	{ "sensors", test_sensors_cases },
+	{ "align", test_align_cases },
+	{ "capture", test_capture_cases },
+	{ "history", test_history_cases },
+};
+
+const char *test_file(const char *text, size_t len) {
+	static char path[64];
+	int fd;
+
+	snprintf(path, sizeof(path), "/tmp/unit-tests-XXXXXX");
+	fd = mkstemp(path);
+	if (fd == -1 || write(fd, text, len) != (ssize_t)len) {
+		perror("test file");
+		exit(1);
+	}
+	close(fd);
+
+	return path;
+}
+
+static int run_suite(const char *name, const struct test_case *cases) {
+	const struct test_case *tc;
+	int failed = 0;
+
+	for (tc = cases; tc->name; tc++) {
+		if (tc->run()) {
+			printf("FAIL %s.%s\n", name, tc->name);
+			failed++;
+		} else {
+			printf("ok   %s.%s\n", name, tc->name);
+		}
+	}
+
+	return failed;
+}
+
+int main(int argc, const char **argv) {
+	int n, m, failed = 0;
+
+	for (n = 0; n < (int)(sizeof(suites) / sizeof(suites[0])); n++) {
+		if (argc > 1) {
+			for (m = 1; m < argc && strcmp(argv[m], suites[n].name); m++) {
+			}
+			if (m == argc) {
+				continue;
+			}
+		}
+		failed += run_suite(suites[n].name, suites[n].cases);
+	}
+
+	/* a suite name misspelt runs nothing */
+	for (m = 1; m < argc; m++) {
+		for (n = 0; n < (int)(sizeof(suites) / sizeof(suites[0])) &&
+			    strcmp(argv[m], suites[n].name); n++) {
+		}
+		if (n == (int)(sizeof(suites) / sizeof(suites[0]))) {
+			fprintf(stderr, "Error: unknown suite %s\n", argv[m]);
+			failed++;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
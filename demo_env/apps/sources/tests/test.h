@@ -0,0 +1,48 @@
+/*
+ * Header of the behaviour tests of the modules without libwebsockets.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+
+/*
+ * One test, run() returns 0 when the behaviour is the expected one. The
+ * tables of cases end with an entry without name.
+ */
+
+struct test_case {
+	const char *name;
+	int (*run)(void);
+};
+
+/* fail the running test, with the condition that didn't hold */
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 1; \
+		} \
+	} while (0)
+
+extern const struct test_case test_rules_cases[];
+extern const struct test_case test_ppg_cases[];
+extern const struct test_case test_sched_cases[];
+extern const struct test_case test_sampling_cases[];
+extern const struct test_case test_feed_cases[];
+extern const struct test_case test_gateway_cases[];
+extern const struct test_case test_health_cases[];
+extern const struct test_case test_rolling_cases[];
+extern const struct test_case test_detector_cases[];
+extern const struct test_case test_sensors_cases[];
+extern const struct test_case test_align_cases[];
+extern const struct test_case test_capture_cases[];
+extern const struct test_case test_history_cases[];
+
+/* a file of len bytes of text, its path in a static buffer */
+const char *test_file(const char *text, size_t len);
+
+#endif /* _TEST_H_ */
@@ -0,0 +1,108 @@
+/*
+ * Tests of the time alignment of the channels on a common grid.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+
+#include "align.h"
+#include "test.h"
+
+#define MS 1000000LL
+
+/* a grid point between two readings, held or interpolated */
+static int modes(void) {
+	struct align a;
+	struct align_sample out;
+
+	align_init(&a, ALIGN_HOLD, 100);
+	align_add(&a, CHANNEL_TEMP, 1050 * MS, 20.0f);
+	align_add(&a, CHANNEL_TEMP, 1150 * MS, 22.0f);
+	CHECK(align_next(&a, 1150 * MS, &out) == 1);
+	CHECK(out.time_ns == 1100 * MS && out.valid[CHANNEL_TEMP]);
+	CHECK(out.value[CHANNEL_TEMP] == 20.0f);
+	CHECK(!out.valid[CHANNEL_HUMM]);
+
+	align_init(&a, ALIGN_LINEAR, 100);
+	align_add(&a, CHANNEL_TEMP, 1050 * MS, 20.0f);
+	align_add(&a, CHANNEL_TEMP, 1150 * MS, 22.0f);
+	CHECK(align_next(&a, 1150 * MS, &out) == 1);
+	CHECK(fabsf(out.value[CHANNEL_TEMP] - 21.0f) < 1e-5f);
+
+	/* the next point has no reading after it yet */
+	CHECK(align_next(&a, 1150 * MS, &out) == 0);
+
+	align_init(&a, ALIGN_OFF, 100);
+	align_add(&a, CHANNEL_TEMP, 1050 * MS, 20.0f);
+	CHECK(align_next(&a, 1050 * MS, &out) == 0);
+
+	return 0;
+}
+
+/*
+ * A fast and a slow channel: the grid waits for the slow one, the points
+ * it waited for are all emitted and the fast one is interpolated from its
+ * own readings.
+ */
+static int periods(void) {
+	struct align a;
+	struct align_sample out;
+	int64_t t, last = 0;
+	int points = 0;
+
+	align_init(&a, ALIGN_LINEAR, 250);
+	for (t = 1000; t < 30000; t += 250) {
+		align_add(&a, CHANNEL_PROXIMITY, t * MS, (float)t);
+		if (t % 4000 == 0) {
+			align_add(&a, CHANNEL_TEMP, t * MS, (float)t);
+		}
+		while (align_next(&a, t * MS, &out)) {
+			CHECK(!last || out.time_ns == last + 250 * MS);
+			CHECK(out.valid[CHANNEL_PROXIMITY]);
+			CHECK(out.value[CHANNEL_PROXIMITY] == (float)(out.time_ns / MS));
+			last = out.time_ns;
+			points++;
+		}
+	}
+	CHECK(points > 80);
+
+	return 0;
+}
+
+/* a channel that stopped delivering no longer holds the grid */
+static int stale(void) {
+	struct align a;
+	struct align_sample out;
+	int64_t t;
+	int points = 0;
+
+	align_init(&a, ALIGN_HOLD, 100);
+	align_add(&a, CHANNEL_HUMM, 900 * MS, 40.0f);
+	align_add(&a, CHANNEL_HUMM, 1000 * MS, 40.0f);
+	for (t = 1000; t <= 2000; t += 100) {
+		align_add(&a, CHANNEL_LIGHT, t * MS, 300.0f);
+		while (align_next(&a, t * MS, &out)) {
+			points++;
+		}
+	}
+	CHECK(points >= 8);
+	CHECK(out.valid[CHANNEL_LIGHT] && !out.valid[CHANNEL_HUMM]);
+
+	return 0;
+}
+
+static int dewpoint(void) {
+	CHECK(fabsf(align_dewpoint(20.0f, 50.0f) - 9.26f) < 0.05f);
+	CHECK(fabsf(align_dewpoint(25.0f, 100.0f) - 25.0f) < 0.01f);
+
+	return 0;
+}
+
+const struct test_case test_align_cases[] = {
+	{ "modes", modes },
+	{ "periods", periods },
+	{ "stale", stale },
+	{ "dewpoint", dewpoint },
+	{ NULL, NULL }
+};
@@ -0,0 +1,101 @@
+/*
+ * Tests of the triggered capture.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdlib.h>
+
+#include "capture.h"
+#include "test.h"
+
+#define PERIOD_NS 2500000 /* 400Hz */
+
+static struct capture capture;
+
+static int parse(void) {
+	struct capture_config config;
+
+	CHECK(capture_parse("none", &config) == 0);
+	CHECK(config.edge == CAPTURE_NONE && config.pre_ms == CAPTURE_PRE_MS &&
+	      config.post_ms == CAPTURE_POST_MS);
+
+	CHECK(capture_parse("falling 500 pre 100 post 2000", &config) == 0);
+	CHECK(config.edge == CAPTURE_FALLING && config.level == 500 &&
+	      config.pre_ms == 100 && config.post_ms == 2000);
+
+	/* the windows together fit the ring */
+	CHECK(capture_parse("rising 1 pre 2560 post 2560", &config) == 0);
+	CHECK(capture_parse("rising 1 pre 3000 post 3000", &config) == -1);
+	CHECK(capture_parse("rising 1 post 20000", &config) == -1);
+	CHECK(capture_parse("rising", &config) == -1);
+	CHECK(capture_parse("sideways 1", &config) == -1);
+	CHECK(capture_parse("none pre", &config) == -1);
+	CHECK(config.edge == CAPTURE_RISING && config.pre_ms == 2560);
+
+	return 0;
+}
+
+/* the windows before and after a rising edge, the trigger at pre */
+static int rising(void) {
+	struct capture_config config;
+	struct capture_header *hdr;
+	struct capture_point *pt;
+	int n, done = -1;
+
+	CHECK(capture_parse("rising 1000 pre 100 post 50", &config) == 0);
+	capture_init(&capture, &config, CAPTURE_SOURCE_PPG);
+
+	for (n = 0; n < 1000 && done == -1; n++) {
+		if (capture_push(&capture, (int64_t)n * PERIOD_NS, n < 500 ? 10 : 2000)) {
+			done = n;
+		}
+	}
+	CHECK(done == 500 + 20);
+
+	hdr = malloc(capture_size(&capture));
+	CHECK(hdr);
+	capture_blob(&capture, hdr, 1234);
+	pt = (struct capture_point *)(hdr + 1);
+	CHECK(hdr->type == CAPTURE_BLOB_TYPE && !hdr->forced && hdr->trigger_ms == 1234);
+	CHECK(hdr->pre == 40 && hdr->count == 40 + 21);
+	CHECK(pt[hdr->pre].offset_us == 0 && pt[hdr->pre].value == 2000);
+	CHECK(pt[hdr->pre - 1].value == 10 && pt[0].offset_us == -100000);
+	free(hdr);
+
+	/* armed again, the level stays above */
+	for (n = 1000; n < 1100; n++) {
+		CHECK(!capture_push(&capture, (int64_t)n * PERIOD_NS, 2000));
+	}
+
+	return 0;
+}
+
+/* a command triggers on the next sample */
+static int forced(void) {
+	struct capture_config config;
+	int n;
+
+	CHECK(capture_parse("none pre 10 post 10", &config) == 0);
+	capture_init(&capture, &config, CAPTURE_SOURCE_PPG);
+
+	for (n = 0; n < 100; n++) {
+		CHECK(!capture_push(&capture, (int64_t)n * PERIOD_NS, 5000));
+	}
+	capture_force(&capture);
+	for (n = 100; n < 104; n++) {
+		CHECK(!capture_push(&capture, (int64_t)n * PERIOD_NS, 5000));
+	}
+	CHECK(capture_push(&capture, (int64_t)n * PERIOD_NS, 5000));
+	CHECK(capture.trigger_forced && capture.captures == 1);
+	CHECK(capture_trigger_ns(&capture) == 100LL * PERIOD_NS);
+
+	return 0;
+}
+
+const struct test_case test_capture_cases[] = {
+	{ "parse", parse },
+	{ "rising", rising },
+	{ "forced", forced },
+	{ NULL, NULL }
+};
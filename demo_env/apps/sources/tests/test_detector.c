@@ -0,0 +1,137 @@
+/*
+ * Tests of the streaming anomaly and change detectors of the channels.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "config_file.h"
+#include "detector.h"
+#include "test.h"
+
+static struct detector_event events[DETECTOR_EVENTS_MAX];
+
+/* a reading out of the range raises an event, back in it clears it */
+static int range(void) {
+	struct detector d;
+
+	CHECK(detector_compile("temp range -10 50", &d) == 0);
+	CHECK(d.enabled);
+
+	CHECK(detector_update(&d, CHANNEL_TEMP, 20.0f, events) == 0);
+	CHECK(detector_update(&d, CHANNEL_TEMP, 60.0f, events) == 1);
+	CHECK(events[0].kind == DETECT_RANGE && events[0].direction == 1 &&
+	      !events[0].cleared && events[0].reference == 50.0f);
+	CHECK(detector_update(&d, CHANNEL_TEMP, 61.0f, events) == 0);
+	CHECK(detector_update(&d, CHANNEL_TEMP, 20.0f, events) == 1);
+	CHECK(events[0].cleared && events[0].direction == 1);
+	CHECK(d.events[CHANNEL_TEMP][DETECT_RANGE] == 1);
+
+	return 0;
+}
+
+/* "stuck" identical readings raise an event, a different one clears it */
+static int stuck(void) {
+	struct detector d;
+	int n;
+
+	CHECK(detector_compile("# stuck\nproximity stuck 5\n", &d) == 0);
+
+	for (n = 0; n < 4; n++) {
+		CHECK(detector_update(&d, CHANNEL_PROXIMITY, 12.0f, events) == 0);
+	}
+	CHECK(detector_update(&d, CHANNEL_PROXIMITY, 12.0f, events) == 1);
+	CHECK(events[0].kind == DETECT_STUCK && events[0].reference == 12.0f);
+	CHECK(detector_update(&d, CHANNEL_PROXIMITY, 12.0f, events) == 0);
+	CHECK(detector_update(&d, CHANNEL_PROXIMITY, 13.0f, events) == 1);
+	CHECK(events[0].kind == DETECT_STUCK && events[0].cleared);
+
+	return 0;
+}
+
+/* a step of the level fires once, in its direction, then is learnt */
+static int change(void) {
+	struct detector d;
+	int n, count = 0, fired = 0;
+
+	CHECK(detector_compile("humm change sigma 0.5", &d) == 0);
+
+	for (n = 0; n < 100; n++) {
+		CHECK(detector_update(&d, CHANNEL_HUMM, 40.0f + (n & 1) * 0.2f, events) == 0);
+	}
+	for (n = 0; n < 100; n++) {
+		count = detector_update(&d, CHANNEL_HUMM, 50.0f + (n & 1) * 0.2f, events);
+		if (count) {
+			CHECK(events[0].kind == DETECT_CHANGE && events[0].direction == 1);
+			CHECK(events[0].reference < 41.0f);
+			fired++;
+		}
+	}
+	CHECK(fired == 1);
+
+	return 0;
+}
+
+/* an error leaves the detectors as they were */
+static int rejected(void) {
+	static const char *const invalid[] = {
+		"pressure change",
+		"temp change slack -1",
+		"temp change threshold 0",
+		"temp change alpha 2",
+		"temp stuck 1",
+		"temp range 10 0",
+		"temp range 10",
+		"temp sometimes",
+	};
+	struct detector d;
+	int n;
+
+	CHECK(detector_compile("light range 0 1000", &d) == 0);
+	for (n = 0; n < (int)(sizeof(invalid) / sizeof(invalid[0])); n++) {
+		CHECK(detector_compile(invalid[n], &d) == -1);
+		CHECK(d.ch[CHANNEL_LIGHT].range && !d.ch[CHANNEL_TEMP].change);
+	}
+
+	return 0;
+}
+
+/* a file is compiled whole whatever its size, but a line too long is refused */
+static int long_file(void) {
+	struct detector d;
+	char text[4096];
+	const char *path;
+	int n, ret;
+
+	memset(text, '#', sizeof(text));
+	for (n = 63; n < (int)sizeof(text); n += 64) {
+		text[n] = '\n';
+	}
+	memcpy(text, "temp range 0 40\n", 16);
+	memcpy(text + sizeof(text) - 64, "light stuck 3\n", 14);
+
+	path = test_file(text, sizeof(text));
+	ret = detector_load_file(path, &d);
+	unlink(path);
+	CHECK(ret == 0 && d.ch[CHANNEL_TEMP].range && d.ch[CHANNEL_LIGHT].stuck);
+
+	memset(text, ' ', CONFIG_LINE_MAX);
+	memcpy(text + CONFIG_LINE_MAX, "\nhumm range 0 90\n", 18);
+	path = test_file(text, CONFIG_LINE_MAX + 18);
+	ret = detector_load_file(path, &d);
+	unlink(path);
+	CHECK(ret == -1 && !d.ch[CHANNEL_HUMM].range);
+
+	return 0;
+}
+
+const struct test_case test_detector_cases[] = {
+	{ "range", range },
+	{ "stuck", stuck },
+	{ "change", change },
+	{ "rejected", rejected },
+	{ "long_file", long_file },
+	{ NULL, NULL }
+};
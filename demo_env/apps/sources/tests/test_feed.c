@@ -0,0 +1,215 @@
+/*
+ * Tests of the shared memory sample feed: the order of the records, the
+ * readers lapped by the producer and the seqlock of the slots.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "sample_feed.h"
+#include "test.h"
+
+#define FEED_RACE_SAMPLES 200000
+
+static char feed_name[64];
+
+/* every field of the sample of seq holds seq, a torn copy mixes two */
+static void publish(struct sample_feed *feed, uint64_t seq) {
+	struct sensor_sample sample;
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		sample.value[n] = (float)(seq % 1000000);
+		sample.is_active[n] = 1;
+		sample.time_ns[n] = (int64_t)seq;
+	}
+	sample_feed_publish(feed, &sample, (int64_t)seq);
+}
+
+static int consistent(const struct sample_feed_record *record) {
+	int n;
+
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		if (record->sample.value[n] != (float)(record->seq % 1000000) ||
+		    record->sample.time_ns[n] != (int64_t)record->seq) {
+			return 0;
+		}
+	}
+
+	return record->timestamp_ns == (int64_t)record->seq;
+}
+
+/* a producer and a reader of its own feed, the reader maps it read-only */
+static int feed_open(struct sample_feed **producer, struct sample_feed **reader) {
+	snprintf(feed_name, sizeof(feed_name), "/unit-tests-feed-%d", (int)getpid());
+
+	*producer = sample_feed_create(feed_name);
+	if (*producer == NULL) {
+		return -1;
+	}
+	*reader = sample_feed_open(feed_name);
+	if (*reader == NULL) {
+		sample_feed_destroy(*producer);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void feed_close(struct sample_feed *producer, struct sample_feed *reader) {
+	sample_feed_close(reader);
+	sample_feed_destroy(producer);
+}
+
+/* a reader gets the records published after it started, in order */
+static int in_order(void) {
+	struct sample_feed *producer, *feed;
+	struct sample_feed_reader reader;
+	struct sample_feed_record record;
+	uint64_t seq;
+
+	CHECK(feed_open(&producer, &feed) == 0);
+
+	CHECK(sample_feed_latest(feed, &record) == 0);
+	publish(producer, 0);
+	sample_feed_reader_init(&reader, feed);
+	CHECK(sample_feed_read(&reader, &record) == 0);
+	CHECK(sample_feed_wait(&reader, 10) == 0);
+
+	for (seq = 1; seq <= 10; seq++) {
+		publish(producer, seq);
+	}
+	CHECK(sample_feed_wait(&reader, 10) == 1);
+	for (seq = 1; seq <= 10; seq++) {
+		CHECK(sample_feed_read(&reader, &record) == 1);
+		CHECK(record.seq == seq && consistent(&record));
+	}
+	CHECK(sample_feed_read(&reader, &record) == 0);
+	CHECK(reader.lost == 0);
+
+	CHECK(sample_feed_latest(feed, &record) == 1 && record.seq == 10);
+
+	feed_close(producer, feed);
+
+	return 0;
+}
+
+/* a reader lapped skips to the oldest record left and counts the others lost */
+static int lapped(void) {
+	struct sample_feed *producer, *feed;
+	struct sample_feed_reader reader;
+	struct sample_feed_record record;
+	uint64_t seq, head = 3 * SAMPLE_FEED_SLOTS + 5;
+
+	CHECK(feed_open(&producer, &feed) == 0);
+
+	sample_feed_reader_init(&reader, feed);
+	for (seq = 0; seq < head; seq++) {
+		publish(producer, seq);
+	}
+
+	/* a slot of margin is kept from the producer */
+	CHECK(sample_feed_read(&reader, &record) == 1);
+	CHECK(record.seq == head - SAMPLE_FEED_SLOTS + 1 && consistent(&record));
+	CHECK(reader.lost == head - SAMPLE_FEED_SLOTS + 1);
+
+	for (seq = record.seq + 1; seq < head; seq++) {
+		CHECK(sample_feed_read(&reader, &record) == 1 && record.seq == seq);
+	}
+	CHECK(sample_feed_read(&reader, &record) == 0);
+	CHECK(reader.lost == head - SAMPLE_FEED_SLOTS + 1);
+
+	feed_close(producer, feed);
+
+	return 0;
+}
+
+/* a slot the producer is rewriting isn't read until it is done */
+static int slot_locked(void) {
+	struct sample_feed *producer, *feed;
+	struct sample_feed_reader reader;
+	struct sample_feed_record record;
+	struct sample_feed_slot *slot;
+
+	CHECK(feed_open(&producer, &feed) == 0);
+
+	sample_feed_reader_init(&reader, feed);
+	publish(producer, 0);
+
+	/* as in the middle of sample_feed_publish() */
+	slot = &producer->hdr->slot[0];
+	atomic_fetch_add(&slot->lock, 1);
+	CHECK(sample_feed_read(&reader, &record) == 0 && reader.next == 0);
+	CHECK(sample_feed_latest(feed, &record) == 0);
+
+	atomic_fetch_add(&slot->lock, 1);
+	CHECK(sample_feed_read(&reader, &record) == 1 && record.seq == 0);
+	CHECK(consistent(&record));
+
+	feed_close(producer, feed);
+
+	return 0;
+}
+
+static void *thread_publish(void *d) {
+	struct sample_feed *producer = d;
+	uint64_t seq;
+
+	for (seq = 0; seq < FEED_RACE_SAMPLES; seq++) {
+		publish(producer, seq);
+	}
+
+	return NULL;
+}
+
+/*
+ * A reader racing the producer never copies a torn record, and every
+ * record is either read once, in order, or counted lost. The race needs
+ * two CPUs to bite.
+ */
+static int seqlock(void) {
+	struct sample_feed *producer, *feed;
+	struct sample_feed_reader reader;
+	struct sample_feed_record record;
+	pthread_t thread;
+	uint64_t read = 0, next = 0;
+	int torn = 0, disordered = 0;
+
+	CHECK(feed_open(&producer, &feed) == 0);
+
+	sample_feed_reader_init(&reader, feed);
+	CHECK(pthread_create(&thread, NULL, thread_publish, producer) == 0);
+
+	while (next < FEED_RACE_SAMPLES) {
+		if (!sample_feed_read(&reader, &record)) {
+			continue;
+		}
+		read++;
+		if (!consistent(&record)) {
+			torn++;
+		}
+		if (record.seq < next) {
+			disordered++;
+		}
+		next = record.seq + 1;
+	}
+	pthread_join(thread, NULL);
+
+	CHECK(torn == 0 && disordered == 0);
+	CHECK(read + reader.lost == FEED_RACE_SAMPLES);
+
+	feed_close(producer, feed);
+
+	return 0;
+}
+
+const struct test_case test_feed_cases[] = {
+	{ "in_order", in_order },
+	{ "lapped", lapped },
+	{ "slot_locked", slot_locked },
+	{ "seqlock", seqlock },
+	{ NULL, NULL }
+};
@@ -0,0 +1,99 @@
+/*
+ * Tests of the board list file of the gateway mode.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gateway.h"
+#include "test.h"
+
+static struct gateway_config config;
+
+static int load(const char *text) {
+	const char *path;
+	int ret;
+
+	path = test_file(text, strlen(text));
+	ret = gateway_load_file(path, &config);
+	unlink(path);
+
+	return ret;
+}
+
+/* the port and the path are optional, comments and blank lines skipped */
+static int boards(void) {
+	CHECK(load("# boards\n"
+		   "\n"
+		   "kitchen 192.168.1.10   # the default port\r\n"
+		   "\tgarage.1 garage.local 8080 /graph\n") == 0);
+	CHECK(config.count == 2);
+
+	CHECK(strcmp(config.boards[0].id, "kitchen") == 0);
+	CHECK(strcmp(config.boards[0].address, "192.168.1.10") == 0);
+	CHECK(config.boards[0].port == GATEWAY_DEFAULT_PORT);
+	CHECK(strcmp(config.boards[0].path, "/") == 0);
+
+	CHECK(strcmp(config.boards[1].id, "garage.1") == 0);
+	CHECK(strcmp(config.boards[1].address, "garage.local") == 0);
+	CHECK(config.boards[1].port == 8080);
+	CHECK(strcmp(config.boards[1].path, "/graph") == 0);
+
+	return 0;
+}
+
+/* the ids go verbatim in the JSON, and are unique */
+static int rejected(void) {
+	static const char *const invalid[] = {
+		"kitchen\n",
+		"kit\"chen 10.0.0.1\n",
+		"kitchen 10.0.0.1 0\n",
+		"kitchen 10.0.0.1 65536\n",
+		"kitchen 10.0.0.1 80x\n",
+		"kitchen 10.0.0.1\ngarage 10.0.0.2\nkitchen 10.0.0.3\n",
+		"# no board\n\n",
+	};
+	char text[GATEWAY_ADDRESS_MAX + 16];
+	int n;
+
+	for (n = 0; n < (int)(sizeof(invalid) / sizeof(invalid[0])); n++) {
+		CHECK(load(invalid[n]) == -1);
+	}
+
+	snprintf(text, sizeof(text), "kitchen %0*d\n", GATEWAY_ADDRESS_MAX, 1);
+	CHECK(load(text) == -1);
+	snprintf(text, sizeof(text), "%0*d 10.0.0.1\n", GATEWAY_ID_MAX, 1);
+	CHECK(load(text) == -1);
+
+	CHECK(gateway_load_file("/nonexistent/boards", &config) == -1);
+
+	return 0;
+}
+
+/* up to GATEWAY_BOARDS_MAX boards */
+static int board_count(void) {
+	char text[GATEWAY_BOARDS_MAX * 24 + 32] = "";
+	char line[24];
+	int n;
+
+	for (n = 0; n < GATEWAY_BOARDS_MAX; n++) {
+		snprintf(line, sizeof(line), "board%d 10.0.0.%d\n", n, n);
+		strcat(text, line);
+	}
+	CHECK(load(text) == 0 && config.count == GATEWAY_BOARDS_MAX);
+
+	strcat(text, "extra 10.0.1.1\n");
+	CHECK(load(text) == -1);
+
+	return 0;
+}
+
+const struct test_case test_gateway_cases[] = {
+	{ "boards", boards },
+	{ "rejected", rejected },
+	{ "board_count", board_count },
+	{ NULL, NULL }
+};
@@ -0,0 +1,84 @@
+/*
+ * Tests of the circuit breaker tracking the health of each sensor.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include "sensor_health.h"
+#include "test.h"
+
+static enum health_event fail(struct sensor_health *h, int times, long now) {
+	enum health_event ev = HEALTH_EVENT_NONE;
+
+	while (times--) {
+		ev = sensor_health_report(h, 0, now);
+	}
+
+	return ev;
+}
+
+/* HEALTH_FAILURES in a row open the breaker, a success in between doesn't */
+static int opens(void) {
+	struct sensor_health h;
+
+	sensor_health_init(&h, "hs3001");
+	CHECK(sensor_health_active(&h));
+
+	CHECK(fail(&h, HEALTH_FAILURES - 1, 0) == HEALTH_EVENT_NONE);
+	CHECK(!sensor_health_active(&h));
+	CHECK(sensor_health_report(&h, 1, 0) == HEALTH_EVENT_NONE);
+	CHECK(sensor_health_active(&h));
+
+	CHECK(fail(&h, HEALTH_FAILURES, 0) == HEALTH_EVENT_OPENED);
+	CHECK(h.opened == 1 && h.errors == 2 * HEALTH_FAILURES - 1);
+	CHECK(!sensor_health_allow(&h, HEALTH_BACKOFF_MIN - 1));
+
+	return 0;
+}
+
+/* the probes back off exponentially up to HEALTH_BACKOFF_MAX */
+static int probes(void) {
+	struct sensor_health h;
+	long now = 0;
+	int backoff = HEALTH_BACKOFF_MIN;
+
+	sensor_health_init(&h, "ob1203");
+	CHECK(fail(&h, HEALTH_FAILURES, now) == HEALTH_EVENT_OPENED);
+
+	while (backoff < HEALTH_BACKOFF_MAX) {
+		CHECK(!sensor_health_allow(&h, now + backoff - 1));
+		now += backoff;
+		CHECK(sensor_health_allow(&h, now));
+		CHECK(h.state == HEALTH_HALF_OPEN);
+		CHECK(sensor_health_report(&h, 0, now) == HEALTH_EVENT_PROBE_FAILED);
+		backoff = backoff * 2 < HEALTH_BACKOFF_MAX ? backoff * 2 : HEALTH_BACKOFF_MAX;
+		CHECK(h.backoff == backoff);
+	}
+
+	return 0;
+}
+
+/* a probe answering closes the breaker and resets the backoff */
+static int recovers(void) {
+	struct sensor_health h;
+
+	sensor_health_init(&h, "ob1203");
+	fail(&h, HEALTH_FAILURES, 0);
+	CHECK(sensor_health_allow(&h, HEALTH_BACKOFF_MIN));
+	CHECK(sensor_health_report(&h, 0, HEALTH_BACKOFF_MIN) == HEALTH_EVENT_PROBE_FAILED);
+	CHECK(sensor_health_allow(&h, 3 * HEALTH_BACKOFF_MIN));
+	CHECK(sensor_health_report(&h, 1, 3 * HEALTH_BACKOFF_MIN) == HEALTH_EVENT_RECOVERED);
+
+	CHECK(h.state == HEALTH_CLOSED && h.backoff == HEALTH_BACKOFF_MIN);
+	CHECK(sensor_health_active(&h));
+	CHECK(sensor_health_allow(&h, 3 * HEALTH_BACKOFF_MIN));
+
+	return 0;
+}
+
+const struct test_case test_health_cases[] = {
+	{ "opens", opens },
+	{ "probes", probes },
+	{ "recovers", recovers },
+	{ NULL, NULL }
+};
@@ -0,0 +1,89 @@
+/*
+ * Tests of the history of the messages kept for the resuming clients.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "history.h"
+#include "test.h"
+
+static int retained(const struct history *h, uint64_t seq, const char *text) {
+	const struct history_entry *e = history_get(h, seq);
+
+	return e && e->len == strlen(text) && !memcmp(history_data(h, e), text, e->len);
+}
+
+static int append_get(void) {
+	struct history h;
+
+	CHECK(history_init(&h, 64) == 0);
+	CHECK(!history_get(&h, 1));
+
+	history_append(&h, 1, "{\"a\":1}", 7, 2);
+	history_append(&h, 2, "{\"b\":2}", 7, 3);
+	CHECK(retained(&h, 1, "{\"a\":1}") && retained(&h, 2, "{\"b\":2}"));
+	CHECK(history_get(&h, 2)->tag == 3);
+	CHECK(!history_get(&h, 3) && !history_get(&h, 0));
+
+	history_destroy(&h);
+
+	return 0;
+}
+
+/* the oldest messages make room, what is retained stays consecutive */
+static int wraps(void) {
+	struct history h;
+	char text[16];
+	uint64_t seq;
+
+	CHECK(history_init(&h, 100) == 0);
+	for (seq = 1; seq <= 50; seq++) {
+		snprintf(text, sizeof(text), "message %03d", (int)seq);
+		history_append(&h, seq, text, strlen(text), 0);
+		CHECK(retained(&h, seq, text));
+		CHECK(h.used <= h.size);
+	}
+	CHECK(h.next == 51 && h.first > 40);
+	for (seq = h.first; seq < h.next; seq++) {
+		snprintf(text, sizeof(text), "message %03d", (int)seq);
+		CHECK(retained(&h, seq, text));
+	}
+	CHECK(!history_get(&h, h.first - 1));
+
+	history_destroy(&h);
+
+	return 0;
+}
+
+/* a gap in the seq or a message larger than the history clears it */
+static int clears(void) {
+	struct history h;
+	char big[65];
+
+	CHECK(history_init(&h, 64) == 0);
+	history_append(&h, 1, "one", 3, 0);
+	history_append(&h, 5, "five", 4, 0);
+	CHECK(!history_get(&h, 1) && retained(&h, 5, "five"));
+
+	memset(big, 'x', sizeof(big));
+	history_append(&h, 6, big, sizeof(big), 0);
+	CHECK(!history_get(&h, 5) && !history_get(&h, 6));
+	history_append(&h, 7, "seven", 5, 0);
+	CHECK(retained(&h, 7, "seven"));
+
+	history_destroy(&h);
+
+	CHECK(history_init(&h, 0) == -1);
+
+	return 0;
+}
+
+const struct test_case test_history_cases[] = {
+	{ "append_get", append_get },
+	{ "wraps", wraps },
+	{ "clears", clears },
+	{ NULL, NULL }
+};
@@ -0,0 +1,139 @@
+/*
+ * Tests of the OB1203 PPG FIFO drain, against the simulated sensor.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "i2c_sched.h"
+#include "ob1203.h"
+#include "test.h"
+#include "vclock.h"
+
+#define PPG_BUS "/dev/i2c-ppg"
+#define PPG_ATTEMPTS 20
+
+/* sample is the k-th one the simulated sensor produced since the PPG mode was enabled */
+static int same_sample(uint32_t sample, int k) {
+	float s = (float)k / OB1203_PPG_RATE_HZ;
+	long expected = (long)(100000.0f + 2000.0f * sinf(2 * 3.14159265f * 1.2f * s));
+
+	return labs((long)sample - expected) <= 1;
+}
+
+/* the PPG mode restarted, the FIFO empty and the first sample due in 1/rate */
+static int64_t ppg_restart(void) {
+	set_standby(PPG_BUS, OB1203_SLAVE_ADDRESS, 1);
+	set_ppg_mode(PPG_BUS, OB1203_SLAVE_ADDRESS);
+
+	return vclock_now_ns();
+}
+
+/* sleep until the middle of the period the n-th sample is in the FIFO */
+static void ppg_wait(int64_t start, int n) {
+	int64_t until = start + (2 * n + 1) * 1000000000LL / OB1203_PPG_RATE_HZ / 2;
+	int64_t now = vclock_now_ns();
+
+	if (until > now) {
+		vclock_usleep((until - now) / 1000);
+	}
+}
+
+/* the samples drained are the ones produced, in order */
+static int drain_order(void) {
+	struct i2c_sched sched;
+	struct ob1203_ppg_data data;
+	int64_t start;
+	int n, m, k = 0;
+
+	CHECK(i2c_sched_init_inline(&sched, PPG_BUS) == 0);
+
+	start = ppg_restart();
+	for (n = 1; n <= 3; n++) {
+		ppg_wait(start, 10 * n);
+		CHECK(read_ppg_fifo(&sched, OB1203_SLAVE_ADDRESS, &data, 0) > 0);
+		CHECK(!data.overflow);
+		for (m = 0; m < data.count; m++, k++) {
+			CHECK(same_sample(data.samples[m], k));
+		}
+	}
+	CHECK(k >= 30);
+
+	/* nothing produced since */
+	CHECK(read_ppg_fifo(&sched, OB1203_SLAVE_ADDRESS, &data, 0) == 0);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/*
+ * Equal pointers are a full FIFO when the drain is late: the 32 samples
+ * are read, not 0. The drain lands on the exact full period by sleeping,
+ * so a few attempts are allowed.
+ */
+static int exactly_full(void) {
+	struct i2c_sched sched;
+	struct ob1203_ppg_data data;
+	int64_t start;
+	int n, attempt, full = 0;
+
+	CHECK(i2c_sched_init_inline(&sched, PPG_BUS) == 0);
+
+	for (attempt = 0; attempt < PPG_ATTEMPTS && !full; attempt++) {
+		start = ppg_restart();
+		ppg_wait(start, OB1203_FIFO_DEPTH);
+		n = read_ppg_fifo(&sched, OB1203_SLAVE_ADDRESS, &data, 1);
+		CHECK(n == data.count);
+		if (n == OB1203_FIFO_DEPTH && !data.overflow) {
+			full = 1;
+		}
+	}
+	CHECK(full);
+
+	for (n = 0; n < OB1203_FIFO_DEPTH; n++) {
+		CHECK(same_sample(data.samples[n], n));
+	}
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* past full the oldest samples are lost and counted, the newest read */
+static int overflow(void) {
+	struct i2c_sched sched;
+	struct ob1203_ppg_data data;
+	int64_t start;
+	int n, first;
+
+	CHECK(i2c_sched_init_inline(&sched, PPG_BUS) == 0);
+
+	start = ppg_restart();
+	ppg_wait(start, OB1203_FIFO_DEPTH + 20);
+	CHECK(read_ppg_fifo(&sched, OB1203_SLAVE_ADDRESS, &data, 0) == OB1203_FIFO_DEPTH);
+	CHECK(data.overflow > 0);
+
+	/* the lost ones came first */
+	first = data.overflow;
+	for (n = 0; n < OB1203_FIFO_DEPTH; n++) {
+		CHECK(same_sample(data.samples[n], first + n));
+	}
+
+	/* the overflow count was cleared */
+	CHECK(read_ppg_fifo(&sched, OB1203_SLAVE_ADDRESS, &data, 0) >= 0);
+	CHECK(data.overflow == 0);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+const struct test_case test_ppg_cases[] = {
+	{ "drain_order", drain_order },
+	{ "exactly_full", exactly_full },
+	{ "overflow", overflow },
+	{ NULL, NULL }
+};
@@ -0,0 +1,72 @@
+/*
+ * Tests of the rolling statistics of each channel over fixed windows.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <math.h>
+
+#include "rolling_stats.h"
+#include "test.h"
+
+static struct rolling_stats stats;
+
+/* the moments and the extremes over slices merged and not */
+static int moments(void) {
+	struct rolling_summary sum;
+	long now = 0;
+	int n;
+
+	rolling_init(&stats, now);
+	for (n = 1; n <= 20; n++) {
+		now += 250;
+		rolling_update(&stats, CHANNEL_TEMP, (float)n, now);
+	}
+
+	rolling_summary(&stats, CHANNEL_TEMP, ROLLING_1M, now, &sum);
+	CHECK(sum.n == 20);
+	CHECK(fabs(sum.mean - 10.5) < 1e-9);
+	CHECK(fabs(sum.stddev - sqrt(35.0)) < 1e-9);
+	CHECK(sum.min == 1.0f && sum.max == 20.0f);
+	CHECK(sum.quantile >= 18.0f && sum.quantile <= 20.0f);
+
+	/* the other channels have no reading */
+	rolling_summary(&stats, CHANNEL_HUMM, ROLLING_1M, now, &sum);
+	CHECK(sum.n == 0);
+
+	return 0;
+}
+
+/* the readings leave a window once it moved past them */
+static int window_moves(void) {
+	struct rolling_summary sum;
+	long now = 0;
+	int n;
+
+	rolling_init(&stats, now);
+	rolling_update(&stats, CHANNEL_LIGHT, 5000.0f, now);
+	for (n = 0; n < 120; n++) {
+		now += 1000;
+		rolling_update(&stats, CHANNEL_LIGHT, 100.0f, now);
+	}
+
+	rolling_summary(&stats, CHANNEL_LIGHT, ROLLING_1M, now, &sum);
+	CHECK(sum.n == ROLLING_SLICES - 1 + 1);
+	CHECK(sum.min == 100.0f && sum.max == 100.0f && sum.stddev < 1e-6);
+
+	/* still in the hour */
+	rolling_summary(&stats, CHANNEL_LIGHT, ROLLING_1H, now, &sum);
+	CHECK(sum.n == 121 && sum.max == 5000.0f);
+
+	/* nothing read for longer than the window */
+	rolling_summary(&stats, CHANNEL_LIGHT, ROLLING_1M, now + 61000, &sum);
+	CHECK(sum.n == 0);
+
+	return 0;
+}
+
+const struct test_case test_rolling_cases[] = {
+	{ "moments", moments },
+	{ "window_moves", window_moves },
+	{ NULL, NULL }
+};
@@ -0,0 +1,165 @@
+/*
+ * Tests of the rule engine switching the LED from the sensor samples.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "config_file.h"
+#include "rules.h"
+#include "test.h"
+
+static int evaluate(struct rule_set *set, int channel, float value, int active) {
+	struct sensor_sample sample;
+	int fresh[CHANNEL_COUNT] = { 0 };
+
+	memset(&sample, 0, sizeof(sample));
+	sample.value[channel] = value;
+	sample.is_active[channel] = active;
+	fresh[channel] = 1;
+
+	return rules_evaluate(set, &sample, fresh);
+}
+
+/* asserted after "for" samples, released past the hysteresis band only */
+static int assert_release(void) {
+	struct rule_set set;
+
+	CHECK(rules_compile("proximity > 300 for 3 hysteresis 20 -> led on", &set) == 0);
+	CHECK(set.count == 1);
+
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 310, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 310, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 310, 1) == RULE_LED_ON);
+
+	/* under the threshold but inside the band */
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 290, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 290, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 290, 1) == RULE_LED_NONE);
+
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 270, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 270, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_PROXIMITY, 270, 1) == RULE_LED_OFF);
+
+	return 0;
+}
+
+/* a sample without the channel active restarts the count */
+static int inactive_restarts(void) {
+	struct rule_set set;
+
+	CHECK(rules_compile("temp >= 30 for 2 -> led off", &set) == 0);
+
+	CHECK(evaluate(&set, CHANNEL_TEMP, 30, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_TEMP, 30, 0) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_TEMP, 30, 1) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_TEMP, 30, 1) == RULE_LED_OFF);
+
+	return 0;
+}
+
+/* a cycle not reading the channel neither advances nor restarts the count */
+static int not_read_skipped(void) {
+	struct rule_set set;
+	struct sensor_sample sample;
+	int fresh[CHANNEL_COUNT] = { 0 };
+
+	CHECK(rules_compile("light > 100 for 2 -> led on", &set) == 0);
+
+	memset(&sample, 0, sizeof(sample));
+	sample.value[CHANNEL_LIGHT] = 200;
+	sample.is_active[CHANNEL_LIGHT] = 1;
+	fresh[CHANNEL_TEMP] = 1;
+
+	CHECK(evaluate(&set, CHANNEL_LIGHT, 200, 1) == RULE_LED_NONE);
+	CHECK(rules_evaluate(&set, &sample, fresh) == RULE_LED_NONE);
+	CHECK(rules_evaluate(&set, &sample, fresh) == RULE_LED_NONE);
+	CHECK(evaluate(&set, CHANNEL_LIGHT, 200, 1) == RULE_LED_ON);
+
+	return 0;
+}
+
+/* the comments and the blank lines are skipped, RULES_MAX rules at most */
+static int rule_file(void) {
+	struct rule_set set;
+	char text[RULES_MAX * 32 + 64] = "# rules\n\n";
+	int n;
+
+	for (n = 0; n < RULES_MAX; n++) {
+		strcat(text, "humm < 20 -> led on\r\n");
+	}
+	CHECK(rules_compile(text, &set) == 0);
+	CHECK(set.count == RULES_MAX);
+
+	strcat(text, "humm < 20 -> led on\n");
+	CHECK(rules_compile(text, &set) == -1);
+	CHECK(set.count == RULES_MAX);
+
+	return 0;
+}
+
+/* an error leaves the set as it was */
+static int rejected(void) {
+	static const char *const invalid[] = {
+		"pressure > 1 -> led on",
+		"temp = 1 -> led on",
+		"temp > warm -> led on",
+		"temp > 1 for 0 -> led on",
+		"temp > 1 hysteresis -2 -> led on",
+		"temp > 1",
+		"temp > 1 -> led",
+		"temp > 1 -> led dim",
+		"temp > 1 -> led on now",
+	};
+	struct rule_set set;
+	int n;
+
+	CHECK(rules_compile("light > 100 -> led on", &set) == 0);
+	for (n = 0; n < (int)(sizeof(invalid) / sizeof(invalid[0])); n++) {
+		CHECK(rules_compile(invalid[n], &set) == -1);
+		CHECK(set.count == 1 && set.rules[0].channel == CHANNEL_LIGHT);
+	}
+
+	return 0;
+}
+
+/* a file is compiled whole whatever its size, but a line too long is refused */
+static int long_file(void) {
+	struct rule_set set;
+	char text[4096];
+	const char *path;
+	int n, ret;
+
+	memset(text, '#', sizeof(text));
+	for (n = 63; n < (int)sizeof(text); n += 64) {
+		text[n] = '\n';
+	}
+	memcpy(text, "temp > 1 -> led on\n", 19);
+	memcpy(text + sizeof(text) - 64, "humm < 5 -> led off # last\n", 27);
+
+	path = test_file(text, sizeof(text));
+	ret = rules_load_file(path, &set);
+	unlink(path);
+	CHECK(ret == 0 && set.count == 2 && set.rules[1].channel == CHANNEL_HUMM);
+
+	memset(text, ' ', CONFIG_LINE_MAX);
+	memcpy(text + CONFIG_LINE_MAX, "\ntemp > 1 -> led on\n", 20);
+	path = test_file(text, CONFIG_LINE_MAX + 20);
+	ret = rules_load_file(path, &set);
+	unlink(path);
+	CHECK(ret == -1 && set.count == 2);
+
+	return 0;
+}
+
+const struct test_case test_rules_cases[] = {
+	{ "assert_release", assert_release },
+	{ "inactive_restarts", inactive_restarts },
+	{ "not_read_skipped", not_read_skipped },
+	{ "rule_file", rule_file },
+	{ "rejected", rejected },
+	{ "long_file", long_file },
+	{ NULL, NULL }
+};
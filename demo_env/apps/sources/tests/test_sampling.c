@@ -0,0 +1,103 @@
+/*
+ * Tests of the adaptive sampling rate controller.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include "sampling.h"
+#include "test.h"
+
+static const struct sampling_config adaptive = { 1, -1, -1, -1.0f, -1.0f };
+
+/* not adaptive, every reading is due a period after the previous one */
+static int fixed_period(void) {
+	struct sampling s;
+	int n;
+
+	sampling_init(&s, 250);
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		CHECK(sampling_due(&s, n, 0));
+	}
+
+	CHECK(sampling_update(&s, CHANNEL_TEMP, 20.0f, 1000) == 250);
+	CHECK(!sampling_due(&s, CHANNEL_TEMP, 1249));
+	CHECK(sampling_due(&s, CHANNEL_TEMP, 1250));
+
+	/* the others were never read */
+	CHECK(sampling_next_due(&s) == 0);
+
+	return 0;
+}
+
+/* stable readings stretch the period up to max_period, a jump resets it */
+static int adaptation(void) {
+	struct sampling s;
+	int n, period = 0, last = 0;
+
+	sampling_init(&s, 250);
+	CHECK(sampling_configure(&s, CHANNEL_TEMP, &adaptive) == 0);
+
+	CHECK(sampling_update(&s, CHANNEL_TEMP, 20.0f, 0) == 250);
+	for (n = 0; n < 40; n++) {
+		period = sampling_update(&s, CHANNEL_TEMP, 20.0f, 0);
+		CHECK(period >= last);
+		last = period;
+	}
+	CHECK(period == SAMPLING_MAX_PERIOD);
+
+	CHECK(sampling_update(&s, CHANNEL_TEMP, 25.0f, 0) == 250);
+
+	return 0;
+}
+
+/* configuring one channel leaves the adaptation of the others running */
+static int per_channel(void) {
+	struct sampling s;
+	struct sampling_config config = { -1, 500, -1, -1.0f, -1.0f };
+	int n;
+
+	sampling_init(&s, 250);
+	CHECK(sampling_configure(&s, -1, &adaptive) == 0);
+	for (n = 0; n < 40; n++) {
+		sampling_update(&s, CHANNEL_TEMP, 20.0f, 0);
+		sampling_update(&s, CHANNEL_PROXIMITY, 10.0f, 0);
+	}
+	CHECK(s.ch[CHANNEL_TEMP].period == SAMPLING_MAX_PERIOD);
+
+	CHECK(sampling_configure(&s, CHANNEL_PROXIMITY, &adaptive) == 0);
+	CHECK(s.ch[CHANNEL_PROXIMITY].period == 250);
+	CHECK(s.ch[CHANNEL_TEMP].period == SAMPLING_MAX_PERIOD);
+	CHECK(s.ch[CHANNEL_TEMP].adaptive);
+
+	/* the periods only, the adaptation isn't restarted */
+	CHECK(sampling_configure(&s, CHANNEL_TEMP, &config) == 0);
+	CHECK(s.ch[CHANNEL_TEMP].min_period == 500);
+	CHECK(s.ch[CHANNEL_TEMP].period == SAMPLING_MAX_PERIOD);
+
+	return 0;
+}
+
+/* the periods are bounded by SAMPLING_PERIOD_FLOOR and ordered */
+static int invalid_periods(void) {
+	struct sampling s;
+	struct sampling_config floor = { -1, SAMPLING_PERIOD_FLOOR, -1, -1.0f, -1.0f };
+	struct sampling_config under = { -1, SAMPLING_PERIOD_FLOOR - 1, -1, -1.0f, -1.0f };
+	struct sampling_config reversed = { -1, 1000, 500, -1.0f, -1.0f };
+
+	sampling_init(&s, 250);
+	CHECK(sampling_configure(&s, CHANNEL_LIGHT, &floor) == 0);
+	CHECK(s.ch[CHANNEL_LIGHT].min_period == SAMPLING_PERIOD_FLOOR);
+	CHECK(sampling_configure(&s, CHANNEL_LIGHT, &under) == -1);
+	CHECK(sampling_configure(&s, CHANNEL_LIGHT, &reversed) == -1);
+	CHECK(s.ch[CHANNEL_LIGHT].min_period == SAMPLING_PERIOD_FLOOR);
+
+	return 0;
+}
+
+const struct test_case test_sampling_cases[] = {
+	{ "fixed_period", fixed_period },
+	{ "adaptation", adaptation },
+	{ "per_channel", per_channel },
+	{ "invalid_periods", invalid_periods },
+	{ NULL, NULL }
+};
@@ -0,0 +1,214 @@
+/*
+ * Tests of the merging of the I2C transfers by the scheduler, on the bus
+ * of the simulated sensors.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include "i2c_sched.h"
+#include "ob1203.h"
+#include "test.h"
+
+#define SCHED_BUS "/dev/i2c-sched"
+#define ABSENT_ADDRESS 0x10 /* no simulated device answers it */
+#define READS_MAX 32
+
+/* register reads of one byte, each with its own status */
+static struct {
+	unsigned char reg;
+	unsigned char value;
+	struct i2c_msg msgs[2];
+	int status; /* 1 until completed */
+} reads[READS_MAX];
+
+static void read_done(void *arg, int status) {
+	*(int *)arg = status;
+}
+
+static int submit_read(struct i2c_sched *sched, int n, uint16_t addr, int flags) {
+	reads[n].reg = 0x00;
+	reads[n].status = 1;
+
+	reads[n].msgs[0].addr = addr;
+	reads[n].msgs[0].flags = 0;
+	reads[n].msgs[0].len = 1;
+	reads[n].msgs[0].buf = &reads[n].reg;
+
+	reads[n].msgs[1].addr = addr;
+	reads[n].msgs[1].flags = I2C_M_RD;
+	reads[n].msgs[1].len = 1;
+	reads[n].msgs[1].buf = &reads[n].value;
+
+	return i2c_sched_submit(sched, reads[n].msgs, 2, flags, read_done, &reads[n].status);
+}
+
+/* everything queued goes in one I2C_RDWR, up to the kernel limit */
+static int merge(void) {
+	struct i2c_sched sched;
+	struct i2c_sched_stats last;
+	int n;
+
+	CHECK(i2c_sched_init_inline(&sched, SCHED_BUS) == 0);
+
+	for (n = 0; n < 4; n++) {
+		CHECK(submit_read(&sched, n, OB1203_SLAVE_ADDRESS, 0) == 0);
+	}
+	i2c_sched_flush(&sched);
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == 1 && last.requests == 4 && last.msgs == 8);
+	for (n = 0; n < 4; n++) {
+		CHECK(reads[n].status == 0);
+	}
+
+	/* 2 messages each, more than I2C_SCHED_MAX_MSGS */
+	for (n = 0; n < READS_MAX; n++) {
+		CHECK(submit_read(&sched, n, OB1203_SLAVE_ADDRESS, 0) == 0);
+	}
+	i2c_sched_flush(&sched);
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == (2 * READS_MAX + I2C_SCHED_MAX_MSGS - 1) / I2C_SCHED_MAX_MSGS);
+	CHECK(last.requests == READS_MAX);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* the bus thread completes the requests the same */
+static int bus_thread(void) {
+	struct i2c_sched sched;
+	struct i2c_completion c;
+	struct i2c_msg msgs[2];
+	unsigned char reg = 0x00, value;
+
+	CHECK(i2c_sched_init(&sched, SCHED_BUS) == 0);
+
+	msgs[0].addr = OB1203_SLAVE_ADDRESS;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg;
+	msgs[1].addr = OB1203_SLAVE_ADDRESS;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = 1;
+	msgs[1].buf = &value;
+
+	i2c_completion_init(&c);
+	CHECK(i2c_sched_submit_completion(&sched, msgs, 2, 0, &c) == 0);
+	CHECK(i2c_sched_submit_completion(&sched, msgs, 2, 0, &c) == 0);
+	i2c_sched_flush(&sched);
+	CHECK(i2c_completion_wait(&c) == 0);
+	CHECK(c.pending == 0 && c.errors == 0);
+
+	/* a device not answering fails the wait */
+	msgs[0].addr = ABSENT_ADDRESS;
+	msgs[1].addr = ABSENT_ADDRESS;
+	CHECK(i2c_sched_submit_completion(&sched, msgs, 2, 0, &c) == 0);
+	i2c_sched_flush(&sched);
+	CHECK(i2c_completion_wait(&c) == -1);
+	i2c_completion_destroy(&c);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* a request with I2C_SCHED_STOP ends the I2C_RDWR it is merged in */
+static int stop(void) {
+	struct i2c_sched sched;
+	struct i2c_sched_stats last;
+
+	CHECK(i2c_sched_init_inline(&sched, SCHED_BUS) == 0);
+
+	submit_read(&sched, 0, OB1203_SLAVE_ADDRESS, 0);
+	submit_read(&sched, 1, OB1203_SLAVE_ADDRESS, I2C_SCHED_STOP);
+	submit_read(&sched, 2, OB1203_SLAVE_ADDRESS, 0);
+	i2c_sched_flush(&sched);
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == 2 && last.requests == 3);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* a device not answering fails its requests only, the others are reissued alone */
+static int isolate(void) {
+	struct i2c_sched sched;
+	struct i2c_sched_stats last;
+
+	CHECK(i2c_sched_init_inline(&sched, SCHED_BUS) == 0);
+
+	submit_read(&sched, 0, OB1203_SLAVE_ADDRESS, 0);
+	submit_read(&sched, 1, ABSENT_ADDRESS, 0);
+	submit_read(&sched, 2, OB1203_SLAVE_ADDRESS, 0);
+	i2c_sched_flush(&sched);
+	CHECK(reads[0].status == 0 && reads[1].status == -1 && reads[2].status == 0);
+
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == 1 + 3 && last.isolated == 3 && last.unreplayed == 0);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* an I2C_SCHED_ALONE request gets an I2C_RDWR of its own, never reissued */
+static int alone(void) {
+	struct i2c_sched sched;
+	struct i2c_sched_stats last;
+
+	CHECK(i2c_sched_init_inline(&sched, SCHED_BUS) == 0);
+
+	submit_read(&sched, 0, OB1203_SLAVE_ADDRESS, 0);
+	submit_read(&sched, 1, ABSENT_ADDRESS, 0);
+	submit_read(&sched, 2, OB1203_SLAVE_ADDRESS, I2C_SCHED_ALONE);
+	submit_read(&sched, 3, OB1203_SLAVE_ADDRESS, 0);
+	i2c_sched_flush(&sched);
+	CHECK(reads[0].status == 0 && reads[1].status == -1);
+	CHECK(reads[2].status == 0 && reads[3].status == 0);
+
+	/* the first two merged and reissued, then the alone one, then the last */
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == 1 + 2 + 1 + 1 && last.isolated == 2);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+/* an I2C_SCHED_NO_REPLAY request fails with the merged I2C_RDWR */
+static int no_replay(void) {
+	struct i2c_sched sched;
+	struct i2c_sched_stats last;
+
+	CHECK(i2c_sched_init_inline(&sched, SCHED_BUS) == 0);
+
+	submit_read(&sched, 0, OB1203_SLAVE_ADDRESS, I2C_SCHED_NO_REPLAY);
+	submit_read(&sched, 1, ABSENT_ADDRESS, 0);
+	submit_read(&sched, 2, OB1203_SLAVE_ADDRESS, 0);
+	i2c_sched_flush(&sched);
+	CHECK(reads[0].status == -1 && reads[1].status == -1 && reads[2].status == 0);
+
+	i2c_sched_get_stats(&sched, NULL, &last);
+	CHECK(last.syscalls == 1 + 2 && last.isolated == 2 && last.unreplayed == 1);
+
+	/* merged with requests that succeed, it succeeds */
+	submit_read(&sched, 0, OB1203_SLAVE_ADDRESS, I2C_SCHED_NO_REPLAY);
+	submit_read(&sched, 1, OB1203_SLAVE_ADDRESS, 0);
+	i2c_sched_flush(&sched);
+	CHECK(reads[0].status == 0 && reads[1].status == 0);
+
+	i2c_sched_destroy(&sched);
+
+	return 0;
+}
+
+const struct test_case test_sched_cases[] = {
+	{ "merge", merge },
+	{ "bus_thread", bus_thread },
+	{ "stop", stop },
+	{ "isolate", isolate },
+	{ "alone", alone },
+	{ "no_replay", no_replay },
+	{ NULL, NULL }
+};
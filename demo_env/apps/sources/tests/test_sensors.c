@@ -0,0 +1,126 @@
+/*
+ * Tests of the sensor instances file: which sensors sit on which bus.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hs3001.h"
+#include "i2c_bus.h"
+#include "ob1203.h"
+#include "sensor_config.h"
+#include "test.h"
+
+static struct sensor_config config;
+
+static int load(const char *text) {
+	const char *path;
+	int ret;
+
+	path = test_file(text, strlen(text));
+	ret = sensor_config_load_file(path, &config);
+	unlink(path);
+
+	return ret;
+}
+
+/* the two sensors of the board on its bus */
+static int board_default(void) {
+	sensor_config_default(&config);
+
+	CHECK(config.bus_count == 1 && strcmp(config.buses[0], I2C_DEVICE_FILE) == 0);
+	CHECK(config.count == 2);
+	CHECK(sensor_config_primary(&config, SENSOR_HS3001)->address == HS3001_SLAVE_ADDRESS);
+	CHECK(sensor_config_primary(&config, SENSOR_OB1203)->address == OB1203_SLAVE_ADDRESS);
+
+	return 0;
+}
+
+/* the address defaults to the type's, the name to the type then "<type>-<n>" */
+static int instances(void) {
+	const struct sensor_instance *s = config.instances;
+
+	CHECK(load("# two boards\n"
+		   "hs3001 /dev/i2c-1\n"
+		   "ob1203 /dev/i2c-1\r\n"
+		   "\n"
+		   "hs3001 /dev/i2c-2 0x45\n"
+		   "  ob1203 /dev/i2c-2 83 hand   # the one by the door\n") == 0);
+
+	CHECK(config.bus_count == 2);
+	CHECK(strcmp(config.buses[0], "/dev/i2c-1") == 0);
+	CHECK(strcmp(config.buses[1], "/dev/i2c-2") == 0);
+
+	CHECK(config.count == 4);
+	CHECK(strcmp(s[0].name, "hs3001") == 0 && s[0].bus == 0);
+	CHECK(s[0].address == HS3001_SLAVE_ADDRESS);
+	CHECK(strcmp(s[1].name, "ob1203") == 0 && s[1].type == SENSOR_OB1203);
+	CHECK(strcmp(s[2].name, "hs3001-1") == 0 && s[2].bus == 1 && s[2].address == 0x45);
+	CHECK(strcmp(s[3].name, "hand") == 0 && s[3].bus == 1 && s[3].address == 83);
+
+	/* the first of each type */
+	CHECK(sensor_config_primary(&config, SENSOR_HS3001) == &s[0]);
+	CHECK(sensor_config_primary(&config, SENSOR_OB1203) == &s[1]);
+
+	return 0;
+}
+
+/* the names go verbatim in the JSON, and are unique like the addresses of a bus */
+static int rejected(void) {
+	static const char *const invalid[] = {
+		"bme280 /dev/i2c-1\n",
+		"hs3001\n",
+		"hs3001 /dev/i2c-1 0x02\nob1203 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1 0x78\nob1203 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1 0x4g\nob1203 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1 0x44 a\"b\nob1203 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1 0x44 x\nob1203 /dev/i2c-1 0x53 x\n",
+		"hs3001 /dev/i2c-1\nob1203 /dev/i2c-1\nhs3001 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1\n",
+		"hs3001 /dev/i2c-1\nob1203 /dev/i2c-2\nob1203 /dev/i2c-3\n"
+		"ob1203 /dev/i2c-4\nob1203 /dev/i2c-5\n",
+	};
+	char text[SENSOR_BUS_PATH_MAX + 32];
+	int n;
+
+	for (n = 0; n < (int)(sizeof(invalid) / sizeof(invalid[0])); n++) {
+		CHECK(load(invalid[n]) == -1);
+	}
+
+	snprintf(text, sizeof(text), "hs3001 /dev/%0*d\n", SENSOR_BUS_PATH_MAX, 1);
+	CHECK(load(text) == -1);
+
+	CHECK(sensor_config_load_file("/nonexistent/sensors", &config) == -1);
+
+	return 0;
+}
+
+/* up to SENSOR_INSTANCES_MAX sensors */
+static int instance_count(void) {
+	char text[SENSOR_INSTANCES_MAX * 32 + 32] = "";
+	char line[32];
+	int n;
+
+	for (n = 0; n < SENSOR_INSTANCES_MAX; n++) {
+		snprintf(line, sizeof(line), "%s /dev/i2c-1 %d\n", n % 2 ? "ob1203" : "hs3001",
+			 0x10 + n);
+		strcat(text, line);
+	}
+	CHECK(load(text) == 0 && config.count == SENSOR_INSTANCES_MAX);
+
+	strcat(text, "hs3001 /dev/i2c-1 0x70\n");
+	CHECK(load(text) == -1);
+
+	return 0;
+}
+
+const struct test_case test_sensors_cases[] = {
+	{ "board_default", board_default },
+	{ "instances", instances },
+	{ "rejected", rejected },
+	{ "instance_count", instance_count },
+	{ NULL, NULL }
+};
@@ -0,0 +1,112 @@
+/*
+ * Replay a recorded trace through the detectors, to tune their thresholds
+ * off the board: prints the events the server would have raised.
+ *
+ *   $ ./sample-feed-reader > trace.txt
+ *   $ ./detector-replay detector.conf [trace.txt]
+ *
+ * The trace is the output of sample-feed-reader, one sample per line as
+ * "<seq> <s.ns> <channel>=<value>..." with the channels read in that cycle,
+ * as the server feeds them to its detectors. The other lines are skipped.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "detector.h"
+
+#define TRACE_LINE_MAX 256
+
+static void print_event(const char *time, const struct detector_event *ev) {
+	const char *direction = "";
+
+	if (ev->kind == DETECT_CHANGE) {
+		direction = ev->direction > 0 ? " up" : " down";
+	} else if (ev->kind == DETECT_RANGE) {
+		direction = ev->direction > 0 ? " above" : " below";
+	}
+
+	printf("%s %s %s%s%s value=%.3f reference=%.3f\n", time,
+	       sensor_channel_name(ev->channel), detector_kind_name(ev->kind),
+	       direction, ev->cleared ? " cleared" : "", ev->value, ev->reference);
+}
+
+int main(int argc, const char **argv) {
+	struct detector_event events[DETECTOR_EVENTS_MAX];
+	struct detector detector;
+	char line[TRACE_LINE_MAX], *token, *save, *value, *end, *time;
+	unsigned long samples = 0;
+	int n, m, count, channel;
+	float v;
+	FILE *fp = stdin;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <detector file> [trace]\n", argv[0]);
+		return 1;
+	}
+
+	if (detector_load_file(argv[1], &detector)) {
+		return 1;
+	}
+
+	if (argc > 2) {
+		fp = fopen(argv[2], "r");
+		if (fp == NULL) {
+			fprintf(stderr, "Error: can't open trace %s\n", argv[2]);
+			return 1;
+		}
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		/* "<seq> <s.ns>" then the active channels */
+		token = strtok_r(line, " ", &save);
+		if (token == NULL || token[strspn(token, "0123456789")] != '\0') {
+			continue;
+		}
+		time = strtok_r(NULL, " ", &save);
+		if (time == NULL) {
+			continue;
+		}
+		samples++;
+
+		while ((token = strtok_r(NULL, " ", &save))) {
+			value = strchr(token, '=');
+			if (value == NULL) {
+				continue;
+			}
+			*value++ = '\0';
+			channel = sensor_channel_lookup(token);
+			v = strtof(value, &end);
+			if (channel == -1 || *end != '\0') {
+				continue;
+			}
+
+			count = detector_update(&detector, channel, v, events);
+			for (n = 0; n < count; n++) {
+				print_event(time, &events[n]);
+			}
+		}
+	}
+
+	if (fp != stdin) {
+		fclose(fp);
+	}
+
+	printf("%lu samples", samples);
+	for (n = 0; n < CHANNEL_COUNT; n++) {
+		for (m = 0; m < DETECT_KIND_COUNT; m++) {
+			if (detector.events[n][m]) {
+				printf(", %s %s: %lu", sensor_channel_name(n),
+				       detector_kind_name(m), detector.events[n][m]);
+			}
+		}
+	}
+	printf("\n");
+
+	return 0;
+}
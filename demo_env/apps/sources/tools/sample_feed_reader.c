@@ -0,0 +1,71 @@
+/*
+ * Example consumer of the shared memory sample feed: prints every sample
+ * published by the server started with --feed, with the channels read
+ * since the previous one. A channel not due in a cycle keeps its last
+ * reading in the record, it isn't printed again.
+ *
+ *   $ ./sample-feed-reader [feed name]
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+
+#include "sample_feed.h"
+
+static volatile sig_atomic_t interrupted;
+
+static void sigint_handler(int sig) {
+	interrupted = 1;
+}
+
+int main(int argc, const char **argv) {
+	struct sample_feed *feed;
+	struct sample_feed_reader reader;
+	struct sample_feed_record record;
+	int64_t time_ns[CHANNEL_COUNT] = { 0 };
+	uint64_t lost = 0;
+	int n;
+
+	signal(SIGINT, sigint_handler);
+
+	feed = sample_feed_open(argc > 1 ? argv[1] : SAMPLE_FEED_NAME);
+	if (feed == NULL) {
+		return 1;
+	}
+
+	if (sample_feed_latest(feed, &record)) {
+		printf("latest: seq %llu\n", (unsigned long long)record.seq);
+	}
+
+	sample_feed_reader_init(&reader, feed);
+
+	while (!interrupted) {
+		if (!sample_feed_read(&reader, &record)) {
+			sample_feed_wait(&reader, 1000);
+			continue;
+		}
+
+		if (reader.lost != lost) {
+			printf("lost %llu samples\n", (unsigned long long)(reader.lost - lost));
+			lost = reader.lost;
+		}
+
+		printf("%llu %lld.%09lld", (unsigned long long)record.seq,
+		       (long long)(record.timestamp_ns / 1000000000),
+		       (long long)(record.timestamp_ns % 1000000000));
+		for (n = 0; n < CHANNEL_COUNT; n++) {
+			if (record.sample.is_active[n] &&
+			    record.sample.time_ns[n] != time_ns[n]) {
+				time_ns[n] = record.sample.time_ns[n];
+				printf(" %s=%.3f", sensor_channel_name(n), record.sample.value[n]);
+			}
+		}
+		printf("\n");
+	}
+
+	sample_feed_close(feed);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Source of the trace events of the acquisition and serving stages.
+ *
+ * Each thread records into its own ring of events, claimed on its first
+ * event: recording is two clock reads and a release store, without lock
+ * nor syscall. The dump copies each ring without stopping the threads,
+ * the events the thread overwrote meanwhile are left out, and writes
+ * them in the Chrome trace event format, loaded by chrome://tracing and
+ * https://ui.perfetto.dev.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+struct trace_buffer {
+	_Atomic uint64_t head; /* events ever recorded */
+	long tid;
+	char name[TRACE_NAME_MAX];
+	struct trace_event ev[TRACE_EVENTS];
+};
+
+static struct trace_buffer buffers[TRACE_THREADS_MAX];
+static _Atomic int buffer_count;
+static _Atomic unsigned long untraced; /* threads beyond TRACE_THREADS_MAX */
+
+static __thread struct trace_buffer *self;
+static __thread int self_untraced;
+
+int64_t trace_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct trace_buffer *buffer(void) {
+	int n;
+
+	if (self || self_untraced) {
+		return self;
+	}
+
+	n = atomic_fetch_add(&buffer_count, 1);
+	if (n >= TRACE_THREADS_MAX) {
+		atomic_fetch_add(&untraced, 1);
+		self_untraced = 1;
+		return NULL;
+	}
+
+	self = &buffers[n];
+	self->tid = syscall(SYS_gettid);
+
+	return self;
+}
+
+void trace_thread_name(const char *name) {
+	struct trace_buffer *b = buffer();
+
+	if (b) {
+		snprintf(b->name, sizeof(b->name), "%s", name);
+	}
+}
+
+static void record(const char *name, int64_t start_ns, int64_t dur_ns) {
+	struct trace_buffer *b = buffer();
+	struct trace_event *ev;
+	uint64_t head;
+
+	if (b == NULL) {
+		return;
+	}
+
+	/* only this thread writes its ring */
+	head = atomic_load_explicit(&b->head, memory_order_relaxed);
+	ev = &b->ev[head & (TRACE_EVENTS - 1)];
+	ev->name = name;
+	ev->start_ns = start_ns;
+	ev->dur_ns = dur_ns;
+	atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+void trace_complete(const char *name, int64_t start_ns) {
+	record(name, start_ns, trace_now_ns() - start_ns);
+}
+
+void trace_instant(const char *name) {
+	record(name, trace_now_ns(), -1);
+}
+
+void trace_scope_end(struct trace_scope *scope) {
+	trace_complete(scope->name, scope->start_ns);
+}
+
+int trace_mutex_lock(pthread_mutex_t *mutex, const char *name) {
+	int64_t start = trace_now_ns();
+	int ret = pthread_mutex_lock(mutex);
+
+	trace_complete(name, start);
+
+	return ret;
+}
+
+/*
+ * Copy the events of a ring still in it, oldest first, into ev. An event
+ * is valid if the thread didn't start to overwrite its slot by the end of
+ * the copy. Returns the number of events copied.
+ */
+static int snapshot(struct trace_buffer *b, struct trace_event *ev) {
+	uint64_t head, first, last, n;
+
+	head = atomic_load_explicit(&b->head, memory_order_acquire);
+	first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+	for (n = first; n < head; n++) {
+		ev[n - first] = b->ev[n & (TRACE_EVENTS - 1)];
+	}
+
+	atomic_thread_fence(memory_order_acquire);
+	last = atomic_load_explicit(&b->head, memory_order_relaxed);
+
+	/* the slot of event "last" may be half written, it held last - TRACE_EVENTS */
+	if (last + 1 > first + TRACE_EVENTS) {
+		n = last + 1 - TRACE_EVENTS - first;
+		if (n >= head - first) {
+			return 0;
+		}
+		memmove(ev, ev + n, (head - first - n) * sizeof(*ev));
+		return (int)(head - first - n);
+	}
+
+	return (int)(head - first);
+}
+
+static void print_time(FILE *fp, const char *key, int64_t ns) {
+	fprintf(fp, ",\"%s\":%lld.%03lld", key, (long long)(ns / 1000), (long long)(ns % 1000));
+}
+
+/* write the events of every thread as Chrome trace event JSON */
+int trace_dump(FILE *fp) {
+	struct trace_event *ev;
+	struct trace_buffer *b;
+	int n, m, count, threads, sep = 0;
+	long pid = getpid();
+
+	ev = malloc(TRACE_EVENTS * sizeof(*ev));
+	if (ev == NULL) {
+		fprintf(stderr, "Error: trace dump allocation failed\n");
+		return -1;
+	}
+
+	threads = atomic_load(&buffer_count);
+	if (threads > TRACE_THREADS_MAX) {
+		threads = TRACE_THREADS_MAX;
+	}
+
+	fprintf(fp, "{\"traceEvents\":[");
+
+	for (n = 0; n < threads; n++) {
+		b = &buffers[n];
+		if (!b->tid) {
+			continue; /* being claimed */
+		}
+
+		if (b->name[0]) {
+			fprintf(fp, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%ld,"
+				"\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+				sep++ ? "," : "", pid, b->tid, b->name);
+		}
+
+		count = snapshot(b, ev);
+		for (m = 0; m < count; m++) {
+			fprintf(fp, "%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":%ld,\"tid\":%ld",
+				sep++ ? "," : "", ev[m].dur_ns < 0 ? "i" : "X",
+				ev[m].name, pid, b->tid);
+			print_time(fp, "ts", ev[m].start_ns);
+			if (ev[m].dur_ns < 0) {
+				fprintf(fp, ",\"s\":\"t\"}");
+			} else {
+				print_time(fp, "dur", ev[m].dur_ns);
+				fprintf(fp, "}");
+			}
+		}
+	}
+
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"untraced_threads\":%lu}}\n",
+		atomic_load(&untraced));
+
+	free(ev);
+
+	return ferror(fp) ? -1 : 0;
+}
+
+int trace_dump_file(const char *path) {
+	FILE *fp;
+	int ret;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: can't open trace file %s\n", path);
+		return -1;
+	}
+
+	ret = trace_dump(fp);
+	if (fclose(fp) || ret) {
+		fprintf(stderr, "Error: can't write trace file %s\n", path);
+		return -1;
+	}
+
+	return 0;
+}
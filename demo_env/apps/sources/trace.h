@@ -0,0 +1,80 @@
+/*
+ * Header of the trace events of the acquisition and serving stages.
+ *
+ * Built with SENSOR_TRACE only, the macros expand to nothing else and the
+ * locks are taken directly.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_FILE "sensor-trace.json" /* dump of the SIGUSR1 by default */
+
+#if defined(SENSOR_TRACE)
+
+#define TRACE_EVENTS 2048 /* kept per thread, power of 2 */
+#define TRACE_THREADS_MAX 16 /* threads recording, the others are not traced */
+#define TRACE_NAME_MAX 16
+
+/* one event, name is a string literal */
+
+struct trace_event {
+	const char *name;
+	int64_t start_ns; /* CLOCK_MONOTONIC */
+	int64_t dur_ns; /* -1 for an instant event */
+};
+
+/* a scope being traced, recorded when it is left */
+
+struct trace_scope {
+	const char *name;
+	int64_t start_ns;
+};
+
+int64_t trace_now_ns(void);
+void trace_thread_name(const char *name);
+void trace_complete(const char *name, int64_t start_ns);
+void trace_instant(const char *name);
+void trace_scope_end(struct trace_scope *scope);
+int trace_mutex_lock(pthread_mutex_t *mutex, const char *name);
+int trace_dump(FILE *fp);
+int trace_dump_file(const char *path);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/* name the calling thread in the trace */
+#define TRACE_THREAD(name) trace_thread_name(name)
+
+/* trace the rest of the enclosing block */
+#define TRACE_SCOPE(name) \
+	struct trace_scope TRACE_CONCAT(trace_scope_, __LINE__) \
+		__attribute__((cleanup(trace_scope_end))) = { name, trace_now_ns() }
+
+/* trace a part of a block, from TRACE_BEGIN() to TRACE_END() on the same var */
+#define TRACE_BEGIN(var) int64_t var = trace_now_ns()
+#define TRACE_END(var, name) trace_complete(name, var)
+
+#define TRACE_INSTANT(name) trace_instant(name)
+
+/* pthread_mutex_lock() tracing the wait for the mutex */
+#define TRACE_LOCK(mutex, name) trace_mutex_lock(mutex, name)
+
+#else
+
+#define TRACE_THREAD(name) do { } while (0)
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_BEGIN(var) do { } while (0)
+#define TRACE_END(var, name) do { } while (0)
+#define TRACE_INSTANT(name) do { } while (0)
+#define TRACE_LOCK(mutex, name) pthread_mutex_lock(mutex)
+
+#endif
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,113 @@
+/*
+ * Source of the clock of the sampling, real or virtual.
+ *
+ * The virtual clocks are the real ones scaled from the moment the speed is
+ * set: base + (real - base) * speed. Both of them follow the monotonic
+ * clock, so the virtual wall clock doesn't step with the real one.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#include <stdio.h>
+
+#include "vclock.h"
+
+#define NS_PER_US 1000
+#define NS_PER_SEC 1000000000
+
+static int speed = 1;
+static int64_t base_ns; /* CLOCK_MONOTONIC when the speed was set */
+static int64_t wall_ns; /* CLOCK_REALTIME then */
+
+static int64_t clock_ns(clockid_t id) {
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+
+	return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void to_timespec(int64_t ns, struct timespec *ts) {
+	ts->tv_sec = (time_t)(ns / NS_PER_SEC);
+	ts->tv_nsec = (long)(ns % NS_PER_SEC);
+}
+
+/* 1 for the real clocks up to VCLOCK_SPEED_MAX */
+int vclock_set_speed(int value) {
+	if (value < 1 || value > VCLOCK_SPEED_MAX) {
+		fprintf(stderr, "Error: clock speed must be 1 to %d\n", VCLOCK_SPEED_MAX);
+		return -1;
+	}
+
+	base_ns = clock_ns(CLOCK_MONOTONIC);
+	wall_ns = clock_ns(CLOCK_REALTIME);
+	speed = value;
+
+	return 0;
+}
+
+int vclock_speed(void) {
+	return speed;
+}
+
+/* CLOCK_MONOTONIC and CLOCK_REALTIME are virtual, the other clocks real */
+int vclock_gettime(clockid_t id, struct timespec *ts) {
+	int64_t elapsed;
+
+	if (speed == 1 || (id != CLOCK_MONOTONIC && id != CLOCK_REALTIME)) {
+		return clock_gettime(id, ts);
+	}
+
+	elapsed = (clock_ns(CLOCK_MONOTONIC) - base_ns) * speed;
+	to_timespec((id == CLOCK_MONOTONIC ? base_ns : wall_ns) + elapsed, ts);
+
+	return 0;
+}
+
+/* the virtual CLOCK_MONOTONIC in ns */
+int64_t vclock_now_ns(void) {
+	struct timespec ts;
+
+	vclock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+void vclock_usleep(int64_t us) {
+	struct timespec ts;
+
+	if (us <= 0) {
+		return;
+	}
+
+	to_timespec(us * NS_PER_US / speed, &ts);
+	nanosleep(&ts, NULL);
+}
+
+/*
+ * pthread_cond_timedwait() with abstime in the virtual CLOCK_MONOTONIC,
+ * the condition has to wait on the real CLOCK_MONOTONIC.
+ */
+int vclock_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+			  const struct timespec *abstime) {
+	struct timespec ts;
+	int64_t ns;
+
+	if (speed == 1) {
+		return pthread_cond_timedwait(cond, mutex, abstime);
+	}
+
+	ns = (int64_t)abstime->tv_sec * NS_PER_SEC + abstime->tv_nsec;
+	to_timespec(ns > base_ns ? base_ns + (ns - base_ns) / speed : base_ns, &ts);
+
+	return pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+/* a delay in virtual us as real us, at least 1 when it isn't 0 */
+int64_t vclock_real_us(int64_t us) {
+	if (us <= 0 || speed == 1) {
+		return us;
+	}
+
+	return us >= speed ? us / speed : 1;
+}
@@ -0,0 +1,38 @@
+/*
+ * Header of the clock of the sampling, real or virtual.
+ *
+ * Copyright (C) 2022 Renesas Electronics Corp. All rights reserved.
+ */
+
+#ifndef _VCLOCK_H_
+#define _VCLOCK_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define VCLOCK_SPEED_MAX 10000 /* fastest virtual clock, times the real one */
+
+/*
+ * The timing of the sampling and of the drivers goes through these. At
+ * speed 1, the default, they are the real clocks. Above, the virtual
+ * clocks run speed times faster than the real ones from the moment the
+ * speed is set, and the sleeps and the timeouts are as much shorter, so
+ * a long run of the simulated sensors fits in minutes. The speed is set
+ * once at startup, before any thread reads the clocks.
+ *
+ * The times are of the virtual clocks, the sleeps and the deadlines are
+ * in virtual time too. vclock_real_us() converts a delay in virtual us to
+ * the real one, for the timers of the event loop.
+ */
+
+int vclock_set_speed(int speed);
+int vclock_speed(void);
+int vclock_gettime(clockid_t id, struct timespec *ts);
+int64_t vclock_now_ns(void);
+void vclock_usleep(int64_t us);
+int vclock_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+			  const struct timespec *abstime);
+int64_t vclock_real_us(int64_t us);
+
+#endif /* _VCLOCK_H_ */
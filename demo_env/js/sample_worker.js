@@ -0,0 +1,240 @@
+/*
+ * sample_worker.js
+ *
+ * Web Worker of the dashboard. It owns the WebSocket, decodes the samples
+ * into fixed-size typed-array rings and hands the page at most one
+ * decimated frame at a time: the next one only goes once the page drew
+ * the previous one and gave its buffers back, so the page redraws at most
+ * once per animation frame and the memory stays flat.
+ *
+ * The other sensor instances of the board get a series per channel named
+ * "<instance>.<channel>", created with their first sample.
+ *
+ * When the connection drops, the worker reconnects with the seq and epoch
+ * of the last message as ?resume=<epoch>-<seq>, and the server sends the
+ * messages missed meanwhile in one frame first, so the series go on
+ * without a hole unless the server reports a gap.
+ *
+ * Copyright (c) 2022 Renesas Electronics Corp.
+ * This software is released under the MIT License,
+ * see https://opensource.org/licenses/MIT
+ */
+
+var RING_SIZE = 4096; // samples kept per series, power of 2
+var RECONNECT_DELAY = 1000; // ms
+var SERIES = ["temp", "humm", "light"];
+var INSTANCE_CHANNELS = ["temp", "humm", "light", "proximity"];
+
+var socket = null;
+var url = null;
+var resume = null; // "<epoch>-<seq>" of the last message received
+var board = null;
+var rings = {};
+var latest = {};
+var buffers = {}; // per series, given to the page with a frame and back with "ack"
+var widths = {}; // canvas width of each series, in pixels
+var in_flight = false; // a frame is waiting to be drawn
+var dirty = false; // samples received since the last frame
+
+function Ring(size) {
+  this.time = new Float64Array(size);
+  this.value = new Float32Array(size);
+  this.head = 0; // samples ever pushed
+}
+
+Ring.prototype.push = function(time, value) {
+  var i = this.head & (this.time.length - 1);
+
+  this.time[i] = time;
+  this.value[i] = value;
+  this.head++;
+};
+
+// the samples of the ring, at most about "width" of them: the min and the
+// max of each pair of pixel columns, in time order so peaks are kept
+Ring.prototype.decimate = function(width, out_time, out_value) {
+  var mask = this.time.length - 1;
+  var count = Math.min(this.head, this.time.length);
+  var first = this.head - count;
+  var columns = Math.max(1, width >> 1);
+  var n = 0, c, k, start, end, min, max, a, b;
+
+  if(count <= width) {
+    for(k = first; k < this.head; k++) {
+      out_time[n] = this.time[k & mask];
+      out_value[n++] = this.value[k & mask];
+    }
+    return n;
+  }
+
+  for(c = 0; c < columns; c++) {
+    start = first + Math.floor(c * count / columns);
+    end = first + Math.floor((c + 1) * count / columns);
+    min = max = start;
+    for(k = start + 1; k < end; k++) {
+      if(this.value[k & mask] < this.value[min & mask]) {
+        min = k;
+      } else if(this.value[k & mask] > this.value[max & mask]) {
+        max = k;
+      }
+    }
+    a = Math.min(min, max);
+    b = Math.max(min, max);
+    out_time[n] = this.time[a & mask];
+    out_value[n++] = this.value[a & mask];
+    if(b != a) {
+      out_time[n] = this.time[b & mask];
+      out_value[n++] = this.value[b & mask];
+    }
+  }
+  return n;
+};
+
+function add_series(name) {
+  rings[name] = new Ring(RING_SIZE);
+  widths[name] = 300;
+}
+
+SERIES.forEach(add_series);
+
+function send_frame() {
+  var frame = { type: "frame", series: {}, latest: latest };
+  var transfer = [];
+
+  Object.keys(rings).forEach(function(name) {
+    var width = Math.min(widths[name] || 300, RING_SIZE);
+    var buffer = buffers[name];
+
+    if(!buffer || buffer.time.length < width) {
+      buffer = { time: new Float64Array(width), value: new Float32Array(width) };
+    }
+    buffers[name] = null;
+
+    buffer.count = rings[name].decimate(width, buffer.time, buffer.value);
+    frame.series[name] = buffer;
+    transfer.push(buffer.time.buffer, buffer.value.buffer);
+  });
+
+  latest = {};
+  dirty = false;
+  in_flight = true;
+  self.postMessage(frame, transfer);
+}
+
+// a sample of another instance, only its active channels
+function decode_instance(datas, now) {
+  INSTANCE_CHANNELS.forEach(function(channel) {
+    var name = datas.instance + "." + channel;
+
+    if(!datas[channel] || datas[channel].isActive != true) {
+      return;
+    }
+    if(!rings[name]) {
+      add_series(name);
+    }
+    rings[name].push(now, +datas[channel].value);
+    latest[name] = +datas[channel].value;
+  });
+}
+
+function decode(data) {
+  var datas;
+
+  if(typeof data !== "string") {
+    return; // PPG batches, not drawn by this page
+  }
+
+  datas = JSON.parse(data);
+  if(datas.resume) {
+    // the messages missed while disconnected, in order
+    if(datas.resume.gap || datas.resume.restarted) {
+      console.warn("messages lost while disconnected", datas.resume);
+    }
+    datas.messages.forEach(decode_message);
+    if(datas.resume.to >= datas.resume.from || datas.resume.restarted) {
+      resume = datas.resume.epoch + "-" + datas.resume.to;
+    }
+    return;
+  }
+  decode_message(datas);
+}
+
+function decode_message(datas) {
+  var now;
+
+  if(datas.seq) {
+    resume = datas.epoch + "-" + datas.seq;
+  }
+  if(board && datas.board != board) {
+    return;
+  }
+
+  now = Date.now();
+  if(datas.instance) {
+    decode_instance(datas, now);
+  } else if(datas.temp) {
+    SERIES.forEach(function(name) {
+      if(datas[name].isActive == true) {
+        // the time the board read the channel, boards before it had none
+        rings[name].push(+datas[name].time || now, +datas[name].value);
+        latest[name] = +datas[name].value;
+      }
+    });
+    if(datas.proximity.isActive == true) {
+      latest.proximity = +datas.proximity.value;
+    }
+  } else {
+    return;
+  }
+
+  dirty = true;
+  if(!in_flight) {
+    send_frame();
+  }
+}
+
+function connect() {
+  var resuming = resume ? url + (url.indexOf("?") < 0 ? "?" : "&") + "resume=" + resume : url;
+
+  socket = new WebSocket(resuming, "graph-update");
+  socket.binaryType = "arraybuffer";
+  socket.onmessage = function(e) {
+    decode(e.data);
+  };
+  socket.onclose = function() {
+    socket = null;
+    setTimeout(connect, RECONNECT_DELAY);
+  };
+}
+
+self.onmessage = function(event) {
+  var msg = event.data;
+
+  switch(msg.type) {
+  case "connect":
+    board = msg.board;
+    url = msg.url;
+    connect();
+    break;
+
+  case "send":
+    if(socket && socket.readyState == WebSocket.OPEN) {
+      socket.send(JSON.stringify(msg.command));
+    }
+    break;
+
+  case "ack":
+    // the page drew the last frame and gives its buffers back
+    Object.keys(msg.widths).forEach(function(name) {
+      widths[name] = msg.widths[name];
+    });
+    Object.keys(msg.series).forEach(function(name) {
+      buffers[name] = msg.series[name];
+    });
+    in_flight = false;
+    if(dirty) {
+      send_frame();
+    }
+    break;
+  }
+};
@@ -6,11 +6,16 @@
  * see https://opensource.org/licenses/MIT
  */
 
-var socket = new WebSocket("ws://192.168.1.50:3000/", "graph-update");
+// the WebSocket and the decoding live in a worker, see sample_worker.js
+var worker = new Worker("./js/sample_worker.js");
+var frame = null; // decimated series from the worker, drawn on the next animation frame
+var instance_cells = {}; // latest value cell of each series of the other sensor instances
 var temp_ctx = document.getElementById("temp_canvas").getContext("2d");
 var hum_ctx = document.getElementById("hum_canvas").getContext("2d");
 var light_ctx = document.getElementById("light_canvas").getContext("2d");
 var state = "auto";
+// ?board=<id>: the board shown when connected to a gateway
+var board = new URLSearchParams(location.search).get("board");
 var thresh = "";
 var tempGradientFill = temp_ctx.createLinearGradient(0,0,0,450);
 var humGradientFill = hum_ctx.createLinearGradient(0,0,0,450);
@@ -48,7 +53,6 @@ proximity_threshold.addEventListener('keypress', update_proximity_threshold);
 var tempChart = new Chart(temp_ctx, {
   type: "line",
   data: {
-    labels: [],
     datasets: [
       {
         label: "Temperature [℃]",
@@ -57,11 +61,14 @@ var tempChart = new Chart(temp_ctx, {
         borderColor: 'rgb(255,255,255)',
         backgroundColor: tempGradientFill,
         pointBackgroundColor: '#006A92',
-        borderWidth: 2
+        borderWidth: 2,
+        pointRadius: 0,
+        lineTension: 0
       }
     ],
   },
   options: {
+    animation: false,
     legend: {
       labels: {
         fontColor: '#FFF',
@@ -95,9 +102,12 @@ var tempChart = new Chart(temp_ctx, {
           color: '#FFF',
           borderDash: [2, 2]
         },
+        type: 'linear',
         ticks:{
           fontColor: '#FFF',
-          fontSize: 10
+          fontSize: 10,
+          maxTicksLimit: 8,
+          callback: format_time
         },
     }]
   }
@@ -107,7 +117,6 @@ var tempChart = new Chart(temp_ctx, {
 var humChart = new Chart(hum_ctx, {
     type: "line",
     data: {
-        labels: [],
         datasets: [
             {
                 label: "Humidity [%]",
@@ -116,11 +125,14 @@ var humChart = new Chart(hum_ctx, {
                 borderColor: 'rgb(41,235,253)',
                 backgroundColor: humGradientFill,
                 pointBackgroundColor: '#FFF',
-                borderWidth: 2
+                borderWidth: 2,
+                pointRadius: 0,
+                lineTension: 0
             }
         ],
     },
     options: {
+        animation: false,
         legend: {
             labels: {
                 fontColor: '#FFF',
@@ -153,9 +165,12 @@ var humChart = new Chart(hum_ctx, {
                     color: '#FFF',
                     borderDash: [2, 2]
                 },
+                type: 'linear',
                 ticks: {
                     fontColor: '#FFF',
-                    fontSize: 10
+                    fontSize: 10,
+                    maxTicksLimit: 8,
+                    callback: format_time
                 },
             }]
         }
@@ -164,7 +179,6 @@ var humChart = new Chart(hum_ctx, {
 var lightChart = new Chart(light_ctx, {
   type: "line",
   data: {
-    labels: [],
     datasets: [
       {
         label: "Ambient Light [lx]",
@@ -173,11 +187,14 @@ var lightChart = new Chart(light_ctx, {
         borderColor: 'rgb(253,192,4)',
         backgroundColor: lightGradientFill,
         pointBackgroundColor: '#FFF',
-        borderWidth: 2
+        borderWidth: 2,
+        pointRadius: 0,
+        lineTension: 0
       }
     ],
   },
   options: {
+    animation: false,
     legend: {
       labels: {
         fontColor: '#FFF',
@@ -211,83 +228,106 @@ var lightChart = new Chart(light_ctx, {
           color: '#FFF',
           borderDash: [2, 2]
         },
+        type: 'linear',
         ticks:{
           fontColor: '#FFF',
-          fontSize: 10
+          fontSize: 10,
+          maxTicksLimit: 8,
+          callback: format_time
         },
     }]
   }
 }
 });
 
-$(() => {
-  socket.onmessage = function(event) {
-    var datas = JSON.parse(event.data);
-    var time = moment();
-    var outputTime = time.format("HH : mm : ss");
-
-    if(datas.temp.isActive == true){
-      tempChart.data.labels.push(outputTime);
-      tempChart.data.datasets[0].data.push(datas.temp.value);
-
-      if (tempChart.data.labels.length > 10){
-        tempChart.data.labels.shift();
-        tempChart.data.datasets.forEach((dataset) => {
-            dataset.data.shift();
-        });
-      }
+function format_time(value) {
+  return moment(value).format("HH : mm : ss");
+}
+
+// copy a decimated series in the dataset, reusing its point objects
+function set_series(chart, series) {
+  var data = chart.data.datasets[0].data;
 
-      tempChart.update();
-      $("#tempcell").text(datas.temp.value+" ℃");
+  for(var n = 0; n < series.count; n++) {
+    if(n < data.length) {
+      data[n].x = series.time[n];
+      data[n].y = series.value[n];
+    } else {
+      data.push({ x: series.time[n], y: series.value[n] });
     }
+  }
+  data.length = series.count;
+  chart.update(0);
+}
 
-    if(datas.humm.isActive == true){
-      humChart.data.labels.push(outputTime);
-      humChart.data.datasets[0].data.push(datas.humm.value);
+function draw() {
+  var latest = frame.latest;
+  var series = frame.series;
+  var transfer;
 
-      if (humChart.data.labels.length > 10){
-        humChart.data.labels.shift();
-        humChart.data.datasets.forEach((dataset) => {
-            dataset.data.shift();
-        });
-      }
+  set_series(tempChart, series.temp);
+  set_series(humChart, series.humm);
+  set_series(lightChart, series.light);
 
-      humChart.update();
-      $("#humcell").text(datas.humm.value+" %");
-    }
+  if(latest.temp !== undefined) {
+    $("#tempcell").text(latest.temp.toFixed(3) + " ℃");
+  }
+  if(latest.humm !== undefined) {
+    $("#humcell").text(latest.humm.toFixed(3) + " %");
+  }
+  if(latest.light !== undefined) {
+    $("#lightcell").text(latest.light + " lx");
+  }
 
-    if(datas.light.isActive == true){
-      lightChart.data.labels.push(outputTime);
-      lightChart.data.datasets[0].data.push(datas.light.value);
+  if(latest.proximity !== undefined) {
+    proximity = latest.proximity;
+    $("#proximitycell").text(proximity);
 
-      if (lightChart.data.labels.length > 10){
-        lightChart.data.labels.shift();
-        lightChart.data.datasets.forEach((dataset) => {
-            dataset.data.shift();
-        });
-      }
+    // the led itself is switched by the rule on the board
+    if(proximity >= proximity_threshold_value) {
+      led_icon.src = "img/icon_led-on.png";
+    } else {
+      led_icon.src = "img/icon_led-off.png";
+    }
+  }
 
-      lightChart.update();
-      $("#lightcell").text(datas.light.value+" lx");
+  // the other sensor instances, their latest value only
+  Object.keys(latest).forEach(function(name) {
+    if(name.indexOf(".") < 0) {
+      return;
+    }
+    if(!instance_cells[name]) {
+      instance_cells[name] = $("<div>").appendTo("#instancecells");
     }
+    instance_cells[name].text(name + ": " + latest[name]);
+  });
+
+  // give the buffers back, the worker sends the next frame when it has one
+  transfer = [];
+  Object.keys(series).forEach(function(name) {
+    transfer.push(series[name].time.buffer, series[name].value.buffer);
+  });
+  worker.postMessage({
+    type: "ack",
+    widths: {
+      temp: tempChart.chartArea.right - tempChart.chartArea.left,
+      humm: humChart.chartArea.right - humChart.chartArea.left,
+      light: lightChart.chartArea.right - lightChart.chartArea.left
+    },
+    series: series
+  }, transfer);
+  frame = null;
+}
 
-    if(datas.proximity.isActive == true){
-      proximity = datas.proximity.value;
-      $("#proximitycell").text(proximity);
-
-      if(proximity >= proximity_threshold_value) {
-        socket.send(JSON.stringify({
-          led: "on"
-        }));
-        led_icon.src = "img/icon_led-on.png";
-      } else {
-        socket.send(JSON.stringify({
-          led: "off"
-        }));
-        led_icon.src = "img/icon_led-off.png";
-      }
+$(() => {
+  worker.onmessage = function(event) {
+    if(event.data.type == "frame") {
+      frame = event.data;
+      requestAnimationFrame(draw);
     }
   };
+
+  worker.postMessage({ type: "connect", url: "ws://192.168.1.50:3000/", board: board });
 });
 
 function update_temp_yaxes_max(e) {
@@ -321,7 +361,21 @@ function update_light_yaxes_min(e) {
 function update_proximity_threshold(e) {
   if(e.keyCode === 13) {  // input enter key
     proximity_threshold_value = +proximity_threshold.value;
+    send_proximity_rule();
+  }
+}
+
+// the board evaluates the threshold after each sample, even with no browser
+// connected. Sent on edits only: the rule replaces the rule set of the board,
+// a reconnect must not overwrite its --rules file or those of other clients.
+function send_proximity_rule() {
+  var command = {
+    rules: "proximity >= " + proximity_threshold_value + " -> led on"
+  };
+  if(board) {
+    command.board = board;
   }
+  worker.postMessage({ type: "send", command: command });
 }
 
 document.addEventListener('DOMContentLoaded', function(){